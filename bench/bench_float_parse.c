@@ -0,0 +1,224 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Сравнение разбора чисел функциями strtod и bim_float_strtod.
+ * Из json-файла выбираются все числовые значения (в моделях зданий это
+ * почти исключительно координаты XY.points[].x/y), после чего каждый
+ * набор разбирается обеими функциями. Второй набор содержит те же числа,
+ * записанные с полной точностью (%.17g), как их выгружают САПР.
+ * Перед замером проверяется, что результаты совпадают до бита.
+ *
+ * Использование:
+ *   bench_float_parse <file.json> [repeat]
+ *   bench_float_parse -g <levels> <rooms_per_level> [repeat]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "bim_float.h"
+#include "bim_generator.h"
+
+typedef double (*parser_t)(const char *, char **);
+
+/// Набор чисел, записанных подряд через '\0'
+typedef struct
+{
+    char        *text;      ///< Записи чисел
+    size_t      size;       ///< Объем записей, байт
+    const char  **numbers;  ///< Начала записей
+    size_t      count;      ///< Количество чисел
+} _numbers_t;
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char* _read_file(const char *filename, size_t *size)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = (char *)malloc((size_t)length + 1);
+    if (data && fread(data, 1, (size_t)length, fp) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    if (!data) return NULL;
+    data[length] = '\0';
+    *size = (size_t)length;
+    return data;
+}
+
+static void _numbers_add(_numbers_t *set, size_t *cap, const char *str, size_t len)
+{
+    if (set->count == *cap)
+    {
+        *cap = *cap ? *cap * 2 : 1024;
+        set->numbers = (const char **)realloc(set->numbers, sizeof (const char *) * *cap);
+    }
+    memcpy(set->text + set->size, str, len);
+    set->numbers[set->count++] = set->text + set->size;
+    set->size += len;
+    set->text[set->size++] = '\0';
+}
+
+// Выбирает числовые значения вне строк
+static _numbers_t _extract(const char *json, size_t size)
+{
+    _numbers_t set = {(char *)malloc(size + 1), 0, NULL, 0};
+    size_t cap = 0;
+    bool in_string = false;
+    for (const char *p = json; *p; p++)
+    {
+        if (in_string)
+        {
+            if (*p == '\\' && p[1]) p++;
+            else if (*p == '"') in_string = false;
+            continue;
+        }
+        if (*p == '"')
+        {
+            in_string = true;
+            continue;
+        }
+        if (*p == '-' || (*p >= '0' && *p <= '9'))
+        {
+            const char *begin = p;
+            while (p[1] && strchr("0123456789+-.eE", p[1])) p++;
+            _numbers_add(&set, &cap, begin, (size_t)(p - begin + 1));
+        }
+    }
+    return set;
+}
+
+static _numbers_t _reprint(const _numbers_t *src)
+{
+    _numbers_t set = {(char *)malloc(src->count * 32), 0, NULL, 0};
+    size_t cap = 0;
+    char buf[32];
+    for (size_t i = 0; i < src->count; i++)
+    {
+        int len = snprintf(buf, sizeof (buf), "%.17g", strtod(src->numbers[i], NULL));
+        _numbers_add(&set, &cap, buf, (size_t)len);
+    }
+    return set;
+}
+
+static void _numbers_free(_numbers_t *set)
+{
+    free(set->text);
+    free(set->numbers);
+}
+
+static size_t _mismatches(const _numbers_t *set)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < set->count; i++)
+    {
+        double v1 = strtod(set->numbers[i], NULL);
+        double v2 = bim_float_strtod(set->numbers[i], NULL);
+        count += memcmp(&v1, &v2, sizeof (double)) != 0;
+    }
+    return count;
+}
+
+// Лучшее время разбора всего набора, с
+static double _measure(parser_t parser, const _numbers_t *set, int repeat, double *checksum)
+{
+    double best = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        double sum = 0;
+        double t0 = _now();
+        for (size_t i = 0; i < set->count; i++)
+            sum += parser(set->numbers[i], NULL);
+        double dt = _now() - t0;
+        if (r == 0 || dt < best) best = dt;
+        *checksum = sum;
+    }
+    return best;
+}
+
+static void _print(const char *title, const _numbers_t *set, int repeat)
+{
+    double sum1, sum2;
+    size_t bad = _mismatches(set);
+    double t1 = _measure(strtod, set, repeat, &sum1);
+    double t2 = _measure(bim_float_strtod, set, repeat, &sum2);
+    double mb = set->size / (1024.0 * 1024.0);
+
+    printf("%s: чисел %lu, %.1f МиБ, расхождений %lu\n", title, set->count, mb, bad);
+    printf("  %-16s %8.2f нс/число %8.1f МиБ/с   (сумма %.17g)\n", "strtod", t1 * 1e9 / set->count, mb / t1, sum1);
+    printf("  %-16s %8.2f нс/число %8.1f МиБ/с   (сумма %.17g)\n", "bim_float_strtod", t2 * 1e9 / set->count, mb / t2, sum2);
+    printf("  ускорение %.2fx\n", t1 / t2);
+}
+
+int main(int argc, char **argv)
+{
+    char filename[256];
+    int repeat = 5;
+
+    if (argc >= 4 && strcmp(argv[1], "-g") == 0)
+    {
+        uint32_t levels = strtoul(argv[2], NULL, 10);
+        uint32_t rooms = strtoul(argv[3], NULL, 10);
+        if (argc > 4) repeat = atoi(argv[4]);
+        snprintf(filename, sizeof (filename), "bench_building_%ux%u.json", levels, rooms);
+        if (bim_generator_write(filename, levels, rooms) != 0)
+        {
+            fprintf(stderr, "Не удалось записать файл %s\n", filename);
+            return EXIT_FAILURE;
+        }
+    } else if (argc >= 2)
+    {
+        snprintf(filename, sizeof (filename), "%s", argv[1]);
+        if (argc > 2) repeat = atoi(argv[2]);
+    } else
+    {
+        fprintf(stderr, "Использование: %s <file.json> [repeat] | -g <levels> <rooms> [repeat]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t size;
+    char *json = _read_file(filename, &size);
+    if (!json)
+    {
+        fprintf(stderr, "Не удалось прочитать файл %s\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    _numbers_t plain = _extract(json, size);
+    _numbers_t full = _reprint(&plain);
+    free(json);
+
+    _print("как в файле", &plain, repeat);
+    _print("%.17g", &full, repeat);
+
+    size_t bad = _mismatches(&plain) + _mismatches(&full);
+    _numbers_free(&plain);
+    _numbers_free(&full);
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,392 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Замеры геометрических функций на полигонах здания.
+ * Из модели выбираются полигоны всех элементов, после чего каждая
+ * функция прогоняется по всему набору repeat раз, в таблицу попадает
+ * лучшее время в пересчете на один полигон.
+ *
+ * Использование:
+ *   bench_geometry <file.json> [repeat]
+ *   bench_geometry -g <levels> <rooms_per_level> [repeat]
+ *
+ * Затем замеряется вычисление ширины всех проемов здания
+ * (_calculate_transits_width из bim_tools.c) на уже построенной модели
+ * при 1, 2, 4, ... потоках вплоть до количества процессоров
+ * Площади и принадлежность точки сравниваются с вычислениями по хранилищу
+ * геометрии первого этажа (double и float), затем замеряется поиск зоны
+ * по точке: перебором зон первого этажа и по индексу этажа.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bim_json_object.h"
+#include "bim_tools.h"
+#include "bim_index.h"
+#include "bim_parallel.h"
+#include "bim_geometry_store.h"
+#include "bim_polygon_tools.h"
+#include "bim_generator.h"
+
+// Внутренняя функция bim_tools.c
+int _calculate_transits_width(ArrayList *zones, ArrayList *transits, uint32_t handles_count);
+
+/// Полигоны элементов здания
+typedef struct
+{
+    const polygon_t **polygons;
+    size_t          count;
+} _set_t;
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static _set_t _collect(const bim_json_object_t *bim)
+{
+    _set_t set = {NULL, 0};
+    for (size_t i = 0; i < bim->levels_count; i++)
+        set.count += bim->levels[i].elements_count;
+    set.polygons = (const polygon_t **)malloc(sizeof (polygon_t *) * (set.count ? set.count : 1));
+
+    size_t k = 0;
+    for (size_t i = 0; i < bim->levels_count; i++)
+        for (size_t j = 0; j < bim->levels[i].elements_count; j++)
+            set.polygons[k++] = bim->levels[i].elements[j].polygon;
+    return set;
+}
+
+static void _print(const char *title, double best, size_t count, double checksum)
+{
+    printf("  %-28s %10.1f нс/объект %10.3f мс   (сумма %.6f)\n", title, best * 1e9 / count, best * 1e3, checksum);
+}
+
+static void _bench_area(const _set_t *set, int repeat)
+{
+    double *areas = (double *)malloc(sizeof (double) * set->count);
+    double best[3] = {0, 0, 0}, sum[3] = {0, 0, 0};
+
+    for (int r = 0; r < repeat; r++)
+    {
+        double t0 = _now();
+        sum[0] = 0;
+        for (size_t i = 0; i < set->count; i++)
+            sum[0] += geom_tools_area_polygon_triangulated(*set->polygons[i]);
+
+        double t1 = _now();
+        sum[1] = 0;
+        for (size_t i = 0; i < set->count; i++)
+            sum[1] += geom_tools_area_polygon(*set->polygons[i]);
+
+        double t2 = _now();
+        geom_tools_area_polygons(set->polygons, set->count, areas);
+        double t3 = _now();
+        sum[2] = 0;
+        for (size_t i = 0; i < set->count; i++)
+            sum[2] += areas[i];
+
+        double dt[3] = {t1 - t0, t2 - t1, t3 - t2};
+        for (int k = 0; k < 3; k++)
+            if (r == 0 || dt[k] < best[k]) best[k] = dt[k];
+    }
+
+    printf("Площадь многоугольника, полигонов: %lu\n", set->count);
+    _print("триангуляция (Triangle)", best[0], set->count, sum[0]);
+    _print("shoelace", best[1], set->count, sum[1]);
+    _print("shoelace, пакетный вызов", best[2], set->count, sum[2]);
+    free(areas);
+}
+
+// Вершины каждого элемента проверяются относительно полигона следующего
+// элемента, как вершины проема относительно соседней зоны
+static void _bench_point_in(const _set_t *set, int repeat)
+{
+    uint8_t *inside = (uint8_t *)malloc(256);
+    double best[4] = {0, 0, 0, 0};
+    size_t hits[4] = {0, 0, 0, 0}, points = 0;
+
+    for (size_t i = 0; i < set->count; i++)
+        points += set->polygons[i]->point_count;
+
+    for (int r = 0; r < repeat; r++)
+    {
+        memset(hits, 0, sizeof (hits));
+        double t0 = _now();
+        for (size_t i = 0; i < set->count; i++)
+        {
+            const polygon_t *p = set->polygons[i], *z = set->polygons[(i + 1) % set->count];
+            for (size_t j = 0; j < p->point_count; j++)
+                hits[0] += geom_tools_is_point_in_polygon_triangulated(p->points[j], z);
+        }
+
+        double t1 = _now();
+        for (size_t i = 0; i < set->count; i++)
+        {
+            const polygon_t *p = set->polygons[i], *z = set->polygons[(i + 1) % set->count];
+            for (size_t j = 0; j < p->point_count; j++)
+                hits[1] += geom_tools_is_point_in_polygon(p->points[j], z);
+        }
+
+        double t2 = _now();
+        for (size_t i = 0; i < set->count; i++)
+        {
+            const polygon_t *p = set->polygons[i], *z = set->polygons[(i + 1) % set->count];
+            size_t n = p->point_count < 256 ? p->point_count : 256;
+            geom_tools_is_points_in_polygon(p->points, n, z, inside);
+            for (size_t j = 0; j < n; j++)
+                hits[2] += inside[j];
+        }
+        double t3 = _now();
+
+        geom_tools_set_robust(true);
+        for (size_t i = 0; i < set->count; i++)
+        {
+            const polygon_t *p = set->polygons[i], *z = set->polygons[(i + 1) % set->count];
+            for (size_t j = 0; j < p->point_count; j++)
+                hits[3] += geom_tools_is_point_in_polygon(p->points[j], z);
+        }
+        geom_tools_set_robust(false);
+        double t4 = _now();
+
+        double dt[4] = {t1 - t0, t2 - t1, t3 - t2, t4 - t3};
+        for (int k = 0; k < 4; k++)
+            if (r == 0 || dt[k] < best[k]) best[k] = dt[k];
+    }
+
+    printf("Принадлежность точки многоугольнику, точек: %lu\n", points);
+    _print("триангуляция (Triangle)", best[0], points, (double)hits[0]);
+    _print("winding number", best[1], points, (double)hits[1]);
+    _print("winding number, пакетный", best[2], points, (double)hits[2]);
+    _print("winding number, точные предикаты", best[3], points, (double)hits[3]);
+    free(inside);
+}
+
+// Время вычисления ширины всех проемов при заданном количестве потоков
+static double _transits_width_time(bim_t *bim, uint32_t threads, int repeat, double *sum)
+{
+    double best = 0;
+    bim_tools_set_threads(threads);
+    for (int r = 0; r < repeat; r++)
+    {
+        for (size_t i = 0; i < bim->transits->length; i++)
+            ((bim_transit_t *)bim->transits->data[i])->width = -1;
+
+        double t0 = _now();
+        int result = _calculate_transits_width(bim->zones, bim->transits, bim->json->handles_count);
+        double dt = _now() - t0;
+        if (result != 0)
+            fprintf(stderr, "Ошибка вычисления ширины проемов\n");
+        if (r == 0 || dt < best) best = dt;
+    }
+
+    *sum = 0;
+    for (size_t i = 0; i < bim->transits->length; i++)
+        *sum += ((bim_transit_t *)bim->transits->data[i])->width;
+    return best;
+}
+
+// Ширина проемов при 1, 2, 4, ... потоках до количества процессоров
+static void _bench_transits_width(bim_t *bim, int repeat)
+{
+    uint32_t cpus = bim_parallel_cpu_count();
+    uint32_t threads = bim_tools_get_threads();
+    double sum = 0;
+    double base = _transits_width_time(bim, 1, repeat, &sum);
+
+    printf("Ширина проемов, проемов: %u, процессоров: %u\n", bim->transits->length, cpus);
+    _print("_calculate_transits_width", base, bim->transits->length, sum);
+    for (uint32_t t = 2; t / 2 < cpus; t *= 2)
+    {
+        uint32_t n = t < cpus ? t : cpus;
+        double best = _transits_width_time(bim, n, repeat, &sum);
+        char title[64];
+        snprintf(title, sizeof (title), "  потоков: %u, ускорение %.2f", n, base / best);
+        _print(title, best, bim->transits->length, sum);
+    }
+    bim_tools_set_threads(threads);
+}
+
+// Площади и принадлежность точки по хранилищу геометрии первого этажа
+// в сравнении с теми же вычислениями по массивам point_t
+static void _bench_store(bim_t *bim, int repeat)
+{
+    const bim_level_t *level = &bim->object->levels[0];
+    size_t count = level->zone_count + level->transit_count;
+    if (count < 2)
+        return;
+
+    const polygon_t **polygons = (const polygon_t **)malloc(sizeof (polygon_t *) * count);
+    for (size_t k = 0; k < count; k++)
+        polygons[k] = k < level->zone_count ? level->zones[k].base->polygon : level->transits[k - level->zone_count].base->polygon;
+    bim_geometry_store_t *stores[2] = {bim_geometry_store_new(level, BIM_GEOMETRY_DOUBLE),
+                                       bim_geometry_store_new(level, BIM_GEOMETRY_FLOAT)};
+    double *areas = (double *)malloc(sizeof (double) * count);
+    uint8_t *inside = (uint8_t *)malloc(256);
+
+    double best[6] = {0}, sum[6] = {0};
+    size_t points = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        double t[7];
+        t[0] = _now();
+        geom_tools_area_polygons(polygons, count, areas);
+        sum[0] = 0;
+        for (size_t k = 0; k < count; k++) sum[0] += areas[k];
+
+        for (int m = 0; m < 2; m++)
+        {
+            t[1 + m] = _now();
+            bim_geometry_store_areas(stores[m], areas);
+            sum[1 + m] = 0;
+            for (size_t k = 0; k < count; k++) sum[1 + m] += areas[k];
+        }
+
+        // Вершины каждого элемента относительно следующего элемента
+        t[3] = _now();
+        sum[3] = 0;
+        points = 0;
+        for (size_t k = 0; k < count; k++)
+        {
+            const polygon_t *p = polygons[k];
+            size_t n = p->point_count < 256 ? p->point_count : 256;
+            geom_tools_is_points_in_polygon(p->points, n, polygons[(k + 1) % count], inside);
+            for (size_t j = 0; j < n; j++) sum[3] += inside[j];
+            points += n;
+        }
+        for (int m = 0; m < 2; m++)
+        {
+            t[4 + m] = _now();
+            sum[4 + m] = 0;
+            for (size_t k = 0; k < count; k++)
+            {
+                const polygon_t *p = polygons[k];
+                size_t n = p->point_count < 256 ? p->point_count : 256;
+                bim_geometry_store_points_in_polygon(stores[m], (k + 1) % count, p->points, n, inside);
+                for (size_t j = 0; j < n; j++) sum[4 + m] += inside[j];
+            }
+        }
+        t[6] = _now();
+
+        for (int k = 0; k < 6; k++)
+            if (r == 0 || t[k + 1] - t[k] < best[k]) best[k] = t[k + 1] - t[k];
+    }
+
+    printf("Хранилище геометрии первого этажа, многоугольников: %lu, точек: %lu\n", count, points);
+    _print("площадь, point_t", best[0], count, sum[0]);
+    _print("площадь, хранилище double", best[1], count, sum[1]);
+    _print("площадь, хранилище float", best[2], count, sum[2]);
+    _print("точка в многоугольнике, point_t", best[3], points, sum[3]);
+    _print("точка, хранилище double", best[4], points, sum[4]);
+    _print("точка, хранилище float", best[5], points, sum[5]);
+
+    bim_geometry_store_free(stores[0]);
+    bim_geometry_store_free(stores[1]);
+    free(polygons);
+    free(areas);
+    free(inside);
+}
+
+// Зона по точке: вершины проемов первого этажа ищутся перебором зон этажа и по индексу
+static void _bench_zone_at(bim_t *bim, int repeat)
+{
+    const bim_level_t *level = &bim->object->levels[0];
+    if (!level->index)
+        return;
+
+    double best[2] = {0, 0};
+    size_t hits[2] = {0, 0}, points = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        memset(hits, 0, sizeof (hits));
+        points = 0;
+        double t0 = _now();
+        for (size_t t = 0; t < level->transit_count; t++)
+        {
+            const polygon_t *p = level->transits[t].base->polygon;
+            for (size_t j = 0; j < p->point_count; j++, points++)
+                for (size_t z = 0; z < level->zone_count; z++)
+                    if (geom_tools_is_point_in_polygon(p->points[j], level->zones[z].base->polygon))
+                    {
+                        hits[0]++;
+                        break;
+                    }
+        }
+
+        double t1 = _now();
+        for (size_t t = 0; t < level->transit_count; t++)
+        {
+            const polygon_t *p = level->transits[t].base->polygon;
+            for (size_t j = 0; j < p->point_count; j++)
+                hits[1] += bim_index_zone_at(level, p->points[j]) != NULL;
+        }
+        double t2 = _now();
+
+        double dt[2] = {t1 - t0, t2 - t1};
+        for (int k = 0; k < 2; k++)
+            if (r == 0 || dt[k] < best[k]) best[k] = dt[k];
+    }
+
+    printf("Зона по точке, зон на этаже: %lu, точек: %lu\n", level->zone_count, points);
+    _print("перебор зон этажа", best[0], points, (double)hits[0]);
+    _print("bim_index_zone_at", best[1], points, (double)hits[1]);
+}
+
+int main(int argc, char **argv)
+{
+    char filename[256];
+    int repeat = 5;
+
+    if (argc >= 4 && strcmp(argv[1], "-g") == 0)
+    {
+        uint32_t levels = strtoul(argv[2], NULL, 10);
+        uint32_t rooms = strtoul(argv[3], NULL, 10);
+        if (argc > 4) repeat = atoi(argv[4]);
+        snprintf(filename, sizeof (filename), "bench_building_%ux%u.json", levels, rooms);
+        if (bim_generator_write(filename, levels, rooms) != 0)
+        {
+            fprintf(stderr, "Не удалось записать файл %s\n", filename);
+            return EXIT_FAILURE;
+        }
+    } else if (argc >= 2)
+    {
+        snprintf(filename, sizeof (filename), "%s", argv[1]);
+        if (argc > 2) repeat = atoi(argv[2]);
+    } else
+    {
+        fprintf(stderr, "Использование: %s <file.json> [repeat] | -g <levels> <rooms> [repeat]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bim_t *bim = bim_tools_new(filename);
+    if (!bim)
+        return EXIT_FAILURE;
+
+    _set_t set = _collect(bim->json);
+    _bench_area(&set, repeat);
+    _bench_point_in(&set, repeat);
+    _bench_transits_width(bim, repeat);
+    _bench_store(bim, repeat);
+    _bench_zone_at(bim, repeat);
+
+    free(set.polygons);
+    bim_tools_free(bim);
+    return EXIT_SUCCESS;
+}
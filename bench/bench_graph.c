@@ -0,0 +1,300 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Замеры графа здания: построение и шаг моделирования (evac_moving_step)
+ * по графу CSR в сравнении со списками смежности (bim_graph_list_t) и шаг
+ * по расписанию (evac_moving_step_scheduled). Модель загружается для
+ * каждого варианта, чтобы они моделировали движение людей независимо,
+ * после замера результаты сравниваются.
+ *
+ * Затем шаг моделирования замеряется при разном порядке зон и переходов
+ * (bim_order.h): в порядке файла, в случайном порядке (как в файле,
+ * записанном без учета связей) и после перенумерации случайного порядка
+ * обходом в ширину и RCM. Время шага зависит и от порядка обработки зон
+ * в очереди, поэтому отдельно замеряется обход графа в ширину от зоны
+ * вне здания с чтением зон и переходов: его объем работы от нумерации
+ * не зависит, меняется только расположение данных в памяти.
+ *
+ * С ключом -s шаг моделирования замеряется на одноэтажных зданиях, в которых
+ * все соседние помещения соединены дверями (BIM_GENERATOR_MESH): 625, 1250,
+ * ... max_rooms помещений. На таких зданиях очередь зон на обработку длинная:
+ * очередь на arraylist (evac_moving_step_list) сортируется и просматривается
+ * целиком при каждом добавлении и извлечении зоны, и время шага растет
+ * быстрее квадрата числа зон, поэтому она замеряется одним шагом и только
+ * до legacy_max помещений. Очередь evac_moving_step -- двоичная куча.
+ *
+ * Использование:
+ *   bench_graph <file.json> [steps]
+ *   bench_graph -g <levels> <rooms_per_level> [steps]
+ *   bench_graph -s <max_rooms> [steps] [legacy_max]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_evac.h"
+#include "bim_order.h"
+#include "bim_generator.h"
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void _print(const char *title, double time, uint32_t steps, uint32_t zones)
+{
+    printf("  %-28s %10.3f мс %12.3f мс/шаг %14.0f зон/с\n",
+           title, time * 1e3, time * 1e3 / steps, (double)zones * steps / time);
+}
+
+// Случайная перестановка 0..count-1 (тасование Фишера-Йетса)
+static void _shuffle(uint32_t *rank, uint32_t count, uint64_t *seed)
+{
+    for (uint32_t i = 0; i < count; i++)
+        rank[i] = i;
+    for (uint32_t i = count; i > 1; i--)
+    {
+        *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t j = (uint32_t)((*seed >> 33) % i);
+        uint32_t tmp = rank[i - 1];
+        rank[i - 1] = rank[j];
+        rank[j] = tmp;
+    }
+}
+
+// Обход графа в ширину от зоны вне здания с чтением зон и переходов
+static double _sweep(const bim_graph_t *graph, const bim_t *bim, uint32_t *queue, uint8_t *visited)
+{
+    uint32_t outside = graph->node_count - 1;
+    double sum = 0;
+    size_t head = 0, tail = 0;
+    memset(visited, 0, graph->node_count);
+    visited[outside] = 1;
+    queue[tail++] = outside;
+    while (head < tail)
+    {
+        uint32_t v = queue[head++];
+        const bim_zone_t *zone = bim->zones->data[v];
+        sum += zone->num_of_people + zone->potential;
+        for (uint32_t k = graph->offsets[v]; k < graph->offsets[v + 1]; k++)
+        {
+            const bim_transit_t *transit = bim->transits->data[graph->adjacent[k].eid];
+            sum += transit->width;
+            uint32_t u = graph->adjacent[k].dest;
+            if (visited[u]) continue;
+            visited[u] = 1;
+            queue[tail++] = u;
+        }
+    }
+    return sum;
+}
+
+// Время шагов моделирования и обходов графа на модели из файла при заданном
+// порядке: 0 -- порядок файла, 1 -- случайный, 2 и 3 -- случайный, затем BFS или RCM
+static double _order_time(const char *filename, int variant, uint32_t steps, double *sweep_time)
+{
+    bim_t *bim = bim_tools_new(filename);
+    bim_graph_t *graph = bim_graph_new(bim);
+    if (variant > 0)
+    {
+        uint32_t zone_count = bim->zones->length, transit_count = bim->transits->length;
+        uint32_t *zone_rank = (uint32_t *)malloc(sizeof (uint32_t) * (zone_count + transit_count));
+        uint32_t *transit_rank = zone_rank + zone_count;
+        uint64_t seed = 42;
+        _shuffle(zone_rank, zone_count - 1, &seed); // зона вне здания остается последней
+        zone_rank[zone_count - 1] = zone_count - 1;
+        _shuffle(transit_rank, transit_count, &seed);
+        bim_order_apply(bim, graph, zone_rank, transit_rank, NULL);
+        free(zone_rank);
+    }
+    if (variant > 1)
+        bim_order_renumber(bim, graph, variant == 2 ? BIM_ORDER_BFS : BIM_ORDER_RCM, NULL);
+
+    uint32_t *queue = (uint32_t *)malloc(sizeof (uint32_t) * graph->node_count);
+    uint8_t *visited = (uint8_t *)malloc(graph->node_count);
+    volatile double sum = 0;
+    double t0 = _now();
+    for (uint32_t s = 0; s < steps; s++)
+        sum += _sweep(graph, bim, queue, visited);
+    *sweep_time = _now() - t0;
+    free(queue);
+    free(visited);
+
+    evac_def_modeling_step(bim, bim->zones->length);
+    t0 = _now();
+    for (uint32_t s = 0; s < steps; s++)
+        evac_moving_step(graph, bim->zones, bim->transits);
+    double time = _now() - t0;
+
+    bim_graph_free(graph);
+    bim_tools_free(bim);
+    return time;
+}
+
+// Время шага моделирования в зависимости от количества зон
+static int _steps_sweep(uint32_t max_rooms, uint32_t steps, uint32_t legacy_max)
+{
+    const char *filename = "bench_graph_mesh.json";
+    printf("%10s %10s %16s %16s %16s\n", "rooms", "zones", "list ms/step", "CSR ms/step", "schedule ms/step");
+
+    for (uint32_t rooms = 625; rooms <= max_rooms; rooms *= 2)
+    {
+        if (bim_generator_write_ex(filename, 1, rooms, BIM_GENERATOR_MESH) != 0)
+        {
+            fprintf(stderr, "Не удалось записать файл %s\n", filename);
+            return EXIT_FAILURE;
+        }
+        bim_t *b1 = bim_tools_new(filename);
+        bim_t *b2 = bim_tools_new(filename);
+        if (!b1 || !b2)
+            return EXIT_FAILURE;
+        bim_graph_t *graph = bim_graph_new(b2);
+        bim_schedule_t *schedule = evac_schedule_new(graph);
+        if (!graph || !schedule)
+            return EXIT_FAILURE;
+        evac_def_modeling_step(b1, b1->zones->length);
+        printf("%10u %10u", rooms, b1->zones->length);
+
+        bool legacy = rooms <= legacy_max;
+        if (legacy)
+        {
+            bim_graph_list_t *list = bim_graph_list_new(b1);
+            double t0 = _now();
+            evac_moving_step_list(list, b1->zones, b1->transits);
+            printf(" %16.3f", (_now() - t0) * 1e3);
+            bim_graph_list_free(list);
+        } else
+            printf(" %16s", "-");
+
+        double t0 = _now();
+        for (uint32_t s = 0; s < steps; s++)
+            evac_moving_step(graph, b2->zones, b2->transits);
+        double t1 = _now();
+        for (uint32_t s = 0; s < steps; s++)
+            evac_moving_step_scheduled(schedule, graph, b2->zones, b2->transits);
+        double t2 = _now();
+        printf(" %16.3f %16.3f\n", (t1 - t0) * 1e3 / steps, (t2 - t1) * 1e3 / steps);
+
+        evac_schedule_free(schedule);
+        bim_graph_free(graph);
+        bim_tools_free(b1);
+        bim_tools_free(b2);
+    }
+
+    remove(filename);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    const char *generated = "bench_graph.json";
+    uint32_t steps = 100;
+
+    if (argc >= 3 && strcmp(argv[1], "-s") == 0)
+    {
+        if (argc > 3) steps = atoi(argv[3]);
+        return _steps_sweep(strtoul(argv[2], NULL, 10), steps ? steps : 1, argc > 4 ? strtoul(argv[4], NULL, 10) : 5000);
+    } else if (argc >= 4 && strcmp(argv[1], "-g") == 0)
+    {
+        if (bim_generator_write(generated, atoi(argv[2]), atoi(argv[3])) != 0)
+            return EXIT_FAILURE;
+        filename = generated;
+        if (argc > 4) steps = atoi(argv[4]);
+    } else if (argc >= 2)
+    {
+        filename = argv[1];
+        if (argc > 2) steps = atoi(argv[2]);
+    } else
+    {
+        fprintf(stderr, "Использование: %s <file.json> [steps] | -g <levels> <rooms_per_level> [steps] | -s <max_rooms> [steps] [legacy_max]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (steps == 0) steps = 1;
+
+    bim_t *b1 = bim_tools_new(filename);
+    bim_t *b2 = bim_tools_new(filename);
+    bim_t *b3 = bim_tools_new(filename);
+    if (!b1 || !b2 || !b3)
+        return EXIT_FAILURE;
+
+    double t0 = _now();
+    bim_graph_list_t *list = bim_graph_list_new(b1);
+    double t1 = _now();
+    bim_graph_t *graph = bim_graph_new(b2);
+    double t2 = _now();
+    bim_schedule_t *schedule = evac_schedule_new(graph);
+    if (!list || !graph || !schedule)
+        return EXIT_FAILURE;
+
+    uint32_t zones = b1->zones->length;
+    printf("Граф здания, зон: %u, переходов: %u\n", zones, b1->transits->length);
+    printf("  %-28s %10.3f мс\n", "построение, списки", (t1 - t0) * 1e3);
+    printf("  %-28s %10.3f мс\n", "построение, CSR", (t2 - t1) * 1e3);
+
+    evac_def_modeling_step(b1, zones);
+    printf("Шаг моделирования, шагов: %u\n", steps);
+
+    t0 = _now();
+    for (uint32_t s = 0; s < steps; s++)
+        evac_moving_step_list(list, b1->zones, b1->transits);
+    t1 = _now();
+    for (uint32_t s = 0; s < steps; s++)
+        evac_moving_step(graph, b2->zones, b2->transits);
+    t2 = _now();
+    for (uint32_t s = 0; s < steps; s++)
+        evac_moving_step_scheduled(schedule, graph, b3->zones, b3->transits);
+    double t3 = _now();
+
+    _print("списки смежности", t1 - t0, steps, zones);
+    _print("CSR", t2 - t1, steps, zones);
+    _print("CSR, расписание", t3 - t2, steps, zones);
+    printf("  ускорение %.2f, с расписанием %.2f\n", (t1 - t0) / (t2 - t1), (t1 - t0) / (t3 - t2));
+
+    size_t mismatches = 0;
+    for (uint32_t i = 0; i < zones; i++)
+    {
+        double people = ((bim_zone_t *)b1->zones->data[i])->num_of_people;
+        mismatches += people != ((bim_zone_t *)b2->zones->data[i])->num_of_people
+                      || people != ((bim_zone_t *)b3->zones->data[i])->num_of_people;
+    }
+    if (mismatches)
+        printf("  результаты различаются в %zu зонах\n", mismatches);
+
+    evac_schedule_free(schedule);
+    bim_graph_list_free(list);
+    bim_graph_free(graph);
+    bim_tools_free(b1);
+    bim_tools_free(b2);
+    bim_tools_free(b3);
+
+    const char *titles[] = {"порядок файла", "случайный порядок", "случайный, затем BFS", "случайный, затем RCM"};
+    double sweeps[4];
+    printf("Порядок зон и переходов, шагов: %u\n", steps);
+    for (int variant = 0; variant < 4; variant++)
+        _print(titles[variant], _order_time(filename, variant, steps, &sweeps[variant]), steps, zones);
+    printf("Обход графа в ширину с чтением зон и переходов, обходов: %u\n", steps);
+    for (int variant = 0; variant < 4; variant++)
+        _print(titles[variant], sweeps[variant], steps, zones);
+
+    if (filename == generated) remove(generated);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Сравнение потокового загрузчика (bim_json_new) и загрузчика
+ * через дерево json-c (bim_json_new_dom).
+ * Каждый загрузчик запускается в отдельном процессе, чтобы пиковый
+ * объем резидентной памяти (ru_maxrss) относился только к нему.
+ * Количество обращений к куче подсчитывается обертками над malloc
+ * и родственными функциями (см. --wrap в CMakeLists.txt).
+ *
+ * Режим -s строит одноэтажные здания с удвоением числа помещений
+ * от 256 до max_rooms и показывает, как растет пиковая память
+ * с размером этажа (рост должен быть линейным).
+ *
+ * Использование:
+ *   bench_json_loader <file.json> [repeat]
+ *   bench_json_loader -g <levels> <rooms_per_level> [repeat]
+ *   bench_json_loader -s <max_rooms>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "bim_json_object.h"
+#include "bim_generator.h"
+
+typedef bim_json_object_t* (*loader_t)(const char *);
+
+static uint64_t _allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+char* __real_strdup(const char *s);
+char* __real_strndup(const char *s, size_t n);
+
+void* __wrap_malloc(size_t size)                { _allocs++; return __real_malloc(size); }
+void* __wrap_calloc(size_t nmemb, size_t size)  { _allocs++; return __real_calloc(nmemb, size); }
+void* __wrap_realloc(void *ptr, size_t size)    { _allocs++; return __real_realloc(ptr, size); }
+char* __wrap_strdup(const char *s)              { _allocs++; return __real_strdup(s); }
+char* __wrap_strndup(const char *s, size_t n)   { _allocs++; return __real_strndup(s, n); }
+
+typedef struct
+{
+    double      time;   ///< Лучшее время загрузки, с
+    uint64_t    allocs; ///< Количество обращений к куче за одну загрузку
+    long        rss;    ///< Пиковый объем резидентной памяти процесса, КиБ
+} _result_t;
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int _run(loader_t loader, const char *filename, int repeat, _result_t *result)
+{
+    int fd[2];
+    if (pipe(fd) != 0) return -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fd[0]);
+        _result_t best = {1e30, 0, 0};
+        for (int i = 0; i < repeat; i++)
+        {
+            uint64_t allocs = _allocs;
+            double t0 = _now();
+            bim_json_object_t *bim = loader(filename);
+            double dt = _now() - t0;
+            best.allocs = _allocs - allocs;
+            if (!bim) _exit(EXIT_FAILURE);
+            bim_json_free(bim);
+            if (dt < best.time) best.time = dt;
+        }
+        ssize_t n = write(fd[1], &best, sizeof (best));
+        _exit(n == sizeof (best) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fd[1]);
+
+    _result_t best;
+    ssize_t n = read(fd[0], &best, sizeof (best));
+    close(fd[0]);
+
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    if (n != sizeof (best) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return -1;
+
+    best.rss = usage.ru_maxrss;
+    *result = best;
+    return 0;
+}
+
+static void _print(const char *title, loader_t loader, const char *filename, int repeat)
+{
+    _result_t r;
+    if (_run(loader, filename, repeat, &r) != 0)
+    {
+        printf("%-8s failed\n", title);
+        return;
+    }
+    printf("%-8s load %10.3f ms   allocs %10lu   peak RSS %10ld KiB\n",
+           title, r.time * 1e3, r.allocs, r.rss);
+}
+
+static int _sweep(uint32_t max_rooms)
+{
+    const char *filename = "bench_level_size.json";
+    printf("%10s %10s %14s %14s %14s %14s\n",
+           "rooms", "elements", "stream KiB", "B/element", "dom KiB", "B/element");
+
+    for (uint32_t rooms = 256; rooms <= max_rooms; rooms *= 2)
+    {
+        if (bim_generator_write(filename, 1, rooms) != 0)
+        {
+            fprintf(stderr, "Не удалось записать файл %s\n", filename);
+            return EXIT_FAILURE;
+        }
+        uint64_t count = bim_generator_elements_count(1, rooms);
+
+        printf("%10u %10lu", rooms, count);
+        loader_t loaders[] = {bim_json_new, bim_json_new_dom};
+        for (size_t i = 0; i < sizeof (loaders) / sizeof (loaders[0]); i++)
+        {
+            _result_t r;
+            if (_run(loaders[i], filename, 1, &r) == 0)
+                printf(" %14ld %14.1f", r.rss, r.rss * 1024.0 / count);
+            else
+                printf(" %14s %14s", "failed", "-");
+        }
+        printf("\n");
+    }
+
+    remove(filename);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    char filename[256];
+    int repeat = 3;
+
+    if (argc >= 3 && strcmp(argv[1], "-s") == 0)
+    {
+        return _sweep(strtoul(argv[2], NULL, 10));
+    } else if (argc >= 4 && strcmp(argv[1], "-g") == 0)
+    {
+        uint32_t levels = strtoul(argv[2], NULL, 10);
+        uint32_t rooms = strtoul(argv[3], NULL, 10);
+        if (argc > 4) repeat = atoi(argv[4]);
+        snprintf(filename, sizeof (filename), "bench_building_%ux%u.json", levels, rooms);
+        if (bim_generator_write(filename, levels, rooms) != 0)
+        {
+            fprintf(stderr, "Не удалось записать файл %s\n", filename);
+            return EXIT_FAILURE;
+        }
+        printf("Сгенерировано здание: %s, элементов: %lu\n", filename, bim_generator_elements_count(levels, rooms));
+    } else if (argc >= 2)
+    {
+        snprintf(filename, sizeof (filename), "%s", argv[1]);
+        if (argc > 2) repeat = atoi(argv[2]);
+    } else
+    {
+        fprintf(stderr, "Использование: %s <file.json> [repeat] | -g <levels> <rooms> [repeat] | -s <max_rooms>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    _print("stream", bim_json_new, filename, repeat);
+    _print("dom", bim_json_new_dom, filename, repeat);
+
+    return EXIT_SUCCESS;
+}
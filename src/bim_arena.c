@@ -0,0 +1,162 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bim_arena.h"
+
+#define ARENA_ALIGN 8
+
+static size_t _align(size_t value)
+{
+    return (value + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static uint8_t* _block_data(bim_arena_block_t *block)
+{
+    return (uint8_t *)block + _align(sizeof (bim_arena_block_t));
+}
+
+static bim_arena_block_t* _block_new(size_t size)
+{
+    bim_arena_block_t *block = (bim_arena_block_t *)malloc(_align(sizeof (bim_arena_block_t)) + size);
+    if (!block)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+bim_arena_t* bim_arena_new(size_t block_size)
+{
+    bim_arena_t *arena = (bim_arena_t *)malloc(sizeof (bim_arena_t));
+    if (!arena)
+        return NULL;
+    arena->head = NULL;
+    arena->block_size = block_size ? _align(block_size) : BIM_ARENA_BLOCK_SIZE;
+    arena->blocks_count = 0;
+    arena->bytes_used = 0;
+    return arena;
+}
+
+void* bim_arena_alloc(bim_arena_t *arena, size_t size)
+{
+    size = _align(size ? size : 1);
+    bim_arena_block_t *head = arena->head;
+
+    if (!head || head->size - head->used < size)
+    {
+        // Крупный участок получает собственный блок и встает за текущим,
+        // чтобы остаток текущего блока продолжал использоваться
+        if (size > arena->block_size / 4 && head)
+        {
+            bim_arena_block_t *block = _block_new(size);
+            if (!block)
+                return NULL;
+            block->used = size;
+            block->next = head->next;
+            head->next = block;
+            arena->blocks_count++;
+            arena->bytes_used += size;
+            return _block_data(block);
+        }
+
+        bim_arena_block_t *block = _block_new(size > arena->block_size ? size : arena->block_size);
+        if (!block)
+            return NULL;
+        block->next = head;
+        arena->head = block;
+        arena->blocks_count++;
+        head = block;
+    }
+
+    void *ptr = _block_data(head) + head->used;
+    head->used += size;
+    arena->bytes_used += size;
+    return ptr;
+}
+
+void* bim_arena_calloc(bim_arena_t *arena, size_t count, size_t size)
+{
+    void *ptr = bim_arena_alloc(arena, count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* bim_arena_memdup(bim_arena_t *arena, const void *data, size_t size)
+{
+    void *ptr = bim_arena_alloc(arena, size);
+    if (ptr && size)
+        memcpy(ptr, data, size);
+    return ptr;
+}
+
+char* bim_arena_strdup(bim_arena_t *arena, const char *str)
+{
+    return (char *)bim_arena_memdup(arena, str, strlen(str) + 1);
+}
+
+char* bim_arena_strndup(bim_arena_t *arena, const char *str, size_t n)
+{
+    size_t len = strnlen(str, n);
+    char *ptr = (char *)bim_arena_alloc(arena, len + 1);
+    if (ptr)
+    {
+        memcpy(ptr, str, len);
+        ptr[len] = '\0';
+    }
+    return ptr;
+}
+
+void bim_arena_adopt(bim_arena_t *arena, bim_arena_t *other)
+{
+    if (!other)
+        return;
+
+    bim_arena_block_t *first = other->head;
+    if (first)
+    {
+        // Блоки другого региона встают за текущим блоком
+        bim_arena_block_t *last = first;
+        while (last->next) last = last->next;
+        if (arena->head)
+        {
+            last->next = arena->head->next;
+            arena->head->next = first;
+        } else
+        {
+            arena->head = first;
+        }
+    }
+    arena->blocks_count += other->blocks_count;
+    arena->bytes_used += other->bytes_used;
+    free(other);
+}
+
+void bim_arena_free(bim_arena_t *arena)
+{
+    if (!arena)
+        return;
+    bim_arena_block_t *block = arena->head;
+    while (block)
+    {
+        bim_arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
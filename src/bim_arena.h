@@ -0,0 +1,96 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Регион памяти (arena) для размещения модели здания
+
+Память выделяется крупными блоками и раздается последовательно,
+поэтому данные, созданные подряд, лежат рядом. Отдельные участки
+не освобождаются, весь регион освобождается одним вызовом bim_arena_free.
+*/
+
+#ifndef BIM_ARENA_H
+#define BIM_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Размер блока региона по умолчанию
+#define BIM_ARENA_BLOCK_SIZE (256 * 1024)
+
+typedef struct bim_arena_block bim_arena_block_t;
+
+/// Блок региона
+struct bim_arena_block
+{
+    bim_arena_block_t   *next;  ///< Предыдущий заполненный блок
+    size_t              size;   ///< Размер области данных блока
+    size_t              used;   ///< Занятая часть области данных
+};
+
+/// Регион памяти
+typedef struct
+{
+    bim_arena_block_t   *head;          ///< Текущий блок
+    size_t              block_size;     ///< Размер новых блоков
+    uint64_t            blocks_count;   ///< Количество выделенных блоков
+    uint64_t            bytes_used;     ///< Объем выданной памяти
+} bim_arena_t;
+
+/*!
+Создает новый регион
+
+\param[in] block_size Размер блока (0 -- BIM_ARENA_BLOCK_SIZE)
+\returns Указатель на регион или NULL
+*/
+bim_arena_t*    bim_arena_new       (size_t block_size);
+
+/*!
+Выделяет участок памяти из региона, выровненный на 8 байт
+
+\param[in] arena Регион
+\param[in] size  Размер участка
+\returns Указатель на участок или NULL
+*/
+void*           bim_arena_alloc     (bim_arena_t *arena, size_t size);
+
+/// Выделяет обнуленный участок памяти из региона
+void*           bim_arena_calloc    (bim_arena_t *arena, size_t count, size_t size);
+
+/// Копирует участок памяти в регион
+void*           bim_arena_memdup    (bim_arena_t *arena, const void *data, size_t size);
+
+/// Копирует строку в регион
+char*           bim_arena_strdup    (bim_arena_t *arena, const char *str);
+
+/// Копирует не более n символов строки в регион
+char*           bim_arena_strndup   (bim_arena_t *arena, const char *str, size_t n);
+
+/*!
+Передает память другого региона во владение arena
+
+Участки, выделенные из other, остаются на месте и освобождаются
+вместе с arena. Сам other удаляется
+
+\param[in] arena Регион-владелец
+\param[in] other Присоединяемый регион
+*/
+void            bim_arena_adopt     (bim_arena_t *arena, bim_arena_t *other);
+
+/// Освобождает регион и всю выделенную из него память
+void            bim_arena_free      (bim_arena_t *arena);
+
+#endif //BIM_ARENA_H
@@ -136,15 +136,15 @@ static double evac_speed_on_stair(double density_in_zone, int direction)
 static double speed_in_element(const bim_zone_t *receiving_zone,  // принимающая зона
                                const bim_zone_t *giver_zone)      // отдающая зона
 {
-    double density_in_giver_zone = giver_zone->base->z_level / giver_zone->area;
+    double density_in_giver_zone = giver_zone->z_level / giver_zone->area;
     // По умолчанию, используется скорость движения по горизонтальной поверхности
     double v_zone = speed_in_room(density_in_giver_zone, evac_speed_max);
 
-    double dh = receiving_zone->base->z_level - giver_zone->base->z_level;   // Разница высот зон
+    double dh = receiving_zone->z_level - giver_zone->z_level;   // Разница высот зон
 
     // Если принимающее помещение является лестницей и находится на другом уровне,
     // то скорость будет рассчитываться как по наклонной поверхности
-    if (fabs(dh) > 1e-3 && receiving_zone->base->sign == STAIR)
+    if (fabs(dh) > 1e-3 && receiving_zone->sign == STAIR)
     {
       /* Иначе определяем направление движения по лестнице
        * -1 вниз, 1 вверх
@@ -256,7 +256,7 @@ static void reset_zones(const ArrayList *zones)
     {
         bim_zone_t *zone = zones->data[i];
         zone->is_visited = false;
-        zone->potential = (zone->base->sign == OUTSIDE) ? 0 : __FLT_MAX__;
+        zone->potential = (zone->sign == OUTSIDE) ? 0 : __FLT_MAX__;
     }
 }
 
@@ -272,7 +272,7 @@ static void reset_transits(const ArrayList *transits)
 
 static int elementideq_callback(const ArrayListValue value1, const ArrayListValue value2)
 {
-    return ((bim_zone_t *)value1)->base->id == ((bim_zone_t *)value2)->base->id;
+    return ((bim_zone_t *)value1)->id == ((bim_zone_t *)value2)->id;
 }
 
 static int potentialcmp_callback (const ArrayListValue value1, const ArrayListValue value2)
@@ -280,7 +280,272 @@ static int potentialcmp_callback (const ArrayListValue value1, const ArrayListVa
     return ((bim_zone_t *)value1)->potential < ((bim_zone_t *)value2)->potential;
 }
 
+// Переход людей из отдающей зоны в принимающую через проем
+static inline void _flow(bim_zone_t *receiving_zone, bim_zone_t *giver_zone, bim_transit_t *transit)
+{
+    receiving_zone->potential = potential_element(receiving_zone, giver_zone, transit);
+    double moved_people = part_people_flow(receiving_zone, giver_zone, transit);
+    receiving_zone->num_of_people += moved_people;
+    giver_zone->num_of_people -= moved_people;
+    transit->num_of_people = moved_people;
+
+    giver_zone->is_visited = true;
+    transit->is_visited = true;
+}
+
+// Переход людей из отдающей зоны в принимающую через проем.
+// Отдающая зона, у которой есть другие выходы, добавляется в очередь обработки
+static inline void _move_people(bim_zone_t *receiving_zone, bim_zone_t *giver_zone,
+                                bim_transit_t *transit, ArrayList *zones_to_process)
+{
+    _flow(receiving_zone, giver_zone, transit);
+
+    if (giver_zone->outputs_count > 1 && !giver_zone->is_blocked
+        && arraylist_index_of(zones_to_process, elementideq_callback, giver_zone) < 0)
+    {
+        arraylist_append(zones_to_process, giver_zone);
+    }
+}
+
+// Следующая принимающая зона -- зона очереди с наименьшим потенциалом
+static inline bim_zone_t *_next_zone(ArrayList *zones_to_process)
+{
+    arraylist_sort(zones_to_process, potentialcmp_callback);
+    if (zones_to_process->length == 0)
+        return NULL;
+
+    bim_zone_t *zone = zones_to_process->data[0];
+    arraylist_remove(zones_to_process, 0);
+    return zone;
+}
+
+/// Элемент очереди зон
+typedef struct
+{
+    float       potential;  ///< Потенциал зоны при добавлении в очередь
+    uint32_t    order;      ///< Порядковый номер добавления
+    uint32_t    zone;       ///< Номер зоны
+} _queue_item_t;
+
+/*!
+Очередь зон на обработку: двоичная куча по возрастанию потенциала
+
+При равных потенциалах первой извлекается зона, добавленная позже, как
+в очереди на arraylist (evac_moving_step_list): там potentialcmp_callback
+не различает зоны и arraylist_sort переносит в начало последнюю из них.
+Потенциал зоны меняется, только пока она принимающая, то есть вне
+очереди, поэтому ключи элементов кучи не обновляются. Наличие зоны в
+очереди отмечается в битовом множестве.
+*/
+typedef struct
+{
+    uint32_t        length;         ///< Количество зон в очереди
+    uint32_t        order;          ///< Счетчик добавлений
+    bool            by_potential;   ///< В очередь добавлялись зоны с потенциалом меньше __FLT_MAX__
+    _queue_item_t   *items;         ///< Куча, не больше одного элемента на зону
+    uint64_t        *queued;        ///< Битовое множество зон в очереди
+} _queue_t;
+
+static int _queue_init(_queue_t *queue, uint32_t zone_count)
+{
+    size_t words = (zone_count + 63) / 64;
+    queue->items = (_queue_item_t *)malloc(sizeof (uint64_t) * words + sizeof (_queue_item_t) * zone_count);
+    if (!queue->items)
+        return -1;
+    queue->queued = (uint64_t *)(queue->items + zone_count);
+    memset(queue->queued, 0, sizeof (uint64_t) * words);
+    queue->length = 0;
+    queue->order = 0;
+    queue->by_potential = false;
+    return 0;
+}
+
+static inline bool _queue_less(const _queue_item_t *a, const _queue_item_t *b)
+{
+    return a->potential < b->potential || (a->potential == b->potential && a->order > b->order);
+}
+
+static void _queue_push(_queue_t *queue, const bim_zone_t *zone)
+{
+    uint32_t id = (uint32_t)zone->id;
+    if (queue->queued[id / 64] & (1ULL << (id % 64)))
+        return;
+    queue->queued[id / 64] |= 1ULL << (id % 64);
+    queue->by_potential |= zone->potential != __FLT_MAX__;
+
+    _queue_item_t item = {zone->potential, queue->order++, id};
+    uint32_t i = queue->length++;
+    while (i > 0)
+    {
+        uint32_t parent = (i - 1) / 2;
+        if (!_queue_less(&item, &queue->items[parent])) break;
+        queue->items[i] = queue->items[parent];
+        i = parent;
+    }
+    queue->items[i] = item;
+}
+
+// Извлекает зону с наименьшим потенциалом, UINT32_MAX -- очередь пуста
+static uint32_t _queue_pop(_queue_t *queue)
+{
+    if (queue->length == 0)
+        return UINT32_MAX;
+
+    uint32_t id = queue->items[0].zone;
+    queue->queued[id / 64] &= ~(1ULL << (id % 64));
+
+    _queue_item_t item = queue->items[--queue->length];
+    uint32_t i = 0;
+    while (1)
+    {
+        uint32_t child = 2 * i + 1;
+        if (child >= queue->length) break;
+        if (child + 1 < queue->length && _queue_less(&queue->items[child + 1], &queue->items[child])) child++;
+        if (!_queue_less(&queue->items[child], &item)) break;
+        queue->items[i] = queue->items[child];
+        i = child;
+    }
+    queue->items[i] = item;
+    return id;
+}
+
+// Шаг моделирования по графу, порядок переходов людей записывается в расписание (если задано)
+static void _moving_step(const bim_graph_t *graph, const ArrayList *zones, const ArrayList *transits,
+                         bim_schedule_t *schedule)
+{
+    reset_zones(zones);
+    reset_transits(transits);
+
+    size_t unprocessed_zones_count = zones->length;
+    _queue_t queue;
+    if (_queue_init(&queue, graph->node_count) != 0)
+    {
+        LOG_ERROR("Не удалось выделить память для очереди зон");
+        // Пустое расписание было бы принято как действительное, поэтому оно сбрасывается
+        if (schedule) schedule->count = UINT32_MAX;
+        return;
+    }
+
+    uint32_t outside_id = graph->node_count - 1;
+    const bim_adjacent_t *adjacent = graph->adjacent;
+    uint32_t begin = graph->offsets[outside_id];
+    uint32_t end = graph->offsets[outside_id + 1];
+    bim_zone_t *receiving_zone = zones->data[outside_id];
+
+    while (1)
+    {
+        uint32_t count = end - begin < receiving_zone->outputs_count ? end - begin : (uint32_t)receiving_zone->outputs_count;
+        for (uint32_t k = begin; k < begin + count; k++)
+        {
+            bim_transit_t *transit = transits->data[adjacent[k].eid];
+            if (transit->is_visited || transit->is_blocked) continue;
+
+            bim_zone_t *giver_zone = zones->data[adjacent[k].dest];
+            _flow(receiving_zone, giver_zone, transit);
+            // Отдающая зона, у которой есть другие выходы, добавляется в очередь обработки
+            if (giver_zone->outputs_count > 1 && !giver_zone->is_blocked)
+                _queue_push(&queue, giver_zone);
+
+            if (schedule)
+            {
+                schedule->receiving[schedule->count] = receiving_zone->id;
+                schedule->giving[schedule->count] = adjacent[k].dest;
+                schedule->transits[schedule->count] = adjacent[k].eid;
+                schedule->count++;
+            }
+        }
+        // Если очередь пуста, на следующей итерации обход продолжится с этого места
+        begin += count;
+
+        uint32_t next = _queue_pop(&queue);
+        if (next != UINT32_MAX)
+        {
+            receiving_zone = zones->data[next];
+            begin = graph->offsets[next];
+            end = graph->offsets[next + 1];
+        }
+
+        if (unprocessed_zones_count == 0) break;
+        --unprocessed_zones_count;
+    }
+
+    if (schedule) schedule->by_potential = queue.by_potential;
+    free(queue.items);
+}
+
 void evac_moving_step(const bim_graph_t *graph, const ArrayList *zones, const ArrayList *transits)
+{
+    _moving_step(graph, zones, transits, NULL);
+}
+
+bim_schedule_t* evac_schedule_new(const bim_graph_t *graph)
+{
+    size_t numbers = 3 * (size_t)graph->edge_count;
+    bim_schedule_t *schedule = (bim_schedule_t *)malloc(sizeof (bim_schedule_t) + sizeof (uint32_t) * numbers
+                                                        + sizeof (bool) * (graph->node_count + graph->edge_count));
+    if (!schedule)
+    {
+        LOG_ERROR("Не удалось выделить память для расписания шага моделирования");
+        return NULL;
+    }
+
+    schedule->count = UINT32_MAX;
+    schedule->by_potential = false;
+    schedule->zone_count = graph->node_count;
+    schedule->transit_count = graph->edge_count;
+    schedule->receiving = (uint32_t *)(schedule + 1);
+    schedule->giving = schedule->receiving + graph->edge_count;
+    schedule->transits = schedule->giving + graph->edge_count;
+    schedule->blocked = (bool *)(schedule->receiving + numbers);
+    return schedule;
+}
+
+void evac_schedule_free(bim_schedule_t *schedule)
+{
+    free(schedule);
+}
+
+// Расписание построено при тех же признаках is_blocked зон и переходов.
+// Признаки копируются в расписание, чтобы после перестроения оно считалось актуальным
+static bool _schedule_actual(bim_schedule_t *schedule, const ArrayList *zones, const ArrayList *transits)
+{
+    bool actual = schedule->count != UINT32_MAX && !schedule->by_potential;
+    bool *zone_blocked = schedule->blocked;
+    bool *transit_blocked = schedule->blocked + schedule->zone_count;
+    for (uint32_t i = 0; i < schedule->zone_count; i++)
+    {
+        bool blocked = ((bim_zone_t *)zones->data[i])->is_blocked;
+        actual &= zone_blocked[i] == blocked;
+        zone_blocked[i] = blocked;
+    }
+    for (uint32_t i = 0; i < schedule->transit_count; i++)
+    {
+        bool blocked = ((bim_transit_t *)transits->data[i])->is_blocked;
+        actual &= transit_blocked[i] == blocked;
+        transit_blocked[i] = blocked;
+    }
+    return actual;
+}
+
+void evac_moving_step_scheduled(bim_schedule_t *schedule, const bim_graph_t *graph,
+                                const ArrayList *zones, const ArrayList *transits)
+{
+    if (!_schedule_actual(schedule, zones, transits))
+    {
+        schedule->count = 0;
+        _moving_step(graph, zones, transits, schedule);
+        return;
+    }
+
+    reset_zones(zones);
+    reset_transits(transits);
+
+    for (uint32_t i = 0; i < schedule->count; i++)
+        _flow(zones->data[schedule->receiving[i]], zones->data[schedule->giving[i]],
+              transits->data[schedule->transits[i]]);
+}
+
+void evac_moving_step_list(const bim_graph_list_t *graph, const ArrayList *zones, const ArrayList *transits)
 {
     reset_zones(zones);
     reset_transits(transits);
@@ -295,36 +560,19 @@ void evac_moving_step(const bim_graph_t *graph, const ArrayList *zones, const Ar
 
     while (1)
     {
-        for (size_t i = 0; i < receiving_zone->base->outputs_count && ptr != NULL; i++, ptr = ptr->next)
+        for (size_t i = 0; i < receiving_zone->outputs_count && ptr != NULL; i++, ptr = ptr->next)
         {
             bim_transit_t *transit = transits->data[ptr->eid];
             if (transit->is_visited || transit->is_blocked) continue;
 
-            bim_zone_t *giver_zone  = zones->data[ptr->dest];
-
-            receiving_zone->potential = potential_element(receiving_zone, giver_zone, transit);
-            double moved_people = part_people_flow(receiving_zone, giver_zone, transit);
-            receiving_zone->num_of_people += moved_people;
-            giver_zone->num_of_people -= moved_people;
-            transit->num_of_people = moved_people;
-
-            giver_zone->is_visited = true;
-            transit->is_visited = true;
-
-            if (giver_zone->base->outputs_count > 1 && !giver_zone->is_blocked
-                && arraylist_index_of(zones_to_process, elementideq_callback, giver_zone) < 0)
-            {
-                arraylist_append(zones_to_process, giver_zone);
-            }
+            _move_people(receiving_zone, zones->data[ptr->dest], transit, zones_to_process);
         }
 
-        arraylist_sort(zones_to_process, potentialcmp_callback);
-
-        if (zones_to_process->length > 0)
+        bim_zone_t *next = _next_zone(zones_to_process);
+        if (next)
         {
-            receiving_zone = zones_to_process->data[0];
-            ptr = graph->head[receiving_zone->base->id];
-            arraylist_remove(zones_to_process, 0);
+            receiving_zone = next;
+            ptr = graph->head[receiving_zone->id];
         }
 
         if (unprocessed_zones_count == 0) break;
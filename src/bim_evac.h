@@ -19,9 +19,46 @@
 #include "bim_graph.h"
 #include "logger.h"
 
+typedef struct schedule bim_schedule_t;
+
+/*!
+Расписание шага моделирования
+
+Последовательность переходов людей за шаг (принимающая зона, отдающая
+зона, переход) в виде массивов номеров. Порядок обхода определяется
+графом и признаками is_blocked зон и переходов, а потенциалами -- только
+если в очередь зон evac_moving_step попадают зоны с разными потенциалами
+(иначе зоны обрабатываются в порядке, обратном добавлению). Расписание
+записывается на шаге моделирования и используется на следующих, пока не
+изменятся признаки is_blocked. Если порядок зависел от потенциалов,
+расписание записывается заново на каждом шаге.
+Граф после перенумерации (bim_order.h) требует нового расписания.
+Расписание занимает один блок памяти.
+*/
+struct schedule
+{
+    uint32_t    count;          ///< Количество переходов людей за шаг, UINT32_MAX -- расписание не построено
+    uint32_t    zone_count;     ///< Количество зон, включая зону вне здания
+    uint32_t    transit_count;  ///< Количество переходов
+    uint32_t    *receiving;     ///< Номера принимающих зон, transit_count элементов
+    uint32_t    *giving;        ///< Номера отдающих зон, transit_count элементов
+    uint32_t    *transits;      ///< Номера переходов, transit_count элементов
+    bool        *blocked;       ///< Признаки is_blocked зон и затем переходов, при которых построено расписание
+    bool        by_potential;   ///< Порядок обхода мог зависеть от потенциалов зон
+};
+
 void    evac_def_modeling_step  (const bim_t *bim, uint64_t bim_element_count);
 void    evac_bim_ext_init       (const ArrayList *zones, const ArrayList *transits);
 void    evac_moving_step        (const bim_graph_t *graph, const ArrayList *zones, const ArrayList *transits);
+// Тот же шаг моделирования по графу в виде списков смежности (для сравнения)
+void    evac_moving_step_list   (const bim_graph_list_t *graph, const ArrayList *zones, const ArrayList *transits);
+
+// Расписание для шага моделирования по графу (строится на первом шаге evac_moving_step_scheduled)
+bim_schedule_t* evac_schedule_new   (const bim_graph_t *graph);
+void            evac_schedule_free  (bim_schedule_t *schedule);
+// Шаг моделирования по расписанию, при изменении признаков is_blocked расписание строится заново
+void    evac_moving_step_scheduled  (bim_schedule_t *schedule, const bim_graph_t *graph,
+                                     const ArrayList *zones, const ArrayList *transits);
 
 void    evac_time_inc           (void);
 void    evac_time_reset         (void);
@@ -0,0 +1,189 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "bim_float.h"
+#include "bim_float_table.h"
+
+#define MAX_DIGITS      19                  ///< Значащих цифр, которые гарантированно помещаются в uint64_t
+#define EXACT_MANTISSA  (1ULL << 53)        ///< Мантиссы до 2^53 представимы в double точно
+#define EXACT_EXP10     22                  ///< 10^22 -- наибольшая точно представимая степень десяти
+
+static bool _clinger       (uint64_t mantissa, int64_t exp10, bool negative, double *value);
+static bool _eisel_lemire  (uint64_t mantissa, int64_t exp10, bool negative, double *value);
+
+static const double _exact_pow10[EXACT_EXP10 + 1] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool _is_digit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+double bim_float_strtod(const char *str, char **endptr)
+{
+    const char *p = str;
+    bool negative = (*p == '-');
+    if (negative) p++;
+
+    uint64_t mantissa = 0;
+    int64_t  exp10 = 0;
+    int      digits = 0;    // значащие цифры без ведущих нулей
+
+    const char *int_begin = p;
+    for (; _is_digit(*p); p++)
+    {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        digits += (digits > 0 || *p != '0');
+    }
+    bool has_int = (p != int_begin);
+
+    bool has_frac = false;
+    if (*p == '.' && _is_digit(p[1]))
+    {
+        const char *frac_begin = ++p;
+        for (; _is_digit(*p); p++)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += (digits > 0 || *p != '0');
+        }
+        exp10 = -(int64_t)(p - frac_begin);
+        has_frac = true;
+    }
+    else if (*p == '.' && has_int)
+    {
+        p++; // "1." -- допустимая для strtod запись
+    }
+
+    // Пустая мантисса, шестнадцатеричная запись, inf/nan, пробелы -- разбирает strtod
+    if (!has_int && !has_frac)
+        return strtod(str, endptr);
+    if (has_int && !has_frac && p - int_begin == 1 && *int_begin == '0' && (*p == 'x' || *p == 'X'))
+        return strtod(str, endptr);
+
+    if (*p == 'e' || *p == 'E')
+    {
+        const char *e = p + 1;
+        bool exp_negative = false;
+        if (*e == '+' || *e == '-') exp_negative = (*e++ == '-');
+        if (_is_digit(*e))
+        {
+            int64_t exp_value = 0;
+            for (; _is_digit(*e); e++)
+                if (exp_value < 100000) exp_value = exp_value * 10 + (*e - '0');
+            exp10 += exp_negative ? -exp_value : exp_value;
+            p = e;
+        }
+    }
+
+    if (endptr) *endptr = (char *)p;
+
+    // Мантисса могла переполниться -- точный разбор остается за strtod
+    if (digits > MAX_DIGITS)
+        return strtod(str, endptr);
+
+    double value;
+    if (_clinger(mantissa, exp10, negative, &value))      return value;
+    if (_eisel_lemire(mantissa, exp10, negative, &value)) return value;
+    return strtod(str, endptr);
+}
+
+// Оба операнда представимы точно, поэтому одно умножение или деление
+// дает правильно округленный результат
+static bool _clinger(uint64_t mantissa, int64_t exp10, bool negative, double *value)
+{
+    if (mantissa > EXACT_MANTISSA || exp10 < -EXACT_EXP10 || exp10 > EXACT_EXP10)
+        return false;
+
+    double v = (double)mantissa;
+    v = exp10 < 0 ? v / _exact_pow10[-exp10] : v * _exact_pow10[exp10];
+    *value = negative ? -v : v;
+    return true;
+}
+
+static void _mul128(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    *lo = (uint64_t)r;
+}
+
+// Алгоритм Эйзеля-Лемира: произведение нормализованной мантиссы на
+// 128-битную мантиссу 5^exp10 дает 54 старших бита результата. Если
+// отброшенные биты не позволяют однозначно округлить, возвращает false
+static bool _eisel_lemire(uint64_t mantissa, int64_t exp10, bool negative, double *value)
+{
+    if (mantissa == 0)
+    {
+        *value = negative ? -0.0 : 0.0;
+        return true;
+    }
+    if (exp10 < BIM_POW5_MIN_EXP10 || exp10 > BIM_POW5_MAX_EXP10)
+        return false;
+
+    const uint64_t *pow5 = bim_pow5_128[exp10 - BIM_POW5_MIN_EXP10];
+
+    int clz = __builtin_clzll(mantissa);
+    mantissa <<= clz;
+    // 217706 / 2^16 ~ log2(10)
+    uint64_t exp2 = (uint64_t)(((217706 * exp10) >> 16) + 64 + 1023 - clz);
+
+    uint64_t hi, lo;
+    _mul128(mantissa, pow5[0], &hi, &lo);
+
+    // Младших битов может не хватить -- уточняем по второй половине степени
+    if ((hi & 0x1FF) == 0x1FF && lo + mantissa < mantissa)
+    {
+        uint64_t hi2, lo2;
+        _mul128(mantissa, pow5[1], &hi2, &lo2);
+        uint64_t merged_hi = hi, merged_lo = lo + hi2;
+        if (merged_lo < lo) merged_hi++;
+        if ((merged_hi & 0x1FF) == 0x1FF && merged_lo + 1 == 0 && lo2 + mantissa < mantissa)
+            return false;
+        hi = merged_hi;
+        lo = merged_lo;
+    }
+
+    uint64_t msb = hi >> 63;
+    uint64_t result = hi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+
+    // Ровно посередине между соседними double -- нужна точная арифметика
+    if (lo == 0 && (hi & 0x1FF) == 0 && (result & 3) == 1)
+        return false;
+
+    result += result & 1;
+    result >>= 1;
+    if (result >> 53)
+    {
+        result >>= 1;
+        exp2++;
+    }
+
+    // Денормализованные числа и переполнение
+    if (exp2 - 1 >= 0x7FF - 1)
+        return false;
+
+    uint64_t bits = exp2 << 52 | (result & 0x000FFFFFFFFFFFFFULL);
+    if (negative) bits |= 0x8000000000000000ULL;
+    memcpy(value, &bits, sizeof (double));
+    return true;
+}
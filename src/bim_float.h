@@ -0,0 +1,40 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Быстрый разбор десятичных чисел с плавающей точкой
+
+Число вида [-]цифры[.цифры][e[+-]цифры] с не более чем 19 значащими
+цифрами переводится в double без обращения к strtod: сначала пробуется
+точное умножение на степень десяти (метод Клингера), затем алгоритм
+Эйзеля-Лемира по таблице 128-битных степеней пяти. Результат совпадает
+с strtod до бита. Остальные случаи (длинные мантиссы, пограничные
+значения, inf/nan, шестнадцатеричная запись) передаются в strtod.
+*/
+
+#ifndef BIM_FLOAT_H
+#define BIM_FLOAT_H
+
+/*!
+Разбирает число из строки. Поведение совпадает с strtod
+
+\param[in]  str     Строка, завершенная нулем
+\param[out] endptr  Указатель на первый неразобранный символ (может быть NULL)
+\returns Значение числа
+*/
+double bim_float_strtod(const char *str, char **endptr);
+
+#endif //BIM_FLOAT_H
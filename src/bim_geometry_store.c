@@ -0,0 +1,413 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <float.h>
+#include "bim_geometry_store.h"
+
+// Векторы расширений GCC шириной в регистр целевого процессора: четыре
+// double для AVX, два для SSE2 и NEON. Компилятор переводит операции над
+// ними в векторные команды, поэтому вычисления написаны один раз для всех
+// архитектур. Более широкий вектор без поддержки процессора компилятор
+// разбивает на скалярные операции, что медленнее обычного кода
+#if defined(__AVX__)
+#define LANES 4
+#else
+#define LANES 2
+#endif
+typedef double  _vd __attribute__((vector_size(LANES * sizeof (double))));
+typedef int64_t _vl __attribute__((vector_size(LANES * sizeof (int64_t))));
+typedef float   _vf __attribute__((vector_size(LANES * sizeof (float))));
+
+// Массивы координат дополняются в конце, чтобы векторное чтение
+// последних ребер не выходило за пределы памяти
+#define PADDING (2 * LANES)
+
+// Вычисления подставляются в две версии функций -- для double и для float,
+// параметр single становится константой
+#define KERNEL static inline __attribute__((always_inline))
+
+#if LANES == 4
+static const _vl _lane = {0, 1, 2, 3};
+#else
+static const _vl _lane = {0, 1};
+#endif
+
+KERNEL _vd _load(const void *array, size_t i, bool single)
+{
+    if (single)
+    {
+        _vf v;
+        memcpy(&v, (const float *)array + i, sizeof (v));
+        return __builtin_convertvector(v, _vd);
+    }
+    _vd v;
+    memcpy(&v, (const double *)array + i, sizeof (v));
+    return v;
+}
+
+KERNEL double _get(const void *array, size_t i, bool single)
+{
+    return single ? (double)((const float *)array)[i] : ((const double *)array)[i];
+}
+
+static inline double _sum(_vd v)
+{
+    double sum = 0;
+    for (int l = 0; l < LANES; l++) sum += v[l];
+    return sum;
+}
+
+static inline int64_t _lsum(_vl v)
+{
+    int64_t sum = 0;
+    for (int l = 0; l < LANES; l++) sum += v[l];
+    return sum;
+}
+
+// Поэлементный выбор: mask ? a : b
+static inline _vd _select(_vl mask, _vd a, _vd b)
+{
+    return (_vd)(((_vl)a & mask) | ((_vl)b & ~mask));
+}
+
+static inline _vd _abs(_vd v)
+{
+    return (_vd)((_vl)v & INT64_MAX);
+}
+
+// Оценка погрешности ориентации, как в _orient из bim_polygon_tools.c
+#define CCW_ERRBOUND_A ((3.0 + 16.0 * (DBL_EPSILON / 2)) * (DBL_EPSILON / 2))
+
+// Ориентация троек точек (a, b, c) по элементам, формула та же, что
+// в bim_polygon_tools.c. В режиме точных предикатов элементы, знак которых
+// может быть неверным, уточняются geom_tools_orient2d
+KERNEL _vd _orient(_vd ax, _vd ay, _vd bx, _vd by, _vd cx, _vd cy, bool robust)
+{
+    _vd detleft = (bx - ax) * (cy - ay);
+    _vd detright = (by - ay) * (cx - ax);
+    _vd det = detleft - detright;
+    if (robust)
+    {
+        _vl uncertain = _abs(det) < CCW_ERRBOUND_A * (_abs(detleft) + _abs(detright));
+        if (_lsum(uncertain) != 0)
+            for (int l = 0; l < LANES; l++)
+                if (uncertain[l])
+                    det[l] = geom_tools_orient2d((point_t){ax[l], ay[l]}, (point_t){bx[l], by[l]}, (point_t){cx[l], cy[l]});
+    }
+    return det;
+}
+
+// Ребра [i, i + LANES), которые принадлежат многоугольнику (i + lane < end)
+static inline _vl _valid(size_t i, size_t end)
+{
+    return (_lane + (int64_t)i) < (int64_t)end;
+}
+
+// Координата точки в системе отсчета хранилища. В режиме float она округляется
+// так же, как вершины многоугольников, поэтому совпадающие точки остаются совпадающими
+static double _coord(const bim_geometry_store_t *store, double v, double origin)
+{
+    return store->precision == BIM_GEOMETRY_FLOAT ? (double)(float)(v - origin) : v - origin;
+}
+
+bim_geometry_store_t* bim_geometry_store_new(const bim_level_t *level, bim_geometry_precision_t precision)
+{
+    size_t count = level->zone_count + level->transit_count;
+    const polygon_t **polygons = (const polygon_t **)malloc(sizeof (polygon_t *) * (count ? count : 1));
+    if (!polygons)
+        return NULL;
+    for (size_t i = 0; i < level->zone_count; i++)
+        polygons[i] = level->zones[i].base->polygon;
+    for (size_t i = 0; i < level->transit_count; i++)
+        polygons[level->zone_count + i] = level->transits[i].base->polygon;
+
+    bim_geometry_store_t *store = bim_geometry_store_new_polygons(polygons, count, precision);
+    free(polygons);
+    return store;
+}
+
+bim_geometry_store_t* bim_geometry_store_new_polygons(const polygon_t *const *polygons, size_t count, bim_geometry_precision_t precision)
+{
+    bim_geometry_store_t *store = (bim_geometry_store_t *)calloc(1, sizeof (bim_geometry_store_t));
+    if (!store)
+        return NULL;
+    store->precision = precision;
+    store->polygon_count = count;
+
+    size_t total = 0;
+    point_t min = {INFINITY, INFINITY};
+    for (size_t k = 0; k < count; k++)
+    {
+        const polygon_t *polygon = polygons[k];
+        if (!polygon || polygon->point_count == 0)
+            continue;
+        total += polygon->point_count + 1;
+        for (size_t i = 0; i < polygon->point_count; i++)
+        {
+            min.x = fmin(min.x, polygon->points[i].x);
+            min.y = fmin(min.y, polygon->points[i].y);
+        }
+    }
+    if (precision == BIM_GEOMETRY_FLOAT && total > 0)
+        store->origin = min;
+
+    // Смещения, габариты и координаты размещаются одним блоком
+    size_t item = precision == BIM_GEOMETRY_FLOAT ? sizeof (float) : sizeof (double);
+    size_t offsets_size = sizeof (uint64_t) * (count + 1);
+    size_t boxes_size = sizeof (point_t) * 2 * count;
+    size_t coords_size = (item * (total + PADDING) + 31) & ~(size_t)31;
+    size_t head_size = (offsets_size + boxes_size + 31) & ~(size_t)31;
+    char *block = (char *)aligned_alloc(32, head_size + 2 * coords_size);
+    if (!block)
+    {
+        free(store);
+        return NULL;
+    }
+    memset(block + head_size, 0, 2 * coords_size);
+    store->offsets = (uint64_t *)block;
+    store->boxes = (point_t *)(block + offsets_size);
+    store->x = block + head_size;
+    store->y = block + head_size + coords_size;
+
+    size_t j = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        const polygon_t *polygon = polygons[k];
+        size_t n = polygon ? polygon->point_count : 0;
+        point_t *bmin = &store->boxes[2 * k], *bmax = &store->boxes[2 * k + 1];
+        bmin->x = bmin->y = INFINITY;
+        bmax->x = bmax->y = -INFINITY;
+        store->offsets[k] = j;
+        for (size_t i = 0; i <= n && n > 0; i++, j++)
+        {
+            const point_t *p = &polygon->points[i < n ? i : 0];
+            double x = _coord(store, p->x, store->origin.x);
+            double y = _coord(store, p->y, store->origin.y);
+            if (precision == BIM_GEOMETRY_FLOAT)
+            {
+                ((float *)store->x)[j] = (float)x;
+                ((float *)store->y)[j] = (float)y;
+            } else
+            {
+                ((double *)store->x)[j] = x;
+                ((double *)store->y)[j] = y;
+            }
+            bmin->x = fmin(bmin->x, x); bmax->x = fmax(bmax->x, x);
+            bmin->y = fmin(bmin->y, y); bmax->y = fmax(bmax->y, y);
+        }
+    }
+    store->offsets[count] = j;
+    return store;
+}
+
+void bim_geometry_store_free(bim_geometry_store_t *store)
+{
+    if (!store)
+        return;
+    free(store->offsets);
+    free(store);
+}
+
+size_t bim_geometry_store_point_count(const bim_geometry_store_t *store, size_t k)
+{
+    size_t n = store->offsets[k + 1] - store->offsets[k];
+    return n ? n - 1 : 0;
+}
+
+// Удвоенная ориентированная площадь многоугольника k. Как и в geom_tools_area_polygon,
+// координаты отсчитываются от первой вершины и ребра, примыкающие к ней, не суммируются
+KERNEL double _shoelace(const bim_geometry_store_t *store, size_t k, bool single)
+{
+    size_t b = store->offsets[k], e = store->offsets[k + 1];
+    if (e - b < 4) // Меньше трех вершин
+        return 0;
+
+    // Слагаемые i = b + 1 .. e - 2: полные векторы, затем остаток с маской
+    const double xb = _get(store->x, b, single), yb = _get(store->y, b, single);
+    _vd acc = {0};
+    size_t i = b + 1;
+    for (; i + LANES <= e - 1; i += LANES)
+    {
+        _vd x0 = _load(store->x, i, single) - xb, y0 = _load(store->y, i, single) - yb;
+        _vd x1 = _load(store->x, i + 1, single) - xb, y1 = _load(store->y, i + 1, single) - yb;
+        acc += x0 * y1 - x1 * y0;
+    }
+    if (i < e - 1)
+    {
+        _vd x0 = _load(store->x, i, single) - xb, y0 = _load(store->y, i, single) - yb;
+        _vd x1 = _load(store->x, i + 1, single) - xb, y1 = _load(store->y, i + 1, single) - yb;
+        _vd term = x0 * y1 - x1 * y0;
+        acc += (_vd)((_vl)term & _valid(i, e - 1));
+    }
+    return _sum(acc);
+}
+
+void bim_geometry_store_areas(const bim_geometry_store_t *store, double *areas)
+{
+    if (store->precision == BIM_GEOMETRY_FLOAT)
+        for (size_t k = 0; k < store->polygon_count; k++)
+            areas[k] = fabs(_shoelace(store, k, true)) * 0.5;
+    else
+        for (size_t k = 0; k < store->polygon_count; k++)
+            areas[k] = fabs(_shoelace(store, k, false)) * 0.5;
+}
+
+// Число оборотов контура вокруг точки, как в _winding из bim_polygon_tools.c.
+// За шаг обрабатываются LANES ребер
+KERNEL uint8_t _winding(const bim_geometry_store_t *store, size_t k, double px, double py, bool single, bool robust)
+{
+    const _vd pxv = (_vd){0} + px, pyv = (_vd){0} + py;
+    size_t b = store->offsets[k], e = store->offsets[k + 1];
+    _vl on = {0}, wn = {0};
+    for (size_t i = b; i < e - 1; i += LANES)
+    {
+        _vd ax = _load(store->x, i, single), ay = _load(store->y, i, single);
+        _vd bx = _load(store->x, i + 1, single), by = _load(store->y, i + 1, single);
+        _vd s = _orient(ax, ay, bx, by, pxv, pyv, robust);
+        _vl valid = _valid(i, e - 1);
+
+        on |= valid & (s == 0)
+            & (((px >= ax) & (px <= bx)) | ((px >= bx) & (px <= ax)))
+            & (((py >= ay) & (py <= by)) | ((py >= by) & (py <= ay)));
+        _vl up = (ay <= py) & (by > py) & (s > 0);      // Ребро пересекает луч снизу вверх, точка слева
+        _vl down = (ay > py) & (by <= py) & (s < 0);    // Ребро пересекает луч сверху вниз, точка справа
+        wn += (down - up) & valid;                      // Истина -- это -1
+    }
+    if (_lsum(on) != 0)
+        return 1; // Точка на ребре
+    return _lsum(wn) != 0;
+}
+
+void bim_geometry_store_points_in_polygon(const bim_geometry_store_t *store, size_t k,
+                                          const point_t *points, size_t count, uint8_t *inside)
+{
+    const point_t *min = &store->boxes[2 * k], *max = &store->boxes[2 * k + 1];
+    bool single = store->precision == BIM_GEOMETRY_FLOAT;
+    bool robust = geom_tools_get_robust();
+    for (size_t i = 0; i < count; i++)
+    {
+        double px = _coord(store, points[i].x, store->origin.x);
+        double py = _coord(store, points[i].y, store->origin.y);
+        if (bim_geometry_store_point_count(store, k) < 3
+            || px < min->x || px > max->x || py < min->y || py > max->y)
+            inside[i] = 0;
+        else
+            inside[i] = single ? _winding(store, k, px, py, true, robust) : _winding(store, k, px, py, false, robust);
+    }
+}
+
+// Пересечение отрезка p1p2 с ребрами, как в geom_tools_intersected_edges
+KERNEL size_t _intersected(const bim_geometry_store_t *store, size_t k, point_t p1, point_t p2, size_t *last, bool single, bool robust)
+{
+    const _vd p1x = (_vd){0} + p1.x, p1y = (_vd){0} + p1.y, p2x = (_vd){0} + p2.x, p2y = (_vd){0} + p2.y;
+    size_t b = store->offsets[k], e = store->offsets[k + 1];
+    double lminx = fmin(p1.x, p2.x), lmaxx = fmax(p1.x, p2.x);
+    double lminy = fmin(p1.y, p2.y), lmaxy = fmax(p1.y, p2.y);
+
+    _vl count = {0}, lastv = (_vl){0} - 1;
+    for (size_t i = b; i < e - 1; i += LANES)
+    {
+        _vd ax = _load(store->x, i, single), ay = _load(store->y, i, single);
+        _vd bx = _load(store->x, i + 1, single), by = _load(store->y, i + 1, single);
+        _vd ex = bx - ax, ey = by - ay;
+
+        _vl skip = ((ax < lminx) & (bx < lminx)) | ((ax > lmaxx) & (bx > lmaxx))
+                 | ((ay < lminy) & (by < lminy)) | ((ay > lmaxy) & (by > lmaxy))
+                 | ((ex == 0) & (ey == 0));
+        _vd s1 = _orient(ax, ay, bx, by, p1x, p1y, robust);
+        _vd s2 = _orient(ax, ay, bx, by, p2x, p2y, robust);
+        _vd area_a = _orient(p1x, p1y, p2x, p2y, ax, ay, robust);
+        _vd area_b = _orient(p1x, p1y, p2x, p2y, bx, by, robust);
+
+        _vl hit = _valid(i, e - 1) & ~skip & (area_a * area_b <= 0) & (s1 * s2 <= 0);
+        count -= hit;
+        lastv = (hit & (_lane + (int64_t)(i - b))) | (~hit & lastv);
+    }
+
+    int64_t edge = -1;
+    for (int l = 0; l < LANES; l++)
+        if (lastv[l] > edge) edge = lastv[l];
+    if (edge >= 0)
+        *last = (size_t)edge;
+    return _lsum(count);
+}
+
+size_t bim_geometry_store_intersected_edges(const bim_geometry_store_t *store, size_t k, const line_t line, size_t *last)
+{
+    point_t p1 = {_coord(store, line.p1.x, store->origin.x), _coord(store, line.p1.y, store->origin.y)};
+    point_t p2 = {_coord(store, line.p2.x, store->origin.x), _coord(store, line.p2.y, store->origin.y)};
+    const point_t *min = &store->boxes[2 * k], *max = &store->boxes[2 * k + 1];
+    if (fmax(p1.x, p2.x) < min->x || fmin(p1.x, p2.x) > max->x || fmax(p1.y, p2.y) < min->y || fmin(p1.y, p2.y) > max->y)
+        return 0;
+
+    bool robust = geom_tools_get_robust();
+    if (store->precision == BIM_GEOMETRY_FLOAT)
+        return _intersected(store, k, p1, p2, last, true, robust);
+    return _intersected(store, k, p1, p2, last, false, robust);
+}
+
+// Ближайшая точка контура: для каждого ребра -- как в geom_tools_nearest_point,
+// из точек ребер выбирается ближайшая (при равенстве -- на ребре с меньшим номером)
+KERNEL point_t _nearest(const bim_geometry_store_t *store, size_t k, double px, double py, size_t *edge, bool single)
+{
+    size_t b = store->offsets[k], e = store->offsets[k + 1];
+    _vd best = (_vd){0} + INFINITY, bestx = best, besty = best;
+    _vl besti = (_vl){0} - 1;
+    for (size_t i = b; i < e - 1; i += LANES)
+    {
+        _vd ax = _load(store->x, i, single), ay = _load(store->y, i, single);
+        _vd bx = _load(store->x, i + 1, single), by = _load(store->y, i + 1, single);
+        _vd A = px - ax, B = py - ay, C = bx - ax, D = by - ay;
+        _vd len_sq = C * C + D * D;
+        _vd param = (A * C + B * D) / len_sq;
+
+        // Ребро короче 1e-9 или проекция до его начала -- начало ребра,
+        // проекция за концом -- конец ребра
+        _vl at_a = (len_sq < 1e-18) | (param < 0);
+        _vl at_b = ~at_a & (param > 1);
+        _vd xx = _select(at_a, ax, _select(at_b, bx, ax + param * C));
+        _vd yy = _select(at_a, ay, _select(at_b, by, ay + param * D));
+        _vd d = (xx - px) * (xx - px) + (yy - py) * (yy - py);
+
+        _vl better = _valid(i, e - 1) & (d < best);
+        best = _select(better, d, best);
+        bestx = _select(better, xx, bestx);
+        besty = _select(better, yy, besty);
+        besti = (better & (_lane + (int64_t)(i - b))) | (~better & besti);
+    }
+
+    int l = 0;
+    for (int m = 1; m < LANES; m++)
+        if (besti[m] >= 0 && (besti[l] < 0 || best[m] < best[l] || (best[m] == best[l] && besti[m] < besti[l])))
+            l = m;
+    if (besti[l] < 0)
+        return (point_t){NAN, NAN};
+    if (edge) *edge = (size_t)besti[l];
+    return (point_t){bestx[l], besty[l]};
+}
+
+point_t bim_geometry_store_nearest_point(const bim_geometry_store_t *store, size_t k, const point_t point, size_t *edge)
+{
+    if (bim_geometry_store_point_count(store, k) == 0)
+        return point;
+
+    double px = _coord(store, point.x, store->origin.x);
+    double py = _coord(store, point.y, store->origin.y);
+    point_t p = store->precision == BIM_GEOMETRY_FLOAT
+              ? _nearest(store, k, px, py, edge, true)
+              : _nearest(store, k, px, py, edge, false);
+    return (point_t){p.x + store->origin.x, p.y + store->origin.y};
+}
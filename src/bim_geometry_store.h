@@ -0,0 +1,133 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*!
+\file
+\brief Хранилище геометрии этажа в виде структуры массивов
+
+Вершины всех многоугольников этажа хранятся подряд в двух массивах
+координат x[] и y[] (structure of arrays) вместо отдельного массива
+point_t у каждого элемента. Ребра многоугольника лежат в памяти
+подряд, поэтому вычисления по хранилищу (площадь, принадлежность точки,
+пересечение отрезка с ребрами, ближайшая точка контура) обрабатывают
+по несколько ребер за шаг векторными командами процессора.
+
+Координаты хранятся в double или, чтобы вдвое уменьшить объем данных,
+в float. Во втором случае координаты отсчитываются от левого нижнего
+угла этажа, а вычисления все равно выполняются в double, поэтому
+погрешность результатов определяется только округлением координат
+при записи в хранилище: не больше FLT_EPSILON / 2 от размера этажа
+по каждой координате. В режиме double результаты принадлежности точки,
+пересечения и ближайшей точки совпадают с функциями bim_polygon_tools,
+в том числе в режиме точных предикатов (geom_tools_set_robust).
+*/
+
+#ifndef BIM_GEOMETRY_STORE_H
+#define BIM_GEOMETRY_STORE_H
+
+#include "bim_tools.h"
+
+/// Тип координат в хранилище
+typedef enum
+{
+    BIM_GEOMETRY_DOUBLE,    ///< double, абсолютные координаты
+    BIM_GEOMETRY_FLOAT      ///< float, координаты относительно origin
+} bim_geometry_precision_t;
+
+/// Хранилище геометрии. Многоугольники пронумерованы так: зоны 0..zone_count-1,
+/// переходы zone_count..zone_count+transit_count-1 (в порядке массивов этажа)
+struct bim_geometry_store
+{
+    bim_geometry_precision_t precision;
+    point_t     origin;         ///< Начало отсчета координат (для BIM_GEOMETRY_DOUBLE -- 0, 0)
+    uint64_t    polygon_count;  ///< Количество многоугольников
+    uint64_t    *offsets;       ///< Вершины многоугольника k -- [offsets[k], offsets[k + 1]) (polygon_count + 1 элементов).
+                                ///< Последняя из них -- копия первой, поэтому ребро i соединяет вершины i и i + 1
+    point_t     *boxes;         ///< Габариты многоугольников относительно origin: boxes[2 * k] -- min, boxes[2 * k + 1] -- max
+    void        *x;             ///< Координаты x вершин (double или float)
+    void        *y;             ///< Координаты y вершин (double или float)
+};
+typedef struct bim_geometry_store bim_geometry_store_t;
+
+/*!
+Строит хранилище геометрии этажа
+
+\param[in] level     Этаж, полигоны его элементов должны быть загружены
+\param[in] precision Тип координат
+\returns Хранилище или NULL, если не хватило памяти
+*/
+bim_geometry_store_t*   bim_geometry_store_new      (const bim_level_t *level, bim_geometry_precision_t precision);
+
+/*!
+Строит хранилище для произвольного набора многоугольников
+
+\param[in] polygons  Массив указателей на многоугольники (NULL -- многоугольник без вершин)
+\param[in] count     Количество многоугольников
+\param[in] precision Тип координат
+\returns Хранилище или NULL, если не хватило памяти
+*/
+bim_geometry_store_t*   bim_geometry_store_new_polygons(const polygon_t *const *polygons, size_t count, bim_geometry_precision_t precision);
+
+/// Освобождает хранилище
+void                    bim_geometry_store_free     (bim_geometry_store_t *store);
+
+/// Количество вершин многоугольника k без повторенной в конце первой вершины
+size_t                  bim_geometry_store_point_count(const bim_geometry_store_t *store, size_t k);
+
+/*!
+Площади всех многоугольников хранилища по формуле Гаусса
+
+\param[in]  store Хранилище
+\param[out] areas Массив площадей (polygon_count элементов)
+*/
+void    bim_geometry_store_areas                (const bim_geometry_store_t *store, double *areas);
+
+/*!
+Принадлежность набора точек многоугольнику по числу оборотов, как в
+geom_tools_is_points_in_polygon. Точка на границе принадлежит многоугольнику
+
+\param[in]  store   Хранилище
+\param[in]  k       Номер многоугольника
+\param[in]  points  Массив точек
+\param[in]  count   Количество точек
+\param[out] inside  Результат для каждой точки: 1 внутри или на границе, 0 снаружи
+*/
+void    bim_geometry_store_points_in_polygon    (const bim_geometry_store_t *store, size_t k,
+                                                 const point_t *points, size_t count, uint8_t *inside);
+
+/*!
+Поиск ребер многоугольника, которые пересекает отрезок, как в
+geom_tools_intersected_edges
+
+\param[in]  store Хранилище
+\param[in]  k     Номер многоугольника
+\param[in]  line  Отрезок
+\param[out] last  Номер последнего пересеченного ребра
+\returns Количество пересеченных ребер
+*/
+size_t  bim_geometry_store_intersected_edges    (const bim_geometry_store_t *store, size_t k, const line_t line, size_t *last);
+
+/*!
+Ближайшая к заданной точка контура многоугольника. Для каждого ребра
+точка ищется как в geom_tools_nearest_point
+
+\param[in]  store Хранилище
+\param[in]  k     Номер многоугольника
+\param[in]  point Точка
+\param[out] edge  Номер ребра, на котором лежит найденная точка (может быть NULL)
+\returns Ближайшая точка контура. Если у многоугольника нет вершин, возвращается point
+*/
+point_t bim_geometry_store_nearest_point        (const bim_geometry_store_t *store, size_t k, const point_t point, size_t *edge);
+
+#endif //BIM_GEOMETRY_STORE_H
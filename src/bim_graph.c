@@ -14,36 +14,62 @@
  */
 
 #include "bim_graph.h"
+#include "logger.h"
 
-bim_graph_t*  _graph_create(const bim_edge *edges, uint32_t edge_count, uint32_t node_count);
-void        _graph_create_edges(const ArrayList *list_doors, ArrayListEqualFunc callback, bim_edge *edges, const ArrayList *rooms_and_stairs);
-int32_t     _arraylist_equal_callback(const ArrayListValue value1, const ArrayListValue value2);
+bim_graph_t*        _graph_create(const bim_edge *edges, uint32_t edge_count, uint32_t node_count);
+bim_graph_list_t*   _graph_list_create(const bim_edge *edges, uint32_t edge_count, uint32_t node_count);
+int         _graph_create_edges(const bim_t *bim, bim_edge *edges);
 
-bim_graph_t *bim_graph_new(const bim_t *bim)
+// Ребра модели: из отображенного файла или вычисленные заново.
+// Во втором случае массив выделяется в куче и возвращается также через owned
+static const bim_edge *_graph_model_edges(const bim_t *bim, bim_edge **owned)
 {
-    bim_edge edges[bim->transits->length];
-    _graph_create_edges(bim->transits, _arraylist_equal_callback, edges, bim->zones);
+    *owned = NULL;
+    if (bim->edges)
+        return bim->edges;
 
-    bim_graph_t *bim_graph = _graph_create(edges, bim->transits->length, bim->zones->length);
-    if (!bim_graph)
+    // Список ребер может не поместиться в стек на больших зданиях
+    *owned = (bim_edge *)malloc(sizeof (bim_edge) * (bim->transits->length ? bim->transits->length : 1));
+    if (*owned && _graph_create_edges(bim, *owned) != 0)
     {
-        return NULL;
+        free(*owned);
+        *owned = NULL;
     }
+    return *owned;
+}
+
+bim_graph_t *bim_graph_new(const bim_t *bim)
+{
+    bim_edge *owned;
+    const bim_edge *edges = _graph_model_edges(bim, &owned);
+    bim_graph_t *bim_graph = _graph_create(edges, bim->transits->length, bim->zones->length);
+    free(owned);
+    return bim_graph;
+}
 
+bim_graph_list_t *bim_graph_list_new(const bim_t *bim)
+{
+    bim_edge *owned;
+    const bim_edge *edges = _graph_model_edges(bim, &owned);
+    bim_graph_list_t *bim_graph = _graph_list_create(edges, bim->transits->length, bim->zones->length);
+    free(owned);
     return bim_graph;
 }
 
+int bim_graph_edges(const bim_t *bim, bim_edge *edges)
+{
+    return _graph_create_edges(bim, edges);
+}
+
 // Function to print adjacency list representation of a graph
 void bim_graph_print(const bim_graph_t* graph)
 {
-    for (size_t i = 0; i < graph->node_count; i++)
+    for (uint32_t i = 0; i < graph->node_count; i++)
     {
         // print current vertex and all its neighbors
-        const bim_node* ptr = graph->head[i];
-        while (ptr != NULL)
+        for (uint32_t k = graph->offsets[i]; k < graph->offsets[i + 1]; k++)
         {
-            printf("%zu —(%lu)-> %lu\t", i, ptr->eid, ptr->dest);
-            ptr = ptr->next;
+            printf("%u —(%u)-> %u\t", i, graph->adjacent[k].eid, graph->adjacent[k].dest);
         }
         printf("\n");
     }
@@ -51,16 +77,89 @@ void bim_graph_print(const bim_graph_t* graph)
 
 void bim_graph_free(bim_graph_t* graph)
 {
-    for(size_t i = 0; i < graph->node_count; i++)
+    if (!graph)
+        return;
+    free(graph->adjacent);
+    free(graph);
+}
+
+void bim_graph_list_free(bim_graph_list_t *graph)
+{
+    if (!graph)
+        return;
+    for (size_t i = 0; i < graph->node_count; i++)
     {
-        free(graph->head[i]);
+        bim_node *node = graph->head[i];
+        while (node)
+        {
+            bim_node *next = node->next;
+            free(node);
+            node = next;
+        }
     }
     free(graph->head);
     free(graph);
 }
 
-// Function to create an adjacency list from specified edges
+// Граф CSR строится в два прохода по ребрам: подсчет степеней вершин
+// и раскладка смежных вершин. Счетчик offsets[v] после префиксной суммы
+// указывает на конец списка вершины v и при раскладке сдвигается к его
+// началу, поэтому ребра ложатся в обратном порядке, как в списках смежности
 bim_graph_t* _graph_create(const bim_edge *edges, uint32_t edge_count, uint32_t node_count)
+{
+    if (!edges)
+        return NULL;
+
+    if (!node_count || !edge_count)
+        return NULL;
+
+    for (uint32_t i = 0; i < edge_count; i++)
+    {
+        if (edges[i].src >= node_count || edges[i].dest >= node_count)
+        {
+            LOG_ERROR("Ребро %u связывает несуществующие вершины (%lu, %lu)", i, edges[i].src, edges[i].dest);
+            return NULL;
+        }
+    }
+
+    bim_graph_t *graph = (bim_graph_t *)calloc(1, sizeof (bim_graph_t) + sizeof (uint32_t) * (node_count + 1));
+    if (!graph)
+        return NULL;
+
+    graph->adjacent = (bim_adjacent_t *)malloc(sizeof (bim_adjacent_t) * 2 * edge_count);
+    if (!graph->adjacent)
+    {
+        free(graph);
+        return NULL;
+    }
+    graph->node_count = node_count;
+    graph->edge_count = edge_count;
+
+    uint32_t *offsets = graph->offsets;
+    for (uint32_t i = 0; i < edge_count; i++)
+    {
+        offsets[edges[i].src]++;
+        offsets[edges[i].dest]++;
+    }
+    for (uint32_t v = 1; v <= node_count; v++)
+    {
+        offsets[v] += offsets[v - 1];
+    }
+
+    for (uint32_t i = 0; i < edge_count; i++)
+    {
+        uint32_t src = (uint32_t)edges[i].src;
+        uint32_t dest = (uint32_t)edges[i].dest;
+        uint32_t eid = (uint32_t)edges[i].id;
+        graph->adjacent[--offsets[src]] = (bim_adjacent_t){dest, eid};
+        graph->adjacent[--offsets[dest]] = (bim_adjacent_t){src, eid};
+    }
+
+    return graph;
+}
+
+// Function to create an adjacency list from specified edges
+bim_graph_list_t* _graph_list_create(const bim_edge *edges, uint32_t edge_count, uint32_t node_count)
 {
     if (!edges)
         return NULL;
@@ -69,7 +168,7 @@ bim_graph_t* _graph_create(const bim_edge *edges, uint32_t edge_count, uint32_t
         return NULL;
 
     // allocate storage for the graph data structure
-    bim_graph_t* graph = (bim_graph_t*)malloc(sizeof(bim_graph_t));
+    bim_graph_list_t* graph = (bim_graph_list_t*)malloc(sizeof(bim_graph_list_t));
     if (!graph)
         return NULL;
 
@@ -120,34 +219,57 @@ bim_graph_t* _graph_create(const bim_edge *edges, uint32_t edge_count, uint32_t
     return graph;
 }
 
-void _graph_create_edges(const ArrayList *list_doors, ArrayListEqualFunc callback, bim_edge *edges, const ArrayList *rooms_and_stairs)
-{
-    for (size_t i = 0; i < list_doors->length; i++, edges++)
-    {
-        edges->id = i;
+#define NO_ZONE UINT32_MAX
 
-        uint64_t ids[] = {0, rooms_and_stairs->length};
-        for (size_t k = 0, j = 0; k < rooms_and_stairs->length; ++k)
-            if (callback(rooms_and_stairs->data[k], list_doors->data[i]) && j != 2)
-                ids[j++] = k;
+// Ребро перехода соединяет зоны из его связей (Output). Номер UUID зоны
+// переводится в номер зоны таблицей, индексированной номерами UUID, поэтому
+// ребра строятся за один проход по переходам. Ребро направлено от зоны
+// с меньшим номером к зоне с большим. Недостающая сторона перехода --
+// зона вне здания: в файле выход (DOOR_WAY_OUT) ссылается только на одну зону.
+// Возвращает 0 или -1, если не хватило памяти
+int _graph_create_edges(const bim_t *bim, bim_edge *edges)
+{
+    const ArrayList *list_doors = bim->transits;
+    const ArrayList *rooms_and_stairs = bim->zones;
+    uint32_t handles_count = bim->json->handles_count + 1; // + зона вне здания
+    uint32_t outside = rooms_and_stairs->length - 1;
 
-        edges->src = ids[0];
-        edges->dest = ids[1];
+    uint32_t *zone_by_handle = (uint32_t *)malloc(sizeof (uint32_t) * handles_count);
+    if (!zone_by_handle)
+    {
+        LOG_ERROR("Не удалось выделить память для построения ребер графа");
+        return -1;
+    }
+    memset(zone_by_handle, 0xff, sizeof (uint32_t) * handles_count);
+    for (size_t k = 0; k < rooms_and_stairs->length; ++k)
+    {
+        uint32_t handle = ((const bim_zone_t *)rooms_and_stairs->data[k])->base->handle;
+        if (handle < handles_count)
+            zone_by_handle[handle] = k;
     }
-}
-
-int32_t _arraylist_equal_callback(const ArrayListValue value1, const ArrayListValue value2)
-{
-    const bim_zone_t *element1 = value1;
-    const bim_transit_t *element2 = value2;
 
-    for(size_t i = 0; i < element1->base->outputs_count; i++)
+    for (size_t i = 0; i < list_doors->length; i++, edges++)
     {
-        if (strcmp(element1->base->outputs[i], element2->base->uuid) == 0)
+        const bim_json_element_t *door = ((const bim_transit_t *)list_doors->data[i])->base;
+        uint32_t ids[2] = {NO_ZONE, NO_ZONE};
+        uint8_t found = 0;
+        for (size_t j = 0; j < door->outputs_count && found < 2; j++)
         {
-            return 1;
+            uint32_t handle = door->outputs[j];
+            uint32_t zone = handle < handles_count ? zone_by_handle[handle] : NO_ZONE;
+            if (zone == NO_ZONE || (found == 1 && ids[0] == zone)) continue;
+            ids[found++] = zone;
         }
+        if (found < 2 && door->sign != DOOR_WAY_OUT)
+            LOG_WARN("Переход %s связан с %u зонами здания, вторая сторона -- зона вне здания", door->uuid, found);
+        for (; found < 2; found++)
+            ids[found] = outside;
+
+        edges->id = i;
+        edges->src = ids[0] < ids[1] ? ids[0] : ids[1];
+        edges->dest = ids[0] < ids[1] ? ids[1] : ids[0];
     }
 
+    free(zone_by_handle);
     return 0;
 }
@@ -25,13 +25,40 @@
 #include "bim_tools.h"
 
 typedef struct graph bim_graph_t;
+typedef struct adjacent bim_adjacent_t;
+typedef struct graph_list bim_graph_list_t;
 typedef struct node bim_node;
 typedef struct edge bim_edge;
 
-//https://www.techiedelight.com/implement-graph-data-structure-c
+/*!
+Граф здания в формате CSR (compressed sparse row)
 
-// Data structure to store a graph object
+Смежные вершины вершины v записаны подряд в adjacent[offsets[v]] ...
+adjacent[offsets[v + 1] - 1]. Каждое ребро (переход) записано дважды:
+у каждой из двух связанных им зон. Смежные вершины идут в порядке
+убывания номера ребра, как в списке смежности bim_graph_list_t.
+Граф занимает два блока памяти: структура вместе с offsets и adjacent.
+*/
 struct graph
+{
+    uint32_t        node_count; ///< Количество вершин (зон, включая зону вне здания)
+    uint32_t        edge_count; ///< Количество ребер (переходов)
+    bim_adjacent_t  *adjacent;  ///< Смежные вершины, 2 * edge_count элементов
+    uint32_t        offsets[];  ///< Начало списка смежности вершины, node_count + 1 элементов
+};
+
+/// Смежная вершина в графе CSR
+struct adjacent
+{
+    uint32_t    dest;   ///< Номер смежной вершины (зоны)
+    uint32_t    eid;    ///< Номер ребра (перехода)
+};
+
+//https://www.techiedelight.com/implement-graph-data-structure-c
+
+// Граф в виде списков смежности: по узлу на каждое направление ребра.
+// Оставлен для сравнения с графом CSR (bench_graph)
+struct graph_list
 {
     // An array of pointers to Node to represent an adjacency list
     bim_node**  head;
@@ -54,7 +81,13 @@ struct edge {
 };
 
 bim_graph_t*  bim_graph_new    (const bim_t *bim);
+// Заполняет массив ребер графа (по одному на каждый переход).
+// Возвращает 0 или -1, если не хватило памяти
+int         bim_graph_edges  (const bim_t *bim, bim_edge *edges);
 void        bim_graph_print  (const bim_graph_t *graph);
 void        bim_graph_free   (bim_graph_t* graph);
 
+bim_graph_list_t*   bim_graph_list_new  (const bim_t *bim);
+void                bim_graph_list_free (bim_graph_list_t *graph);
+
 #endif //BIM_GRAPH_H
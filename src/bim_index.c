@@ -0,0 +1,279 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bim_index.h"
+
+#define MAX_GRID_SIDE 4096  ///< Ограничение количества строк и столбцов сетки
+
+static const polygon_t* _polygon    (const bim_level_t *level, uint64_t k);
+static void             _cell_range (const bim_index_t *index, point_t min, point_t max,
+                                     uint32_t *c0, uint32_t *c1, uint32_t *r0, uint32_t *r1);
+static uint32_t         _cell_of    (const bim_index_t *index, double v, double origin, uint32_t limit);
+static bool             _touch      (const polygon_t *a, const polygon_t *b);
+
+bim_index_t* bim_index_new(const bim_level_t *level)
+{
+    uint64_t count = level->zone_count + level->transit_count;
+    if (count == 0 || count >= UINT32_MAX)
+        return NULL;
+
+    bim_index_t *index = (bim_index_t *)calloc(1, sizeof (bim_index_t));
+    if (!index)
+        return NULL;
+    index->zone_count = level->zone_count;
+    index->transit_count = level->transit_count;
+    index->boxes = (point_t *)malloc(sizeof (point_t) * 2 * count);
+    if (!index->boxes)
+    {
+        bim_index_free(index);
+        return NULL;
+    }
+
+    point_t min = {INFINITY, INFINITY}, max = {-INFINITY, -INFINITY};
+    for (uint64_t k = 0; k < count; k++)
+    {
+        const polygon_t *polygon = _polygon(level, k);
+        point_t *bmin = &index->boxes[2 * k], *bmax = &index->boxes[2 * k + 1];
+        bmin->x = bmin->y = INFINITY;
+        bmax->x = bmax->y = -INFINITY;
+        for (size_t i = 0; polygon && i < polygon->point_count; i++)
+        {
+            bmin->x = fmin(bmin->x, polygon->points[i].x); bmax->x = fmax(bmax->x, polygon->points[i].x);
+            bmin->y = fmin(bmin->y, polygon->points[i].y); bmax->y = fmax(bmax->y, polygon->points[i].y);
+        }
+        min.x = fmin(min.x, bmin->x); max.x = fmax(max.x, bmax->x);
+        min.y = fmin(min.y, bmin->y); max.y = fmax(max.y, bmax->y);
+    }
+    if (min.x > max.x) // Ни у одного элемента нет точек
+        min = max = (point_t){0, 0};
+
+    // Около одного элемента на ячейку
+    double width = max.x - min.x, height = max.y - min.y;
+    double cell = sqrt(fmax(width * height, 1e-12) / count);
+    double cols = fmin(fmax(ceil(width / cell), 1), MAX_GRID_SIDE);
+    double rows = fmin(fmax(ceil(height / cell), 1), MAX_GRID_SIDE);
+    index->min = min;
+    index->cols = (uint32_t)cols;
+    index->rows = (uint32_t)rows;
+    index->cell_size = fmax(fmax(width / cols, height / rows), 1e-9);
+
+    // Списки ячеек в одном массиве: подсчет, префиксные суммы, заполнение
+    size_t cells_count = (size_t)index->cols * index->rows;
+    index->cells = (uint32_t *)calloc(cells_count + 1, sizeof (uint32_t));
+    if (!index->cells)
+    {
+        bim_index_free(index);
+        return NULL;
+    }
+
+    uint64_t items_count = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint64_t k = 0; k < count; k++)
+        {
+            const point_t *bmin = &index->boxes[2 * k], *bmax = &index->boxes[2 * k + 1];
+            if (bmin->x > bmax->x)
+                continue;
+
+            uint32_t c0, c1, r0, r1;
+            _cell_range(index, *bmin, *bmax, &c0, &c1, &r0, &r1);
+            for (uint32_t r = r0; r <= r1; r++)
+                for (uint32_t c = c0; c <= c1; c++)
+                {
+                    size_t cell_index = (size_t)r * index->cols + c;
+                    if (pass == 0)
+                        index->cells[cell_index + 1]++;
+                    else
+                        index->items[index->cells[cell_index]++] = (uint32_t)k;
+                }
+        }
+
+        if (pass == 0)
+        {
+            // Сумма накапливается в 64 битах и проверяется до записи в ячейки uint32_t
+            for (size_t i = 0; i < cells_count && items_count < UINT32_MAX; i++)
+            {
+                items_count += index->cells[i + 1];
+                index->cells[i + 1] = (uint32_t)items_count;
+            }
+            if (items_count >= UINT32_MAX)
+            {
+                bim_index_free(index);
+                return NULL;
+            }
+            index->items = (uint32_t *)malloc(sizeof (uint32_t) * (items_count ? items_count : 1));
+            if (!index->items)
+            {
+                bim_index_free(index);
+                return NULL;
+            }
+        }
+    }
+    // После заполнения cells[i] указывает на конец списка ячейки i, то есть на начало i+1
+    memmove(index->cells + 1, index->cells, sizeof (uint32_t) * cells_count);
+    index->cells[0] = 0;
+
+    return index;
+}
+
+void bim_index_free(bim_index_t *index)
+{
+    if (!index)
+        return;
+    free(index->cells);
+    free(index->items);
+    free(index->boxes);
+    free(index);
+}
+
+bim_zone_t* bim_index_zone_at(const bim_level_t *level, const point_t point)
+{
+    const bim_index_t *index = level->index;
+    if (!index)
+        return NULL;
+
+    if (point.x < index->min.x || point.y < index->min.y
+        || point.x > index->min.x + index->cols * index->cell_size
+        || point.y > index->min.y + index->rows * index->cell_size)
+        return NULL;
+
+    uint32_t c = _cell_of(index, point.x, index->min.x, index->cols);
+    uint32_t r = _cell_of(index, point.y, index->min.y, index->rows);
+    size_t cell_index = (size_t)r * index->cols + c;
+
+    // Номера в списке ячейки возрастают, первая найденная зона имеет наименьший номер
+    for (uint32_t i = index->cells[cell_index]; i < index->cells[cell_index + 1]; i++)
+    {
+        uint32_t k = index->items[i];
+        if (k >= index->zone_count)
+            break; // Дальше только переходы
+
+        const point_t *bmin = &index->boxes[2 * k], *bmax = &index->boxes[2 * k + 1];
+        if (point.x < bmin->x || point.x > bmax->x || point.y < bmin->y || point.y > bmax->y)
+            continue;
+        if (geom_tools_is_point_in_polygon(point, level->zones[k].base->polygon))
+            return &level->zones[k];
+    }
+    return NULL;
+}
+
+size_t bim_index_zones_touching(const bim_level_t *level, const polygon_t *polygon, bim_zone_t **zones, size_t max)
+{
+    const bim_index_t *index = level->index;
+    if (!index || !polygon || polygon->point_count == 0)
+        return 0;
+
+    point_t qmin = polygon->points[0], qmax = polygon->points[0];
+    for (size_t i = 1; i < polygon->point_count; i++)
+    {
+        qmin.x = fmin(qmin.x, polygon->points[i].x); qmax.x = fmax(qmax.x, polygon->points[i].x);
+        qmin.y = fmin(qmin.y, polygon->points[i].y); qmax.y = fmax(qmax.y, polygon->points[i].y);
+    }
+
+    uint32_t c0, c1, r0, r1;
+    _cell_range(index, qmin, qmax, &c0, &c1, &r0, &r1);
+
+    size_t found = 0;
+    for (uint32_t r = r0; r <= r1; r++)
+        for (uint32_t c = c0; c <= c1; c++)
+        {
+            size_t cell_index = (size_t)r * index->cols + c;
+            for (uint32_t i = index->cells[cell_index]; i < index->cells[cell_index + 1]; i++)
+            {
+                uint32_t k = index->items[i];
+                if (k >= index->zone_count)
+                    break;
+
+                const point_t *bmin = &index->boxes[2 * k], *bmax = &index->boxes[2 * k + 1];
+                if (bmax->x < qmin.x || bmin->x > qmax.x || bmax->y < qmin.y || bmin->y > qmax.y)
+                    continue;
+
+                // Зона, занимающая несколько ячеек, проверяется только в ячейке,
+                // где лежит левый нижний угол пересечения габаритов
+                if (_cell_of(index, fmax(bmin->x, qmin.x), index->min.x, index->cols) != c
+                    || _cell_of(index, fmax(bmin->y, qmin.y), index->min.y, index->rows) != r)
+                    continue;
+
+                if (!_touch(polygon, level->zones[k].base->polygon))
+                    continue;
+
+                // Вставка с сохранением порядка номеров, в массиве остаются max наименьших
+                bim_zone_t *zone = &level->zones[k];
+                size_t stored = found < max ? found : max;
+                size_t pos = stored;
+                while (pos > 0 && zones[pos - 1] > zone)
+                    pos--;
+                if (pos < max)
+                {
+                    size_t tail = (stored < max ? stored : max - 1) - pos;
+                    memmove(&zones[pos + 1], &zones[pos], sizeof (bim_zone_t *) * tail);
+                    zones[pos] = zone;
+                }
+                found++;
+            }
+        }
+    return found;
+}
+
+static const polygon_t* _polygon(const bim_level_t *level, uint64_t k)
+{
+    if (k < level->zone_count)
+        return level->zones[k].base->polygon;
+    return level->transits[k - level->zone_count].base->polygon;
+}
+
+static uint32_t _cell_of(const bim_index_t *index, double v, double origin, uint32_t limit)
+{
+    double cell = floor((v - origin) / index->cell_size);
+    if (cell < 0) return 0;
+    if (cell >= limit) return limit - 1;
+    return (uint32_t)cell;
+}
+
+static void _cell_range(const bim_index_t *index, point_t min, point_t max,
+                        uint32_t *c0, uint32_t *c1, uint32_t *r0, uint32_t *r1)
+{
+    *c0 = _cell_of(index, min.x, index->min.x, index->cols);
+    *c1 = _cell_of(index, max.x, index->min.x, index->cols);
+    *r0 = _cell_of(index, min.y, index->min.y, index->rows);
+    *r1 = _cell_of(index, max.y, index->min.y, index->rows);
+}
+
+// Многоугольники пересекаются или касаются: вершина одного лежит в другом
+// или пересекаются их ребра
+static bool _touch(const polygon_t *a, const polygon_t *b)
+{
+    if (!a || !b)
+        return false;
+
+    for (size_t i = 0; i < a->point_count; i++)
+        if (geom_tools_is_point_in_polygon(a->points[i], b))
+            return true;
+    for (size_t i = 0; i < b->point_count; i++)
+        if (geom_tools_is_point_in_polygon(b->points[i], a))
+            return true;
+
+    for (size_t i = 0; i < a->point_count; i++)
+    {
+        line_t ea = {a->points[i], a->points[i + 1 < a->point_count ? i + 1 : 0]};
+        for (size_t j = 0; j < b->point_count; j++)
+        {
+            line_t eb = {b->points[j], b->points[j + 1 < b->point_count ? j + 1 : 0]};
+            if (geom_tools_is_intersect_line(ea, eb))
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Пространственный индекс зон и переходов этажа
+
+Равномерная сетка над габаритными прямоугольниками полигонов этажа. Размер
+ячейки выбирается так, чтобы на ячейку приходилось около одного элемента,
+поэтому запросы просматривают в среднем несколько элементов независимо
+от размера этажа. Индекс строится в bim_tools_new для каждого этажа, если
+полигоны сохраняются (bim_tools_set_keep_geometry), и доступен через
+bim_level_t.index.
+*/
+
+#ifndef BIM_INDEX_H
+#define BIM_INDEX_H
+
+#include "bim_tools.h"
+
+/// Индекс этажа. Элементы пронумерованы так: зоны 0..zone_count-1,
+/// переходы zone_count..zone_count+transit_count-1 (в порядке массивов этажа)
+struct bim_index
+{
+    point_t     min;            ///< Левый нижний угол сетки
+    double      cell_size;      ///< Сторона ячейки
+    uint32_t    cols;           ///< Количество столбцов сетки
+    uint32_t    rows;           ///< Количество строк сетки
+    uint32_t    *cells;         ///< Начало списка элементов каждой ячейки в items (cols * rows + 1 элементов)
+    uint32_t    *items;         ///< Номера элементов, попавших в ячейки
+    point_t     *boxes;         ///< Габариты элементов: boxes[2 * k] -- min, boxes[2 * k + 1] -- max
+    uint64_t    zone_count;     ///< Количество зон этажа
+    uint64_t    transit_count;  ///< Количество переходов этажа
+};
+typedef struct bim_index bim_index_t;
+
+/*!
+Строит индекс этажа
+
+\param[in] level Этаж, полигоны его элементов должны быть загружены
+\returns Индекс или NULL, если на этаже нет элементов или не хватило памяти
+*/
+bim_index_t*    bim_index_new           (const bim_level_t *level);
+
+/// Освобождает индекс
+void            bim_index_free          (bim_index_t *index);
+
+/*!
+Зона этажа, которой принадлежит точка
+
+Точка на границе принадлежит зоне. Если точка лежит на общей стене
+нескольких зон, возвращается зона с меньшим номером в массиве этажа
+
+\param[in] level Этаж с построенным индексом
+\param[in] point Точка
+\returns Зона или NULL, если точка вне зон этажа или индекс не построен
+*/
+bim_zone_t*     bim_index_zone_at       (const bim_level_t *level, const point_t point);
+
+/*!
+Зоны этажа, которые пересекаются с многоугольником или касаются его,
+например зоны, которые соединяет проем
+
+\param[in]  level   Этаж с построенным индексом
+\param[in]  polygon Многоугольник
+\param[out] zones   Массив для найденных зон, в порядке возрастания номеров в массиве этажа
+\param[in]  max     Размер массива zones
+\returns Количество найденных зон. Если оно больше max, в zones записаны только первые max
+*/
+size_t          bim_index_zones_touching(const bim_level_t *level, const polygon_t *polygon, bim_zone_t **zones, size_t max);
+
+#endif //BIM_INDEX_H
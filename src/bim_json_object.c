@@ -13,12 +13,14 @@
  * limitations under the License.
  */
 
+#include <malloc.h>
 #include "bim_json_object.h"
+#include "bim_uuid_table.h"
 #include "json-c/json.h"        ///< https://github.com/rbtylee/tutorial-jsonc/blob/master/tutorial/index.md
 
 #define streq(str1, str2) strcmp(str1, str2) == 0
 
-bim_json_object_t* bim_json_new(const char* filename)
+bim_json_object_t* bim_json_new_dom(const char* filename)
 {
     json_object *root;
     root = json_object_from_file(filename);
@@ -28,50 +30,67 @@ bim_json_object_t* bim_json_new(const char* filename)
         return NULL;
     }
 
-    bim_json_object_t *bim = (bim_json_object_t*)malloc(sizeof(bim_json_object_t));
+    bim_arena_t *arena = bim_arena_new(0);
+    bim_json_object_t *bim = (bim_json_object_t*)bim_arena_alloc(arena, sizeof(bim_json_object_t));
+    bim->arena = arena;
+    bim->geometry = bim_arena_new(0);
+    bim_uuid_table_t *uuids = bim_uuid_table_new(0);
     json_object *name_building = json_object_object_get(root, "NameBuilding");
-    bim->name = strdup(json_object_get_string(name_building));
+    bim->name = bim_arena_strdup(arena, json_object_get_string(name_building));
 
     json_object *address = json_object_object_get(root, "Address");
     json_object *st_address = json_object_object_get(address, "StreetAddress");
     json_object *city = json_object_object_get(address, "City");
     json_object *add_info = json_object_object_get(address, "AddInfo");
-    bim->address.street_address = strdup(json_object_get_string(st_address));
-    bim->address.city = strdup(json_object_get_string(city));
-    bim->address.add_info = strdup(json_object_get_string(add_info));
+    bim->address.street_address = bim_arena_strdup(arena, json_object_get_string(st_address));
+    bim->address.city = bim_arena_strdup(arena, json_object_get_string(city));
+    bim->address.add_info = bim_arena_strdup(arena, json_object_get_string(add_info));
 
     json_object *levels = json_object_object_get(root, "Level");
-    uint8_t levels_count = json_object_array_length(levels);
-    bim_json_level_t *bim_levels = (bim_json_level_t*)malloc(sizeof (bim_json_level_t) * levels_count);
+    size_t levels_count = json_object_array_length(levels);
+    bim_json_level_t *bim_levels = (bim_json_level_t*)bim_arena_alloc(arena, sizeof (bim_json_level_t) * levels_count);
     bim->levels_count = levels_count;
     bim->levels = bim_levels;
 
     uint64_t bim_element_rs_id = 0;
     uint64_t bim_element_d_id = 0;
     json_object *temp1;
-    for (uint8_t i = 0; i < levels_count; i++, bim_levels++)
+    for (size_t i = 0; i < levels_count; i++, bim_levels++)
     {
         temp1 = json_object_array_get_idx(levels, i);
         json_object *level_name = json_object_object_get(temp1, "NameLevel");
         json_object *level_z = json_object_object_get(temp1, "ZLevel");
-        bim_levels->name = strdup(json_object_get_string(level_name));
+        bim_levels->name = bim_arena_strdup(arena, json_object_get_string(level_name));
         bim_levels->z_level = json_object_get_double(level_z);
 
         json_object *elements = json_object_object_get(temp1, "BuildElement");
-        uint8_t elements_count = json_object_array_length(elements);
-        bim_json_element_t *bim_elements = (bim_json_element_t*)malloc(sizeof (bim_json_element_t) * elements_count);
+        size_t elements_count = json_object_array_length(elements);
+        bim_json_element_t *bim_elements = (bim_json_element_t*)bim_arena_alloc(arena, sizeof (bim_json_element_t) * elements_count);
         bim_levels->elements = bim_elements;
         bim_levels->elements_count = elements_count;
+
+        // Связи всех элементов этажа размещаются в одном пуле
+        uint64_t level_outputs_count = 0;
+        for (size_t j = 0; j < elements_count; j++)
+        {
+            json_object *outputs = json_object_object_get(json_object_array_get_idx(elements, j), "Output");
+            level_outputs_count += json_object_array_length(outputs);
+        }
+        uint32_t *level_outputs = (uint32_t*)bim_arena_alloc(arena, sizeof (uint32_t) * level_outputs_count);
+        bim_levels->outputs = level_outputs;
+        bim_levels->outputs_count = level_outputs_count;
+
         json_object *temp2;
-        for (uint8_t j = 0; j < elements_count; j++, bim_elements++)
+        for (size_t j = 0; j < elements_count; j++, bim_elements++)
         {
             temp2 = json_object_array_get_idx(elements, j);
             json_object *e_name = json_object_object_get(temp2, "Name");
             json_object *e_size_z = json_object_object_get(temp2, "SizeZ");
             json_object *e_sign = json_object_object_get(temp2, "Sign");
             json_object *e_id = json_object_object_get(temp2, "Id");
-            bim_elements->uuid = strndup(json_object_get_string(e_id), UUID_SIZE);
-            bim_elements->name = strdup(json_object_get_string(e_name));
+            bim_elements->uuid = bim_arena_strndup(arena, json_object_get_string(e_id), UUID_SIZE);
+            bim_elements->handle = bim_uuid_table_intern(uuids, bim_elements->uuid);
+            bim_elements->name = bim_arena_strdup(arena, json_object_get_string(e_name));
             bim_elements->size_z = json_object_get_double(e_size_z);
 
             bim_elements->numofpeople = 0;
@@ -94,28 +113,30 @@ bim_json_object_t* bim_json_new(const char* filename)
             bim_elements->sign = b_element_sign;
 
             json_object *outputs = json_object_object_get(temp2, "Output");
-            uint8_t outputs_count = json_object_array_length(outputs);
-            char **bim_element_outputs = (char**)malloc(sizeof (char*) * elements_count);
+            size_t outputs_count = json_object_array_length(outputs);
+            uint32_t *bim_element_outputs = level_outputs;
+            bim_elements->outputs_begin = level_outputs - bim_levels->outputs;
             bim_elements->outputs = bim_element_outputs;
             bim_elements->outputs_count = outputs_count;
+            level_outputs += outputs_count;
             json_object *temp3;
             for (size_t k = 0; k < outputs_count; k++)
             {
                 temp3 = json_object_array_get_idx(outputs, k);
-                bim_element_outputs[k] = strndup(json_object_get_string(temp3), UUID_SIZE);
+                bim_element_outputs[k] = bim_uuid_table_intern(uuids, json_object_get_string(temp3));
             }
 
             json_object *xy = json_object_object_get(temp2, "XY");
             json_object *xy0 = json_object_array_get_idx(xy, 0);
             json_object *points = json_object_object_get(xy0, "points");
-            uint8_t points_count = json_object_array_length(points);
-            polygon_t *bim_polygon = (polygon_t*)malloc(sizeof (polygon_t));
+            size_t points_count = json_object_array_length(points);
+            polygon_t *bim_polygon = (polygon_t*)bim_arena_alloc(bim->geometry, sizeof (polygon_t));
             bim_polygon->point_count = points_count;
-            point_t *bim_points = (point_t*)malloc(sizeof (point_t) * points_count);
+            point_t *bim_points = (point_t*)bim_arena_alloc(bim->geometry, sizeof (point_t) * points_count);
             bim_polygon->points = bim_points;
             bim_elements->polygon = bim_polygon;
             json_object *temp4;
-            for (uint8_t k = 0; k < points_count; k++, bim_points++)
+            for (size_t k = 0; k < points_count; k++, bim_points++)
             {
                 temp4 = json_object_array_get_idx(points, k);
                 json_object *x = json_object_object_get(temp4, "x");
@@ -128,6 +149,9 @@ bim_json_object_t* bim_json_new(const char* filename)
 
     json_object_put(root);
 
+    bim->handles_count = bim_uuid_table_count(uuids);
+    bim_uuid_table_free(uuids);
+
     return bim;
 }
 
@@ -137,45 +161,27 @@ bim_json_object_t* bim_json_copy (const bim_json_object_t* bim_object)
     return (bim_json_object_t *)bim_object;
 }
 
-static void _element_delete(bim_json_element_t *element)
+void bim_json_release_geometry (bim_json_object_t* bim)
 {
-    free(element->uuid);
-    free(element->name);
-    for (size_t i = 0; i < element->outputs_count; i++)
-    {
-        free(element->outputs[i]);
-    }
-    free(element->outputs);
+    if (!bim->geometry)
+        return;
 
-    if (element->polygon)
-    {
-        free(element->polygon->points);
-        free(element->polygon);
-    }
-}
+    for (size_t i = 0; i < bim->levels_count; i++)
+        for (size_t j = 0; j < bim->levels[i].elements_count; j++)
+            bim->levels[i].elements[j].polygon = NULL;
 
-static void _level_delete(bim_json_level_t *level)
-{
-    bim_json_element_t *elements_ptr = level->elements;
-    for (uint8_t j = 0; j < level->elements_count; j++, elements_ptr++)
-    {
-        _element_delete(elements_ptr);
-    }
-    free(level->name);
-    free(level->elements);
+    bim_arena_free(bim->geometry);
+    bim->geometry = NULL;
+
+#ifdef __GLIBC__
+    // Блоки региона могли быть выделены в куче процесса, а не отдельными
+    // отображениями, и без этого остались бы в резидентной памяти
+    malloc_trim(0);
+#endif
 }
 
 void bim_json_free (bim_json_object_t* bim)
 {
-    bim_json_level_t *levels_ptr = bim->levels;
-    for (uint8_t i = 0; i < bim->levels_count; i++, levels_ptr++)
-    {
-        _level_delete(levels_ptr);
-    }
-    free(bim->levels);
-    free(bim->address.add_info);
-    free(bim->address.city);
-    free(bim->address.street_address);
-    free(bim->name);
-    free(bim);
+    bim_arena_free(bim->geometry);
+    bim_arena_free(bim->arena);
 }
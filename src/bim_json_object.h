@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "bim_polygon_tools.h"
+#include "bim_arena.h"
 #include "logger.h"
 
 /// Количество символов в UUID
@@ -55,14 +56,18 @@ typedef struct
 {
     uint64_t                id;             ///< Внутренний номер элемента (генерируется)
     char                    *uuid;          ///< [JSON] UUID идентификатор элемента
+    uint32_t                handle;         ///< Номер UUID элемента в здании (см. bim_uuid_table.h)
     char                    *name;          ///< [JSON] Название элемента
     float                   size_z;         ///< [JSON] Высота элемента
     float                   z_level;        ///< Уровень, на котором находится элемент
     uint16_t                numofpeople;    ///< [JSON] Количество людей в элементе
     bim_element_sign_t      sign;           ///< [JSON] Тип элемента
     polygon_t               *polygon;       ///< [JSON] Полигон элемента
-    uint8_t                 outputs_count;  ///< Количество связанных с текущим элементов
-    char                    **outputs;      ///< [JSON] Массив UUID элементов, которые являются соседними
+    uint64_t                digest;         ///< Отпечаток полигона и типа элемента (0 -- не вычислен)
+    uint32_t                outputs_count;  ///< Количество связанных с текущим элементов
+    uint32_t                outputs_begin;  ///< Смещение связей элемента в пуле связей этажа
+    uint32_t                *outputs;       ///< [JSON] Массив номеров UUID элементов, которые являются соседними
+                                            ///< (участок пула связей этажа, начиная с outputs_begin)
 } bim_json_element_t;
 
 /// Структура поля, описывающего географическое положение объекта
@@ -78,27 +83,56 @@ typedef struct
 {
     char                *name;          ///< [JSON] Название этажа
     float               z_level;        ///< [JSON] Высота этажа над нулевой отметкой
-    uint16_t            elements_count; ///< Количство элементов на этаже
+    uint64_t            elements_count; ///< Количство элементов на этаже
     bim_json_element_t  *elements;      ///< [JSON] Массив элементов, которые принадлежат этажу
+    uint64_t            outputs_count;  ///< Размер пула связей этажа
+    uint32_t            *outputs;       ///< Пул связей всех элементов этажа
 } bim_json_level_t;
 
 /// Структура, описывающая здание
 typedef struct
 {
     char                *name;          ///< [JSON] Название здания
-    uint8_t             levels_count;   ///< Количество уровней в здании
+    uint64_t            levels_count;   ///< Количество уровней в здании
     bim_json_level_t    *levels;        ///< [JSON] Массив уровней здания
     bim_json_address_t  address;        ///< [JSON] Информация о местоположении объекта
+    uint32_t            handles_count;  ///< Количество номеров UUID, выданных при загрузке
+    bim_arena_t         *arena;         ///< Регион, из которого выделена память объекта, кроме полигонов
+    bim_arena_t         *geometry;      ///< Регион полигонов элементов (NULL после bim_json_release_geometry)
 } bim_json_object_t;
 
 /*!
 Создает новый объект типа bim_object_t
 
+Файл разбирается потоково: данные раскладываются по структурам
+по мере чтения, без построения промежуточного дерева json-c
+
 \param[in] filename Имя файла
 \returns Указатель на объект типа bim_object_t
 */
 bim_json_object_t*  bim_json_new        (const char* filename);
 
+/*!
+Создает новый объект типа bim_object_t, разбирая этажи в нескольких потоках
+
+Результат совпадает с bim_json_new
+
+\param[in] filename Имя файла
+\param[in] threads  Количество потоков (при threads <= 1 -- bim_json_new)
+\returns Указатель на объект типа bim_object_t
+*/
+bim_json_object_t*  bim_json_new_parallel(const char* filename, uint32_t threads);
+
+/*!
+Создает новый объект типа bim_object_t через дерево json-c
+
+Оставлен для сравнения с потоковым загрузчиком bim_json_new
+
+\param[in] filename Имя файла
+\returns Указатель на объект типа bim_object_t
+*/
+bim_json_object_t*  bim_json_new_dom    (const char* filename);
+
 /*!
 Копирует объект типа bim_object_t и возвращает указатель на новый объект
 
@@ -107,9 +141,22 @@ bim_json_object_t*  bim_json_new        (const char* filename);
 */
 bim_json_object_t*  bim_json_copy       (const bim_json_object_t *bim_object);
 
+/*!
+Освобождает полигоны элементов
+
+Полигоны нужны только для вычисления площадей и ширин при создании
+модели, во время моделирования они не используются. После вызова
+поле polygon всех элементов равно NULL
+
+\param[in] bim_object Объект типа bim_object_t
+*/
+void           bim_json_release_geometry(bim_json_object_t* bim_object);
+
 /*!
 Удаляет объект типа bim_object_t и освобождает память
 
+Вся память объекта освобождается вместе с его регионами
+
 \param[in] bim_object Объект типа bim_object_t
 */
 void           bim_json_free     (bim_json_object_t* bim_object);
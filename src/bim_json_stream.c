@@ -0,0 +1,981 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Потоковый загрузчик json-файла здания.
+ *
+ * Файл читается блоками фиксированного размера, токенизатор выдает
+ * лексемы по мере поступления данных, а разборщик сразу раскладывает
+ * их по структурам bim_json_level_t/bim_json_element_t.
+ * Дерево json-c не строится, поэтому расход памяти определяется только
+ * размером итоговой модели здания.
+ *
+ * При параллельной загрузке файл отображается в память, первый проход
+ * разбирает поля здания и находит границы этажей, после чего этажи
+ * разбираются независимо в нескольких потоках. Номера UUID и внутренние
+ * номера элементов затем сшиваются так, что результат совпадает
+ * с последовательным разбором.
+ *
+ * Числа, основную массу которых составляют координаты точек контуров,
+ * переводятся в double функцией bim_float_strtod (см. bim_float.h).
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bim_json_object.h"
+#include "bim_uuid_table.h"
+#include "bim_parallel.h"
+#include "bim_float.h"
+
+#define streq(str1, str2) (strcmp(str1, str2) == 0)
+
+/// Размер блока чтения файла
+#define STREAM_CHUNK_SIZE (64 * 1024)
+
+typedef enum
+{
+    TOKEN_ERROR,
+    TOKEN_EOF,
+    TOKEN_OBJECT_BEGIN,
+    TOKEN_OBJECT_END,
+    TOKEN_ARRAY_BEGIN,
+    TOKEN_ARRAY_END,
+    TOKEN_COLON,
+    TOKEN_COMMA,
+    TOKEN_STRING,
+    TOKEN_NUMBER,
+    TOKEN_TRUE,
+    TOKEN_FALSE,
+    TOKEN_NULL
+} _token_t;
+
+/// Участок файла, занятый одним этажом
+typedef struct
+{
+    size_t      begin;      ///< Смещение начала этажа
+    size_t      end;        ///< Смещение за концом этажа
+    uint64_t    line;       ///< Номер строки начала этажа
+} _span_t;
+
+typedef struct
+{
+    FILE        *fp;        ///< NULL -- разбирается участок файла в памяти (chunk, len)
+    char        *chunk;     ///< Буфер чтения
+    size_t      pos;        ///< Текущая позиция в буфере
+    size_t      len;        ///< Количество прочитанных в буфер байт
+    uint64_t    line;       ///< Номер строки (для сообщений об ошибках)
+
+    _token_t    token;      ///< Последняя прочитанная лексема
+    bool        pushback;   ///< Лексема возвращена в поток и будет выдана повторно
+    char        *text;      ///< Текст строковой или числовой лексемы
+    size_t      text_len;
+    size_t      text_cap;
+    bool        failed;     ///< Признак ошибки разбора
+
+    uint64_t    rs_id;      ///< Счетчик номеров помещений и лестниц
+    uint64_t    d_id;       ///< Счетчик номеров переходов
+
+    bim_arena_t         *arena;     ///< Регион, из которого выделяется результат разбора
+    bim_arena_t         *geometry;  ///< Регион для полигонов элементов
+    point_t             *points;    ///< Временный массив точек текущего полигона
+    size_t              points_cap;
+    bim_uuid_table_t    *uuids;     ///< Таблица номеров UUID
+    char                (*outputs)[UUID_SIZE + 1]; ///< Временный массив UUID связей текущего элемента
+    size_t              outputs_cap;
+    uint32_t            *handles;   ///< Временный пул связей текущего этажа
+    size_t              handles_count;
+    size_t              handles_cap;
+    bim_json_element_t  *elements;  ///< Временный массив элементов текущего этажа
+    size_t              elements_cap;
+
+    bool                scan_levels;    ///< Вместо разбора этажей только найти их границы
+    bool                levels_found;
+    _span_t             *spans;         ///< Границы этажей
+    size_t              spans_count;
+    size_t              spans_cap;
+} _stream_t;
+
+// Увеличивает временный массив. При нехватке памяти массив остается прежним
+static int _grow(void **ptr, size_t *cap, size_t need, size_t item_size)
+{
+    if (need <= *cap) return 0;
+    size_t new_cap = *cap ? *cap : 4;
+    while (new_cap < need) new_cap *= 2;
+    void *p = realloc(*ptr, new_cap * item_size);
+    if (!p)
+    {
+        LOG_ERROR("Недостаточно памяти для загрузки файла");
+        return -1;
+    }
+    *ptr = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static int _getc(_stream_t *s)
+{
+    if (s->pos == s->len)
+    {
+        if (!s->fp) return EOF;
+        s->len = fread(s->chunk, 1, STREAM_CHUNK_SIZE, s->fp);
+        s->pos = 0;
+        if (s->len == 0) return EOF;
+    }
+    return (unsigned char)s->chunk[s->pos++];
+}
+
+static void _ungetc(_stream_t *s)
+{
+    // Возврат всегда выполняется сразу после _getc, поэтому символ еще в буфере
+    s->pos--;
+}
+
+static void _text_push(_stream_t *s, char c)
+{
+    if (_grow((void **)&s->text, &s->text_cap, s->text_len + 2, sizeof (char)))
+    {
+        s->failed = true;
+        return;
+    }
+    s->text[s->text_len++] = c;
+    s->text[s->text_len] = '\0';
+}
+
+static void _text_reset(_stream_t *s)
+{
+    if (_grow((void **)&s->text, &s->text_cap, 1, sizeof (char)))
+    {
+        s->failed = true;
+        return;
+    }
+    s->text_len = 0;
+    s->text[0] = '\0';
+}
+
+static void _text_push_utf8(_stream_t *s, uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        _text_push(s, (char)cp);
+    } else if (cp < 0x800)
+    {
+        _text_push(s, (char)(0xC0 | (cp >> 6)));
+        _text_push(s, (char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000)
+    {
+        _text_push(s, (char)(0xE0 | (cp >> 12)));
+        _text_push(s, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        _text_push(s, (char)(0x80 | (cp & 0x3F)));
+    } else
+    {
+        _text_push(s, (char)(0xF0 | (cp >> 18)));
+        _text_push(s, (char)(0x80 | ((cp >> 12) & 0x3F)));
+        _text_push(s, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        _text_push(s, (char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+static int _read_hex4(_stream_t *s)
+{
+    int value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int c = _getc(s);
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return -1;
+    }
+    return value;
+}
+
+static _token_t _lex_string(_stream_t *s)
+{
+    _text_reset(s);
+    if (s->failed) return TOKEN_ERROR;
+    int c;
+    while ((c = _getc(s)) != '"')
+    {
+        if (c == EOF) return TOKEN_ERROR;
+        if (c != '\\')
+        {
+            if (c == '\n') s->line++;
+            _text_push(s, (char)c);
+            continue;
+        }
+
+        c = _getc(s);
+        switch (c)
+        {
+        case '"':  _text_push(s, '"');  break;
+        case '\\': _text_push(s, '\\'); break;
+        case '/':  _text_push(s, '/');  break;
+        case 'b':  _text_push(s, '\b'); break;
+        case 'f':  _text_push(s, '\f'); break;
+        case 'n':  _text_push(s, '\n'); break;
+        case 'r':  _text_push(s, '\r'); break;
+        case 't':  _text_push(s, '\t'); break;
+        case 'u':
+        {
+            int cp = _read_hex4(s);
+            if (cp < 0) return TOKEN_ERROR;
+            // Суррогатная пара UTF-16
+            if (cp >= 0xD800 && cp <= 0xDBFF)
+            {
+                if (_getc(s) != '\\' || _getc(s) != 'u') return TOKEN_ERROR;
+                int low = _read_hex4(s);
+                if (low < 0xDC00 || low > 0xDFFF) return TOKEN_ERROR;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+            _text_push_utf8(s, (uint32_t)cp);
+            break;
+        }
+        default: return TOKEN_ERROR;
+        }
+    }
+    // Текст лексемы мог не поместиться в память
+    return s->failed ? TOKEN_ERROR : TOKEN_STRING;
+}
+
+static _token_t _lex_number(_stream_t *s, int c)
+{
+    _text_reset(s);
+    if (s->failed) return TOKEN_ERROR;
+    while (c != EOF && (isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+    {
+        _text_push(s, (char)c);
+        c = _getc(s);
+    }
+    if (c != EOF) _ungetc(s);
+    return s->failed ? TOKEN_ERROR : TOKEN_NUMBER;
+}
+
+static _token_t _lex_literal(_stream_t *s, int c)
+{
+    _text_reset(s);
+    if (s->failed) return TOKEN_ERROR;
+    while (c != EOF && isalpha(c))
+    {
+        _text_push(s, (char)c);
+        c = _getc(s);
+    }
+    if (c != EOF) _ungetc(s);
+    if (s->failed) return TOKEN_ERROR;
+
+    if (streq(s->text, "true"))  return TOKEN_TRUE;
+    if (streq(s->text, "false")) return TOKEN_FALSE;
+    if (streq(s->text, "null"))  return TOKEN_NULL;
+    return TOKEN_ERROR;
+}
+
+static _token_t _next(_stream_t *s)
+{
+    if (s->pushback)
+    {
+        s->pushback = false;
+        return s->token;
+    }
+
+    int c;
+    do
+    {
+        c = _getc(s);
+        if (c == '\n') s->line++;
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+
+    switch (c)
+    {
+    case EOF: s->token = TOKEN_EOF;          break;
+    case '{': s->token = TOKEN_OBJECT_BEGIN; break;
+    case '}': s->token = TOKEN_OBJECT_END;   break;
+    case '[': s->token = TOKEN_ARRAY_BEGIN;  break;
+    case ']': s->token = TOKEN_ARRAY_END;    break;
+    case ':': s->token = TOKEN_COLON;        break;
+    case ',': s->token = TOKEN_COMMA;        break;
+    case '"': s->token = _lex_string(s);     break;
+    default:
+        if (c == '-' || isdigit(c)) s->token = _lex_number(s, c);
+        else if (isalpha(c))        s->token = _lex_literal(s, c);
+        else                        s->token = TOKEN_ERROR;
+    }
+
+    if (s->token == TOKEN_ERROR) s->failed = true;
+    return s->token;
+}
+
+static void _unget(_stream_t *s)
+{
+    s->pushback = true;
+}
+
+static bool _expect(_stream_t *s, _token_t token)
+{
+    if (_next(s) == token) return true;
+    s->failed = true;
+    return false;
+}
+
+// Переходит к следующему ключу объекта. Текст ключа остается в s->text
+static bool _object_next_key(_stream_t *s, bool *first)
+{
+    _token_t t = _next(s);
+    if (t == TOKEN_OBJECT_END) return false;
+    if (!*first)
+    {
+        if (t != TOKEN_COMMA) { s->failed = true; return false; }
+        t = _next(s);
+    }
+    *first = false;
+    if (t != TOKEN_STRING) { s->failed = true; return false; }
+
+    // Текст ключа сохраняется, так как ':' не затирает текст лексемы
+    return _expect(s, TOKEN_COLON);
+}
+
+// Переходит к следующему элементу массива
+static bool _array_next_item(_stream_t *s, bool *first)
+{
+    _token_t t = _next(s);
+    if (t == TOKEN_ARRAY_END) return false;
+    if (*first)
+    {
+        *first = false;
+        _unget(s);
+        return !s->failed;
+    }
+    if (t != TOKEN_COMMA) s->failed = true;
+    return !s->failed;
+}
+
+static void _skip_value(_stream_t *s)
+{
+    uint64_t depth = 0;
+    do
+    {
+        switch (_next(s))
+        {
+        case TOKEN_OBJECT_BEGIN:
+        case TOKEN_ARRAY_BEGIN:  depth++; break;
+        case TOKEN_OBJECT_END:
+        case TOKEN_ARRAY_END:    depth--; break;
+        case TOKEN_ERROR:
+        case TOKEN_EOF:          s->failed = true; return;
+        default: break;
+        }
+    } while (depth > 0 && !s->failed);
+}
+
+static char* _read_string(_stream_t *s)
+{
+    if (_next(s) == TOKEN_STRING) return bim_arena_strdup(s->arena, s->text);
+    _unget(s);
+    _skip_value(s);
+    return NULL;
+}
+
+static double _read_number(_stream_t *s)
+{
+    switch (_next(s))
+    {
+    case TOKEN_NUMBER:
+    case TOKEN_STRING: return bim_float_strtod(s->text, NULL);
+    case TOKEN_TRUE:   return 1;
+    case TOKEN_FALSE:
+    case TOKEN_NULL:   return 0;
+    default:
+        _unget(s);
+        _skip_value(s);
+        return 0;
+    }
+}
+
+static void _parse_point(_stream_t *s, point_t *point)
+{
+    point->x = 0;
+    point->y = 0;
+    if (!_expect(s, TOKEN_OBJECT_BEGIN)) return;
+    bool first = true;
+    while (_object_next_key(s, &first))
+    {
+        if      (streq(s->text, "x")) point->x = _read_number(s);
+        else if (streq(s->text, "y")) point->y = _read_number(s);
+        else _skip_value(s);
+    }
+}
+
+static void _parse_points(_stream_t *s, polygon_t *polygon)
+{
+    uint64_t count = 0;
+
+    if (!_expect(s, TOKEN_ARRAY_BEGIN)) return;
+    bool first = true;
+    while (_array_next_item(s, &first))
+    {
+        if (_grow((void **)&s->points, &s->points_cap, count + 1, sizeof (point_t)))
+        {
+            s->failed = true;
+            break;
+        }
+        _parse_point(s, &s->points[count++]);
+    }
+
+    polygon->point_count = count;
+    polygon->points = (point_t *)bim_arena_memdup(s->geometry, s->points, sizeof (point_t) * count);
+}
+
+// Разбирает поле "XY". Используется только первый контур
+static void _parse_xy(_stream_t *s, polygon_t *polygon)
+{
+    if (!_expect(s, TOKEN_ARRAY_BEGIN)) return;
+    bool first_item = true;
+    bool is_first_contour = true;
+    while (_array_next_item(s, &first_item))
+    {
+        if (!is_first_contour)
+        {
+            _skip_value(s);
+            continue;
+        }
+        is_first_contour = false;
+
+        if (!_expect(s, TOKEN_OBJECT_BEGIN)) return;
+        bool first = true;
+        while (_object_next_key(s, &first))
+        {
+            if (streq(s->text, "points") && polygon->points == NULL) _parse_points(s, polygon);
+            else _skip_value(s);
+        }
+    }
+}
+
+// UUID связей сохраняются во временном массиве, номера им выдаются
+// после разбора всего элемента (см. _parse_element)
+static size_t _parse_outputs(_stream_t *s)
+{
+    size_t count = 0;
+
+    if (!_expect(s, TOKEN_ARRAY_BEGIN)) return 0;
+    bool first = true;
+    while (_array_next_item(s, &first))
+    {
+        if (_next(s) != TOKEN_STRING)
+        {
+            _unget(s);
+            _skip_value(s);
+            continue;
+        }
+        if (_grow((void **)&s->outputs, &s->outputs_cap, count + 1, sizeof (*s->outputs)))
+        {
+            s->failed = true;
+            break;
+        }
+        snprintf(s->outputs[count++], sizeof (*s->outputs), "%s", s->text);
+    }
+
+    return count;
+}
+
+static void _parse_element(_stream_t *s, bim_json_element_t *element)
+{
+    char sign[16] = "";
+    double numofpeople = 0;
+    size_t outputs_count = 0;
+
+    if (!_expect(s, TOKEN_OBJECT_BEGIN)) return;
+    bool first = true;
+    while (_object_next_key(s, &first))
+    {
+        if (streq(s->text, "Id"))
+        {
+            if (_next(s) == TOKEN_STRING) element->uuid = bim_arena_strndup(s->arena, s->text, UUID_SIZE);
+            else { _unget(s); _skip_value(s); }
+        }
+        else if (streq(s->text, "Name"))        element->name = _read_string(s);
+        else if (streq(s->text, "SizeZ"))       element->size_z = _read_number(s);
+        else if (streq(s->text, "Sign"))
+        {
+            if (_next(s) == TOKEN_STRING) snprintf(sign, sizeof (sign), "%s", s->text);
+            else { _unget(s); _skip_value(s); }
+        }
+        else if (streq(s->text, "NumPeople"))   numofpeople = _read_number(s);
+        else if (streq(s->text, "Output"))      outputs_count = _parse_outputs(s);
+        else if (streq(s->text, "XY"))          _parse_xy(s, element->polygon);
+        else _skip_value(s);
+    }
+
+    // Порядок ключей в объекте произвольный, поэтому тип элемента
+    // и связанные с ним поля определяются после разбора всего объекта
+    bim_element_sign_t b_element_sign = UNDEFINDED;
+    if (sign[0])
+    {
+        if (streq(sign, "Room"))
+        {
+            b_element_sign = ROOM;
+            element->id = s->rs_id++;
+            element->numofpeople = numofpeople;
+        }
+        else if (streq(sign, "Staircase"))    { b_element_sign = STAIR;       element->id = s->rs_id++; }
+        else if (streq(sign, "DoorWay"))      { b_element_sign = DOOR_WAY;    element->id = s->d_id++;  }
+        else if (streq(sign, "DoorWayInt"))   { b_element_sign = DOOR_WAY_INT;element->id = s->d_id++;  }
+        else if (streq(sign, "DoorWayOut"))   { b_element_sign = DOOR_WAY_OUT;element->id = s->d_id++;  }
+    }
+    element->sign = b_element_sign;
+
+    if (!element->uuid) element->uuid = bim_arena_strdup(s->arena, "");
+    if (!element->name) element->name = bim_arena_strdup(s->arena, "");
+
+    // Номер UUID самого элемента выдается раньше номеров его связей
+    // независимо от порядка ключей, как и в bim_json_new_dom
+    element->handle = bim_uuid_table_intern(s->uuids, element->uuid);
+    if (_grow((void **)&s->handles, &s->handles_cap, s->handles_count + outputs_count, sizeof (uint32_t)))
+    {
+        s->failed = true;
+        outputs_count = 0;
+    }
+    for (size_t i = 0; i < outputs_count; i++)
+        s->handles[s->handles_count + i] = bim_uuid_table_intern(s->uuids, s->outputs[i]);
+    element->outputs_begin = s->handles_count;
+    element->outputs_count = outputs_count;
+    s->handles_count += outputs_count;
+}
+
+// Элементы этажа и их связи собираются во временных массивах и копируются
+// в регион двумя участками после разбора всего этажа
+static void _parse_elements(_stream_t *s, bim_json_level_t *level)
+{
+    size_t count = 0;
+    s->handles_count = 0;
+
+    if (!_expect(s, TOKEN_ARRAY_BEGIN)) return;
+    bool first = true;
+    while (_array_next_item(s, &first))
+    {
+        if (_grow((void **)&s->elements, &s->elements_cap, count + 1, sizeof (bim_json_element_t)))
+        {
+            s->failed = true;
+            break;
+        }
+        bim_json_element_t *element = &s->elements[count++];
+        memset(element, 0, sizeof (bim_json_element_t));
+        element->polygon = (polygon_t *)bim_arena_calloc(s->geometry, 1, sizeof (polygon_t));
+        _parse_element(s, element);
+    }
+
+    level->elements = (bim_json_element_t *)bim_arena_memdup(s->arena, s->elements, sizeof (bim_json_element_t) * count);
+    level->elements_count = count;
+    level->outputs = (uint32_t *)bim_arena_memdup(s->arena, s->handles, sizeof (uint32_t) * s->handles_count);
+    level->outputs_count = s->handles_count;
+    for (size_t i = 0; i < count; i++)
+        level->elements[i].outputs = level->outputs + level->elements[i].outputs_begin;
+}
+
+static void _parse_level(_stream_t *s, bim_json_level_t *level)
+{
+    if (!_expect(s, TOKEN_OBJECT_BEGIN)) return;
+    bool first = true;
+    while (_object_next_key(s, &first))
+    {
+        if      (streq(s->text, "NameLevel"))    level->name = _read_string(s);
+        else if (streq(s->text, "ZLevel"))       level->z_level = _read_number(s);
+        else if (streq(s->text, "BuildElement") && level->elements == NULL) _parse_elements(s, level);
+        else _skip_value(s);
+    }
+
+    if (!level->name) level->name = bim_arena_strdup(s->arena, "");
+    // Высота этажа может идти в файле после списка элементов
+    for (size_t i = 0; i < level->elements_count; i++)
+    {
+        level->elements[i].z_level = level->z_level;
+    }
+}
+
+static void _parse_levels(_stream_t *s, bim_json_object_t *bim)
+{
+    size_t cap = 0;
+    size_t count = 0;
+    bim_json_level_t *levels = NULL;
+
+    if (!_expect(s, TOKEN_ARRAY_BEGIN)) return;
+    bool first = true;
+    while (_array_next_item(s, &first))
+    {
+        if (_grow((void **)&levels, &cap, count + 1, sizeof (bim_json_level_t)))
+        {
+            s->failed = true;
+            break;
+        }
+        bim_json_level_t *level = &levels[count++];
+        memset(level, 0, sizeof (bim_json_level_t));
+        _parse_level(s, level);
+    }
+
+    bim->levels = (bim_json_level_t *)bim_arena_memdup(s->arena, levels, sizeof (bim_json_level_t) * count);
+    bim->levels_count = count;
+    free(levels);
+}
+
+// Пропускает пробельные символы и возвращает следующий символ, не извлекая его
+static int _peek_raw(_stream_t *s)
+{
+    int c;
+    do
+    {
+        c = _getc(s);
+        if (c == '\n') s->line++;
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+    if (c != EOF) _ungetc(s);
+    return c;
+}
+
+// Пропускает объект без разбора на лексемы: учитываются только скобки и строки
+static void _skip_object_raw(_stream_t *s)
+{
+    uint64_t depth = 0;
+    bool in_string = false;
+    int c;
+    while ((c = _getc(s)) != EOF)
+    {
+        if (c == '\n') s->line++;
+        if (in_string)
+        {
+            if (c == '\\') _getc(s);
+            else if (c == '"') in_string = false;
+        }
+        else if (c == '"') in_string = true;
+        else if (c == '{' || c == '[') depth++;
+        else if ((c == '}' || c == ']') && --depth == 0) return;
+    }
+    s->failed = true;
+}
+
+// Находит границы элементов массива "Level" для параллельного разбора
+static void _scan_levels(_stream_t *s)
+{
+    if (!_expect(s, TOKEN_ARRAY_BEGIN)) return;
+    if (_peek_raw(s) == ']')
+    {
+        _getc(s);
+        return;
+    }
+
+    while (!s->failed)
+    {
+        if (_peek_raw(s) != '{')
+        {
+            s->failed = true;
+            return;
+        }
+        if (_grow((void **)&s->spans, &s->spans_cap, s->spans_count + 1, sizeof (_span_t)))
+        {
+            s->failed = true;
+            return;
+        }
+        _span_t *span = &s->spans[s->spans_count++];
+        span->begin = s->pos;
+        span->line = s->line;
+        _skip_object_raw(s);
+        span->end = s->pos;
+
+        int c = _peek_raw(s);
+        _getc(s);
+        if (c == ']') return;
+        if (c != ',') s->failed = true;
+    }
+}
+
+static void _parse_address(_stream_t *s, bim_json_address_t *address)
+{
+    if (!_expect(s, TOKEN_OBJECT_BEGIN)) return;
+    bool first = true;
+    while (_object_next_key(s, &first))
+    {
+        if      (streq(s->text, "StreetAddress")) address->street_address = _read_string(s);
+        else if (streq(s->text, "City"))          address->city = _read_string(s);
+        else if (streq(s->text, "AddInfo"))       address->add_info = _read_string(s);
+        else _skip_value(s);
+    }
+}
+
+static void _parse_root(_stream_t *s, bim_json_object_t *bim)
+{
+    if (!_expect(s, TOKEN_OBJECT_BEGIN)) return;
+    bool first = true;
+    while (_object_next_key(s, &first))
+    {
+        if      (streq(s->text, "NameBuilding")) bim->name = _read_string(s);
+        else if (streq(s->text, "Address"))      _parse_address(s, &bim->address);
+        else if (streq(s->text, "Level") && !s->levels_found)
+        {
+            s->levels_found = true;
+            if (s->scan_levels) _scan_levels(s);
+            else _parse_levels(s, bim);
+        }
+        else _skip_value(s);
+    }
+}
+
+static void _stream_init(_stream_t *s, bim_arena_t *arena, bim_arena_t *geometry)
+{
+    memset(s, 0, sizeof (*s));
+    s->line = 1;
+    s->arena = arena;
+    s->geometry = geometry;
+}
+
+// Освобождает временные массивы разбора
+static void _stream_release(_stream_t *s)
+{
+    free(s->text);
+    free(s->points);
+    free(s->outputs);
+    free(s->handles);
+    free(s->elements);
+    free(s->spans);
+}
+
+static void _set_defaults(bim_json_object_t *bim)
+{
+    if (!bim->name) bim->name = bim_arena_strdup(bim->arena, "");
+    if (!bim->address.city) bim->address.city = bim_arena_strdup(bim->arena, "");
+    if (!bim->address.street_address) bim->address.street_address = bim_arena_strdup(bim->arena, "");
+    if (!bim->address.add_info) bim->address.add_info = bim_arena_strdup(bim->arena, "");
+}
+
+bim_json_object_t* bim_json_new(const char* filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        LOG_ERROR("Не удалось прочитать файл. Проверьте правильность имени файла и пути: %s", filename);
+        return NULL;
+    }
+
+    bim_arena_t *arena = bim_arena_new(0);
+    bim_json_object_t *bim = (bim_json_object_t*)bim_arena_calloc(arena, 1, sizeof(bim_json_object_t));
+    bim->arena = arena;
+    bim->geometry = bim_arena_new(0);
+
+    _stream_t s;
+    _stream_init(&s, arena, bim->geometry);
+    s.fp = fp;
+    s.chunk = (char *)malloc(STREAM_CHUNK_SIZE);
+    s.uuids = bim_uuid_table_new(0);
+
+    _parse_root(&s, bim);
+
+    fclose(fp);
+    free(s.chunk);
+    _stream_release(&s);
+
+    bim->handles_count = bim_uuid_table_count(s.uuids);
+    bim_uuid_table_free(s.uuids);
+
+    if (s.failed)
+    {
+        LOG_ERROR("Ошибка разбора файла %s в строке %lu", filename, s.line);
+        bim_json_free(bim);
+        return NULL;
+    }
+
+    _set_defaults(bim);
+    return bim;
+}
+
+/// Результат разбора одного этажа
+typedef struct
+{
+    bim_uuid_table_t    *uuids;     ///< Номера UUID, выданные в пределах этажа
+    uint64_t            rs_count;   ///< Количество помещений и лестниц этажа
+    uint64_t            d_count;    ///< Количество переходов этажа
+    bool                failed;
+    uint64_t            line;       ///< Строка, на которой остановился разбор
+} _level_result_t;
+
+typedef struct
+{
+    const char          *data;      ///< Содержимое файла
+    const _span_t       *spans;
+    bim_json_level_t    *levels;
+    _level_result_t     *results;
+    _stream_t           *workers;   ///< Состояние разбора каждого потока
+} _parallel_t;
+
+static void _parse_level_worker(void *ctx, size_t index, uint32_t worker)
+{
+    _parallel_t *p = ctx;
+    _stream_t *s = &p->workers[worker];
+    const _span_t *span = &p->spans[index];
+    _level_result_t *result = &p->results[index];
+
+    s->chunk = (char *)p->data + span->begin;
+    s->len = span->end - span->begin;
+    s->pos = 0;
+    s->line = span->line;
+    s->pushback = false;
+    s->failed = false;
+    s->rs_id = 0;
+    s->d_id = 0;
+    s->uuids = result->uuids = bim_uuid_table_new(0);
+
+    _parse_level(s, &p->levels[index]);
+    if (!s->failed && _next(s) != TOKEN_EOF) s->failed = true;
+
+    result->rs_count = s->rs_id;
+    result->d_count = s->d_id;
+    result->failed = s->failed;
+    result->line = s->line;
+}
+
+// Номера UUID и внутренние номера элементов этажей становятся сквозными
+// в том же порядке, что и при последовательном разборе
+static int _stitch_levels(bim_json_object_t *bim, const _level_result_t *results, bim_uuid_table_t *uuids)
+{
+    uint64_t rs_id = 0;
+    uint64_t d_id = 0;
+    uint32_t *remap = NULL;
+    size_t remap_cap = 0;
+
+    for (size_t i = 0; i < bim->levels_count; i++)
+    {
+        bim_json_level_t *level = &bim->levels[i];
+        const bim_uuid_table_t *local = results[i].uuids;
+        uint32_t count = bim_uuid_table_count(local);
+        if (_grow((void **)&remap, &remap_cap, count, sizeof (uint32_t)))
+        {
+            free(remap);
+            return -1;
+        }
+        for (uint32_t h = 0; h < count; h++)
+            remap[h] = bim_uuid_table_intern(uuids, bim_uuid_table_key(local, h));
+
+        for (size_t j = 0; j < level->elements_count; j++)
+        {
+            bim_json_element_t *element = &level->elements[j];
+            element->handle = remap[element->handle];
+            switch (element->sign)
+            {
+            case ROOM:
+            case STAIR:         element->id += rs_id; break;
+            case DOOR_WAY:
+            case DOOR_WAY_INT:
+            case DOOR_WAY_OUT:  element->id += d_id;  break;
+            default: break;
+            }
+        }
+        for (size_t k = 0; k < level->outputs_count; k++)
+            level->outputs[k] = remap[level->outputs[k]];
+
+        rs_id += results[i].rs_count;
+        d_id += results[i].d_count;
+    }
+
+    free(remap);
+    return 0;
+}
+
+bim_json_object_t* bim_json_new_parallel(const char* filename, uint32_t threads)
+{
+    if (threads <= 1)
+        return bim_json_new(filename);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_ERROR("Не удалось прочитать файл. Проверьте правильность имени файла и пути: %s", filename);
+        return NULL;
+    }
+
+    struct stat st;
+    char *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return bim_json_new(filename);
+    size_t size = st.st_size;
+
+    bim_arena_t *arena = bim_arena_new(0);
+    bim_json_object_t *bim = (bim_json_object_t*)bim_arena_calloc(arena, 1, sizeof(bim_json_object_t));
+    bim->arena = arena;
+    bim->geometry = bim_arena_new(0);
+
+    // Поля здания разбираются сразу, от этажей запоминаются только границы
+    _stream_t s;
+    _stream_init(&s, arena, bim->geometry);
+    s.chunk = data;
+    s.len = size;
+    s.scan_levels = true;
+    _parse_root(&s, bim);
+
+    bool failed = s.failed;
+    uint64_t line = s.line;
+    if (!failed)
+    {
+        size_t count = s.spans_count;
+        bim->levels_count = count;
+        bim->levels = (bim_json_level_t *)bim_arena_calloc(arena, count, sizeof (bim_json_level_t));
+
+        if (threads > count) threads = count;
+        _stream_t *workers = (_stream_t *)calloc(threads ? threads : 1, sizeof (_stream_t));
+        _level_result_t *results = (_level_result_t *)calloc(count ? count : 1, sizeof (_level_result_t));
+        for (uint32_t w = 0; w < threads; w++)
+            _stream_init(&workers[w], bim_arena_new(0), bim_arena_new(0));
+
+        _parallel_t p = {data, s.spans, bim->levels, results, workers};
+        bim_parallel_for(threads, count, _parse_level_worker, &p);
+
+        for (uint32_t w = 0; w < threads; w++)
+        {
+            bim_arena_adopt(arena, workers[w].arena);
+            bim_arena_adopt(bim->geometry, workers[w].geometry);
+            _stream_release(&workers[w]);
+        }
+
+        for (size_t i = 0; i < count && !failed; i++)
+        {
+            failed = results[i].failed;
+            line = results[i].line;
+        }
+
+        bim_uuid_table_t *uuids = bim_uuid_table_new(0);
+        if (!failed && _stitch_levels(bim, results, uuids)) failed = true;
+        bim->handles_count = bim_uuid_table_count(uuids);
+
+        bim_uuid_table_free(uuids);
+        for (size_t i = 0; i < count; i++)
+            bim_uuid_table_free(results[i].uuids);
+        free(results);
+        free(workers);
+    }
+
+    _stream_release(&s);
+    munmap(data, size);
+
+    if (failed)
+    {
+        LOG_ERROR("Ошибка разбора файла %s в строке %lu", filename, line);
+        bim_json_free(bim);
+        return NULL;
+    }
+
+    _set_defaults(bim);
+    return bim;
+}
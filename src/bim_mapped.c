@@ -0,0 +1,639 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Бинарный кэш здания (.bimb)
+ *
+ * Файл состоит из заголовка и секций, на которые заголовок ссылается
+ * смещениями от начала файла. Указателей в файле нет, поэтому его можно
+ * отображать в память по любому адресу.
+ *
+ * +-----------+--------+----------+---------+--------+-------+-------+---------+
+ * | заголовок | этажи  | элементы | выходы  | точки  | ребра | exits | строки  |
+ * +-----------+--------+----------+---------+--------+-------+-------+---------+
+ *
+ * Строки хранятся с завершающим нулем и смещениями от начала секции строк,
+ * связи элементов и выходы -- номерами UUID (uint32_t).
+ * Для зон и переходов в записи элемента хранится уже вычисленная площадь
+ * или ширина, ребра графа записаны в формате bim_edge.
+ * Порядок байт -- порядок байт машины, на которой создан кэш.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_index.h"
+#include "bim_parallel.h"
+
+#define BIMB_MAGIC      "BIMB"
+#define BIMB_VERSION    2
+#define BIMB_BYTE_ORDER 0x01020304u
+#define BIMB_ALIGN      8
+
+bim_t* _bim_tools_new(const char *file, bool keep_geometry);
+void   _level_index  (void *ctx, size_t index, uint32_t worker);
+
+typedef struct
+{
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    byte_order;
+    uint32_t    levels_count;
+    uint64_t    file_size;
+    uint64_t    elements_count;
+    uint64_t    zones_count;        ///< Количество зон без учета зоны вне здания
+    uint64_t    transits_count;
+    uint64_t    outputs_count;
+    uint64_t    points_count;
+    uint64_t    exits_count;        ///< Количество выходов из здания
+    uint64_t    handles_count;      ///< Количество номеров UUID
+
+    uint64_t    name;               ///< Строки заголовка
+    uint64_t    city;
+    uint64_t    street_address;
+    uint64_t    add_info;
+    uint64_t    outside_name;
+    uint64_t    outside_uuid;
+
+    uint64_t    levels;             ///< Смещения секций от начала файла
+    uint64_t    elements;
+    uint64_t    outputs;
+    uint64_t    points;
+    uint64_t    edges;
+    uint64_t    exits;
+    uint64_t    strings;
+    uint64_t    strings_size;
+} _bimb_header_t;
+
+typedef struct
+{
+    uint64_t    name;
+    double      z_level;
+    uint64_t    elements_begin;
+    uint64_t    elements_count;
+} _bimb_level_t;
+
+typedef struct
+{
+    uint64_t    id;
+    uint64_t    uuid;
+    uint64_t    name;
+    uint64_t    points_begin;
+    uint64_t    points_count;
+    uint64_t    outputs_begin;
+    uint32_t    outputs_count;
+    uint32_t    sign;
+    float       size_z;
+    float       z_level;
+    float       derived;            ///< Площадь зоны или ширина перехода
+    uint32_t    numofpeople;
+    uint32_t    handle;
+    uint32_t    reserved;
+} _bimb_element_t;
+
+typedef struct
+{
+    uint8_t *data;
+    size_t  size;
+    size_t  cap;
+    bool    failed; ///< Не хватило памяти, дальнейшие записи пропускаются
+} _buffer_t;
+
+static size_t _align(size_t value)
+{
+    return (value + BIMB_ALIGN - 1) & ~(size_t)(BIMB_ALIGN - 1);
+}
+
+static size_t _put(_buffer_t *buf, const void *data, size_t size)
+{
+    size_t offset = buf->size;
+    if (buf->failed || size == 0)
+        return offset;
+    if (buf->size + size > buf->cap)
+    {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap < buf->size + size) cap *= 2;
+        uint8_t *grown = (uint8_t *)realloc(buf->data, cap);
+        if (!grown)
+        {
+            buf->failed = true;
+            return offset;
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    return offset;
+}
+
+static uint64_t _string(_buffer_t *strings, const char *str)
+{
+    return _put(strings, str, strlen(str) + 1);
+}
+
+static int _write_section(FILE *fp, const _buffer_t *buf, uint64_t *offset, uint64_t *pos)
+{
+    static const uint8_t zeros[BIMB_ALIGN] = {0};
+    *offset = *pos;
+    if (buf->size && fwrite(buf->data, 1, buf->size, fp) != buf->size) return -1;
+    size_t padding = _align(buf->size) - buf->size;
+    if (padding && fwrite(zeros, 1, padding, fp) != padding) return -1;
+    *pos += buf->size + padding;
+    return 0;
+}
+
+int bim_tools_compile(const char *json_file, const char *bimb_file)
+{
+    // Полигоны записываются в кэш, поэтому сохраняются независимо от настройки
+    bim_t *bim = _bim_tools_new(json_file, true);
+    if (!bim)
+        return -1;
+
+    const bim_json_object_t *json = bim->json;
+    _buffer_t levels = {0}, elements = {0}, outputs = {0}, points = {0}, edges = {0}, exits = {0}, strings = {0};
+
+    _bimb_header_t header;
+    memset(&header, 0, sizeof (header));
+    memcpy(header.magic, BIMB_MAGIC, 4);
+    header.version = BIMB_VERSION;
+    header.byte_order = BIMB_BYTE_ORDER;
+    header.levels_count = json->levels_count;
+    header.zones_count = bim->zones->length - 1;
+    header.transits_count = bim->transits->length;
+    header.handles_count = json->handles_count;
+    header.name = _string(&strings, json->name);
+    header.city = _string(&strings, json->address.city);
+    header.street_address = _string(&strings, json->address.street_address);
+    header.add_info = _string(&strings, json->address.add_info);
+
+    const bim_zone_t *outside = bim->object->outside;
+    header.outside_name = _string(&strings, outside->base->name);
+    header.outside_uuid = _string(&strings, outside->base->uuid);
+
+    bool memory_ok = true;
+    uint64_t element_index = 0;
+    for (size_t i = 0; i < json->levels_count; i++)
+    {
+        const bim_json_level_t *level = &json->levels[i];
+        const bim_level_t *level_ext = &bim->object->levels[i];
+
+        // Вычисленные значения зон и переходов уровня по номеру элемента в уровне
+        float *derived = (float *)calloc(level->elements_count ? level->elements_count : 1, sizeof (float));
+        if (!derived)
+        {
+            memory_ok = false;
+            break;
+        }
+        for (size_t j = 0; j < level_ext->zone_count; j++)
+            derived[level_ext->zones[j].base - level->elements] = level_ext->zones[j].area;
+        for (size_t j = 0; j < level_ext->transit_count; j++)
+            derived[level_ext->transits[j].base - level->elements] = level_ext->transits[j].width;
+
+        _bimb_level_t blevel = {
+            .name = _string(&strings, level->name),
+            .z_level = level->z_level,
+            .elements_begin = element_index,
+            .elements_count = level->elements_count
+        };
+        _put(&levels, &blevel, sizeof (blevel));
+
+        for (size_t j = 0; j < level->elements_count; j++, element_index++)
+        {
+            const bim_json_element_t *element = &level->elements[j];
+            _bimb_element_t belement = {
+                .id = element->id,
+                .uuid = _string(&strings, element->uuid),
+                .name = _string(&strings, element->name),
+                .points_begin = header.points_count,
+                .points_count = element->polygon->point_count,
+                .outputs_begin = header.outputs_count,
+                .outputs_count = element->outputs_count,
+                .sign = element->sign,
+                .size_z = element->size_z,
+                .z_level = element->z_level,
+                .derived = derived[j],
+                .numofpeople = element->numofpeople,
+                .handle = element->handle
+            };
+            _put(&elements, &belement, sizeof (belement));
+
+            _put(&points, element->polygon->points, sizeof (point_t) * element->polygon->point_count);
+            header.points_count += element->polygon->point_count;
+
+            _put(&outputs, element->outputs, sizeof (uint32_t) * element->outputs_count);
+            header.outputs_count += element->outputs_count;
+        }
+        free(derived);
+    }
+    header.elements_count = element_index;
+
+    _put(&exits, outside->base->outputs, sizeof (uint32_t) * outside->base->outputs_count);
+    header.exits_count = outside->base->outputs_count;
+
+    bool edges_ok = true;
+    if (bim->transits->length)
+    {
+        bim_edge *graph_edges = (bim_edge *)malloc(sizeof (bim_edge) * bim->transits->length);
+        edges_ok = graph_edges && bim_graph_edges(bim, graph_edges) == 0;
+        if (edges_ok)
+            _put(&edges, graph_edges, sizeof (bim_edge) * bim->transits->length);
+        free(graph_edges);
+    }
+
+    memory_ok = memory_ok && !levels.failed && !elements.failed && !outputs.failed && !points.failed
+                && !edges.failed && !exits.failed && !strings.failed;
+
+    int result = -1;
+    FILE *fp = edges_ok && memory_ok ? fopen(bimb_file, "wb") : NULL;
+    if (!edges_ok)
+    {
+        LOG_ERROR("Не удалось построить ребра графа здания: %s", json_file);
+    } else if (!memory_ok)
+    {
+        LOG_ERROR("Не удалось выделить память для кэша здания: %s", json_file);
+    } else if (!fp)
+    {
+        LOG_ERROR("Не удалось открыть файл для записи: %s", bimb_file);
+    } else
+    {
+        // Заголовок пишется дважды: заглушка, затем с известными смещениями секций
+        uint64_t pos = _align(sizeof (header));
+        int err = fseek(fp, pos, SEEK_SET);
+        err = err || _write_section(fp, &levels,   &header.levels,   &pos);
+        err = err || _write_section(fp, &elements, &header.elements, &pos);
+        err = err || _write_section(fp, &outputs,  &header.outputs,  &pos);
+        err = err || _write_section(fp, &points,   &header.points,   &pos);
+        err = err || _write_section(fp, &edges,    &header.edges,    &pos);
+        err = err || _write_section(fp, &exits,    &header.exits,    &pos);
+        err = err || _write_section(fp, &strings,  &header.strings,  &pos);
+        header.strings_size = strings.size;
+        header.file_size = pos;
+        err = err || fseek(fp, 0, SEEK_SET);
+        err = err || fwrite(&header, sizeof (header), 1, fp) != 1;
+        err = fclose(fp) || err;
+        if (err) LOG_ERROR("Ошибка записи файла: %s", bimb_file);
+        else result = 0;
+    }
+
+    free(levels.data); free(elements.data); free(outputs.data); free(points.data);
+    free(edges.data); free(exits.data); free(strings.data);
+    bim_tools_free(bim);
+    return result;
+}
+
+bool bim_tools_is_mapped_file(const char *file)
+{
+    char magic[4] = {0};
+    FILE *fp = fopen(file, "rb");
+    if (!fp)
+        return false;
+    size_t n = fread(magic, 1, sizeof (magic), fp);
+    fclose(fp);
+    return n == sizeof (magic) && memcmp(magic, BIMB_MAGIC, sizeof (magic)) == 0;
+}
+
+static bool _section_ok(const _bimb_header_t *h, uint64_t offset, uint64_t count, uint64_t item_size)
+{
+    return offset % BIMB_ALIGN == 0 && offset <= h->file_size
+           && count <= (h->file_size - offset) / item_size;
+}
+
+static bool _header_ok(const _bimb_header_t *h, size_t size)
+{
+    if (size < sizeof (*h)) return false;
+    if (memcmp(h->magic, BIMB_MAGIC, 4) != 0) return false;
+    if (h->version != BIMB_VERSION || h->byte_order != BIMB_BYTE_ORDER) return false;
+    if (h->file_size != size) return false;
+    return _section_ok(h, h->levels,   h->levels_count,   sizeof (_bimb_level_t))
+        && _section_ok(h, h->elements, h->elements_count, sizeof (_bimb_element_t))
+        && _section_ok(h, h->outputs,  h->outputs_count,  sizeof (uint32_t))
+        && _section_ok(h, h->points,   h->points_count,   sizeof (point_t))
+        && _section_ok(h, h->edges,    h->transits_count, sizeof (bim_edge))
+        && _section_ok(h, h->exits,    h->exits_count,    sizeof (uint32_t))
+        && _section_ok(h, h->strings,  h->strings_size,   1)
+        && h->zones_count + h->transits_count <= h->elements_count
+        && h->handles_count < UINT32_MAX;
+}
+
+// Диапазон [begin, begin + count) лежит в секции из total элементов
+static bool _range_ok(uint64_t begin, uint64_t count, uint64_t total)
+{
+    return begin <= total && count <= total - begin;
+}
+
+// Строка начинается в секции строк и завершается нулем внутри нее
+static bool _string_ok(const _bimb_header_t *h, const char *strings, uint64_t offset)
+{
+    return offset < h->strings_size && memchr(strings + offset, '\0', h->strings_size - offset) != NULL;
+}
+
+static bool _handles_ok(const uint32_t *handles, uint64_t count, uint64_t handles_count)
+{
+    for (uint64_t i = 0; i < count; i++)
+        if (handles[i] > handles_count) return false;
+    return true;
+}
+
+// Проверка записей кэша: диапазоны, строки, номера UUID, номера зон и
+// переходов и ребра графа. Все значения, которые затем используются как
+// индексы, должны лежать в своих секциях
+static bool _records_ok(const _bimb_header_t *h, const uint8_t *map)
+{
+    const char *strings = (const char *)map + h->strings;
+    const _bimb_level_t *blevels = (const _bimb_level_t *)(map + h->levels);
+    const _bimb_element_t *belements = (const _bimb_element_t *)(map + h->elements);
+    const uint32_t *boutputs = (const uint32_t *)(map + h->outputs);
+    const bim_edge *bedges = (const bim_edge *)(map + h->edges);
+
+    if (!_string_ok(h, strings, h->name) || !_string_ok(h, strings, h->city)
+        || !_string_ok(h, strings, h->street_address) || !_string_ok(h, strings, h->add_info)
+        || !_string_ok(h, strings, h->outside_name) || !_string_ok(h, strings, h->outside_uuid))
+        return false;
+    if (!_handles_ok((const uint32_t *)(map + h->exits), h->exits_count, h->handles_count))
+        return false;
+
+    // Номера зон и переходов совпадают с их местом в списках модели
+    uint64_t zones_count = 0, transits_count = 0;
+    for (uint64_t i = 0; i < h->levels_count; i++)
+    {
+        const _bimb_level_t *blevel = &blevels[i];
+        if (!_string_ok(h, strings, blevel->name)
+            || !_range_ok(blevel->elements_begin, blevel->elements_count, h->elements_count))
+            return false;
+
+        // Связи элементов этажа отсчитываются от связей первого элемента
+        uint64_t outputs_base = blevel->elements_count ? belements[blevel->elements_begin].outputs_begin : 0;
+        for (uint64_t j = 0; j < blevel->elements_count; j++)
+        {
+            const _bimb_element_t *belement = &belements[blevel->elements_begin + j];
+            if (!_string_ok(h, strings, belement->uuid) || !_string_ok(h, strings, belement->name)
+                || !_range_ok(belement->points_begin, belement->points_count, h->points_count)
+                || !_range_ok(belement->outputs_begin, belement->outputs_count, h->outputs_count)
+                || belement->outputs_begin < outputs_base
+                || !_handles_ok(&boutputs[belement->outputs_begin], belement->outputs_count, h->handles_count)
+                || belement->handle >= h->handles_count)
+                return false;
+
+            switch (belement->sign)
+            {
+                case ROOM: case STAIR:
+                    if (belement->id != zones_count++) return false;
+                    break;
+                case DOOR_WAY: case DOOR_WAY_INT: case DOOR_WAY_OUT:
+                    if (belement->id != transits_count++) return false;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    if (zones_count != h->zones_count || transits_count != h->transits_count)
+        return false;
+
+    for (uint64_t i = 0; i < h->transits_count; i++)
+        if (bedges[i].src > h->zones_count || bedges[i].dest > h->zones_count || bedges[i].id >= h->transits_count)
+            return false;
+    return true;
+}
+
+// Выделяет участок общего блока памяти
+static void* _take(uint8_t **cursor, size_t size)
+{
+    void *ptr = *cursor;
+    *cursor += _align(size);
+    return ptr;
+}
+
+bim_t* bim_tools_open_mapped(const char *bimb_file)
+{
+    int fd = open(bimb_file, O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_ERROR("Не удалось прочитать файл. Проверьте правильность имени файла и пути: %s", bimb_file);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = st.st_size;
+    uint8_t *map = (uint8_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        LOG_ERROR("Не удалось отобразить файл в память: %s", bimb_file);
+        return NULL;
+    }
+
+    const _bimb_header_t *h = (const _bimb_header_t *)map;
+    if (!_header_ok(h, size) || !_records_ok(h, map))
+    {
+        LOG_ERROR("Файл не является кэшем здания или создан другой версией программы: %s", bimb_file);
+        munmap(map, size);
+        return NULL;
+    }
+
+    char *strings = (char *)map + h->strings;
+    const _bimb_level_t *blevels = (const _bimb_level_t *)(map + h->levels);
+    const _bimb_element_t *belements = (const _bimb_element_t *)(map + h->elements);
+    uint32_t *boutputs = (uint32_t *)(map + h->outputs);
+    uint32_t *bexits = (uint32_t *)(map + h->exits);
+    point_t *bpoints = (point_t *)(map + h->points);
+
+    // Без полигонов страницы секции точек не затрагиваются и не попадают в память
+    bool keep_geometry = bim_tools_get_keep_geometry();
+
+    // Все структуры модели размещаются в одном блоке памяти
+    size_t block_size = _align(sizeof (bim_t))
+                      + _align(sizeof (bim_json_object_t))
+                      + _align(sizeof (bim_json_level_t) * h->levels_count)
+                      + _align(sizeof (bim_json_element_t) * h->elements_count)
+                      + (keep_geometry ? _align(sizeof (polygon_t) * h->elements_count) : 0)
+                      + _align(sizeof (bim_object_t))
+                      + _align(sizeof (bim_level_t) * h->levels_count)
+                      + _align(sizeof (bim_zone_t) * h->zones_count)
+                      + _align(sizeof (bim_transit_t) * h->transits_count)
+                      + _align(sizeof (bim_json_element_t))
+                      + _align(sizeof (bim_zone_t));
+    uint8_t *cursor = (uint8_t *)calloc(1, block_size);
+    if (!cursor)
+    {
+        munmap(map, size);
+        return NULL;
+    }
+
+    bim_t *bim                      = _take(&cursor, sizeof (bim_t));
+    bim_json_object_t *json         = _take(&cursor, sizeof (bim_json_object_t));
+    bim_json_level_t *levels        = _take(&cursor, sizeof (bim_json_level_t) * h->levels_count);
+    bim_json_element_t *elements    = _take(&cursor, sizeof (bim_json_element_t) * h->elements_count);
+    polygon_t *polygons             = keep_geometry ? _take(&cursor, sizeof (polygon_t) * h->elements_count) : NULL;
+    bim_object_t *object            = _take(&cursor, sizeof (bim_object_t));
+    bim_level_t *levels_ext         = _take(&cursor, sizeof (bim_level_t) * h->levels_count);
+    bim_zone_t *zones               = _take(&cursor, sizeof (bim_zone_t) * h->zones_count);
+    bim_transit_t *transits         = _take(&cursor, sizeof (bim_transit_t) * h->transits_count);
+    bim_json_element_t *outside_el  = _take(&cursor, sizeof (bim_json_element_t));
+    bim_zone_t *outside             = _take(&cursor, sizeof (bim_zone_t));
+
+    bim->json = json;
+    bim->object = object;
+    bim->zones = arraylist_new(h->zones_count + 1);
+    bim->transits = arraylist_new(h->transits_count);
+    bim->edges = (const struct edge *)(map + h->edges);
+    bim->mapped = map;
+    bim->mapped_size = size;
+
+    json->name = strings + h->name;
+    json->address.city = strings + h->city;
+    json->address.street_address = strings + h->street_address;
+    json->address.add_info = strings + h->add_info;
+    json->levels_count = h->levels_count;
+    json->levels = levels;
+    json->handles_count = h->handles_count;
+
+    object->name = json->name;
+    object->levels_count = h->levels_count;
+    object->levels = levels_ext;
+    object->outside = outside;
+
+    uint64_t zones_count = 0, transits_count = 0;
+    for (size_t i = 0; i < h->levels_count; i++)
+    {
+        const _bimb_level_t *blevel = &blevels[i];
+        bim_json_level_t *level = &levels[i];
+        bim_level_t *level_ext = &levels_ext[i];
+
+        level->name = strings + blevel->name;
+        level->z_level = blevel->z_level;
+        level->elements_count = blevel->elements_count;
+        level->elements = &elements[blevel->elements_begin];
+        // Связи элементов этажа идут в секции выходов подряд
+        uint64_t outputs_base = blevel->elements_count ? belements[blevel->elements_begin].outputs_begin : 0;
+        level->outputs = &boutputs[outputs_base];
+        level->outputs_count = 0;
+
+        level_ext->name = level->name;
+        level_ext->z_level = level->z_level;
+        level_ext->zones = &zones[zones_count];
+        level_ext->transits = &transits[transits_count];
+        level_ext->index = NULL;
+
+        for (size_t j = 0; j < blevel->elements_count; j++)
+        {
+            uint64_t idx = blevel->elements_begin + j;
+            const _bimb_element_t *belement = &belements[idx];
+            bim_json_element_t *element = &elements[idx];
+            polygon_t *polygon = NULL;
+            if (polygons)
+            {
+                polygon = &polygons[idx];
+                polygon->point_count = belement->points_count;
+                polygon->points = &bpoints[belement->points_begin];
+            }
+
+            element->id = belement->id;
+            element->uuid = strings + belement->uuid;
+            element->handle = belement->handle;
+            element->name = strings + belement->name;
+            element->size_z = belement->size_z;
+            element->z_level = belement->z_level;
+            element->numofpeople = belement->numofpeople;
+            element->sign = belement->sign;
+            element->polygon = polygon;
+            element->digest = 0; // Не хранится в кэше, при bim_tools_reload площадь и ширина пересчитываются
+            element->outputs_count = belement->outputs_count;
+            element->outputs_begin = belement->outputs_begin - outputs_base;
+            element->outputs = &boutputs[belement->outputs_begin];
+            level->outputs_count += element->outputs_count;
+
+            if (element->sign == ROOM || element->sign == STAIR)
+            {
+                bim_zone_t *zone = &zones[zones_count++];
+                zone->base = element;
+                zone->id = element->id;
+                zone->sign = element->sign;
+                zone->z_level = element->z_level;
+                zone->outputs_count = element->outputs_count;
+                zone->is_blocked = false;
+                zone->is_visited = false;
+                zone->potential = __FLT_MAX__;
+                zone->area = belement->derived;
+                zone->num_of_people = element->numofpeople;
+                arraylist_append(bim->zones, zone);
+            }
+            else if (element->sign == DOOR_WAY || element->sign == DOOR_WAY_OUT || element->sign == DOOR_WAY_INT)
+            {
+                bim_transit_t *transit = &transits[transits_count++];
+                transit->base = element;
+                transit->is_blocked = false;
+                transit->is_visited = false;
+                transit->num_of_people = 0;
+                transit->width = belement->derived;
+                arraylist_append(bim->transits, transit);
+            }
+        }
+        level_ext->zone_count = &zones[zones_count] - level_ext->zones;
+        level_ext->transit_count = &transits[transits_count] - level_ext->transits;
+    }
+
+    outside_el->id = zones_count;
+    outside_el->name = strings + h->outside_name;
+    outside_el->uuid = strings + h->outside_uuid;
+    outside_el->handle = h->handles_count;
+    outside_el->sign = OUTSIDE;
+    outside_el->polygon = NULL;
+    outside_el->z_level = 0;
+    outside_el->size_z = __FLT_MAX__;
+    outside_el->numofpeople = 0;
+    outside_el->outputs_count = h->exits_count;
+    outside_el->outputs = bexits;
+
+    outside->base = outside_el;
+    outside->id = outside_el->id;
+    outside->sign = outside_el->sign;
+    outside->z_level = outside_el->z_level;
+    outside->outputs_count = outside_el->outputs_count;
+    outside->is_blocked = false;
+    outside->is_visited = false;
+    outside->potential = 0;
+    outside->area = __FLT_MAX__;
+    outside->num_of_people = 0;
+    arraylist_append(bim->zones, outside);
+
+    if (keep_geometry)
+        bim_parallel_for(bim_tools_get_threads(), h->levels_count, _level_index, object);
+
+    // Номера элементов в файле идут по возрастанию, поэтому списки
+    // уже упорядочены так же, как после сортировки в bim_tools_new
+    return bim;
+}
+
+void _mapped_close(bim_t *bim)
+{
+    for (size_t i = 0; i < bim->object->levels_count; i++)
+        bim_index_free(bim->object->levels[i].index);
+
+    arraylist_free(bim->zones);
+    arraylist_free(bim->transits);
+    munmap(bim->mapped, bim->mapped_size);
+    free(bim);
+}
@@ -0,0 +1,352 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Перестановка выполняется так:
+ *  - списки смежности графа переносятся на места новых номеров вершин
+ *    в тех же массивах графа. Порядок смежных вершин в списке сохраняется,
+ *    поэтому шаг моделирования обходит зоны и переходы в прежнем порядке
+ *    и дает те же результаты, что и до перестановки;
+ *  - структуры зон и переходов каждого этажа сортируются по новым номерам
+ *    внутри массива этажа, поэтому элементы этажа остаются в его массиве,
+ *    а соседние по графу элементы оказываются рядом в памяти;
+ *  - списки bim_t.zones и bim_t.transits заполняются заново.
+ * Номер перехода хранится только как его место в списке переходов,
+ * поэтому для переходов этажа он находится по адресу структуры.
+ */
+
+#include "bim_order.h"
+#include "bim_index.h"
+#include "logger.h"
+
+#define NO_RANK UINT32_MAX
+
+/// Элемент массива этажа с новым номером
+typedef struct
+{
+    uint32_t    rank;       ///< Новый номер элемента
+    uint32_t    position;   ///< Место элемента в массиве этажа
+} _slot_t;
+
+/// Этаж, упорядоченный по адресу массива переходов
+typedef struct
+{
+    const bim_transit_t *transits;  ///< Массив переходов этажа
+    uint64_t            count;      ///< Количество переходов этажа
+    uint64_t            begin;      ///< Номер первого перехода этажа в таблице текущих номеров
+} _transit_block_t;
+
+static int _slot_cmp(const void *a, const void *b)
+{
+    const _slot_t *s1 = a, *s2 = b;
+    return (s1->rank > s2->rank) - (s1->rank < s2->rank);
+}
+
+static int _block_cmp(const void *a, const void *b)
+{
+    uintptr_t p1 = (uintptr_t)((const _transit_block_t *)a)->transits;
+    uintptr_t p2 = (uintptr_t)((const _transit_block_t *)b)->transits;
+    return (p1 > p2) - (p1 < p2);
+}
+
+// Этаж, в массиве переходов которого лежит переход
+static const _transit_block_t *_block_of(const _transit_block_t *blocks, size_t count, const bim_transit_t *transit)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if ((uintptr_t)blocks[mid].transits <= (uintptr_t)transit) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return NULL;
+    const _transit_block_t *block = &blocks[lo - 1];
+    return (size_t)(transit - block->transits) < block->count ? block : NULL;
+}
+
+// Проверяет, что rank -- перестановка чисел 0..count-1. seen -- рабочий массив
+static bool _is_permutation(const uint32_t *rank, uint32_t count, uint8_t *seen)
+{
+    memset(seen, 0, count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (rank[i] >= count || seen[rank[i]]) return false;
+        seen[rank[i]] = 1;
+    }
+    return true;
+}
+
+bim_permutation_t *bim_order_permutation_new(const bim_t *bim)
+{
+    uint32_t zone_count = bim->zones->length;
+    uint32_t transit_count = bim->transits->length;
+    bim_permutation_t *permutation = (bim_permutation_t *)malloc(sizeof (bim_permutation_t) + sizeof (uint32_t) * (zone_count + transit_count));
+    if (!permutation)
+        return NULL;
+
+    permutation->zone_count = zone_count;
+    permutation->transit_count = transit_count;
+    permutation->zones = (uint32_t *)(permutation + 1);
+    permutation->transits = permutation->zones + zone_count;
+    for (uint32_t i = 0; i < zone_count; i++)
+        permutation->zones[i] = i;
+    for (uint32_t i = 0; i < transit_count; i++)
+        permutation->transits[i] = i;
+    return permutation;
+}
+
+void bim_order_permutation_free(bim_permutation_t *permutation)
+{
+    free(permutation);
+}
+
+int bim_order_apply(bim_t *bim, bim_graph_t *graph, const uint32_t *zone_rank,
+                    const uint32_t *transit_rank, bim_permutation_t *permutation)
+{
+    bim_object_t *object = bim->object;
+    uint32_t zone_count = bim->zones->length;
+    uint32_t transit_count = bim->transits->length;
+    if (graph->node_count != zone_count || graph->edge_count != transit_count)
+    {
+        LOG_ERROR("Граф не соответствует модели здания");
+        return -1;
+    }
+    if (permutation && (permutation->zone_count != zone_count || permutation->transit_count != transit_count))
+    {
+        LOG_ERROR("Перестановка не соответствует модели здания");
+        return -1;
+    }
+
+    uint64_t level_zones = 0, level_transits = 0, max_count = 0;
+    for (size_t i = 0; i < object->levels_count; i++)
+    {
+        const bim_level_t *level = &object->levels[i];
+        level_zones += level->zone_count;
+        level_transits += level->transit_count;
+        if (level->zone_count > max_count) max_count = level->zone_count;
+        if (level->transit_count > max_count) max_count = level->transit_count;
+    }
+    if (level_zones + 1 != zone_count || level_transits != transit_count)
+    {
+        LOG_ERROR("Списки зон и переходов не соответствуют этажам здания");
+        return -1;
+    }
+
+    size_t offsets_size = sizeof (uint32_t) * (zone_count + 1);
+    size_t adjacent_size = sizeof (bim_adjacent_t) * 2 * transit_count;
+    size_t current_size = sizeof (uint32_t) * transit_count;
+    size_t blocks_size = sizeof (_transit_block_t) * object->levels_count;
+    size_t slots_size = sizeof (_slot_t) * max_count;
+    size_t buffer_size = sizeof (bim_zone_t) * max_count > sizeof (bim_transit_t) * max_count
+                       ? sizeof (bim_zone_t) * max_count : sizeof (bim_transit_t) * max_count;
+    size_t seen_size = zone_count > transit_count ? zone_count : transit_count;
+    // Массивы с выравниванием 8 байт идут первыми
+    uint8_t *workspace = (uint8_t *)malloc(adjacent_size + blocks_size + buffer_size + offsets_size + current_size + slots_size + seen_size);
+    if (!workspace)
+        return -1;
+    bim_adjacent_t *adjacent = (bim_adjacent_t *)workspace;
+    _transit_block_t *blocks = (_transit_block_t *)(workspace + adjacent_size);
+    void *buffer = (uint8_t *)blocks + blocks_size;
+    uint32_t *offsets = (uint32_t *)((uint8_t *)buffer + buffer_size);
+    uint32_t *current = offsets + zone_count + 1;
+    _slot_t *slots = (_slot_t *)(current + transit_count);
+    uint8_t *seen = (uint8_t *)(slots + max_count);
+
+    if (!_is_permutation(zone_rank, zone_count, seen) || zone_rank[zone_count - 1] != zone_count - 1
+        || !_is_permutation(transit_rank, transit_count, seen))
+    {
+        LOG_ERROR("Новые номера зон и переходов не являются перестановкой");
+        free(workspace);
+        return -1;
+    }
+
+    // Текущие номера переходов по месту в массивах этажей. Этажи без
+    // переходов пропускаются: их массив может начинаться там же, где массив
+    // следующего этажа (модель из кэша размещается одним блоком)
+    uint64_t begin = 0;
+    size_t blocks_count = 0;
+    for (size_t i = 0; i < object->levels_count; i++)
+    {
+        if (object->levels[i].transit_count)
+            blocks[blocks_count++] = (_transit_block_t){object->levels[i].transits, object->levels[i].transit_count, begin};
+        begin += object->levels[i].transit_count;
+    }
+    qsort(blocks, blocks_count, sizeof (_transit_block_t), _block_cmp);
+    for (uint32_t i = 0; i < transit_count; i++)
+    {
+        const bim_transit_t *transit = bim->transits->data[i];
+        const _transit_block_t *block = _block_of(blocks, blocks_count, transit);
+        if (!block)
+        {
+            LOG_ERROR("Переход %s не принадлежит этажам здания", transit->base->uuid);
+            free(workspace);
+            return -1;
+        }
+        current[block->begin + (transit - block->transits)] = i;
+    }
+
+    // Модель изменяется только после всех проверок
+    begin = 0;
+    for (size_t i = 0; i < object->levels_count; i++)
+    {
+        bim_level_t *level = &object->levels[i];
+
+        for (uint32_t j = 0; j < level->zone_count; j++)
+            slots[j] = (_slot_t){zone_rank[level->zones[j].id], j};
+        qsort(slots, level->zone_count, sizeof (_slot_t), _slot_cmp);
+        memcpy(buffer, level->zones, sizeof (bim_zone_t) * level->zone_count);
+        for (uint32_t j = 0; j < level->zone_count; j++)
+        {
+            level->zones[j] = ((const bim_zone_t *)buffer)[slots[j].position];
+            level->zones[j].id = slots[j].rank;
+            bim->zones->data[slots[j].rank] = &level->zones[j];
+        }
+
+        for (uint32_t j = 0; j < level->transit_count; j++)
+            slots[j] = (_slot_t){transit_rank[current[begin + j]], j};
+        begin += level->transit_count;
+        qsort(slots, level->transit_count, sizeof (_slot_t), _slot_cmp);
+        memcpy(buffer, level->transits, sizeof (bim_transit_t) * level->transit_count);
+        for (uint32_t j = 0; j < level->transit_count; j++)
+        {
+            level->transits[j] = ((const bim_transit_t *)buffer)[slots[j].position];
+            bim->transits->data[slots[j].rank] = &level->transits[j];
+        }
+
+        // Индекс этажа ссылается на элементы по месту в массивах этажа
+        if (level->index)
+        {
+            bim_index_free(level->index);
+            level->index = bim_index_new(level);
+        }
+    }
+
+    // Список смежности вершины v переносится на место вершины zone_rank[v]
+    memcpy(offsets, graph->offsets, offsets_size);
+    memcpy(adjacent, graph->adjacent, adjacent_size);
+    graph->offsets[0] = 0;
+    for (uint32_t v = 0; v < zone_count; v++)
+        graph->offsets[zone_rank[v] + 1] = offsets[v + 1] - offsets[v];
+    for (uint32_t v = 1; v <= zone_count; v++)
+        graph->offsets[v] += graph->offsets[v - 1];
+    for (uint32_t v = 0; v < zone_count; v++)
+    {
+        bim_adjacent_t *target = graph->adjacent + graph->offsets[zone_rank[v]];
+        for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++)
+            *target++ = (bim_adjacent_t){zone_rank[adjacent[k].dest], transit_rank[adjacent[k].eid]};
+    }
+    bim->edges = NULL;
+
+    if (permutation)
+    {
+        for (uint32_t i = 0; i < zone_count; i++)
+            permutation->zones[i] = zone_rank[permutation->zones[i]];
+        for (uint32_t i = 0; i < transit_count; i++)
+            permutation->transits[i] = transit_rank[permutation->transits[i]];
+    }
+
+    free(workspace);
+    return 0;
+}
+
+// Соседи вершины, добавленные в очередь обхода Cuthill-McKee, упорядочиваются
+// по возрастанию степени (при равенстве -- по номеру). Соседей немного,
+// поэтому сортировка вставками
+static void _sort_by_degree(const bim_graph_t *graph, uint32_t *items, size_t count)
+{
+    for (size_t i = 1; i < count; i++)
+    {
+        uint32_t v = items[i];
+        uint32_t degree = graph->offsets[v + 1] - graph->offsets[v];
+        size_t j = i;
+        for (; j > 0; j--)
+        {
+            uint32_t u = items[j - 1];
+            uint32_t u_degree = graph->offsets[u + 1] - graph->offsets[u];
+            if (u_degree < degree || (u_degree == degree && u < v)) break;
+            items[j] = u;
+        }
+        items[j] = v;
+    }
+}
+
+int bim_order_renumber(bim_t *bim, bim_graph_t *graph, bim_order_t order, bim_permutation_t *permutation)
+{
+    uint32_t zone_count = graph->node_count;
+    uint32_t transit_count = graph->edge_count;
+    uint32_t outside = zone_count - 1;
+
+    uint32_t *workspace = (uint32_t *)malloc(sizeof (uint32_t) * (2 * zone_count + transit_count));
+    if (!workspace)
+        return -1;
+    uint32_t *zone_rank = workspace;
+    uint32_t *queue = workspace + zone_count;
+    uint32_t *transit_rank = workspace + 2 * zone_count;
+
+    // Обход в ширину от зоны вне здания, затем от остальных непосещенных зон.
+    // До конца обхода zone_rank служит признаком посещения
+    for (uint32_t v = 0; v < zone_count; v++)
+        zone_rank[v] = NO_RANK;
+    size_t head = 0, tail = 0;
+    for (uint32_t i = 0; i < zone_count; i++)
+    {
+        uint32_t root = i == 0 ? outside : i - 1;
+        if (zone_rank[root] != NO_RANK) continue;
+        zone_rank[root] = 0;
+        queue[tail++] = root;
+        while (head < tail)
+        {
+            uint32_t v = queue[head++];
+            size_t first = tail;
+            for (uint32_t k = graph->offsets[v]; k < graph->offsets[v + 1]; k++)
+            {
+                uint32_t u = graph->adjacent[k].dest;
+                if (zone_rank[u] != NO_RANK) continue;
+                zone_rank[u] = 0;
+                queue[tail++] = u;
+            }
+            if (order == BIM_ORDER_RCM)
+                _sort_by_degree(graph, queue + first, tail - first);
+        }
+    }
+
+    // Обход в ширину начинается с зоны вне здания, она переносится в конец.
+    // В порядке RCM обход разворачивается, и зона вне здания оказывается последней
+    for (uint32_t i = 0; i < zone_count; i++)
+    {
+        if (order == BIM_ORDER_RCM) zone_rank[queue[i]] = zone_count - 1 - i;
+        else zone_rank[queue[i]] = i == 0 ? outside : i - 1;
+    }
+
+    // Переходы -- в порядке первого появления у зон в новом порядке
+    for (uint32_t v = 0; v < zone_count; v++)
+        queue[zone_rank[v]] = v;
+    for (uint32_t i = 0; i < transit_count; i++)
+        transit_rank[i] = NO_RANK;
+    uint32_t next = 0;
+    for (uint32_t r = 0; r < zone_count; r++)
+    {
+        uint32_t v = queue[r];
+        for (uint32_t k = graph->offsets[v]; k < graph->offsets[v + 1]; k++)
+        {
+            uint32_t e = graph->adjacent[k].eid;
+            if (transit_rank[e] == NO_RANK) transit_rank[e] = next++;
+        }
+    }
+
+    int result = bim_order_apply(bim, graph, zone_rank, transit_rank, permutation);
+    free(workspace);
+    return result;
+}
@@ -0,0 +1,106 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Перенумерация зон и переходов в порядке обхода графа здания
+
+Зоны и переходы нумеруются в порядке файла, поэтому обход графа от зоны
+вне здания (evac_moving_step) обращается к спискам зон и переходов
+вразброс. Перенумерация располагает соседние по графу элементы рядом:
+в порядке обхода в ширину от зоны вне здания или в порядке Reverse
+Cuthill-McKee. Переставляются списки bim_t.zones и bim_t.transits, сами
+структуры в массивах этажей и списки смежности графа. Зона вне здания
+остается последней.
+
+Порядок смежных вершин в каждом списке смежности сохраняется, поэтому
+шаг моделирования (evac_moving_step) обрабатывает зоны и переходы в том же
+порядке и дает те же результаты, что и без перенумерации. Граф, заново
+построенный по перенумерованной модели (bim_graph_new), упорядочит смежные
+вершины по новым номерам переходов, поэтому граф строится до перенумерации
+и переставляется вместе с моделью.
+
+Исходный порядок сохраняется в таблице перестановки, по которой, например,
+результаты моделирования выводятся в порядке файла.
+*/
+
+#ifndef BIM_ORDER_H
+#define BIM_ORDER_H
+
+#include "bim_tools.h"
+#include "bim_graph.h"
+
+/// Порядок перенумерации
+typedef enum
+{
+    BIM_ORDER_BFS,  ///< Обход в ширину от зоны вне здания
+    BIM_ORDER_RCM   ///< Reverse Cuthill-McKee от зоны вне здания
+} bim_order_t;
+
+/// Таблица перестановки: текущие номера элементов по исходным
+typedef struct
+{
+    uint32_t    zone_count;     ///< Количество зон, включая зону вне здания
+    uint32_t    transit_count;  ///< Количество переходов
+    uint32_t    *zones;         ///< zones[i] -- текущий номер зоны с исходным номером i
+    uint32_t    *transits;      ///< transits[i] -- текущий номер перехода с исходным номером i
+} bim_permutation_t;
+
+/*!
+Создает тождественную перестановку для модели
+
+\param[in] bim Модель здания
+\returns Перестановка или NULL, если не хватило памяти
+*/
+bim_permutation_t*  bim_order_permutation_new   (const bim_t *bim);
+
+/// Освобождает перестановку
+void                bim_order_permutation_free  (bim_permutation_t *permutation);
+
+/*!
+Переставляет зоны и переходы модели
+
+Зона с номером i получает номер zone_rank[i], переход с номером i --
+номер transit_rank[i]. Обновляются списки зон и переходов, номера зон,
+массивы этажей (и индексы этажей, если они построены) и граф: список
+смежности каждой вершины переносится без изменения порядка.
+Готовые ребра из кэша (bim_t.edges) после перестановки не используются
+
+\param[in,out] bim          Модель здания
+\param[in,out] graph        Граф модели (bim_graph_new)
+\param[in] zone_rank        Новые номера зон, зона вне здания должна остаться последней
+\param[in] transit_rank     Новые номера переходов
+\param[in,out] permutation  Перестановка, к которой добавляется эта (может быть NULL)
+\returns 0 в случае успеха, -1 при ошибке (модель не изменяется)
+*/
+int     bim_order_apply     (bim_t *bim, bim_graph_t *graph, const uint32_t *zone_rank,
+                             const uint32_t *transit_rank, bim_permutation_t *permutation);
+
+/*!
+Перенумеровывает зоны и переходы в порядке обхода графа
+
+Переходы нумеруются в порядке первого появления в списках смежности зон,
+взятых в новом порядке. Зоны, недостижимые из зоны вне здания, следуют
+за достижимыми компонентами связности
+
+\param[in,out] bim          Модель здания
+\param[in,out] graph        Граф модели (bim_graph_new)
+\param[in] order            Порядок перенумерации
+\param[in,out] permutation  Перестановка, к которой добавляется эта (может быть NULL)
+\returns 0 в случае успеха, -1 при ошибке (модель не изменяется)
+*/
+int     bim_order_renumber  (bim_t *bim, bim_graph_t *graph, bim_order_t order, bim_permutation_t *permutation);
+
+#endif //BIM_ORDER_H
@@ -0,0 +1,175 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bim_parallel.h"
+
+typedef struct
+{
+    bim_parallel_body_t body;
+    void                *ctx;
+    size_t              count;
+    atomic_size_t       next;   ///< Следующая необработанная часть
+} _loop_t;
+
+/*!
+Пул потоков, общий для всех вызовов bim_parallel_for
+
+Потоки создаются при первом вызове с большим, чем в пуле, количеством
+потоков и живут до завершения программы. Поток пула с номером worker
+участвует в цикле, если worker < threads цикла (поток 0 -- вызывающий).
+*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  start;      ///< Опубликован новый цикл или пул останавливается
+    pthread_cond_t  done;       ///< Все потоки пула закончили цикл
+    pthread_t       *ids;       ///< Потоки пула, ids[i] -- поток с номером i + 1
+    uint32_t        size;       ///< Количество потоков пула
+    uint64_t        generation; ///< Номер текущего цикла
+    _loop_t         *loop;      ///< Текущий цикл
+    uint32_t        threads;    ///< Количество потоков текущего цикла, включая вызывающий
+    uint32_t        running;    ///< Потоки пула, не закончившие текущий цикл
+    bool            busy;       ///< Пул занят циклом
+    bool            stop;
+} _pool_t;
+
+static _pool_t _pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+static void _loop_run(_loop_t *loop, uint32_t worker)
+{
+    size_t index;
+    while ((index = atomic_fetch_add(&loop->next, 1)) < loop->count)
+        loop->body(loop->ctx, index, worker);
+}
+
+static void* _pool_run(void *arg)
+{
+    uint32_t worker = (uint32_t)(uintptr_t)arg;
+    // Поток, созданный во время цикла, участвует в нем: номер цикла уже больше 0
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&_pool.lock);
+    while (1)
+    {
+        while (!_pool.stop && _pool.generation == generation)
+            pthread_cond_wait(&_pool.start, &_pool.lock);
+        if (_pool.stop) break;
+        generation = _pool.generation;
+        if (worker >= _pool.threads) continue;
+
+        _loop_t *loop = _pool.loop;
+        pthread_mutex_unlock(&_pool.lock);
+        _loop_run(loop, worker);
+        pthread_mutex_lock(&_pool.lock);
+        if (--_pool.running == 0)
+            pthread_cond_signal(&_pool.done);
+    }
+    pthread_mutex_unlock(&_pool.lock);
+    return NULL;
+}
+
+static void _pool_stop(void)
+{
+    pthread_mutex_lock(&_pool.lock);
+    _pool.stop = true;
+    pthread_cond_broadcast(&_pool.start);
+    pthread_mutex_unlock(&_pool.lock);
+
+    for (uint32_t i = 0; i < _pool.size; i++)
+        pthread_join(_pool.ids[i], NULL);
+    free(_pool.ids);
+    _pool.ids = NULL;
+    _pool.size = 0;
+}
+
+// Дополняет пул до size потоков (вызывается под блокировкой пула).
+// Если поток создать не удалось, пул остается меньшего размера
+static void _pool_grow(uint32_t size)
+{
+    if (size <= _pool.size)
+        return;
+    pthread_t *ids = (pthread_t *)realloc(_pool.ids, sizeof (pthread_t) * size);
+    if (!ids)
+        return;
+    _pool.ids = ids;
+
+    if (_pool.size == 0)
+        atexit(_pool_stop);
+    while (_pool.size < size
+           && pthread_create(&_pool.ids[_pool.size], NULL, _pool_run, (void *)(uintptr_t)(_pool.size + 1)) == 0)
+        _pool.size++;
+}
+
+static uint32_t _serial_for(size_t count, bim_parallel_body_t body, void *ctx)
+{
+    for (size_t i = 0; i < count; i++)
+        body(ctx, i, 0);
+    return 1;
+}
+
+uint32_t bim_parallel_for(uint32_t threads, size_t count, bim_parallel_body_t body, void *ctx)
+{
+    if (threads > count) threads = count;
+    if (threads <= 1)
+        return _serial_for(count, body, ctx);
+
+    pthread_mutex_lock(&_pool.lock);
+    // Вложенный цикл или цикл из другого потока выполняется последовательно
+    if (_pool.busy || _pool.stop)
+    {
+        pthread_mutex_unlock(&_pool.lock);
+        return _serial_for(count, body, ctx);
+    }
+    _pool_grow(threads - 1);
+    if (threads > _pool.size + 1) threads = _pool.size + 1;
+    if (threads <= 1)
+    {
+        pthread_mutex_unlock(&_pool.lock);
+        return _serial_for(count, body, ctx);
+    }
+
+    _loop_t loop = {body, ctx, count, 0};
+    _pool.busy = true;
+    _pool.loop = &loop;
+    _pool.threads = threads;
+    _pool.running = threads - 1;
+    _pool.generation++;
+    pthread_cond_broadcast(&_pool.start);
+    pthread_mutex_unlock(&_pool.lock);
+
+    _loop_run(&loop, 0);
+
+    pthread_mutex_lock(&_pool.lock);
+    while (_pool.running > 0)
+        pthread_cond_wait(&_pool.done, &_pool.lock);
+    _pool.busy = false;
+    pthread_mutex_unlock(&_pool.lock);
+    return threads;
+}
+
+uint32_t bim_parallel_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+}
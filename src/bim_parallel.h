@@ -0,0 +1,61 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Параллельная обработка независимых частей модели здания
+
+Простой параллельный цикл на потоках POSIX: индексы раздаются потокам
+по одному через атомарный счетчик, поэтому этажи разного размера
+распределяются между потоками равномерно. Потоки берутся из пула,
+который создается при первом параллельном цикле и живет до завершения
+программы, поэтому частые короткие циклы не создают потоки заново.
+*/
+
+#ifndef BIM_PARALLEL_H
+#define BIM_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+Тело параллельного цикла
+
+\param[in] ctx    Общие данные цикла
+\param[in] index  Номер обрабатываемой части, 0..count-1
+\param[in] worker Номер потока, 0..threads-1 (для данных, принадлежащих потоку)
+*/
+typedef void (*bim_parallel_body_t)(void *ctx, size_t index, uint32_t worker);
+
+/*!
+Выполняет body для всех index от 0 до count-1
+
+Порядок обработки не определен. При threads <= 1, внутри другого
+параллельного цикла или одновременно с ним, цикл выполняется в
+вызывающем потоке.
+Возврат происходит после обработки всех частей
+
+\param[in] threads Количество потоков (не больше count)
+\param[in] count   Количество частей
+\param[in] body    Тело цикла
+\param[in] ctx     Общие данные цикла
+\returns Фактическое количество потоков
+*/
+uint32_t    bim_parallel_for        (uint32_t threads, size_t count, bim_parallel_body_t body, void *ctx);
+
+/// Количество доступных процессоров
+uint32_t    bim_parallel_cpu_count  (void);
+
+#endif //BIM_PARALLEL_H
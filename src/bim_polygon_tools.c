@@ -14,93 +14,378 @@
  */
 
 #include "bim_polygon_tools.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdbool.h>
+#include <float.h>
 #include "triangle.h"
 
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Triangle хранит часть состояния в глобальных переменных (randomseed,
+// границы погрешностей, распределитель памяти), поэтому вызовы triangulate
+// не должны пересекаться
+static pthread_mutex_t _triangle_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Режим точных предикатов (geom_tools_set_robust)
+static bool _robust = false;
+static pthread_once_t _exact_once = PTHREAD_ONCE_INIT;
+
+// Оценка погрешности ориентации, вычисленной в double (ccwerrboundA в Triangle,
+// epsilon в Triangle -- половина DBL_EPSILON)
+#define CCW_ERRBOUND_A ((3.0 + 16.0 * (DBL_EPSILON / 2)) * (DBL_EPSILON / 2))
+
+// Константы точной арифметики Triangle. triangulate вызывает exactinit
+// при каждом запуске и записывает те же значения
+static void _exact_init(void)
+{
+    exactinit();
+}
+
+// Удвоенная ориентированная площадь треугольника abc: > 0, если обход
+// против часовой стрелки, < 0 -- по часовой, 0 -- точки на одной прямой.
+// Формула та же, что в counterclockwise(b, c, a) из Triangle. В режиме точных
+// предикатов, если погрешность вычисления может изменить знак, результат
+// уточняется адаптивной арифметикой Triangle (triorient2d), иначе
+// возвращается то же значение, что и без этого режима
+static inline double _orient(double ax, double ay, double bx, double by, double cx, double cy)
+{
+    double detleft = (bx - ax) * (cy - ay);
+    double detright = (by - ay) * (cx - ax);
+    double det = detleft - detright;
+    if (!_robust || fabs(det) >= CCW_ERRBOUND_A * (fabs(detleft) + fabs(detright)))
+        return det;
+
+    REAL pa[2] = {bx, by}, pb[2] = {cx, cy}, pc[2] = {ax, ay};
+    return triorient2d(pa, pb, pc);
+}
+
+void geom_tools_set_robust(bool robust)
+{
+    if (robust)
+        pthread_once(&_exact_once, _exact_init);
+    _robust = robust;
+}
+
+bool geom_tools_get_robust(void)
+{
+    return _robust;
+}
+
+double geom_tools_orient2d(const point_t a, const point_t b, const point_t c)
+{
+    double detleft = (b.x - a.x) * (c.y - a.y);
+    double detright = (b.y - a.y) * (c.x - a.x);
+    double det = detleft - detright;
+    if (fabs(det) >= CCW_ERRBOUND_A * (fabs(detleft) + fabs(detright)))
+        return det;
+
+    pthread_once(&_exact_once, _exact_init);
+    REAL pa[2] = {b.x, b.y}, pb[2] = {c.x, c.y}, pc[2] = {a.x, a.y};
+    return triorient2d(pa, pb, pc);
+}
+
+/// Блок пула памяти триангуляции
+typedef struct _pool_block
+{
+    struct _pool_block  *next;  ///< Предыдущий блок
+    size_t              size;   ///< Размер области данных
+    size_t              used;   ///< Занятая часть области данных
+} _pool_block_t;
+
+#define POOL_ALIGN      16
+#define POOL_MIN_BLOCK  (256 * 1024)
+#define POOL_HEADER     ((sizeof (_pool_block_t) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1))
+
+struct geom_triangulation
+{
+    _pool_block_t   *pool;          ///< Память Triangle, раздается последовательно и освобождается целиком
+    REAL            *points;        ///< Координаты вершин для Triangle
+    size_t          points_size;
+    int             *triangles;     ///< Треугольники пакетного вызова
+    size_t          triangles_size;
+    uint64_t        allocs;         ///< Количество выделений памяти у системы
+};
+
+static void* _pool_alloc(void *context, int size)
+{
+    geom_triangulation_t *ws = context;
+    size_t need = ((size_t)size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    _pool_block_t *block = ws->pool;
+    if (!block || block->used + need > block->size)
+    {
+        size_t block_size = block ? block->size * 2 : POOL_MIN_BLOCK;
+        if (block_size < need) block_size = need;
+        _pool_block_t *next = (_pool_block_t *)malloc(POOL_HEADER + block_size);
+        if (!next)
+            return NULL;
+        ws->allocs++;
+        next->next = block;
+        next->size = block_size;
+        next->used = 0;
+        ws->pool = block = next;
+    }
+    void *ptr = (char *)block + POOL_HEADER + block->used;
+    block->used += need;
+    return ptr;
+}
+
+// Участки пула не освобождаются по отдельности
+static void _pool_release(void *context, void *ptr)
+{
+    (void)context;
+    (void)ptr;
+}
+
+// Освобождает память пула перед следующей триангуляцией. Если ее не хватило
+// и понадобились новые блоки, они заменяются одним блоком общего размера,
+// поэтому дальше триангуляции такого же размера обходятся без обращения к системе
+static void _pool_reset(geom_triangulation_t *ws)
+{
+    _pool_block_t *block = ws->pool;
+    if (!block)
+        return;
+    if (block->next)
+    {
+        size_t total = 0;
+        while (block)
+        {
+            _pool_block_t *next = block->next;
+            total += block->size;
+            free(block);
+            block = next;
+        }
+        ws->pool = NULL;
+        _pool_alloc(ws, (int)(total < INT32_MAX ? total : INT32_MAX));
+        block = ws->pool;
+        if (!block)
+            return;
+    }
+    block->used = 0;
+}
+
+// Увеличивает массив вдвое, пока в нем не поместится count элементов
+static bool _reserve(geom_triangulation_t *ws, void **array, size_t *size, size_t count, size_t item)
+{
+    if (count <= *size)
+        return true;
+    size_t new_size = *size ? *size : 64;
+    while (new_size < count) new_size *= 2;
+    void *ptr = realloc(*array, new_size * item);
+    if (!ptr)
+        return false;
+    ws->allocs++;
+    *array = ptr;
+    *size = new_size;
+    return true;
+}
+
+geom_triangulation_t* geom_tools_triangulation_new(void)
+{
+    return (geom_triangulation_t *)calloc(1, sizeof (geom_triangulation_t));
+}
+
+void geom_tools_triangulation_free(geom_triangulation_t *ws)
+{
+    if (!ws)
+        return;
+    while (ws->pool)
+    {
+        _pool_block_t *next = ws->pool->next;
+        free(ws->pool);
+        ws->pool = next;
+    }
+    free(ws->points);
+    free(ws->triangles);
+    free(ws);
+}
+
+uint64_t geom_tools_triangulation_allocs(const geom_triangulation_t *ws)
+{
+    return ws->allocs;
+}
+
 // https://userpages.umbc.edu/~rostamia/cbook/triangle.html
-/// @return Массив номеров точек треугольников
-static void _triangle_polygon(const polygon_t polygon, int *trianglelist)
+// Триангуляция выпуклой оболочки вершин многоугольника. Вся память Triangle,
+// включая массив треугольников, берется из пула ws и действительна до
+// следующего вызова. Вызывается под _triangle_mutex
+static size_t _triangulate(geom_triangulation_t *ws, const polygon_t *polygon, const int **triangles)
 {
+    _pool_reset(ws);
+    *triangles = NULL;
+    if (polygon->point_count < 3
+        || !_reserve(ws, (void **)&ws->points, &ws->points_size, polygon->point_count * 2, sizeof (REAL)))
+        return 0;
+
+    for (size_t i = 0; i < polygon->point_count; i++)
+    {
+        ws->points[2 * i] = polygon->points[i].x;
+        ws->points[2 * i + 1] = polygon->points[i].y;
+    }
+
     struct triangulateio in;
+    memset(&in, 0, sizeof (in));
+    in.pointlist = ws->points;
+    in.numberofpoints = polygon->point_count;
+    in.trianglelist = NULL;  // Индексы точек треугольников против часовой стрелки, выделяются из пула
 
-    REAL *pointlist = (REAL *) malloc(sizeof (REAL) * polygon.point_count * 2);
-    uint64_t counter = 0;
-    for (size_t i = 0; i < polygon.point_count; i++)
-    {
-        pointlist[counter++] = polygon.points[i].x;
-        pointlist[counter++] = polygon.points[i].y;
-    }
-
-    in.pointlist = pointlist;
-    in.pointattributelist = (REAL*) NULL;
-    in.pointmarkerlist = (int *) NULL;
-    in.numberofpoints = polygon.point_count;
-    in.trianglelist = trianglelist;  // Индексы точек треугольников против часовой стрелки
-    in.numberofpointattributes = 0;
-    in.triangleattributelist = NULL;
-    in.trianglearealist = NULL;
-    in.neighborlist = NULL;
-    in.numberoftriangles = 0;
-    in.numberofcorners = 0;
-    in.numberoftriangleattributes = 0;
-    in.segmentlist = NULL;
-    in.segmentmarkerlist = NULL;
-    in.numberofsegments = 0;
-    in.holelist = NULL;
-    in.numberofholes = 0;
-    in.regionlist = NULL;
-    in.numberofregions = 0;
-    in.edgelist = NULL;
-    in.edgemarkerlist = NULL;
-    in.normlist = NULL;
-    in.numberofedges = 0;
-
-    char *triswitches = "zQ";
+    char triswitches[] = "zQ";
+    trisetallocator(_pool_alloc, _pool_release, ws);
     triangulate(triswitches, &in, &in, NULL);
-    free(pointlist);
+    trisetallocator(NULL, NULL, NULL);
+
+    *triangles = in.trianglelist;
+    return in.trianglelist ? (size_t)in.numberoftriangles : 0;
+}
+
+size_t geom_tools_triangulate(geom_triangulation_t *ws, const polygon_t *polygon, const int **triangles)
+{
+    pthread_mutex_lock(&_triangle_mutex);
+    size_t count = _triangulate(ws, polygon, triangles);
+    pthread_mutex_unlock(&_triangle_mutex);
+    return count;
+}
+
+const int* geom_tools_triangulate_polygons(geom_triangulation_t *ws, const polygon_t *const *polygons, size_t count, size_t *offsets)
+{
+    size_t total = 0;
+    pthread_mutex_lock(&_triangle_mutex);
+    for (size_t i = 0; i < count; i++)
+    {
+        const int *triangles = NULL;
+        size_t n = _triangulate(ws, polygons[i], &triangles);
+        offsets[i] = total;
+        if (n > 0 && _reserve(ws, (void **)&ws->triangles, &ws->triangles_size, 3 * (total + n), sizeof (int)))
+        {
+            memcpy(ws->triangles + 3 * total, triangles, sizeof (int) * 3 * n);
+            total += n;
+        }
+    }
+    offsets[count] = total;
+    _pool_reset(ws);
+    pthread_mutex_unlock(&_triangle_mutex);
+    return ws->triangles;
+}
+
+// Общая рабочая память прежних функций с триангуляцией, используется под _triangle_mutex
+static geom_triangulation_t *_shared_ws = NULL;
+
+static size_t _triangulate_shared(const polygon_t *polygon, const int **triangles)
+{
+    if (!_shared_ws)
+        _shared_ws = geom_tools_triangulation_new();
+    if (!_shared_ws)
+    {
+        *triangles = NULL;
+        return 0;
+    }
+    return _triangulate(_shared_ws, polygon, triangles);
 }
 
-double geom_tools_length_side(const point_t *p1, const point_t *p2)
+double geom_tools_length_side(const point_t p1, const point_t p2)
 {
-    return sqrt(pow(p1->x - p2->x, 2) + pow(p1->y - p2->y, 2));
+    return sqrt(pow(p1.x - p2.x, 2) + pow(p1.y - p2.y, 2));
+}
+
+// Удвоенная ориентированная площадь. При начале координат в p[0]
+// ребра, примыкающие к p[0], дают нулевой вклад, поэтому суммируются
+// векторные произведения соседних точек p[1]..p[n-1]
+static double _shoelace(const point_t *p, size_t n)
+{
+    if (n < 3)
+        return 0;
+
+    size_t i = 1;
+    double sum = 0;
+#if defined(__AVX__)
+    // Две точки за шаг: (x_i, y_i, x_i+1, y_i+1) * (y_i+1, x_i+1, y_i+2, x_i+2)
+    const __m256d o4 = _mm256_setr_pd(p[0].x, p[0].y, p[0].x, p[0].y);
+    __m256d acc4 = _mm256_setzero_pd();
+    for (; i + 2 < n; i += 2)
+    {
+        __m256d a = _mm256_sub_pd(_mm256_loadu_pd(&p[i].x), o4);
+        __m256d b = _mm256_sub_pd(_mm256_loadu_pd(&p[i + 1].x), o4);
+        acc4 = _mm256_add_pd(acc4, _mm256_mul_pd(a, _mm256_permute_pd(b, 0x5)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc4);
+    sum = (lanes[0] - lanes[1]) + (lanes[2] - lanes[3]);
+#endif
+#if defined(__AVX__) || defined(__SSE2__)
+    // Одна точка за шаг: (x_i, y_i) * (y_i+1, x_i+1)
+    const __m128d o2 = _mm_setr_pd(p[0].x, p[0].y);
+    __m128d acc2 = _mm_setzero_pd();
+    for (; i + 1 < n; i++)
+    {
+        __m128d a = _mm_sub_pd(_mm_loadu_pd(&p[i].x), o2);
+        __m128d b = _mm_sub_pd(_mm_loadu_pd(&p[i + 1].x), o2);
+        acc2 = _mm_add_pd(acc2, _mm_mul_pd(a, _mm_shuffle_pd(b, b, 0x1)));
+    }
+    double pair[2];
+    _mm_storeu_pd(pair, acc2);
+    sum += pair[0] - pair[1];
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float64x2_t o2 = {p[0].x, p[0].y};
+    float64x2_t acc2 = vdupq_n_f64(0);
+    for (; i + 1 < n; i++)
+    {
+        float64x2_t a = vsubq_f64(vld1q_f64(&p[i].x), o2);
+        float64x2_t b = vsubq_f64(vld1q_f64(&p[i + 1].x), o2);
+        acc2 = vfmaq_f64(acc2, a, vextq_f64(b, b, 1));
+    }
+    sum = vgetq_lane_f64(acc2, 0) - vgetq_lane_f64(acc2, 1);
+#else
+    const double ox = p[0].x, oy = p[0].y;
+    for (; i + 1 < n; i++)
+        sum += (p[i].x - ox) * (p[i + 1].y - oy) - (p[i + 1].x - ox) * (p[i].y - oy);
+#endif
+    return sum;
 }
 
 double geom_tools_area_polygon(const polygon_t polygon)
 {
-    uint64_t numberof_triangle_corner = polygon.point_count;
-    // Увеличение количества точек, до кратного трем
-    // Необходимо, потому иначе на выходе будет столько же точек, сколько на входе
-    // и для квадрата получится не два треугольника, а 1 и пара точек
-    // т.е. если количество точек не кратно трем,
-    // то последний треугольник не будет замкнут
-    if (numberof_triangle_corner % 3 != 0)
-        numberof_triangle_corner += 3 - numberof_triangle_corner % 3;
+    return fabs(_shoelace(polygon.points, polygon.point_count)) * 0.5;
+}
 
-    int *trianglelist = (int *) malloc(sizeof(int) * numberof_triangle_corner);
-    _triangle_polygon(polygon, trianglelist);
+void geom_tools_area_polygons(const polygon_t *const *polygons, size_t count, double *areas)
+{
+    for (size_t i = 0; i < count; i++)
+        areas[i] = fabs(_shoelace(polygons[i]->points, polygons[i]->point_count)) * 0.5;
+}
+
+double geom_tools_area_polygon_triangulated(const polygon_t polygon)
+{
+    pthread_mutex_lock(&_triangle_mutex);
+    const int *trianglelist = NULL;
+    size_t triangles_count = _triangulate_shared(&polygon, &trianglelist);
 
     //Вычисляем площадь по формуле S=(p(p-ab)(p-bc)(p-ca))^0.5;
     //p=(ab+bc+ca)0.5
     double areaElement = 0;
-    for (size_t i = 0; i < numberof_triangle_corner; i+=3)
+    for (size_t i = 0; i < 3 * triangles_count; i+=3)
     {
         const int ps [] = {trianglelist[i+0], trianglelist[i+1], trianglelist[i+2]};
         const point_t *a = &polygon.points[ps[0]];
         const point_t *b = &polygon.points[ps[1]];
         const point_t *c = &polygon.points[ps[2]];
-        double ab = geom_tools_length_side(a, b);
-        double bc = geom_tools_length_side(b, c);
-        double ca = geom_tools_length_side(c, a);
+        double ab = geom_tools_length_side(*a, *b);
+        double bc = geom_tools_length_side(*b, *c);
+        double ca = geom_tools_length_side(*c, *a);
         double p = (ab + bc + ca) * 0.5;
         areaElement += sqrt(p * (p - ab) * (p - bc) * (p - ca));
     }
+    pthread_mutex_unlock(&_triangle_mutex);
 
-    free(trianglelist);
     return areaElement;
 }
 
 static int _where_point(double aAx, double aAy, double aBx, double aBy, double aPx, double aPy)
 {
-    double s = (aBx - aAx) * (aPy - aAy) - (aBy - aAy) * (aPx - aAx);
+    double s = _orient(aAx, aAy, aBx, aBy, aPx, aPy);
     if (s > 0) return 1;        // Точка слева от вектора AB
     else if(s < 0) return -1;   // Точка справа от вектора AB
     else return 0;              // Точка на векторе, прямо по вектору или сзади вектора
@@ -115,37 +400,166 @@ static uint8_t _is_point_in_triangle(double aAx, double aAy, double aBx, double
     return (q1 >= 0 && q2 >= 0 && q3 >= 0);
 }
 
-uint8_t geom_tools_is_point_in_polygon(const point_t *point, const polygon_t *polygon)
+uint8_t geom_tools_is_point_in_polygon_triangulated(const point_t point, const polygon_t *polygon)
 {
-    uint64_t numberof_triangle_corner = polygon->point_count;
-    // Увеличение количества точек, до кратного трем
-    // Необходимо, потому иначе на выходе будет столько же точек, сколько на входе
-    // и для квадрата получится не два треугольника, а 1 и пара точек
-    // т.е. если количество точек не кратно трем,
-    // то последний треугольник не будет замкнут
-    if (numberof_triangle_corner % 3 != 0)
-        numberof_triangle_corner += 3 - numberof_triangle_corner % 3;
-
-    int *trianglelist = (int *) malloc(sizeof(int) * numberof_triangle_corner);
-    _triangle_polygon(*polygon, trianglelist);
+    pthread_mutex_lock(&_triangle_mutex);
+    const int *trianglelist = NULL;
+    size_t triangles_count = _triangulate_shared(polygon, &trianglelist);
 
     uint8_t result = 0;
-    for (size_t i = 0; i < numberof_triangle_corner; i += 3)
+    for (size_t i = 0; i < 3 * triangles_count; i += 3)
     {
         const point_t *a = &polygon->points[trianglelist[i+0]];
         const point_t *b = &polygon->points[trianglelist[i+1]];
         const point_t *c = &polygon->points[trianglelist[i+2]];
-        result = _is_point_in_triangle(a->x, a->y, b->x, b->y, c->x, c->y, point->x, point->y);
+        result = _is_point_in_triangle(a->x, a->y, b->x, b->y, c->x, c->y, point.x, point.y);
         if (result == 1) break;
     }
-    free(trianglelist);
+    pthread_mutex_unlock(&_triangle_mutex);
     return result;
 }
 
+// Число оборотов контура вокруг точки (winding number, алгоритм Дэна Санди).
+// Точка на ребре или в вершине считается принадлежащей многоугольнику,
+// как и в прежней проверке по треугольникам
+static uint8_t _winding(double px, double py, const point_t *points, size_t n)
+{
+    int wn = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const point_t *a = &points[i];
+        const point_t *b = &points[i + 1 < n ? i + 1 : 0];
+        double s = _orient(a->x, a->y, b->x, b->y, px, py);
+
+        if (s == 0
+            && px >= fmin(a->x, b->x) && px <= fmax(a->x, b->x)
+            && py >= fmin(a->y, b->y) && py <= fmax(a->y, b->y))
+            return 1; // Точка на ребре
+
+        if (a->y <= py)
+        {
+            if (b->y > py && s > 0) wn++;   // Ребро пересекает луч снизу вверх, точка слева
+        } else
+        {
+            if (b->y <= py && s < 0) wn--;  // Ребро пересекает луч сверху вниз, точка справа
+        }
+    }
+    return wn != 0;
+}
+
+uint8_t geom_tools_is_point_in_polygon(const point_t point, const polygon_t *polygon)
+{
+    if (polygon->point_count < 3)
+        return 0;
+    return _winding(point.x, point.y, polygon->points, polygon->point_count);
+}
+
+static void _bbox(const point_t *points, size_t n, point_t *min, point_t *max)
+{
+    *min = *max = points[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        min->x = fmin(min->x, points[i].x); max->x = fmax(max->x, points[i].x);
+        min->y = fmin(min->y, points[i].y); max->y = fmax(max->y, points[i].y);
+    }
+}
+
+static int _outside_bbox(double px, double py, const point_t *min, const point_t *max)
+{
+    return px < min->x || px > max->x || py < min->y || py > max->y;
+}
+
+void geom_tools_is_points_in_polygon(const point_t *points, size_t count, const polygon_t *polygon, uint8_t *inside)
+{
+    const point_t *p = polygon->points;
+    size_t n = polygon->point_count;
+    if (n < 3)
+    {
+        memset(inside, 0, count);
+        return;
+    }
+
+    // Габариты контура считаются один раз на весь набор точек
+    point_t min, max;
+    _bbox(p, n, &min, &max);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double px = points[i].x, py = points[i].y;
+        if (_outside_bbox(px, py, &min, &max))
+            inside[i] = 0;
+        else
+            inside[i] = _winding(px, py, p, n);
+    }
+}
+
+void geom_tools_polygon_cache_init(polygon_cache_t *cache, const polygon_t *polygon, point_t *edges)
+{
+    const point_t *p = polygon->points;
+    size_t n = polygon->point_count;
+
+    cache->polygon = polygon;
+    cache->edges = edges;
+    for (size_t i = 0; i < n; i++)
+    {
+        const point_t *b = &p[i + 1 < n ? i + 1 : 0];
+        edges[i].x = b->x - p[i].x;
+        edges[i].y = b->y - p[i].y;
+    }
+
+    if (n > 0)
+        _bbox(p, n, &cache->min, &cache->max);
+    else
+        cache->min.x = cache->min.y = cache->max.x = cache->max.y = 0;
+}
+
+// То же, что _winding, но векторы ребер уже посчитаны
+static uint8_t _winding_cached(double px, double py, const polygon_cache_t *cache)
+{
+    const point_t *points = cache->polygon->points;
+    size_t n = cache->polygon->point_count;
+    int wn = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const point_t *a = &points[i];
+        const point_t *b = &points[i + 1 < n ? i + 1 : 0];
+        const point_t *e = &cache->edges[i];
+        double bx = b->x, by = b->y;
+        double s = _robust ? _orient(a->x, a->y, bx, by, px, py) : e->x * (py - a->y) - e->y * (px - a->x);
+
+        if (s == 0
+            && px >= fmin(a->x, bx) && px <= fmax(a->x, bx)
+            && py >= fmin(a->y, by) && py <= fmax(a->y, by))
+            return 1; // Точка на ребре
+
+        if (a->y <= py)
+        {
+            if (by > py && s > 0) wn++;
+        } else
+        {
+            if (by <= py && s < 0) wn--;
+        }
+    }
+    return wn != 0;
+}
+
+uint8_t geom_tools_is_point_in_polygon_cached(const point_t point, const polygon_cache_t *cache)
+{
+    if (cache->polygon->point_count < 3 || _outside_bbox(point.x, point.y, &cache->min, &cache->max))
+        return 0;
+    return _winding_cached(point.x, point.y, cache);
+}
+
+void geom_tools_is_points_in_polygon_cached(const point_t *points, size_t count, const polygon_cache_t *cache, uint8_t *inside)
+{
+    for (size_t i = 0; i < count; i++)
+        inside[i] = geom_tools_is_point_in_polygon_cached(points[i], cache);
+}
+
 // signed area of a triangle
 static double _area(const point_t *p1, const point_t *p2, const point_t *p3)
 {
-    return (p2->x - p1->x) * (p3->y - p1->y) - (p2->y - p1->y) * (p3->x - p1->x);
+    return _orient(p1->x, p1->y, p2->x, p2->y, p3->x, p3->y);
 }
 
 static void _fswap(double *v1, double *v2)
@@ -164,31 +578,68 @@ static uint8_t _intersect_1(double a, double b, double c, double d)
 }
 
 // check if two segments intersect
-uint8_t geom_tools_is_intersect_line(const line_t *l1, const line_t *l2)
+uint8_t geom_tools_is_intersect_line(const line_t l1, const line_t l2)
 {
-    const point_t *p1 = l1->p1;
-    const point_t *p2 = l1->p2;
-    const point_t *p3 = l2->p1;
-    const point_t *p4 = l2->p2;
+    const point_t *p1 = &l1.p1;
+    const point_t *p2 = &l1.p2;
+    const point_t *p3 = &l2.p1;
+    const point_t *p4 = &l2.p2;
     return _intersect_1(p1->x, p2->x, p3->x, p4->x)
         && _intersect_1(p1->y, p2->y, p3->y, p4->y)
         && _area(p1, p2, p3) * _area(p1, p2, p4) <= 0
         && _area(p3, p4, p1) * _area(p3, p4, p2) <= 0;
 }
 
+size_t geom_tools_intersected_edges(const polygon_cache_t *cache, const line_t line, size_t *last)
+{
+    const point_t *p1 = &line.p1;
+    const point_t *p2 = &line.p2;
+    point_t lmin = {fmin(p1->x, p2->x), fmin(p1->y, p2->y)};
+    point_t lmax = {fmax(p1->x, p2->x), fmax(p1->y, p2->y)};
+
+    if (lmax.x < cache->min.x || lmin.x > cache->max.x || lmax.y < cache->min.y || lmin.y > cache->max.y)
+        return 0;
+
+    const point_t *points = cache->polygon->points;
+    size_t n = cache->polygon->point_count;
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const point_t *a = &points[i];
+        const point_t *e = &cache->edges[i];
+        if (e->x == 0 && e->y == 0)
+            continue;
+
+        const point_t *b = &points[i + 1 < n ? i + 1 : 0];
+        if (fmax(a->x, b->x) < lmin.x || fmin(a->x, b->x) > lmax.x
+            || fmax(a->y, b->y) < lmin.y || fmin(a->y, b->y) > lmax.y)
+            continue;
+
+        // Те же знаки площадей, что и в geom_tools_is_intersect_line
+        double s1 = _robust ? _orient(a->x, a->y, b->x, b->y, p1->x, p1->y) : e->x * (p1->y - a->y) - e->y * (p1->x - a->x);
+        double s2 = _robust ? _orient(a->x, a->y, b->x, b->y, p2->x, p2->y) : e->x * (p2->y - a->y) - e->y * (p2->x - a->x);
+        if (_area(p1, p2, a) * _area(p1, p2, b) <= 0 && s1 * s2 <= 0)
+        {
+            *last = i;
+            count++;
+        }
+    }
+    return count;
+}
+
 // Определение точки на линии, расстояние до которой от заданной точки является минимальным из существующих
-point_t *geom_tools_nearest_point(const point_t *point_start, const line_t *line)
+point_t geom_tools_nearest_point(const point_t point_start, const line_t line)
 {
-    point_t a = {line->p1->x, line->p1->y};
-    point_t b = {line->p2->x, line->p2->y};
+    point_t a = line.p1;
+    point_t b = line.p2;
 
-    if (geom_tools_length_side(&a, &b) < 1e-9)
+    if (geom_tools_length_side(a, b) < 1e-9)
     {
-        return line->p1;
+        return a;
     }
 
-    double A = point_start->x - a.x;
-    double B = point_start->y - a.y;
+    double A = point_start.x - a.x;
+    double B = point_start.y - a.y;
     double C = b.x - a.x;
     double D = b.y - a.y;
 
@@ -217,9 +668,7 @@ point_t *geom_tools_nearest_point(const point_t *point_start, const line_t *line
         yy = a.y + param * D;
     }
 
-    point_t *point_end = (point_t *) malloc(sizeof (point_t));
-    point_end->x = xx;
-    point_end->y = yy;
+    point_t point_end = {xx, yy};
     return point_end;
 }
 
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <math.h>
+#include <stdbool.h>
 
 typedef struct
 {
@@ -27,10 +28,12 @@ typedef struct
     double y;
 } point_t;
 
+/// Отрезок. Точки хранятся по значению, поэтому отрезок можно возвращать
+/// из функций и хранить на стеке без выделения памяти
 typedef struct
 {
-    point_t *p1;
-    point_t *p2;
+    point_t p1;
+    point_t p2;
 } line_t;
 
 typedef struct
@@ -45,10 +48,222 @@ typedef struct
     point_t *points;
 } polygon_t;
 
+/// Данные многоугольника для повторных запросов к нему: габаритный
+/// прямоугольник и векторы ребер. Заполняются geom_tools_polygon_cache_init
+typedef struct
+{
+    const polygon_t *polygon;   ///< Исходный многоугольник
+    point_t         *edges;     ///< Векторы ребер: edges[i] = points[i+1] - points[i],
+                                ///< последнее ребро замыкает контур
+    point_t         min;        ///< Левый нижний угол габаритного прямоугольника
+    point_t         max;        ///< Правый верхний угол габаритного прямоугольника
+} polygon_cache_t;
+
+/*!
+Включает режим точных геометрических предикатов
+
+Проверки взаимного расположения точек и отрезков (принадлежность точки
+многоугольнику, пересечение отрезков) сводятся к знаку векторного
+произведения. В обычном режиме оно вычисляется в double, и для почти
+коллинеарных точек (дверь на стене помещения) знак может оказаться
+неверным. В режиме точных предикатов знак, который погрешность может
+изменить, уточняется адаптивной арифметикой Triangle. Остальные
+вычисления выполняются как обычно, поэтому в большинстве случаев режим
+не замедляет работу. Режим общий для всех потоков, переключать его
+следует до начала вычислений
+
+\param[in] robust true -- точные предикаты, false -- вычисления в double (по умолчанию)
+*/
+void    geom_tools_set_robust          (bool robust);
+
+/// Включен ли режим точных предикатов
+bool    geom_tools_get_robust          (void);
+
+/*!
+Ориентация тройки точек с точным знаком независимо от режима
+
+\param[in] a Первая точка
+\param[in] b Вторая точка
+\param[in] c Третья точка
+\returns Удвоенная ориентированная площадь треугольника abc: > 0 при обходе
+         против часовой стрелки, < 0 -- по часовой, 0 -- точки на одной прямой
+*/
+double  geom_tools_orient2d            (const point_t a, const point_t b, const point_t c);
+
+/*!
+Площадь многоугольника по формуле Гаусса (shoelace)
+
+Работает за O(n) без выделения памяти. Первая точка может быть повторена
+в конце контура. Координаты отсчитываются от первой точки, что уменьшает
+потерю точности для удаленных от начала координат зданий.
+Для x86 (SSE2/AVX) и ARM (NEON) суммирование векторизовано
+
+\param[in] polygon Многоугольник без самопересечений
+\returns Площадь
+*/
 double  geom_tools_area_polygon        (const polygon_t polygon);
-uint8_t geom_tools_is_point_in_polygon (const point_t *point, const polygon_t *polygon);
-uint8_t geom_tools_is_intersect_line   (const line_t *l1, const line_t *l2);
-double  geom_tools_length_side         (const point_t *p1, const point_t *p2);
-point_t *geom_tools_nearest_point      (const point_t *point_start, const line_t *line);
+
+/*!
+Площади набора многоугольников, например всех зон этажа
+
+\param[in]  polygons   Массив указателей на многоугольники
+\param[in]  count      Количество многоугольников
+\param[out] areas      Массив площадей (count элементов)
+*/
+void    geom_tools_area_polygons       (const polygon_t *const *polygons, size_t count, double *areas);
+
+/*!
+Площадь многоугольника через триангуляцию (Triangle) и формулу Герона
+
+Прежний способ вычисления площади, оставлен для проверки и сравнения.
+Триангулируется выпуклая оболочка точек, поэтому результат верен только
+для выпуклых многоугольников
+*/
+double  geom_tools_area_polygon_triangulated(const polygon_t polygon);
+
+/*!
+Принадлежность точки многоугольнику по числу оборотов (winding number)
+
+Работает за O(n) без триангуляции и выделения памяти, подходит для
+невыпуклых контуров. Точка на границе считается принадлежащей многоугольнику
+
+\param[in] point   Точка
+\param[in] polygon Многоугольник, первая точка может быть повторена в конце
+\returns 1, если точка внутри или на границе, иначе 0
+*/
+uint8_t geom_tools_is_point_in_polygon (const point_t point, const polygon_t *polygon);
+
+/*!
+Принадлежность набора точек одному многоугольнику, например всех вершин проема
+
+Точки вне габаритного прямоугольника многоугольника отсекаются без обхода ребер
+
+\param[in]  points  Массив точек
+\param[in]  count   Количество точек
+\param[in]  polygon Многоугольник
+\param[out] inside  Результат для каждой точки (count элементов): 1 внутри или на границе, 0 снаружи
+*/
+void    geom_tools_is_points_in_polygon(const point_t *points, size_t count, const polygon_t *polygon, uint8_t *inside);
+
+/*!
+Заполняет данные многоугольника для повторных запросов
+
+Память под векторы ребер выделяет вызывающая сторона, чтобы данные
+всех зон здания можно было разместить одним блоком
+
+\param[out] cache   Данные многоугольника
+\param[in]  polygon Многоугольник, должен существовать, пока используется cache
+\param[in]  edges   Массив для векторов ребер (polygon->point_count элементов)
+*/
+void    geom_tools_polygon_cache_init  (polygon_cache_t *cache, const polygon_t *polygon, point_t *edges);
+
+/*!
+То же, что geom_tools_is_point_in_polygon, но с отсечением по габаритному
+прямоугольнику и готовыми векторами ребер
+*/
+uint8_t geom_tools_is_point_in_polygon_cached (const point_t point, const polygon_cache_t *cache);
+
+/*!
+То же, что geom_tools_is_points_in_polygon, но с готовыми данными многоугольника
+*/
+void    geom_tools_is_points_in_polygon_cached(const point_t *points, size_t count, const polygon_cache_t *cache, uint8_t *inside);
+
+/*!
+Поиск ребер многоугольника, которые пересекает отрезок
+
+Отрезок и ребра сначала сравниваются по габаритным прямоугольникам.
+Вырожденные ребра (в том числе замыкающее ребро контура, в котором
+первая точка повторена в конце) не учитываются
+
+\param[in]  cache   Данные многоугольника
+\param[in]  line    Отрезок
+\param[out] last    Номер последнего пересеченного ребра: ребро соединяет
+                    точки last и last + 1 (по модулю количества точек)
+\returns Количество пересеченных ребер
+*/
+size_t  geom_tools_intersected_edges   (const polygon_cache_t *cache, const line_t line, size_t *last);
+
+/*!
+Принадлежность точки многоугольнику через триангуляцию (Triangle)
+
+Прежний способ, оставлен для проверки и сравнения. Проверяется выпуклая
+оболочка точек, и, как у geom_tools_area_polygon_triangulated, результат
+верен только для выпуклых многоугольников
+*/
+uint8_t geom_tools_is_point_in_polygon_triangulated(const point_t point, const polygon_t *polygon);
+
+/// Рабочая память триангуляции
+typedef struct geom_triangulation geom_triangulation_t;
+
+/*!
+Создает рабочую память для повторных триангуляций
+
+Память, которую Triangle выделяет при каждом вызове (вершины, треугольники,
+служебные структуры), берется из пула рабочей памяти и возвращается в него
+целиком перед следующим вызовом. Пул растет до размера самой большой
+триангуляции, после этого триангуляции не обращаются к системному
+распределителю памяти
+
+\returns Рабочая память или NULL
+*/
+geom_triangulation_t* geom_tools_triangulation_new(void);
+
+/// Освобождает рабочую память триангуляции
+void    geom_tools_triangulation_free  (geom_triangulation_t *ws);
+
+/// Количество выделений памяти у системы за время жизни рабочей памяти
+uint64_t geom_tools_triangulation_allocs(const geom_triangulation_t *ws);
+
+/*!
+Триангуляция выпуклой оболочки вершин многоугольника (Triangle, ключи "zQ")
+
+\param[in]  ws        Рабочая память
+\param[in]  polygon   Многоугольник
+\param[out] triangles Номера вершин треугольников (по три на треугольник, против
+                      часовой стрелки). Массив принадлежит ws и действителен
+                      до следующего вызова с этой рабочей памятью
+\returns Количество треугольников
+*/
+size_t  geom_tools_triangulate         (geom_triangulation_t *ws, const polygon_t *polygon, const int **triangles);
+
+/*!
+Триангуляция набора многоугольников
+
+\param[in]  ws       Рабочая память
+\param[in]  polygons Массив указателей на многоугольники
+\param[in]  count    Количество многоугольников
+\param[out] offsets  Номер первого треугольника каждого многоугольника (count + 1 элементов):
+                     треугольники многоугольника i -- [offsets[i], offsets[i + 1])
+\returns Номера вершин треугольников, по три на треугольник. Массив принадлежит ws
+         и действителен до следующего вызова с этой рабочей памятью
+*/
+const int* geom_tools_triangulate_polygons(geom_triangulation_t *ws, const polygon_t *const *polygons, size_t count, size_t *offsets);
+
+/*!
+Проверка пересечения двух отрезков, касание считается пересечением
+
+\param[in] l1 Первый отрезок
+\param[in] l2 Второй отрезок
+\returns 1, если отрезки пересекаются, иначе 0
+*/
+uint8_t geom_tools_is_intersect_line   (const line_t l1, const line_t l2);
+
+/*!
+Расстояние между двумя точками
+
+\param[in] p1 Первая точка
+\param[in] p2 Вторая точка
+\returns Длина отрезка p1p2
+*/
+double  geom_tools_length_side         (const point_t p1, const point_t p2);
+
+/*!
+Ближайшая к заданной точка отрезка
+
+\param[in] point_start Точка
+\param[in] line        Отрезок. Если его длина меньше 1e-9, возвращается line.p1
+\returns Точка отрезка, расстояние до которой от point_start минимально
+*/
+point_t geom_tools_nearest_point       (const point_t point_start, const line_t line);
 
 #endif //BIM_POLYGON_TOOLS_H
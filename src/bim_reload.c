@@ -0,0 +1,233 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Повторная загрузка модели здания после правки файла.
+ *
+ * Файл разбирается заново (разбор занимает малую часть времени создания
+ * модели), а дорогие геометрические расчеты выполняются только для
+ * изменившихся элементов. Элементы старой и новой модели сопоставляются
+ * по UUID, изменение геометрии определяется по отпечатку полигона
+ * (bim_json_element_t.digest):
+ *  - площадь зоны берется из старой модели, если у зоны с тем же UUID
+ *    тот же отпечаток;
+ *  - ширина перехода берется из старой модели, если совпадают отпечаток
+ *    перехода, список соседних зон (по UUID) и их отпечатки.
+ * Граф строится по новой модели целиком (bim_graph_new), это линейный
+ * проход по связям без геометрии.
+ */
+
+#include "bim_tools.h"
+#include "bim_uuid_table.h"
+
+bim_t* _bim_tools_build(bim_json_object_t *bim_json, bool keep_geometry, const bim_t *prev, uint64_t *reused);
+
+/// Элементы предыдущей модели, доступные по UUID
+typedef struct
+{
+    bim_uuid_table_t            *uuids;         ///< UUID элементов предыдущей модели
+    uint32_t                    count;          ///< Количество UUID предыдущей модели
+    const bim_json_element_t    **elements;     ///< Элемент по номеру в uuids
+    const bim_zone_t            **zones;        ///< Зона по номеру в uuids
+    const bim_transit_t         **transits;     ///< Переход по номеру в uuids
+    const bim_json_element_t    **by_handle;    ///< Элемент по номеру UUID в предыдущей модели
+} _index_t;
+
+static uint64_t _mix(uint64_t h, uint64_t value)
+{
+    h ^= value;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+uint64_t _element_digest(const bim_json_element_t *element)
+{
+    uint64_t h = _mix(0xCBF29CE484222325ULL, element->sign);
+    const polygon_t *polygon = element->polygon;
+    if (polygon)
+    {
+        h = _mix(h, polygon->point_count);
+        for (size_t i = 0; i < polygon->point_count; i++)
+        {
+            uint64_t x, y;
+            memcpy(&x, &polygon->points[i].x, sizeof (x));
+            memcpy(&y, &polygon->points[i].y, sizeof (y));
+            h = _mix(_mix(h, x), y);
+        }
+    }
+    return h ? h : 1; // 0 означает, что отпечаток не вычислен
+}
+
+static int _index_new(_index_t *index, const bim_t *prev)
+{
+    const bim_json_object_t *json = prev->json;
+    uint64_t elements_count = 0;
+    for (size_t i = 0; i < json->levels_count; i++)
+        elements_count += json->levels[i].elements_count;
+
+    memset(index, 0, sizeof (*index));
+    index->uuids = bim_uuid_table_new(elements_count);
+    index->elements = (const bim_json_element_t **)calloc(elements_count + 1, sizeof (bim_json_element_t *));
+    index->zones = (const bim_zone_t **)calloc(elements_count + 1, sizeof (bim_zone_t *));
+    index->transits = (const bim_transit_t **)calloc(elements_count + 1, sizeof (bim_transit_t *));
+    index->by_handle = (const bim_json_element_t **)calloc(json->handles_count + 1, sizeof (bim_json_element_t *));
+    if (!index->uuids || !index->elements || !index->zones || !index->transits || !index->by_handle)
+        return -1;
+
+    for (size_t i = 0; i < json->levels_count; i++)
+    {
+        for (size_t j = 0; j < json->levels[i].elements_count; j++)
+        {
+            const bim_json_element_t *element = &json->levels[i].elements[j];
+            uint32_t h = bim_uuid_table_intern(index->uuids, element->uuid);
+            if (h < elements_count && !index->elements[h]) index->elements[h] = element;
+            if (element->handle < json->handles_count && !index->by_handle[element->handle])
+                index->by_handle[element->handle] = element;
+        }
+    }
+    index->count = bim_uuid_table_count(index->uuids);
+
+    for (size_t i = 0; i < prev->zones->length; i++)
+    {
+        const bim_zone_t *zone = prev->zones->data[i];
+        uint32_t h = bim_uuid_table_find(index->uuids, zone->base->uuid);
+        if (h < index->count && index->elements[h] == zone->base) index->zones[h] = zone;
+    }
+    for (size_t i = 0; i < prev->transits->length; i++)
+    {
+        const bim_transit_t *transit = prev->transits->data[i];
+        uint32_t h = bim_uuid_table_find(index->uuids, transit->base->uuid);
+        if (h < index->count && index->elements[h] == transit->base) index->transits[h] = transit;
+    }
+    return 0;
+}
+
+static void _index_free(_index_t *index)
+{
+    bim_uuid_table_free(index->uuids);
+    free(index->elements);
+    free(index->zones);
+    free(index->transits);
+    free(index->by_handle);
+}
+
+// Номер элемента предыдущей модели с тем же UUID или BIM_UUID_HANDLE_NONE
+static uint32_t _find(const _index_t *index, const char *uuid)
+{
+    uint32_t h = bim_uuid_table_find(index->uuids, uuid);
+    return h < index->count ? h : BIM_UUID_HANDLE_NONE;
+}
+
+static bool _same_geometry(const bim_json_element_t *e1, const bim_json_element_t *e2)
+{
+    return e1 && e2 && e1->digest && e1->digest == e2->digest;
+}
+
+// Совпадают ли соседи перехода в обеих моделях
+static bool _same_neighbours(const bim_json_element_t *transit, const bim_json_element_t **by_handle, uint32_t handles_count,
+                             const bim_json_element_t *prev_transit, const _index_t *index, uint32_t prev_handles_count)
+{
+    if (transit->outputs_count != prev_transit->outputs_count)
+        return false;
+
+    for (size_t k = 0; k < transit->outputs_count; k++)
+    {
+        uint32_t h1 = transit->outputs[k], h2 = prev_transit->outputs[k];
+        const bim_json_element_t *e1 = h1 < handles_count ? by_handle[h1] : NULL;
+        const bim_json_element_t *e2 = h2 < prev_handles_count ? index->by_handle[h2] : NULL;
+        if (!_same_geometry(e1, e2) || strcmp(e1->uuid, e2->uuid) != 0)
+            return false;
+    }
+    return true;
+}
+
+uint64_t _reuse_derived(bim_t *bim, const bim_t *prev)
+{
+    _index_t index;
+    if (_index_new(&index, prev) != 0)
+    {
+        _index_free(&index);
+        return 0;
+    }
+
+    const bim_json_object_t *json = bim->json;
+    const bim_json_element_t **by_handle = (const bim_json_element_t **)calloc(json->handles_count + 1, sizeof (bim_json_element_t *));
+    if (!by_handle)
+    {
+        _index_free(&index);
+        return 0;
+    }
+    for (size_t i = 0; i < json->levels_count; i++)
+        for (size_t j = 0; j < json->levels[i].elements_count; j++)
+        {
+            const bim_json_element_t *element = &json->levels[i].elements[j];
+            if (element->handle < json->handles_count && !by_handle[element->handle])
+                by_handle[element->handle] = element;
+        }
+
+    uint64_t reused = 0;
+    for (size_t i = 0; i < bim->zones->length; i++)
+    {
+        bim_zone_t *zone = bim->zones->data[i];
+        uint32_t h = _find(&index, zone->base->uuid);
+        if (h == BIM_UUID_HANDLE_NONE || !index.zones[h] || !_same_geometry(zone->base, index.zones[h]->base))
+            continue;
+        zone->area = index.zones[h]->area;
+        reused++;
+    }
+
+    for (size_t i = 0; i < bim->transits->length; i++)
+    {
+        bim_transit_t *transit = bim->transits->data[i];
+        uint32_t h = _find(&index, transit->base->uuid);
+        if (h == BIM_UUID_HANDLE_NONE || !index.transits[h] || !_same_geometry(transit->base, index.transits[h]->base)
+            || !_same_neighbours(transit->base, by_handle, json->handles_count,
+                                 index.transits[h]->base, &index, prev->json->handles_count))
+            continue;
+        transit->width = index.transits[h]->width;
+        reused++;
+    }
+
+    free(by_handle);
+    _index_free(&index);
+    return reused;
+}
+
+bim_t* bim_tools_reload(bim_t *bim, const char *file, uint64_t *recomputed)
+{
+    bim_t *next = NULL;
+    uint64_t reused = 0;
+    if (bim_tools_is_mapped_file(file))
+    {
+        // В кэше площади и ширины уже вычислены
+        next = bim_tools_open_mapped(file);
+        if (next) reused = next->zones->length - 1 + next->transits->length;
+    } else
+    {
+        bim_json_object_t *json = bim_json_new_parallel(file, bim_tools_get_threads());
+        if (!json)
+        {
+            LOG_ERROR("Не удалось заполнить структуру `bim_t`");
+            return NULL;
+        }
+        next = _bim_tools_build(json, bim_tools_get_keep_geometry(), bim, &reused);
+    }
+    if (!next)
+        return NULL;
+
+    if (recomputed) *recomputed = next->zones->length - 1 + next->transits->length - reused;
+    bim_tools_free(bim);
+    return next;
+}
@@ -14,21 +14,49 @@
  */
 
 #include "bim_tools.h"
+#include "bim_parallel.h"
+#include "bim_index.h"
+
+static uint32_t _threads = 1;           // Количество потоков загрузки модели
+static bool     _keep_geometry = true;  // Сохранять полигоны после создания модели
+static bim_topology_mode_t _topology = BIM_TOPOLOGY_OFF; // Восстановление связей по геометрии
 
 void        _list_sort      (ArrayList *list, ArrayListCompareFunc compare_func);
-int32_t     _id_cmp         (const ArrayListValue value1, const ArrayListValue value2);
+int32_t     _zone_id_cmp    (const ArrayListValue value1, const ArrayListValue value2);
+int32_t     _transit_id_cmp (const ArrayListValue value1, const ArrayListValue value2);
 bim_zone_t* _outside_init   (const bim_json_object_t *bim_json);
-int         _calculate_transits_width(ArrayList *zones, ArrayList *transits);
+int         _calculate_transits_width(ArrayList *zones, ArrayList *transits, uint32_t handles_count);
+void        _mapped_close  (bim_t *bim);
+void        _level_derive  (void *ctx, size_t index, uint32_t worker);
+void        _level_index   (void *ctx, size_t index, uint32_t worker);
+bim_t*      _bim_tools_new (const char *file, bool keep_geometry);
+bim_t*      _bim_tools_build(bim_json_object_t *bim_json, bool keep_geometry, const bim_t *prev, uint64_t *reused);
+uint64_t    _element_digest(const bim_json_element_t *element);
+uint64_t    _reuse_derived (bim_t *bim, const bim_t *prev);
+int64_t     _derive_topology(bim_t *bim, bool rewrite);
 
 bim_t* bim_tools_new(const char* file)
 {
-    bim_json_object_t *bim_json = bim_json_new(file);
+    return _bim_tools_new(file, _keep_geometry);
+}
+
+bim_t* _bim_tools_new(const char *file, bool keep_geometry)
+{
+    bim_json_object_t *bim_json = bim_json_new_parallel(file, _threads);
     if (!bim_json)
     {
         LOG_ERROR("Не удалось заполнить структуру `bim_t`");
         return NULL;
     }
 
+    return _bim_tools_build(bim_json, keep_geometry, NULL, NULL);
+}
+
+// Строит модель по разобранному файлу. Если задана предыдущая модель,
+// площади и ширины неизменившихся элементов берутся из нее (см. bim_reload.c),
+// их количество возвращается в reused
+bim_t* _bim_tools_build(bim_json_object_t *bim_json, bool keep_geometry, const bim_t *prev, uint64_t *reused)
+{
     ArrayList *zones_list = arraylist_new(1);
     ArrayList *transits_list = arraylist_new(1);
 
@@ -36,6 +64,9 @@ bim_t* bim_tools_new(const char* file)
     bim->transits = transits_list;
     bim->zones = zones_list;
     bim->json = bim_json;
+    bim->edges = NULL;
+    bim->mapped = NULL;
+    bim->mapped_size = 0;
 
     bim_object_t *bim_object = (bim_object_t *)malloc(sizeof (bim_object_t));
     if (!bim_object)
@@ -56,6 +87,7 @@ bim_t* bim_tools_new(const char* file)
     {
         level_ext->name = strdup(level->name);
         level_ext->z_level = level->z_level;
+        level_ext->index = NULL;
 
         bim_zone_t *zones = (bim_zone_t *) malloc(sizeof (bim_zone_t) * level->elements_count);
         bim_transit_t *transits = (bim_transit_t *) malloc(sizeof (bim_transit_t) * level->elements_count);
@@ -65,13 +97,18 @@ bim_t* bim_tools_new(const char* file)
         bim_json_element_t *element = level->elements;
         for(size_t j = 0; j < level->elements_count; j++, element++)
         {
+            element->digest = _element_digest(element);
             if (element->sign == ROOM || element->sign == STAIR)
             {
                 zones->base = element;
+                zones->id = element->id;
+                zones->sign = element->sign;
+                zones->z_level = element->z_level;
+                zones->outputs_count = element->outputs_count;
                 zones->is_blocked = false;
                 zones->is_visited = false;
                 zones->potential = __FLT_MAX__;
-                zones->area = geom_tools_area_polygon(*element->polygon);
+                zones->area = -1; // Calculated below
                 zones->num_of_people = element->numofpeople;
                 arraylist_append(zones_list, zones);
                 zones++;
@@ -91,7 +128,7 @@ bim_t* bim_tools_new(const char* file)
         level_ext->transit_count = transits - level_ext->transits;
 
         if (level_ext->zone_count == 0 || level_ext->transit_count == 0)
-            fprintf(stderr, "[func: %s() | line: %u] :: zone_count (%u) or transit_count (%u) is zero\n", __func__, __LINE__, level_ext->zone_count, level_ext->transit_count);
+            fprintf(stderr, "[func: %s() | line: %u] :: zone_count (%lu) or transit_count (%lu) is zero\n", __func__, __LINE__, level_ext->zone_count, level_ext->transit_count);
         else
         {
             level_ext->zones = (bim_zone_t*)realloc(level_ext->zones, sizeof (bim_zone_t) * level_ext->zone_count);
@@ -99,55 +136,91 @@ bim_t* bim_tools_new(const char* file)
         }
     }
 
+    uint64_t reused_count = prev ? _reuse_derived(bim, prev) : 0;
+    if (reused) *reused = reused_count;
+
+    // Этажи независимы, площади их зон и индексы вычисляются параллельно
+    bim_parallel_for(_threads, bim_object->levels_count, _level_derive, bim_object);
+    for (size_t i = 0; i < bim_object->levels_count; i++)
+        for (size_t j = 0; j < bim_object->levels[i].zone_count; j++)
+        {
+            const bim_zone_t *zone = &bim_object->levels[i].zones[j];
+            if (zone->area < 0)
+                LOG_ERROR("Не удалось вычислить площадь зоны: %s (%s)", zone->base->name, zone->base->uuid);
+        }
+    if (keep_geometry || _topology != BIM_TOPOLOGY_OFF)
+        bim_parallel_for(_threads, bim_object->levels_count, _level_index, bim_object);
+
+    // Связи переходов проверяются до построения зоны вне здания и вычисления ширин,
+    // которые от них зависят
+    if (_topology != BIM_TOPOLOGY_OFF && _derive_topology(bim, _topology == BIM_TOPOLOGY_REWRITE) < 0)
+    {
+        LOG_ERROR("Не удалось восстановить связи переходов");
+        for (size_t i = 0; i < bim_object->levels_count; i++)
+        {
+            free(bim_object->levels[i].name);
+            free(bim_object->levels[i].zones);
+            free(bim_object->levels[i].transits);
+            bim_index_free(bim_object->levels[i].index);
+        }
+        free(bim_object->levels);
+        free(bim_object->name);
+        free(bim_object);
+        bim_json_free(bim_json);
+        arraylist_free(zones_list);
+        arraylist_free(transits_list);
+        free(bim);
+        return NULL;
+    }
+
     bim_object->outside = _outside_init(bim_json);
     arraylist_append(zones_list, bim_object->outside);
 
-    arraylist_sort(zones_list, _id_cmp);
-    arraylist_sort(transits_list, _id_cmp);
+    _list_sort(zones_list, _zone_id_cmp);
+    _list_sort(transits_list, _transit_id_cmp);
+
+    _calculate_transits_width(zones_list, transits_list, bim_json->handles_count);
 
-    _calculate_transits_width(zones_list, transits_list);
+    if (!keep_geometry)
+    {
+        for (size_t i = 0; i < bim_object->levels_count; i++)
+        {
+            bim_index_free(bim_object->levels[i].index);
+            bim_object->levels[i].index = NULL;
+        }
+        bim_json_release_geometry(bim_json);
+    }
 
     return bim;
 }
 
-int _find_zone_callback(ArrayListValue value1, ArrayListValue value2)
+/// Зона и данные ее многоугольника для вычисления ширины проемов
+typedef struct
 {
-    const bim_zone_t *zone = value1;
-    char * uuid = value2;
-
-    if (strcmp(zone->base->uuid, uuid) == 0) return 1;
-    else return 0;
-
-}
+    const bim_zone_t    *zone;
+    polygon_cache_t     cache;  ///< Заполняется при первом обращении (cache.polygon != NULL)
+} _zone_geometry_t;
 
-line_t* _intersected_edge(const polygon_t *aPolygonElement, const line_t *aLine)
+// Ребро зоны, которое пересекает отрезок. Если таких ребер несколько, берется последнее
+// Возвращает количество пересеченных ребер, edge заполняется, если оно больше нуля
+size_t _intersected_edge(const polygon_cache_t *zone, const line_t aLine, line_t *edge)
 {
-    line_t *line = (line_t *)malloc(sizeof (line_t));
-    line->p1 = (point_t *)malloc(sizeof (point_t));
-    line->p2 = (point_t *)malloc(sizeof (point_t));
-
-    uint8_t numOfIntersect = 0;
-    for (size_t i = 1; i < aPolygonElement->point_count; ++i)
+    size_t last = 0;
+    size_t numOfIntersect = geom_tools_intersected_edges(zone, aLine, &last);
+    if (numOfIntersect > 0)
     {
-        point_t *pointElementA = &aPolygonElement->points[i-1];
-        point_t *pointElementB = &aPolygonElement->points[i];
-        line_t line_tmp = {pointElementA, pointElementB};
-        bool isIntersect = geom_tools_is_intersect_line(aLine, &line_tmp);
-        if (isIntersect)
-        {
-            line->p1 = pointElementA;
-            line->p2 = pointElementB;
-            numOfIntersect++;
-        }
+        const point_t *points = zone->polygon->points;
+        edge->p1 = points[last];
+        edge->p2 = points[last + 1 < zone->polygon->point_count ? last + 1 : 0];
     }
 
     if (numOfIntersect != 1)
         fprintf(stderr, "[func: %s() | line: %u] :: Ошибка геометрии. Проверьте правильность ввода дверей и вирутальных проемов.\n", __func__, __LINE__);
 
-    return line;
+    return numOfIntersect;
 }
 
-double _width_door_way(const polygon_t *zone1, const polygon_t *zone2, const multiline_t *edge1, const multiline_t *edge2)
+double _width_door_way(const polygon_cache_t *zone1, const polygon_cache_t *zone2, const multiline_t *edge1, const multiline_t *edge2)
 {
     /*
      * Возможные варианты стыковки помещений, которые соединены проемом
@@ -172,129 +245,278 @@ double _width_door_way(const polygon_t *zone1, const polygon_t *zone2, const mul
 
     point_t l1p1 = edge1->points[0];
     point_t l1p2 = edge2->points[0];
-    double length1 = geom_tools_length_side(&l1p1, &l1p2);
+    double length1 = geom_tools_length_side(l1p1, l1p2);
 
     point_t l2p1 = edge1->points[0];
     point_t l2p2 = edge2->points[1];
-    double length2 = geom_tools_length_side(&l2p1, &l2p2);
+    double length2 = geom_tools_length_side(l2p1, l2p2);
 
     // Короткая линия проема, которая пересекает оба помещения
-    line_t dline = {NULL, NULL};
-    if (length1 >= length2)
-    {
-        dline.p1 = &l2p1;
-        dline.p2 = &l2p2;
-    } else
-    {
-        dline.p1 = &l1p1;
-        dline.p2 = &l1p2;
-    }
+    line_t dline = length1 >= length2 ? (line_t){l2p1, l2p2} : (line_t){l1p1, l1p2};
 
     // Линии, которые находятся друг напротив друга и связаны проемом
-    line_t *edgeElementA = _intersected_edge(zone1, &dline);
-    line_t *edgeElementB = _intersected_edge(zone2, &dline);
+    line_t edgeElementA, edgeElementB;
+    if (!_intersected_edge(zone1, dline, &edgeElementA) || !_intersected_edge(zone2, dline, &edgeElementB))
+        return -1;
+
     // Поиск точек, которые являются ближайшими к отрезку edgeElement
     // Расстояние между этими точками и является шириной проема
-    point_t *pt1 = geom_tools_nearest_point(edgeElementA->p1, edgeElementB);
-    point_t *pt2 = geom_tools_nearest_point(edgeElementA->p2, edgeElementB);
+    point_t pt1 = geom_tools_nearest_point(edgeElementA.p1, edgeElementB);
+    point_t pt2 = geom_tools_nearest_point(edgeElementA.p2, edgeElementB);
     double d12 = geom_tools_length_side(pt1, pt2);
 
-    point_t *pt3 = geom_tools_nearest_point(edgeElementB->p1, edgeElementA);
-    point_t *pt4 = geom_tools_nearest_point(edgeElementB->p2, edgeElementA);
+    point_t pt3 = geom_tools_nearest_point(edgeElementB.p1, edgeElementA);
+    point_t pt4 = geom_tools_nearest_point(edgeElementB.p2, edgeElementA);
     double d34 = geom_tools_length_side(pt3, pt4);
 
-    free(edgeElementA); free(edgeElementB);
-    free(pt1); free(pt2); free(pt3); free(pt4);
-
     return (d12 + d34) / 2;
 }
 
-// Вычисление ширины проема по данным из модели здания
-int _calculate_transits_width(ArrayList *zones,    // Список всех зон
-                              ArrayList *transits) // Список всех переходов
+/// Результат вычисления ширины одного проема
+typedef enum
 {
-    for (size_t i = 0; i < transits->length; i++)
+    _WIDTH_OK = 0,
+    _WIDTH_NO_ZONE,     ///< Не найдена зона, соединенная с проемом
+    _WIDTH_NO_EDGES     ///< Вершины проема не делятся между зонами по две
+} _width_status_t;
+
+/// Общие данные параллельного вычисления ширины проемов
+typedef struct
+{
+    ArrayList           *zones;
+    ArrayList           *transits;
+    _zone_geometry_t    *geometries;
+    _zone_geometry_t    **zone_by_handle;
+    point_t             *edges;
+    size_t              *edges_begin;   ///< Начало векторов ребер зоны в edges
+    uint8_t             *status;        ///< _width_status_t каждого проема
+    uint32_t            handles_count;
+} _width_ctx_t;
+
+// Проемы раздаются потокам блоками, чтобы потоки реже обращались к общему счетчику
+#define WIDTH_BLOCK 64
+
+// Данные многоугольников блока зон
+void _zones_cache(void *ctx, size_t index, uint32_t worker)
+{
+    (void)worker;
+    const _width_ctx_t *w = ctx;
+    size_t end = (index + 1) * WIDTH_BLOCK < w->zones->length ? (index + 1) * WIDTH_BLOCK : w->zones->length;
+    for (size_t i = index * WIDTH_BLOCK; i < end; i++)
+        if (w->geometries[i].zone)
+            geom_tools_polygon_cache_init(&w->geometries[i].cache, w->geometries[i].zone->base->polygon, w->edges + w->edges_begin[i]);
+}
+
+// Ширина одного проема. Проемы независимы друг от друга: данные зон
+// только читаются, каждый проем записывает только свою ширину
+_width_status_t _transit_width(const _width_ctx_t *w, bim_transit_t *transit)
+{
+    const bim_json_element_t *btransit = transit->base;
+    uint8_t stair_sing_counter = 0; // Если stair_sing_counter = 2, то проем межэтажный (между лестницами)
+    const polygon_cache_t *zpolygons[btransit->outputs_count + 1];
+
+    for (size_t j = 0; j < btransit->outputs_count; j++)
     {
-        bim_transit_t *transit = transits->data[i];
-        bim_json_element_t *btransit = transit->base;
+        uint32_t handle = btransit->outputs[j];
+        const _zone_geometry_t *geometry = handle <= w->handles_count ? w->zone_by_handle[handle] : NULL;
+        if (!geometry || !geometry->cache.polygon)
+            return _WIDTH_NO_ZONE;
+        zpolygons[j] = &geometry->cache;
+        if (geometry->zone->base->sign == STAIR) stair_sing_counter++;
+    }
+    if (btransit->outputs_count == 0)
+        return _WIDTH_NO_ZONE;
 
-        uint8_t stair_sing_counter = 0; // Если stair_sing_counter = 2, то проем межэтажный (между лестницами)
-        int zuuid = -1; // Идентификатор зоны
-        polygon_t zpolygons[btransit->outputs_count];
+    if (stair_sing_counter == 2) // => Межэтажный проем
+    {
+        transit->width = sqrt((geom_tools_area_polygon(*zpolygons[0]->polygon) + geom_tools_area_polygon(*zpolygons[1]->polygon))/2);
+        return _WIDTH_OK;
+    }
 
-        for (size_t j = 0; j < btransit->outputs_count; j++)
-        {
-            zuuid = arraylist_index_of(zones, _find_zone_callback, btransit->outputs[j]);
-            zpolygons[j] = *((bim_zone_t *)zones->data[zuuid])->base->polygon;
-            if (((bim_zone_t *)zones->data[zuuid])->base->sign == STAIR) stair_sing_counter++;
-        }
+    point_t edge1_points[2], edge2_points[2];
+    multiline_t edge1 = {.point_count=0, .points=edge1_points};
+    multiline_t edge2 = {.point_count=0, .points=edge2_points};
+
+    // Вершины проема (кроме первой, повторенной в конце) классифицируются
+    // относительно первой зоны одним вызовом
+    const polygon_t *tpolygon = btransit->polygon;
+    size_t tpoints_count = tpolygon->point_count > 0 ? tpolygon->point_count - 1 : 0;
+    uint8_t tpoint_in_zpolygon[tpoints_count + 1];
+    geom_tools_is_points_in_polygon_cached(tpolygon->points + 1, tpoints_count, zpolygons[0], tpoint_in_zpolygon);
+    for (size_t j = 0; j < tpoints_count; ++j)
+    {
+        multiline_t *edge = tpoint_in_zpolygon[j] ? &edge1 : &edge2;
+        if (edge->point_count < 2)
+            edge->points[edge->point_count] = tpolygon->points[j + 1];
+        edge->point_count++;
+    }
 
-        if (zuuid == -1)
-        {
-            LOG_ERROR("Не найден элемент, соединенный с переходом: id=%lu, name=%s [%s]",
-                      btransit->id, btransit->uuid, btransit->name);
-            return -1;
-        }
+    if (edge1.point_count != 2 && edge2.point_count != 2)
+        return _WIDTH_NO_EDGES;
 
-        if (stair_sing_counter == 2) // => Межэтажный проем
-        {
-            transit->width = sqrt((geom_tools_area_polygon(zpolygons[0]) + geom_tools_area_polygon(zpolygons[1]))/2);
-            continue;
-        }
+    double width = -1;
+    if (btransit->sign == DOOR_WAY_INT || btransit->sign == DOOR_WAY_OUT)
+    {
+        point_t l1p1 = edge1.points[0];
+        point_t l1p2 = edge1.points[1];
+        double width1 = geom_tools_length_side(l1p1, l1p2);
 
+        point_t l2p1 = edge2.points[0];
+        point_t l2p2 = edge2.points[1];
+        double width2 = geom_tools_length_side(l2p1, l2p2);
 
-        multiline_t edge1 = {.point_count=0, .points=(point_t *) malloc(sizeof (point_t) * 2)};
-        multiline_t edge2 = {.point_count=0, .points=(point_t *) malloc(sizeof (point_t) * 2)};
+        width = (width1 + width2) / 2;
+    } else if (btransit->sign == DOOR_WAY && btransit->outputs_count > 1)
+    {
+        width = _width_door_way(zpolygons[0], zpolygons[1], &edge1, &edge2);
+    }
 
-        const polygon_t *tpolygon = btransit->polygon;
-        for(size_t j = 1; j < tpolygon->point_count; ++j)
-        {
-            const point_t *tpoint = &tpolygon->points[j];
-            const polygon_t *zpolygon = &zpolygons[0];
-            uint8_t tpoint_in_zpolygon = geom_tools_is_point_in_polygon(tpoint, zpolygon);
-            if (tpoint_in_zpolygon)
-                edge1.points[edge1.point_count++] = *tpoint;
-            else
-                edge2.points[edge2.point_count++] = *tpoint;
-        }
+    transit->width = width;
+    return _WIDTH_OK;
+}
 
-        double width = -1;
-        if (edge1.point_count != 2 && edge2.point_count != 2)
-        {
-            free(edge1.points); free(edge2.points);
-            LOG_ERROR("Невозможно вычислить ширину двери: id=%lu, name=%s [%s]",
-                      btransit->id, btransit->uuid, btransit->name);
-            return -1;
-        }
+// Ширина проемов блока
+void _transits_width(void *ctx, size_t index, uint32_t worker)
+{
+    (void)worker;
+    const _width_ctx_t *w = ctx;
+    size_t end = (index + 1) * WIDTH_BLOCK < w->transits->length ? (index + 1) * WIDTH_BLOCK : w->transits->length;
+    for (size_t i = index * WIDTH_BLOCK; i < end; i++)
+    {
+        bim_transit_t *transit = w->transits->data[i];
+        if (transit->width >= 0) continue; // Взята из предыдущей модели
+        w->status[i] = _transit_width(w, transit);
+    }
+}
 
-        if (btransit->sign == DOOR_WAY_INT || btransit->sign == DOOR_WAY_OUT)
-        {
-            point_t l1p1 = edge1.points[0];
-            point_t l1p2 = edge1.points[1];
-            double width1 = geom_tools_length_side(&l1p1, &l1p2);
+// Вычисление ширины проема по данным из модели здания
+// Проемы обрабатываются параллельно (bim_tools_set_threads). Ошибка в одном
+// проеме не прерывает вычисление остальных: его ширина остается -1, а сообщения
+// выводятся после вычисления в порядке списка проемов, поэтому результат
+// и журнал не зависят от количества потоков
+int _calculate_transits_width(ArrayList *zones,         // Список всех зон
+                              ArrayList *transits,      // Список всех переходов
+                              uint32_t handles_count)   // Количество номеров UUID (без зоны вне здания)
+{
+    // Рабочая память выделяется одним блоком, дальше вычисление ширины
+    // не обращается к куче:
+    //  - данные многоугольников зон;
+    //  - зона по номеру UUID (зона вне здания имеет номер handles_count);
+    //  - начало векторов ребер каждой зоны;
+    //  - результаты проемов;
+    //  - векторы ребер всех зон. Данные зон заполняются до вычисления
+    //    ширин и дальше только читаются всеми потоками
+    size_t edges_count = 0;
+    for (size_t i = 0; i < zones->length; i++)
+    {
+        const bim_zone_t *zone = zones->data[i];
+        if (zone->base->polygon)
+            edges_count += zone->base->polygon->point_count;
+    }
 
-            point_t l2p1 = edge2.points[0];
-            point_t l2p2 = edge2.points[1];
-            double width2 = geom_tools_length_side(&l2p1, &l2p2);
+    size_t geometries_size = sizeof (_zone_geometry_t) * (zones->length + 1);
+    size_t zone_by_handle_size = sizeof (_zone_geometry_t *) * (handles_count + 1);
+    size_t edges_begin_size = sizeof (size_t) * (zones->length + 1);
+    size_t status_size = (transits->length + 1 + sizeof (point_t) - 1) / sizeof (point_t) * sizeof (point_t);
+    char *workspace = (char *)calloc(1, geometries_size + zone_by_handle_size + edges_begin_size + status_size + sizeof (point_t) * edges_count);
+    if (!workspace)
+    {
+        LOG_ERROR("Не удалось выделить память для вычисления ширины проемов");
+        return -1;
+    }
 
-            width = (width1 + width2) / 2;
-        } else if (btransit->sign == DOOR_WAY)
-        {
-            width = _width_door_way(&zpolygons[0], &zpolygons[1], &edge1, &edge2);
-        }
+    _width_ctx_t w;
+    w.zones = zones;
+    w.transits = transits;
+    w.handles_count = handles_count;
+    w.geometries = (_zone_geometry_t *)workspace;
+    w.zone_by_handle = (_zone_geometry_t **)(workspace + geometries_size);
+    w.edges_begin = (size_t *)(workspace + geometries_size + zone_by_handle_size);
+    w.status = (uint8_t *)(workspace + geometries_size + zone_by_handle_size + edges_begin_size);
+    w.edges = (point_t *)(workspace + geometries_size + zone_by_handle_size + edges_begin_size + status_size);
+
+    size_t edges_used = 0;
+    for (size_t i = 0; i < zones->length; i++)
+    {
+        bim_zone_t *zone = zones->data[i];
+        if (!zone->base->polygon || zone->base->handle > handles_count || w.zone_by_handle[zone->base->handle])
+            continue;
+        w.geometries[i].zone = zone;
+        w.zone_by_handle[zone->base->handle] = &w.geometries[i];
+        w.edges_begin[i] = edges_used;
+        edges_used += zone->base->polygon->point_count;
+    }
 
-        transit->width = width;
+    bim_parallel_for(_threads, (zones->length + WIDTH_BLOCK - 1) / WIDTH_BLOCK, _zones_cache, &w);
+    bim_parallel_for(_threads, (transits->length + WIDTH_BLOCK - 1) / WIDTH_BLOCK, _transits_width, &w);
 
-        if (transit->width < 0.5)
+    int result = 0;
+    for (size_t i = 0; i < transits->length; i++)
+    {
+        const bim_transit_t *transit = transits->data[i];
+        const bim_json_element_t *btransit = transit->base;
+        switch (w.status[i])
         {
-            LOG_WARN("Ширина проема меньше 0.5 м: id=%lu, name=%s [%s], width=%f",
-                     btransit->id, btransit->name, btransit->uuid, transit->width);
+        case _WIDTH_NO_ZONE:
+            LOG_ERROR("Не найден элемент, соединенный с переходом: id=%lu, name=%s [%s]",
+                      btransit->id, btransit->uuid, btransit->name);
+            result = -1;
+            break;
+        case _WIDTH_NO_EDGES:
+            LOG_ERROR("Невозможно вычислить ширину двери: id=%lu, name=%s [%s]",
+                      btransit->id, btransit->uuid, btransit->name);
+            result = -1;
+            break;
+        default:
+            if (transit->width < 0.5)
+            {
+                LOG_WARN("Ширина проема меньше 0.5 м: id=%lu, name=%s [%s], width=%f",
+                         btransit->id, btransit->name, btransit->uuid, transit->width);
+            }
         }
+    }
+
+    free(workspace);
+    return result;
+}
 
-        free(edge1.points); free(edge2.points);
+void _level_derive(void *ctx, size_t index, uint32_t worker)
+{
+    (void)worker;
+    bim_level_t *level = &((bim_object_t *)ctx)->levels[index];
+    if (level->zone_count == 0)
+        return;
+
+    // Площади зон этажа, не взятых из предыдущей модели, вычисляются одним вызовом
+    const polygon_t **polygons = (const polygon_t **)malloc(sizeof (polygon_t *) * level->zone_count);
+    double *areas = (double *)malloc(sizeof (double) * level->zone_count);
+    // Без памяти площади остаются равными -1, такие зоны выводятся в лог после цикла
+    if (!polygons || !areas)
+    {
+        free(polygons);
+        free(areas);
+        return;
     }
+    size_t count = 0;
+    for (size_t i = 0; i < level->zone_count; i++)
+        if (level->zones[i].area < 0)
+            polygons[count++] = level->zones[i].base->polygon;
+
+    geom_tools_area_polygons(polygons, count, areas);
+
+    for (size_t i = 0, k = 0; i < level->zone_count; i++)
+        if (level->zones[i].area < 0)
+            level->zones[i].area = areas[k++];
 
-    return 0;
+    free(polygons);
+    free(areas);
+}
+
+void _level_index(void *ctx, size_t index, uint32_t worker)
+{
+    (void)worker;
+    bim_level_t *level = &((bim_object_t *)ctx)->levels[index];
+    level->index = bim_index_new(level);
 }
 
 bim_zone_t* _outside_init(const bim_json_object_t * bim_json)
@@ -307,32 +529,47 @@ bim_zone_t* _outside_init(const bim_json_object_t * bim_json)
     outside_element->sign = OUTSIDE;
     outside_element->polygon = NULL;
     outside_element->uuid = strdup("00000000-0000-0000-0000-000000000000");
+    outside_element->handle = bim_json->handles_count;
     outside_element->z_level = 0;
     outside_element->size_z = __FLT_MAX__;
     outside_element->numofpeople = 0;
     outside_element->outputs_count = 0;
-    outside_element->outputs = (char**)malloc(sizeof (char*) * 100);
-    char** ptr = outside_element->outputs;
+    outside_element->outputs_begin = 0;
+    outside_element->digest = 0;
 
+    // Выходы из здания подсчитываются заранее, чтобы выделить массив нужного размера
     for(size_t i = 0; i < bim_json->levels_count; i++)
     {
         for(size_t j = 0; j < bim_json->levels[i].elements_count; j++)
         {
-            bim_json_element_t *element = &bim_json->levels[i].elements[j];
+            const bim_json_element_t *element = &bim_json->levels[i].elements[j];
             if (element->sign == DOOR_WAY_OUT)
-            {
                 outside_element->outputs_count++;
-                *ptr++ = element->uuid;
-            } else if (element->sign == ROOM || element->sign == STAIR)
+            else if (element->sign == ROOM || element->sign == STAIR)
                 outside_element->id++;
         }
     }
-    outside_element->outputs = /*(char**)*/realloc(outside_element->outputs, outside_element->outputs_count * sizeof (char*));
+
+    outside_element->outputs = (uint32_t*)malloc(sizeof (uint32_t) * (outside_element->outputs_count ? outside_element->outputs_count : 1));
+    uint32_t* ptr = outside_element->outputs;
+    for(size_t i = 0; i < bim_json->levels_count; i++)
+    {
+        for(size_t j = 0; j < bim_json->levels[i].elements_count; j++)
+        {
+            const bim_json_element_t *element = &bim_json->levels[i].elements[j];
+            if (element->sign == DOOR_WAY_OUT)
+                *ptr++ = element->handle;
+        }
+    }
 
     bim_zone_t *outside_zone = (bim_zone_t *) malloc(sizeof (bim_zone_t));
     if (!outside_zone)
         return NULL;
     outside_zone->base = outside_element;
+    outside_zone->id = outside_element->id;
+    outside_zone->sign = outside_element->sign;
+    outside_zone->z_level = outside_element->z_level;
+    outside_zone->outputs_count = outside_element->outputs_count;
     outside_zone->is_blocked = false;
     outside_zone->is_visited = false;
     outside_zone->potential = 0;
@@ -349,12 +586,19 @@ bim_t* bim_tools_copy    (const bim_t* bim)
 
 void bim_tools_free (bim_t* bim)
 {
+    if (bim->mapped)
+    {
+        _mapped_close(bim);
+        return;
+    }
+
     bim_object_t *bim_obj = bim->object;
     bim_level_t *lvl_ptr = bim_obj->levels;
     for(size_t i = 0; i < bim_obj->levels_count; i++, lvl_ptr++)
     {
         free(lvl_ptr->zones);
         free(lvl_ptr->transits);
+        bim_index_free(lvl_ptr->index);
     }
     free(bim_obj->levels);
     free(bim_obj->outside->base->name);
@@ -372,6 +616,36 @@ void bim_tools_free (bim_t* bim)
     free(bim);
 }
 
+void bim_tools_set_threads(uint32_t threads)
+{
+    _threads = threads ? threads : bim_parallel_cpu_count();
+}
+
+uint32_t bim_tools_get_threads(void)
+{
+    return _threads;
+}
+
+void bim_tools_set_topology(bim_topology_mode_t mode)
+{
+    _topology = mode;
+}
+
+bim_topology_mode_t bim_tools_get_topology(void)
+{
+    return _topology;
+}
+
+void bim_tools_set_keep_geometry(bool keep)
+{
+    _keep_geometry = keep;
+}
+
+bool bim_tools_get_keep_geometry(void)
+{
+    return _keep_geometry;
+}
+
 void bim_tools_set_people_to_zone(bim_zone_t* zone, float num_of_people)
 {
     zone->num_of_people = num_of_people;
@@ -399,7 +673,7 @@ double bim_tools_get_area_bim(const bim_t* bim)
         for (size_t j = 0; j < bim->object->levels[i].zone_count; j++)
         {
             bim_zone_t zone = bim->object->levels[i].zones[j];
-            if (zone.base->sign == ROOM || zone.base->sign == STAIR)
+            if (zone.sign == ROOM || zone.sign == STAIR)
                 area += bim->object->levels[i].zones[j].area;
         }
     }
@@ -432,11 +706,60 @@ void bim_tools_lists_delete (ArrayList ** lists)
 // *******************************************************
 // -------------------------------------------------------
 
-int32_t _id_cmp (const ArrayListValue value1, const ArrayListValue value2)
+// Устойчивая сортировка слиянием снизу вверх.
+// arraylist_sort -- быстрая сортировка с опорным последним элементом,
+// на уже упорядоченном списке (обычный случай: номера выдаются по порядку
+// следования элементов в файле) она работает за O(n^2) с глубиной рекурсии n
+void _list_sort(ArrayList *list, ArrayListCompareFunc compare_func)
+{
+    size_t n = list->length;
+    size_t i = 1;
+    while (i < n && compare_func(list->data[i - 1], list->data[i]) <= 0) i++;
+    if (i >= n)
+        return;
+
+    ArrayListValue *src = list->data;
+    ArrayListValue *dst = (ArrayListValue *)malloc(sizeof (ArrayListValue) * n);
+    for (size_t width = 1; width < n; width *= 2)
+    {
+        for (size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t a = lo, b = mid, k = lo;
+            while (a < mid && b < hi)
+                dst[k++] = compare_func(src[b], src[a]) < 0 ? src[b++] : src[a++];
+            while (a < mid) dst[k++] = src[a++];
+            while (b < hi)  dst[k++] = src[b++];
+        }
+        ArrayListValue *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != list->data)
+    {
+        memcpy(list->data, src, sizeof (ArrayListValue) * n);
+        free(src);
+    } else
+    {
+        free(dst);
+    }
+}
+
+static int32_t _id_cmp (const bim_json_element_t *e1, const bim_json_element_t *e2)
 {
-    const bim_json_element_t *e1 = value1;
-    const bim_json_element_t *e2 = value2;
     if (e1->id > e2->id) return 1;
     else if (e1->id < e2->id) return -1;
     else return 0;
 }
+
+int32_t _zone_id_cmp (const ArrayListValue value1, const ArrayListValue value2)
+{
+    return _id_cmp(((const bim_zone_t *)value1)->base, ((const bim_zone_t *)value2)->base);
+}
+
+int32_t _transit_id_cmp (const ArrayListValue value1, const ArrayListValue value2)
+{
+    return _id_cmp(((const bim_transit_t *)value1)->base, ((const bim_transit_t *)value2)->base);
+}
@@ -49,50 +49,142 @@ typedef struct
 } bim_transit_t;
 
 /// Структура, расширяющая элемент типа ROOM и STAIR
+///
+/// Поля, которые читаются на каждом шаге моделирования, скопированы из base,
+/// поэтому моделирование не обращается к записям bim_json_element_t
 typedef struct
 {
     bim_json_element_t   *base;
-    bool            is_visited;     ///< Признак посещения элемента
-    bool            is_blocked;     ///< Признак недоступности элемента для движения
+    uint64_t        id;             ///< Внутренний номер элемента (копия base->id)
     float           num_of_people;  ///< Количество людей в элементе
     float           potential;      ///< Время достижения безопасной зоны
     float           area;           ///< Площадь элемента
+    float           z_level;        ///< Уровень элемента (копия base->z_level)
+    uint32_t        outputs_count;  ///< Количество связей элемента (копия base->outputs_count)
+    bim_element_sign_t sign;        ///< Тип элемента (копия base->sign)
+    bool            is_visited;     ///< Признак посещения элемента
+    bool            is_blocked;     ///< Признак недоступности элемента для движения
 } bim_zone_t;
 
+struct bim_index;
+
 /// Структура, описывающая этаж
 typedef struct
 {
     char            *name;          ///< [JSON] Название этажа
     float           z_level;        ///< [JSON] Высота этажа над нулевой отметкой
-    uint16_t        zone_count;     ///< Количство зон на этаже
-    uint16_t        transit_count;  ///< Количство переходов на этаже
+    uint64_t        zone_count;     ///< Количство зон на этаже
+    uint64_t        transit_count;  ///< Количство переходов на этаже
     bim_zone_t      *zones;         ///< Массив зон, которые принадлежат этажу
     bim_transit_t   *transits;      ///< Массив переходов, которые принадлежат этажу
+    struct bim_index *index;        ///< Пространственный индекс зон и переходов (bim_index.h),
+                                    ///< NULL, если полигоны не сохраняются
 } bim_level_t;
 
 /// Структура, описывающая здание
 typedef struct
 {
     char        *name;          ///< [JSON] Название здания
-    uint8_t     levels_count;   ///< Количество уровней в здании
+    uint64_t    levels_count;   ///< Количество уровней в здании
     bim_level_t *levels;        ///< [JSON] Массив уровней здания
     bim_zone_t  *outside;       ///< Зона вне здания
 } bim_object_t;
 
+struct edge;
+
 typedef struct
 {
     bim_json_object_t   *json;      ///< Ссылка на структуру, полученную из json файла
     bim_object_t        *object;    ///< Сслыка на расширенную структуру здания
     ArrayList           *zones;     ///< Список зон объекта
     ArrayList           *transits;  ///< Список переходов объекта
+    const struct edge   *edges;     ///< Готовый список ребер графа (NULL, если его нужно построить)
+    void                *mapped;    ///< Отображенный в память файл кэша (NULL, если модель из json)
+    size_t              mapped_size;///< Размер отображенного файла
 } bim_t;
 
+/*!
+Создает модель здания из json-файла
+
+Этажи разбираются и обрабатываются в bim_tools_get_threads() потоках,
+списки зон и переходов и зона вне здания собираются в одном потоке
+
+\param[in] file Файл модели здания
+\returns Указатель на объект типа bim_t или NULL
+*/
 bim_t *bim_tools_new    (const char *file);
 bim_t *bim_tools_copy   (const bim_t *bim);
 void   bim_tools_free   (bim_t* bim);
 
+/*!
+Сохраняет модель здания в бинарный кэш (.bimb)
+
+Кэш содержит элементы, полигоны, площади зон, ширины переходов и ребра графа,
+поэтому повторная загрузка не требует разбора json и геометрических расчетов
+
+\param[in] json_file Файл модели здания
+\param[in] bimb_file Файл кэша
+\returns 0 в случае успеха, -1 при ошибке
+*/
+int    bim_tools_compile        (const char *json_file, const char *bimb_file);
+
+/*!
+Открывает бинарный кэш здания через mmap
+
+Строки, точки полигонов и ребра графа используются прямо из отображенного
+файла, все структуры модели размещаются одним блоком памяти.
+Освобождается через bim_tools_free
+
+\param[in] bimb_file Файл кэша
+\returns Указатель на объект типа bim_t или NULL
+*/
+bim_t *bim_tools_open_mapped    (const char *bimb_file);
+
+/*!
+Перечитывает файл модели здания после правки
+
+Элементы сопоставляются с текущей моделью по UUID. Площади зон и ширины
+переходов, у которых не изменились полигоны (а у переходов -- и соседние
+зоны), переносятся из текущей модели, остальные вычисляются заново.
+Граф здания нужно построить по новой модели (bim_graph_new).
+Как и realloc, при успехе освобождает bim, при ошибке оставляет его без изменений
+
+\param[in] bim        Текущая модель здания
+\param[in] file       Файл модели здания (json или кэш .bimb)
+\param[out] recomputed Количество зон и переходов, для которых площадь
+                       или ширина вычислены заново (может быть NULL)
+\returns Указатель на новую модель или NULL
+*/
+bim_t *bim_tools_reload         (bim_t *bim, const char *file, uint64_t *recomputed);
+
+/// Проверяет, является ли файл бинарным кэшем здания
+bool   bim_tools_is_mapped_file (const char *file);
+
 bim_json_object_t* bim_tools_get_json_bim (void);
 
+// Устанавливает количество потоков загрузки модели (0 -- по числу процессоров)
+void     bim_tools_set_threads (uint32_t threads);
+uint32_t bim_tools_get_threads (void);
+
+// Сохранять ли полигоны элементов после создания модели (по умолчанию -- да).
+// Без полигонов поле polygon элементов равно NULL, а площади и ширины
+// уже вычислены, поэтому моделированию они не нужны
+void     bim_tools_set_keep_geometry (bool keep);
+bool     bim_tools_get_keep_geometry (void);
+
+/// Восстановление связей переходов (Output) по геометрии при создании модели (см. bim_topology.c)
+typedef enum
+{
+    BIM_TOPOLOGY_OFF,       ///< Связи берутся из файла
+    BIM_TOPOLOGY_CHECK,     ///< Связи сравниваются с геометрией, расхождения выводятся в лог
+    BIM_TOPOLOGY_REWRITE    ///< Связи, которые расходятся с геометрией, заменяются найденными
+} bim_topology_mode_t;
+
+// Режим восстановления связей для bim_tools_new (по умолчанию BIM_TOPOLOGY_OFF).
+// Кэш .bimb хранит связи, полученные при его создании, и не проверяется
+void                bim_tools_set_topology (bim_topology_mode_t mode);
+bim_topology_mode_t bim_tools_get_topology (void);
+
 // Устанавливает в помещение заданное количество людей
 void    bim_tools_set_people_to_zone (bim_zone_t* element, float num_of_people);
 
@@ -0,0 +1,378 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Восстановление связей переходов (Output) по геометрии.
+ *
+ * Для каждого перехода по индексу этажа (bim_index.h) находятся зоны,
+ * которые касаются его полигона:
+ *  - выход (DOOR_WAY_OUT) касается одной зоны, вторая сторона -- зона вне
+ *    здания, которая в файле не указывается;
+ *  - дверь (DOOR_WAY_INT) и проем (DOOR_WAY) касаются двух зон этажа;
+ *  - межэтажный проем (DOOR_WAY) касается одной лестницы своего этажа,
+ *    вторая лестница ищется на этаже выше, затем ниже.
+ * Переход, для которого найдено другое количество зон, остается
+ * со связями из файла.
+ *
+ * Найденные связи сравниваются со связями из файла с обеих сторон:
+ * переход должен ссылаться на свои зоны, а зоны -- на переход. При
+ * перезаписи связи переходов заменяются найденными, а связи зон строятся
+ * заново как обратные к связям переходов. Этажи обрабатываются параллельно,
+ * каждый запрос к индексу просматривает в среднем несколько элементов,
+ * поэтому время растет линейно с количеством элементов.
+ */
+
+#include "bim_tools.h"
+#include "bim_index.h"
+#include "bim_parallel.h"
+
+#define NO_TRANSIT UINT32_MAX
+
+/// Зоны перехода, найденные по геометрии
+typedef struct
+{
+    uint32_t    zones[2];   ///< Номера UUID зон
+    uint8_t     count;      ///< Количество зон
+    bool        resolved;   ///< Найдено ожидаемое количество зон
+    bool        mismatch;   ///< Связи в файле расходятся с найденными
+} _links_t;
+
+typedef struct
+{
+    const bim_object_t  *object;
+    uint64_t            *transit_begin; ///< Номер первого перехода этажа в links
+    _links_t            *links;         ///< Связи всех переходов здания
+} _topology_ctx_t;
+
+int64_t _derive_topology(bim_t *bim, bool rewrite);
+
+static void     _level_links    (void *ctx, size_t index, uint32_t worker);
+static size_t   _stairs_touching(const bim_level_t *level, const polygon_t *polygon, bim_zone_t **stairs);
+static bool     _same_set       (const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count);
+static bool     _contains       (const uint32_t *values, size_t count, uint32_t value);
+static int      _rewrite        (bim_t *bim, const _links_t *links, const uint32_t *transit_by_handle);
+
+// Связи переходов сравниваются с геометрией и, если rewrite, исправляются.
+// Нужны индексы этажей. Возвращает количество расхождений или -1 при ошибке
+int64_t _derive_topology(bim_t *bim, bool rewrite)
+{
+    bim_object_t *object = bim->object;
+    uint32_t handles_count = bim->json->handles_count;
+
+    uint64_t transits_count = 0;
+    uint64_t *transit_begin = (uint64_t *)malloc(sizeof (uint64_t) * (object->levels_count + 1));
+    if (!transit_begin)
+    {
+        LOG_ERROR("Не удалось выделить память для восстановления связей переходов");
+        return -1;
+    }
+    for (size_t i = 0; i < object->levels_count; i++)
+    {
+        transit_begin[i] = transits_count;
+        transits_count += object->levels[i].transit_count;
+    }
+    transit_begin[object->levels_count] = transits_count;
+
+    _links_t *links = (_links_t *)calloc(transits_count + 1, sizeof (_links_t));
+    uint32_t *transit_by_handle = (uint32_t *)malloc(sizeof (uint32_t) * (handles_count + 1));
+    uint32_t *confirmed = (uint32_t *)calloc(transits_count + 1, sizeof (uint32_t));
+    if (!links || !transit_by_handle || !confirmed)
+    {
+        free(transit_begin); free(links); free(transit_by_handle); free(confirmed);
+        LOG_ERROR("Не удалось выделить память для восстановления связей переходов");
+        return -1;
+    }
+
+    _topology_ctx_t ctx = {object, transit_begin, links};
+    bim_parallel_for(bim_tools_get_threads(), object->levels_count, _level_links, &ctx);
+
+    for (uint32_t h = 0; h <= handles_count; h++)
+        transit_by_handle[h] = NO_TRANSIT;
+    for (size_t i = 0; i < object->levels_count; i++)
+        for (size_t j = 0; j < object->levels[i].transit_count; j++)
+            transit_by_handle[object->levels[i].transits[j].base->handle] = transit_begin[i] + j;
+
+    // Сторона зон: каждая ссылка зоны на переход должна быть найдена по геометрии
+    int64_t mismatches = 0;
+    for (size_t i = 0; i < object->levels_count; i++)
+    {
+        const bim_level_t *level = &object->levels[i];
+        for (size_t j = 0; j < level->zone_count; j++)
+        {
+            const bim_json_element_t *zone = level->zones[j].base;
+            for (size_t k = 0; k < zone->outputs_count; k++)
+            {
+                uint32_t handle = zone->outputs[k];
+                uint32_t t = handle <= handles_count ? transit_by_handle[handle] : NO_TRANSIT;
+                if (t == NO_TRANSIT)
+                {
+                    LOG_WARN("Зона ссылается на несуществующий переход: name=%s [%s]", zone->name, zone->uuid);
+                    mismatches++;
+                    continue;
+                }
+                if (_contains(links[t].zones, links[t].count, zone->handle))
+                    confirmed[t]++;
+                else
+                    links[t].mismatch = true;
+            }
+        }
+    }
+
+    // Сторона переходов: список из файла совпадает с найденным, и каждая
+    // найденная зона ссылается на переход ровно один раз
+    for (size_t i = 0; i < object->levels_count; i++)
+    {
+        const bim_level_t *level = &object->levels[i];
+        for (size_t j = 0; j < level->transit_count; j++)
+        {
+            const bim_json_element_t *transit = level->transits[j].base;
+            _links_t *link = &links[transit_begin[i] + j];
+            if (!link->resolved)
+            {
+                LOG_WARN("Не удалось определить зоны перехода по геометрии: name=%s [%s], найдено зон: %u",
+                         transit->name, transit->uuid, link->count);
+                continue;
+            }
+
+            link->mismatch |= !_same_set(transit->outputs, transit->outputs_count, link->zones, link->count)
+                           || confirmed[transit_begin[i] + j] != link->count;
+            if (link->mismatch)
+            {
+                LOG_WARN("Связи перехода расходятся с геометрией%s: name=%s [%s]",
+                         rewrite ? " и будут исправлены" : "", transit->name, transit->uuid);
+                mismatches++;
+            }
+        }
+    }
+
+    int result = 0;
+    if (rewrite && mismatches > 0)
+        result = _rewrite(bim, links, transit_by_handle);
+
+    free(confirmed);
+    free(transit_by_handle);
+    free(links);
+    free(transit_begin);
+    return result == 0 ? mismatches : -1;
+}
+
+static void _level_links(void *ctx, size_t index, uint32_t worker)
+{
+    (void)worker;
+    const _topology_ctx_t *topology = (const _topology_ctx_t *)ctx;
+    const bim_object_t *object = topology->object;
+    const bim_level_t *level = &object->levels[index];
+    _links_t *links = &topology->links[topology->transit_begin[index]];
+
+    bim_zone_t *found[3];
+    for (size_t j = 0; j < level->transit_count; j++)
+    {
+        const bim_json_element_t *transit = level->transits[j].base;
+        _links_t *link = &links[j];
+        size_t count = bim_index_zones_touching(level, transit->polygon, found, 3);
+        for (size_t k = 0; k < count && k < 2; k++)
+            link->zones[k] = found[k]->base->handle;
+        link->count = count < 2 ? count : 2;
+
+        switch (transit->sign)
+        {
+        case DOOR_WAY_OUT:
+            link->resolved = count == 1;
+            break;
+        case DOOR_WAY_INT:
+            link->resolved = count == 2;
+            break;
+        case DOOR_WAY:
+            link->resolved = count == 2;
+            if (count == 1 && found[0]->sign == STAIR)
+            {
+                // Межэтажный проем: лестница на соседнем этаже
+                bim_zone_t *stairs[2];
+                size_t above = index + 1 < object->levels_count
+                             ? _stairs_touching(&object->levels[index + 1], transit->polygon, stairs) : 0;
+                size_t below = above != 1 && index > 0
+                             ? _stairs_touching(&object->levels[index - 1], transit->polygon, stairs) : 0;
+                if (above == 1 || below == 1)
+                {
+                    link->zones[1] = stairs[0]->base->handle;
+                    link->count = 2;
+                    link->resolved = true;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Лестницы этажа, которые касаются многоугольника (записывается не больше двух)
+static size_t _stairs_touching(const bim_level_t *level, const polygon_t *polygon, bim_zone_t **stairs)
+{
+    bim_zone_t *found[4];
+    size_t count = bim_index_zones_touching(level, polygon, found, 4);
+    size_t stairs_count = 0;
+    for (size_t i = 0; i < count && i < 4; i++)
+        if (found[i]->sign == STAIR)
+        {
+            if (stairs_count < 2)
+                stairs[stairs_count] = found[i];
+            stairs_count++;
+        }
+    return stairs_count;
+}
+
+static bool _contains(const uint32_t *values, size_t count, uint32_t value)
+{
+    for (size_t i = 0; i < count; i++)
+        if (values[i] == value)
+            return true;
+    return false;
+}
+
+static bool _same_set(const uint32_t *a, size_t a_count, const uint32_t *b, size_t b_count)
+{
+    if (a_count != b_count)
+        return false;
+    for (size_t i = 0; i < a_count; i++)
+        if (!_contains(b, b_count, a[i]) || !_contains(a, a_count, b[i]))
+            return false;
+    return true;
+}
+
+// Связи переходов заменяются найденными (кроме неопределенных), связи зон
+// строятся как обратные. Пулы связей этажей выделяются заново из региона модели
+static int _rewrite(bim_t *bim, const _links_t *links, const uint32_t *transit_by_handle)
+{
+    bim_object_t *object = bim->object;
+    bim_json_object_t *json = bim->json;
+    uint32_t handles_count = json->handles_count;
+
+    // Итоговые связи перехода: найденные, если они расходятся с файлом, иначе из файла
+#define TRANSIT_OUTPUTS(transit, link) \
+    ((link)->resolved && (link)->mismatch ? (link)->zones : (transit)->outputs)
+#define TRANSIT_OUTPUTS_COUNT(transit, link) \
+    ((link)->resolved && (link)->mismatch ? (link)->count : (transit)->outputs_count)
+
+    // Переходы каждой зоны в виде CSR по номеру UUID зоны
+    uint32_t *zone_begin = (uint32_t *)calloc(handles_count + 2, sizeof (uint32_t));
+    if (!zone_begin)
+        return -1;
+    for (size_t i = 0; i < object->levels_count; i++)
+        for (size_t j = 0; j < object->levels[i].transit_count; j++)
+        {
+            const bim_json_element_t *transit = object->levels[i].transits[j].base;
+            const _links_t *link = &links[transit_by_handle[transit->handle]];
+            const uint32_t *outputs = TRANSIT_OUTPUTS(transit, link);
+            for (size_t k = 0; k < TRANSIT_OUTPUTS_COUNT(transit, link); k++)
+                if (outputs[k] < handles_count)
+                    zone_begin[outputs[k] + 2]++;
+        }
+    for (uint32_t h = 0; h < handles_count; h++)
+        zone_begin[h + 2] += zone_begin[h + 1];
+
+    uint32_t *zone_transits = (uint32_t *)malloc(sizeof (uint32_t) * (zone_begin[handles_count + 1] + 1));
+    if (!zone_transits)
+    {
+        free(zone_begin);
+        return -1;
+    }
+    for (size_t i = 0; i < object->levels_count; i++)
+        for (size_t j = 0; j < object->levels[i].transit_count; j++)
+        {
+            const bim_json_element_t *transit = object->levels[i].transits[j].base;
+            const _links_t *link = &links[transit_by_handle[transit->handle]];
+            const uint32_t *outputs = TRANSIT_OUTPUTS(transit, link);
+            for (size_t k = 0; k < TRANSIT_OUTPUTS_COUNT(transit, link); k++)
+                if (outputs[k] < handles_count)
+                    zone_transits[zone_begin[outputs[k] + 1]++] = transit->handle;
+        }
+    // Теперь zone_begin[h] -- начало, zone_begin[h + 1] -- конец списка зоны h
+
+    // Пулы всех этажей выделяются до изменения связей, чтобы при нехватке
+    // памяти модель осталась в исходном виде
+    int result = 0;
+    uint32_t **pools = (uint32_t **)calloc(object->levels_count + 1, sizeof (uint32_t *));
+    if (!pools)
+        result = -1;
+    for (size_t i = 0; i < object->levels_count && result == 0; i++)
+    {
+        const bim_level_t *level_ext = &object->levels[i];
+
+        uint64_t pool_size = 0;
+        for (size_t j = 0; j < level_ext->zone_count; j++)
+        {
+            uint32_t h = level_ext->zones[j].base->handle;
+            pool_size += zone_begin[h + 1] - zone_begin[h];
+        }
+        for (size_t j = 0; j < level_ext->transit_count; j++)
+        {
+            const bim_json_element_t *transit = level_ext->transits[j].base;
+            pool_size += TRANSIT_OUTPUTS_COUNT(transit, &links[transit_by_handle[transit->handle]]);
+        }
+
+        pools[i] = (uint32_t *)bim_arena_alloc(json->arena, sizeof (uint32_t) * (pool_size ? pool_size : 1));
+        if (!pools[i])
+            result = -1;
+    }
+
+    for (size_t i = 0; i < object->levels_count && result == 0; i++)
+    {
+        bim_level_t *level_ext = &object->levels[i];
+        bim_json_level_t *level = &json->levels[i];
+
+        // Элементы в пуле идут в том же порядке, что и в файле
+        uint32_t *pool = pools[i];
+        uint32_t *cursor = pool;
+        for (size_t j = 0; j < level->elements_count; j++)
+        {
+            bim_json_element_t *element = &level->elements[j];
+            const uint32_t *outputs = NULL;
+            uint32_t count = 0;
+            if (element->sign == ROOM || element->sign == STAIR)
+            {
+                outputs = &zone_transits[zone_begin[element->handle]];
+                count = zone_begin[element->handle + 1] - zone_begin[element->handle];
+            } else if (transit_by_handle[element->handle] != NO_TRANSIT)
+            {
+                const _links_t *link = &links[transit_by_handle[element->handle]];
+                outputs = TRANSIT_OUTPUTS(element, link);
+                count = TRANSIT_OUTPUTS_COUNT(element, link);
+            }
+
+            if (count)
+                memcpy(cursor, outputs, sizeof (uint32_t) * count);
+            element->outputs = cursor;
+            element->outputs_begin = cursor - pool;
+            element->outputs_count = count;
+            cursor += count;
+        }
+        level->outputs = pool;
+        level->outputs_count = cursor - pool;
+
+        for (size_t j = 0; j < level_ext->zone_count; j++)
+            level_ext->zones[j].outputs_count = level_ext->zones[j].base->outputs_count;
+        for (size_t j = 0; j < level_ext->transit_count; j++)
+            if (links[transit_by_handle[level_ext->transits[j].base->handle]].mismatch)
+                level_ext->transits[j].width = -1; // Соседи изменились, ширина вычисляется заново
+    }
+#undef TRANSIT_OUTPUTS
+#undef TRANSIT_OUTPUTS_COUNT
+
+    free(pools);
+    free(zone_transits);
+    free(zone_begin);
+    return result;
+}
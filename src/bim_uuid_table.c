@@ -0,0 +1,166 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bim_uuid_table.h"
+#include "bim_json_object.h"
+
+#define TABLE_MIN_CAPACITY 64
+
+typedef char _key_t[UUID_SIZE + 1];
+
+// Таблица с открытой адресацией. Ячейка хранит номер UUID,
+// сами ключи лежат в плотном массиве по номерам, поэтому таблица
+// не зависит от времени жизни исходных строк
+struct bim_uuid_table
+{
+    uint32_t    *slots;     ///< BIM_UUID_HANDLE_NONE -- свободная ячейка
+    uint32_t    capacity;   ///< Степень двойки
+    uint32_t    count;
+    _key_t      *keys;      ///< Ключи по номерам
+    uint32_t    keys_cap;
+};
+
+static uint32_t _hash(const char *key)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *key; key++)
+    {
+        hash ^= (uint8_t)*key;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t* _slots_new(uint32_t capacity)
+{
+    uint32_t *slots = (uint32_t *)malloc(sizeof (uint32_t) * capacity);
+    if (!slots)
+        return NULL;
+    for (uint32_t i = 0; i < capacity; i++)
+        slots[i] = BIM_UUID_HANDLE_NONE;
+    return slots;
+}
+
+static uint32_t* _find(const bim_uuid_table_t *table, uint32_t *slots, uint32_t capacity, const char *key)
+{
+    uint32_t i = _hash(key) & (capacity - 1);
+    while (slots[i] != BIM_UUID_HANDLE_NONE && strcmp(table->keys[slots[i]], key) != 0)
+        i = (i + 1) & (capacity - 1);
+    return &slots[i];
+}
+
+static int _grow(bim_uuid_table_t *table)
+{
+    uint32_t capacity = table->capacity * 2;
+    uint32_t *slots = _slots_new(capacity);
+    if (!slots)
+        return -1;
+
+    for (uint32_t handle = 0; handle < table->count; handle++)
+        *_find(table, slots, capacity, table->keys[handle]) = handle;
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return 0;
+}
+
+bim_uuid_table_t* bim_uuid_table_new(uint32_t capacity)
+{
+    bim_uuid_table_t *table = (bim_uuid_table_t *)calloc(1, sizeof (bim_uuid_table_t));
+    if (!table)
+        return NULL;
+
+    // Заполнение таблицы не превышает половины
+    table->capacity = TABLE_MIN_CAPACITY;
+    while (table->capacity / 2 < capacity)
+        table->capacity *= 2;
+    table->slots = _slots_new(table->capacity);
+    if (!table->slots)
+    {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+// Ключ таблицы -- первые UUID_SIZE символов строки
+static size_t _key(_key_t key, const char *uuid)
+{
+    size_t len = strnlen(uuid, UUID_SIZE);
+    memcpy(key, uuid, len);
+    key[len] = '\0';
+    return len;
+}
+
+uint32_t bim_uuid_table_find(const bim_uuid_table_t *table, const char *uuid)
+{
+    _key_t key;
+    _key(key, uuid);
+    return *_find(table, table->slots, table->capacity, key);
+}
+
+uint32_t bim_uuid_table_intern(bim_uuid_table_t *table, const char *uuid)
+{
+    _key_t key;
+    size_t len = _key(key, uuid);
+
+    uint32_t *slot = _find(table, table->slots, table->capacity, key);
+    if (*slot != BIM_UUID_HANDLE_NONE)
+        return *slot;
+
+    if (table->count == table->keys_cap)
+    {
+        uint32_t keys_cap = table->keys_cap ? table->keys_cap * 2 : TABLE_MIN_CAPACITY;
+        _key_t *keys = (_key_t *)realloc(table->keys, sizeof (_key_t) * keys_cap);
+        if (!keys)
+            return BIM_UUID_HANDLE_NONE;
+        table->keys = keys;
+        table->keys_cap = keys_cap;
+    }
+
+    if ((table->count + 1) * 2 > table->capacity)
+    {
+        if (_grow(table) != 0)
+            return BIM_UUID_HANDLE_NONE;
+        slot = _find(table, table->slots, table->capacity, key);
+    }
+
+    memcpy(table->keys[table->count], key, len + 1);
+    *slot = table->count++;
+    return *slot;
+}
+
+const char* bim_uuid_table_key(const bim_uuid_table_t *table, uint32_t handle)
+{
+    return handle < table->count ? table->keys[handle] : NULL;
+}
+
+uint32_t bim_uuid_table_count(const bim_uuid_table_t *table)
+{
+    return table->count;
+}
+
+void bim_uuid_table_free(bim_uuid_table_t *table)
+{
+    if (!table)
+        return;
+    free(table->slots);
+    free(table->keys);
+    free(table);
+}
@@ -0,0 +1,73 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Таблица идентификаторов элементов здания
+
+При загрузке модели каждый UUID получает компактный номер (handle).
+Номера выдаются подряд с нуля в порядке первого появления UUID в файле,
+поэтому связи между элементами хранятся и сравниваются как целые числа.
+Таблица нужна только на время загрузки.
+*/
+
+#ifndef BIM_UUID_TABLE_H
+#define BIM_UUID_TABLE_H
+
+#include <stdint.h>
+
+/// Недействительный номер UUID
+#define BIM_UUID_HANDLE_NONE UINT32_MAX
+
+typedef struct bim_uuid_table bim_uuid_table_t;
+
+/*!
+Создает пустую таблицу
+
+\param[in] capacity Ожидаемое количество UUID (0 -- по умолчанию)
+\returns Указатель на таблицу или NULL
+*/
+bim_uuid_table_t*   bim_uuid_table_new      (uint32_t capacity);
+
+/*!
+Возвращает номер UUID, при первом появлении UUID выдает ему новый номер
+
+Учитываются первые UUID_SIZE символов строки
+
+\param[in] table Таблица
+\param[in] uuid  Строка UUID
+\returns Номер UUID или BIM_UUID_HANDLE_NONE при нехватке памяти
+*/
+uint32_t            bim_uuid_table_intern   (bim_uuid_table_t *table, const char *uuid);
+
+/*!
+Возвращает номер UUID без добавления в таблицу
+
+\param[in] table Таблица
+\param[in] uuid  Строка UUID
+\returns Номер UUID или BIM_UUID_HANDLE_NONE, если UUID нет в таблице
+*/
+uint32_t            bim_uuid_table_find     (const bim_uuid_table_t *table, const char *uuid);
+
+/// Возвращает UUID по номеру (NULL, если номер не выдан)
+const char*         bim_uuid_table_key      (const bim_uuid_table_t *table, uint32_t handle);
+
+/// Количество выданных номеров
+uint32_t            bim_uuid_table_count    (const bim_uuid_table_t *table);
+
+/// Удаляет таблицу
+void                bim_uuid_table_free     (bim_uuid_table_t *table);
+
+#endif //BIM_UUID_TABLE_H
@@ -17,7 +17,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "bim_graph.h"
+#include "bim_order.h"
 #include "bim_evac.h"
 #include "logger.h"
 #include "loggerconf.h"
@@ -41,27 +45,93 @@ static void usage(const char *argv0, int exitval, const char *errmsg)
         fp = stderr;
     if (errmsg != NULL)
         fprintf(fp, "ОШИБКА: %s\n\n", errmsg);
-    fprintf(fp, "Использование: %s -f -o [-с] [-l]\n", argv0);
-    fprintf(fp, "  -f - Файл пространнственно-информационной модели здания\n");
+    fprintf(fp, "Использование: %s -f -o [-с] [-l] [-j] [-w] [-t] [-r]\n", argv0);
+    fprintf(fp, "               %s --compile-bim <in.json> <out.bimb>\n", argv0);
+    fprintf(fp, "  -f - Файл пространнственно-информационной модели здания (json или кэш .bimb)\n");
     fprintf(fp, "  -o - Файл с детализацией процесса освобождения здания\n");
     fprintf(fp, "  -c - Файл конфигурции моделирования\n");
     fprintf(fp, "  -l - Файл конфигурции логгирования\n");
+    fprintf(fp, "  -j - Количество потоков загрузки модели (0 - по числу процессоров, по умолчанию 1)\n");
+    fprintf(fp, "  -w, --watch - Следить за файлом модели: после каждой правки обновить модель и повторить моделирование\n");
+    fprintf(fp, "  -t, --topology check|rewrite - Сверить связи переходов (Output) с геометрией и, если rewrite, исправить их\n");
+    fprintf(fp, "  -r, --reorder bfs|rcm - Перенумеровать зоны и переходы в порядке обхода графа (в ширину или RCM), результаты выводятся в порядке файла\n");
+    fprintf(fp, "  --compile-bim - Сохранить модель здания в бинарный кэш для быстрой загрузки\n");
     exit(exitval);
 }
 
-static void output_head(FILE *fp, bim_t *bim);
-static void output_body(FILE *fp, bim_t *bim);
+static void output_head(FILE *fp, bim_t *bim, const bim_permutation_t *permutation);
+static void output_body(FILE *fp, bim_t *bim, const bim_permutation_t *permutation);
 static void output_footer(FILE *fp, bim_t *bim);
+static void simulate(bim_t *bim, const char *input_file, const char *output_file, const char *bim_config_file);
+
+#define WATCH_INTERVAL_MS 200   ///< Период опроса файла модели в режиме наблюдения
+
+static bool         reorder = false;        ///< Перенумеровать зоны и переходы перед моделированием
+static bim_order_t  reorder_type = BIM_ORDER_BFS;
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static struct timespec _file_mtime(const char *file)
+{
+    struct stat st;
+    struct timespec zero = {0, 0};
+    return stat(file, &st) == 0 ? st.st_mtim : zero;
+}
+
+static bool _mtime_eq(struct timespec t1, struct timespec t2)
+{
+    return t1.tv_sec == t2.tv_sec && t1.tv_nsec == t2.tv_nsec;
+}
+
+// Ждет изменения времени модификации файла. Изменение засчитывается,
+// когда время не меняется в течение одного периода опроса, чтобы
+// не читать файл, который еще дописывается
+static bool _wait_for_change(const char *file, struct timespec *mtime)
+{
+    struct timespec interval = {0, WATCH_INTERVAL_MS * 1000000L};
+    nanosleep(&interval, NULL);
+    struct timespec current = _file_mtime(file);
+    if (_mtime_eq(current, *mtime))
+        return false;
+
+    nanosleep(&interval, NULL);
+    if (!_mtime_eq(current, _file_mtime(file)))
+        return false;
+
+    *mtime = current;
+    return true;
+}
 
 int main (int argc, char** argv)
 {
+    // Подготовка бинарного кэша здания
+    if (argc >= 2 && strcmp(argv[1], "--compile-bim") == 0)
+    {
+        if (argc != 4) usage(argv[0], EXIT_FAILURE, "Ожидаются файл здания и файл кэша");
+        logger_initConsoleLogger(stdout);
+        return bim_tools_compile(argv[2], argv[3]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Обработка аргументов командной строки
     char *input_file = NULL;
     char *output_file = NULL;
     char *logger_config_file = NULL;
     char *bim_config_file = NULL;
+    bool watch = false;
+    static const struct option long_options[] =
+    {
+        {"watch",    no_argument,       NULL, 'w'},
+        {"topology", required_argument, NULL, 't'},
+        {"reorder",  required_argument, NULL, 'r'},
+        {NULL,       0,                 NULL, 0}
+    };
     int c;
-    while ((c = getopt (argc, argv, "c:l:o:f:h")) != -1)
+    while ((c = getopt_long (argc, argv, "c:l:o:f:j:wt:r:h", long_options, NULL)) != -1)
     {
         switch (c)
         {
@@ -69,6 +139,19 @@ int main (int argc, char** argv)
         case 'l': logger_config_file = optarg;          break;
         case 'o': output_file = optarg;                 break;
         case 'f': input_file = optarg;                  break;
+        case 'j': bim_tools_set_threads(strtoul(optarg, NULL, 10)); break;
+        case 'w': watch = true;                         break;
+        case 't':
+            if (strcmp(optarg, "check") == 0)           bim_tools_set_topology(BIM_TOPOLOGY_CHECK);
+            else if (strcmp(optarg, "rewrite") == 0)    bim_tools_set_topology(BIM_TOPOLOGY_REWRITE);
+            else usage(argv[0], EXIT_FAILURE, "Режим -t: check или rewrite");
+            break;
+        case 'r':
+            reorder = true;
+            if (strcmp(optarg, "bfs") == 0)             reorder_type = BIM_ORDER_BFS;
+            else if (strcmp(optarg, "rcm") == 0)        reorder_type = BIM_ORDER_RCM;
+            else usage(argv[0], EXIT_FAILURE, "Порядок -r: bfs или rcm");
+            break;
         case 'h': usage(argv[0], EXIT_SUCCESS, NULL);   break;
         default: /* '?' */ usage(argv[0], EXIT_FAILURE, "Неизвестный аргумент");
         }
@@ -87,15 +170,48 @@ int main (int argc, char** argv)
     // Настроки bim
     if (bim_config_file) bim_configure(bim_config_file);
 
-    // Создание структуры здания
-    bim_t *bim = bim_tools_new(input_file);
+    // Создание структуры здания. Полигоны нужны только для вычисления
+    // площадей и ширин, моделирование обходится без них
+    bim_tools_set_keep_geometry(false);
+    struct timespec mtime = _file_mtime(input_file);
+    bim_t *bim = bim_tools_is_mapped_file(input_file) ? bim_tools_open_mapped(input_file)
+                                                      : bim_tools_new(input_file);
+    if (!bim) return EXIT_FAILURE;
+
+    simulate(bim, input_file, output_file, bim_config_file);
+
+    // Режим наблюдения: после каждой правки файла модель обновляется
+    // и моделирование повторяется с теми же настройками
+    while (watch)
+    {
+        if (!_wait_for_change(input_file, &mtime)) continue;
+
+        double t0 = _now();
+        uint64_t recomputed = 0;
+        bim_t *next = bim_tools_reload(bim, input_file, &recomputed);
+        if (!next)
+        {
+            LOG_ERROR("Не удалось обновить модель здания, ожидается следующее изменение файла");
+            continue;
+        }
+        bim = next;
+        LOG_INFO("Модель здания обновлена за %.1f мс, пересчитано элементов: %lu", (_now() - t0) * 1e3, recomputed);
+
+        simulate(bim, input_file, output_file, bim_config_file);
+    }
 
+    bim_tools_free(bim);
+    return 0;
+}
+
+static void simulate(bim_t *bim, const char *input_file, const char *output_file, const char *bim_config_file)
+{
     ArrayList * zones = bim->zones;
     if (cfg_distribution.type == Distribution_UNIFORM)
         for (size_t i = 0; i < zones->length; i++)
         {
             bim_zone_t *zone = zones->data[i];
-            if (zone->base->sign != OUTSIDE)
+            if (zone->sign != OUTSIDE)
                 bim_tools_set_people_to_zone(zone, (zone->area * cfg_distribution.density));
         }
 
@@ -113,14 +229,32 @@ int main (int argc, char** argv)
     LOG_TRACE("Файл с детальной информацией: %s", output_file);
     LOG_TRACE("Название объекта: %s", bim->object->name);
     LOG_TRACE("Площадь здания: %.2f m^2", bim_tools_get_area_bim(bim));
-    LOG_TRACE("Количество этажей: %i", bim->object->levels_count);
+    LOG_TRACE("Количество этажей: %lu", bim->object->levels_count);
     LOG_TRACE("Количество помещений: %i", zones->length);
     LOG_TRACE("Количество дверей: %i", transits->length);
     LOG_TRACE("Количество человек в здании: %.2f чел.", bim_tools_get_numofpeople(bim));
 
     bim_graph_t *graph = bim_graph_new(bim);
+    if (!graph)
+    {
+        LOG_ERROR("Не удалось построить граф здания");
+        return;
+    }
     //bim_graph_print(graph);
 
+    // Перенумерация для моделирования, результаты выводятся в порядке файла
+    bim_permutation_t *permutation = NULL;
+    if (reorder)
+    {
+        permutation = bim_order_permutation_new(bim);
+        if (!permutation || bim_order_renumber(bim, graph, reorder_type, permutation) != 0)
+        {
+            LOG_WARN("Не удалось перенумеровать зоны и переходы, моделирование в порядке файла");
+            bim_order_permutation_free(permutation);
+            permutation = NULL;
+        }
+    }
+
     if (cfg_modeling.step > 0) evac_set_modeling_step(cfg_modeling.step);
     else evac_def_modeling_step(bim, zones->length);
     if (cfg_modeling.speed_max > 0) evac_set_speed_max(cfg_modeling.speed_max);
@@ -131,13 +265,17 @@ int main (int argc, char** argv)
 
     // Файл с результатами
     FILE *fp = fopen(output_file, "w+");
-    output_head(fp, bim);
-    output_body(fp, bim);
+    output_head(fp, bim, permutation);
+    output_body(fp, bim, permutation);
+
+    // Порядок обхода графа от шага к шагу не меняется, пока не перекрыты зоны или переходы
+    bim_schedule_t *schedule = evac_schedule_new(graph);
 
     double remainder = 0.0; // Количество человек, которое может остаться в зд. для остановки цикла
     while(true)
     {
-        evac_moving_step(graph, zones, transits);
+        if (schedule) evac_moving_step_scheduled(schedule, graph, zones, transits);
+        else evac_moving_step(graph, zones, transits);
         evac_time_inc();
 
         double num_of_people = 0;
@@ -149,7 +287,7 @@ int main (int argc, char** argv)
                num_of_people += zone->num_of_people;
             }
         }
-        output_body(fp, bim);
+        output_body(fp, bim, permutation);
 
         if (num_of_people <= remainder) break;
     }
@@ -161,22 +299,26 @@ int main (int argc, char** argv)
     LOG_INFO("---------------------------------------");
 
     output_footer(fp, bim);
+    evac_schedule_free(schedule);
+    bim_order_permutation_free(permutation);
     bim_graph_free(graph);
-    bim_tools_free(bim);
-    return 0;
 }
 
-static void output_head(FILE *fp, bim_t *bim)
+// Зона и переход с исходным номером i (в порядке файла)
+#define ZONE_AT(bim, permutation, i)    ((bim_zone_t *)(bim)->zones->data[(permutation) ? (permutation)->zones[i] : (i)])
+#define TRANSIT_AT(bim, permutation, i) ((bim_transit_t *)(bim)->transits->data[(permutation) ? (permutation)->transits[i] : (i)])
+
+static void output_head(FILE *fp, bim_t *bim, const bim_permutation_t *permutation)
 {
     fprintf(fp, "t;");
     for (size_t i = 0; i < bim->zones->length; i++)
     {
-        bim_zone_t *zone = bim->zones->data[i];
+        bim_zone_t *zone = ZONE_AT(bim, permutation, i);
         fprintf(fp, "%s;%.2f;;;", zone->base->name, zone->area);
     }
     for (size_t i = 0; i < bim->transits->length; i++)
     {
-        bim_transit_t *transit = bim->transits->data[i];
+        bim_transit_t *transit = TRANSIT_AT(bim, permutation, i);
         fprintf(fp, "%s;%.2f;;", transit->base->name, transit->width);
     }
     fprintf(fp, "\n");
@@ -192,17 +334,17 @@ static void output_head(FILE *fp, bim_t *bim)
     fprintf(fp, "\n");
 }
 
-static void output_body(FILE *fp, bim_t *bim)
+static void output_body(FILE *fp, bim_t *bim, const bim_permutation_t *permutation)
 {
     fprintf(fp, "%.2f;", evac_get_time_s());
     for (size_t i = 0; i < bim->zones->length; i++)
     {
-        bim_zone_t *zone = bim->zones->data[i];
+        bim_zone_t *zone = ZONE_AT(bim, permutation, i);
         fprintf(fp, "%u;%u;%.2f;%.2f;", zone->is_blocked, zone->is_visited, zone->num_of_people, zone->potential);
     }
     for (size_t i = 0; i < bim->transits->length; i++)
     {
-        bim_transit_t *transit = bim->transits->data[i];
+        bim_transit_t *transit = TRANSIT_AT(bim, permutation, i);
         fprintf(fp, "%u;%u;%.2f;", transit->is_blocked, transit->is_visited, transit->num_of_people);
     }
     fprintf(fp, "\n");
@@ -0,0 +1,202 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include "bim_generator.h"
+
+#define ROOM_W      6.0     ///< Ширина помещения, м
+#define ROOM_H      4.0     ///< Глубина помещения, м
+#define DOOR_HALF   0.5     ///< Половина ширины двери, м
+#define WALL_HALF   0.1     ///< Половина толщины стены, м
+#define LEVEL_H     3.0     ///< Высота этажа, м
+
+/// Вид элемента, входит в состав UUID
+enum
+{
+    KIND_ROOM = 1,
+    KIND_DOOR_EAST,
+    KIND_DOOR_SOUTH,
+    KIND_STAIR,
+    KIND_DOOR_STAIR,
+    KIND_EXIT,
+    KIND_DOOR_LEVEL
+};
+
+typedef struct
+{
+    uint32_t rooms;
+    uint32_t cols;
+    bool     mesh;  ///< Двери к соседям по столбцу у всех помещений, а не только в коридоре
+} _grid_t;
+
+static _grid_t _grid(uint32_t rooms, uint32_t flags)
+{
+    uint32_t cols = (uint32_t)ceil(sqrt((double)rooms));
+    _grid_t grid = {rooms, cols ? cols : 1, (flags & BIM_GENERATOR_MESH) != 0};
+    return grid;
+}
+
+static bool _has_east(_grid_t g, uint32_t k)  { return (k % g.cols) + 1 < g.cols && k + 1 < g.rooms; }
+static bool _has_south(_grid_t g, uint32_t k) { return (g.mesh || (k % g.cols) == 0) && k + g.cols < g.rooms; }
+
+static void _uuid(FILE *fp, uint32_t level, uint32_t kind, uint32_t index)
+{
+    fprintf(fp, "\"%08x-%04x-4000-8000-%012x\"", level, kind, index);
+}
+
+static void _rect(FILE *fp, double x0, double y0, double x1, double y1)
+{
+    fprintf(fp, "\"XY\":[{\"points\":["
+                "{\"x\":%.6f,\"y\":%.6f},{\"x\":%.6f,\"y\":%.6f},{\"x\":%.6f,\"y\":%.6f},"
+                "{\"x\":%.6f,\"y\":%.6f},{\"x\":%.6f,\"y\":%.6f}]}]",
+            x0, y0, x1, y0, x1, y1, x0, y1, x0, y0);
+}
+
+static void _element_begin(FILE *fp, bool *first, uint32_t level, uint32_t kind, uint32_t index,
+                           const char *sign, double size_z)
+{
+    fprintf(fp, "%s\n{\"Id\":", *first ? "" : ",");
+    *first = false;
+    _uuid(fp, level, kind, index);
+    fprintf(fp, ",\"Name\":\"%s_%u_%u\",\"Sign\":\"%s\",\"SizeZ\":%.1f,", sign, level, index, sign, size_z);
+}
+
+static void _door(FILE *fp, bool *first, uint32_t level, uint32_t kind, uint32_t index, const char *sign,
+                  double x0, double y0, double x1, double y1, bool outputs,
+                  uint32_t l1, uint32_t k1, uint32_t i1, uint32_t l2, uint32_t k2, uint32_t i2, bool has_second)
+{
+    _element_begin(fp, first, level, kind, index, sign, 2.0);
+    _rect(fp, x0, y0, x1, y1);
+    fprintf(fp, ",\"Output\":[");
+    if (outputs)
+    {
+        _uuid(fp, l1, k1, i1);
+        if (has_second)
+        {
+            fprintf(fp, ",");
+            _uuid(fp, l2, k2, i2);
+        }
+    }
+    fprintf(fp, "]}");
+}
+
+static void _write_level(FILE *fp, uint32_t level, uint32_t levels_count, _grid_t g, bool outputs)
+{
+    bool first = true;
+    const double dy = ROOM_H / 2;
+    const double dx = ROOM_W / 2;
+
+    for (uint32_t k = 0; k < g.rooms; k++)
+    {
+        uint32_t c = k % g.cols, r = k / g.cols;
+        double x0 = c * ROOM_W, y0 = r * ROOM_H;
+        _element_begin(fp, &first, level, KIND_ROOM, k, "Room", LEVEL_H);
+        fprintf(fp, "\"NumPeople\":5,");
+        _rect(fp, x0, y0, x0 + ROOM_W, y0 + ROOM_H);
+        fprintf(fp, ",\"Output\":[");
+        bool first_output = true;
+#define OUTPUT(kind, index) do { if (!outputs) break; fprintf(fp, first_output ? "" : ","); first_output = false; _uuid(fp, level, kind, index); } while (0)
+        if (_has_east(g, k))                OUTPUT(KIND_DOOR_EAST, k);
+        if (c > 0)                          OUTPUT(KIND_DOOR_EAST, k - 1);
+        if (_has_south(g, k))               OUTPUT(KIND_DOOR_SOUTH, k);
+        if ((g.mesh || c == 0) && r > 0)    OUTPUT(KIND_DOOR_SOUTH, k - g.cols);
+        if (k == 0)                         OUTPUT(KIND_DOOR_STAIR, 0);
+#undef OUTPUT
+        fprintf(fp, "]}");
+    }
+
+    for (uint32_t k = 0; k < g.rooms; k++)
+    {
+        uint32_t c = k % g.cols, r = k / g.cols;
+        double x = (c + 1) * ROOM_W, y = (r + 1) * ROOM_H;
+        if (_has_east(g, k))
+            _door(fp, &first, level, KIND_DOOR_EAST, k, "DoorWayInt",
+                  x - WALL_HALF, r * ROOM_H + dy - DOOR_HALF, x + WALL_HALF, r * ROOM_H + dy + DOOR_HALF, outputs,
+                  level, KIND_ROOM, k, level, KIND_ROOM, k + 1, true);
+        if (_has_south(g, k))
+            _door(fp, &first, level, KIND_DOOR_SOUTH, k, "DoorWayInt",
+                  c * ROOM_W + dx - DOOR_HALF, y - WALL_HALF, c * ROOM_W + dx + DOOR_HALF, y + WALL_HALF, outputs,
+                  level, KIND_ROOM, k, level, KIND_ROOM, k + g.cols, true);
+    }
+
+    // Лестница слева от первого помещения
+    _element_begin(fp, &first, level, KIND_STAIR, 0, "Staircase", LEVEL_H);
+    fprintf(fp, "\"NumPeople\":0,");
+    _rect(fp, -ROOM_W, 0, 0, ROOM_H);
+    fprintf(fp, ",\"Output\":[");
+    if (outputs)
+    {
+        _uuid(fp, level, KIND_DOOR_STAIR, 0);
+        if (level == 0)                 { fprintf(fp, ","); _uuid(fp, level, KIND_EXIT, 0); }
+        if (level > 0)                  { fprintf(fp, ","); _uuid(fp, level - 1, KIND_DOOR_LEVEL, 0); }
+        if (level + 1 < levels_count)   { fprintf(fp, ","); _uuid(fp, level, KIND_DOOR_LEVEL, 0); }
+    }
+    fprintf(fp, "]}");
+
+    _door(fp, &first, level, KIND_DOOR_STAIR, 0, "DoorWayInt",
+          -WALL_HALF, dy - DOOR_HALF, WALL_HALF, dy + DOOR_HALF, outputs,
+          level, KIND_STAIR, 0, level, KIND_ROOM, 0, g.rooms > 0);
+
+    if (level == 0)
+        _door(fp, &first, level, KIND_EXIT, 0, "DoorWayOut",
+              -ROOM_W - WALL_HALF, dy - DOOR_HALF, -ROOM_W + WALL_HALF, dy + DOOR_HALF, outputs,
+              level, KIND_STAIR, 0, 0, 0, 0, false);
+
+    // Межэтажный проем внутри лестницы, он не касается соседних помещений
+    if (level + 1 < levels_count)
+        _door(fp, &first, level, KIND_DOOR_LEVEL, 0, "DoorWay",
+              -ROOM_W + 1, 1, -1, ROOM_H - 1, outputs,
+              level, KIND_STAIR, 0, level + 1, KIND_STAIR, 0, true);
+}
+
+int bim_generator_write(const char *filename, uint32_t levels_count, uint32_t rooms_per_level)
+{
+    return bim_generator_write_ex(filename, levels_count, rooms_per_level, 0);
+}
+
+int bim_generator_write_ex(const char *filename, uint32_t levels_count, uint32_t rooms_per_level, uint32_t flags)
+{
+    FILE *fp = fopen(filename, "w");
+    if (!fp)
+        return -1;
+
+    _grid_t g = _grid(rooms_per_level, flags);
+    fprintf(fp, "{\"NameBuilding\":\"Synthetic %ux%u\",", levels_count, rooms_per_level);
+    fprintf(fp, "\"Address\":{\"City\":\"\",\"StreetAddress\":\"\",\"AddInfo\":\"\"},");
+    fprintf(fp, "\"Level\":[");
+    for (uint32_t l = 0; l < levels_count; l++)
+    {
+        fprintf(fp, "%s{\"NameLevel\":\"Level %u\",\"ZLevel\":%.1f,\"BuildElement\":[", l ? "," : "", l, l * LEVEL_H);
+        _write_level(fp, l, levels_count, g, !(flags & BIM_GENERATOR_NO_OUTPUTS));
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "]}\n");
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+uint64_t bim_generator_elements_count(uint32_t levels_count, uint32_t rooms_per_level)
+{
+    _grid_t g = _grid(rooms_per_level, 0);
+    uint64_t per_level = g.rooms + 2; // помещения, лестница и дверь на лестницу
+    for (uint32_t k = 0; k < g.rooms; k++)
+        per_level += _has_east(g, k) + _has_south(g, k);
+
+    uint64_t count = per_level * levels_count;
+    if (levels_count > 0) count += 1 + (levels_count - 1); // выход и межэтажные проемы
+    return count;
+}
@@ -0,0 +1,67 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+\file
+\brief Генератор синтетических зданий для тестов и замеров производительности
+
+Здание состоит из одинаковых этажей. На каждом этаже помещения расположены
+сеткой и соединены дверями с соседями по строке, первый столбец сетки
+служит коридором. Лестница каждого этажа примыкает к первому помещению,
+лестницы соседних этажей соединены межэтажным проемом, выход из здания
+находится на лестнице первого этажа.
+*/
+
+#ifndef BIM_GENERATOR_H
+#define BIM_GENERATOR_H
+
+#include <stdint.h>
+
+/*!
+Записывает синтетическое здание в json-файл
+
+\param[in] filename         Имя файла
+\param[in] levels_count     Количество этажей
+\param[in] rooms_per_level  Количество помещений на каждом этаже
+\returns 0 в случае успеха, -1 при ошибке записи
+*/
+int         bim_generator_write         (const char *filename, uint32_t levels_count, uint32_t rooms_per_level);
+
+/// Не записывать связи элементов (пустые массивы "Output")
+#define BIM_GENERATOR_NO_OUTPUTS    0x1
+/// Соединить дверями соседей по столбцу во всех столбцах сетки, а не только в коридоре
+#define BIM_GENERATOR_MESH          0x2
+
+/*!
+То же, что bim_generator_write, с дополнительными флагами
+
+\param[in] filename         Имя файла
+\param[in] levels_count     Количество этажей
+\param[in] rooms_per_level  Количество помещений на каждом этаже
+\param[in] flags            Флаги BIM_GENERATOR_*
+\returns 0 в случае успеха, -1 при ошибке записи
+*/
+int         bim_generator_write_ex      (const char *filename, uint32_t levels_count, uint32_t rooms_per_level, uint32_t flags);
+
+/*!
+Количество элементов здания, которое будет записано bim_generator_write
+
+\param[in] levels_count     Количество этажей
+\param[in] rooms_per_level  Количество помещений на каждом этаже
+\returns Суммарное количество помещений, лестниц и переходов
+*/
+uint64_t    bim_generator_elements_count(uint32_t levels_count, uint32_t rooms_per_level);
+
+#endif //BIM_GENERATOR_H
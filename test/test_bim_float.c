@@ -0,0 +1,155 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include "bim_float.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+static uint64_t _rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t _rand64(void)
+{
+    _rng_state ^= _rng_state << 13;
+    _rng_state ^= _rng_state >> 7;
+    _rng_state ^= _rng_state << 17;
+    return _rng_state;
+}
+
+// Результат и позиция остановки должны совпадать со strtod до бита
+static void _assert_same(const char *str)
+{
+    char *end1, *end2;
+    double v1 = strtod(str, &end1);
+    double v2 = bim_float_strtod(str, &end2);
+    if (memcmp(&v1, &v2, sizeof (double)) != 0 || end1 != end2)
+    {
+        fprintf(stdout, "mismatch on \"%s\": %.17g (%ld) vs %.17g (%ld)\n",
+                str, v1, (long)(end1 - str), v2, (long)(end2 - str));
+        assert(0);
+    }
+}
+
+TEST_CASE edge_cases(void)
+{
+    __LOG_INFO__("started");
+    const char *cases[] =
+    {
+        "0", "-0", "0.0", "-0.0", "1", "-1", "0.1", "0.5", "1.5", "123.456",
+        "1e0", "1E5", "1e+5", "1e-5", "1.e5", "1.", ".5", "-.5", "+1.5", " 2.5",
+        "9007199254740992", "9007199254740993", "9007199254740995",
+        "18446744073709551615", "18446744073709551616", "1234567890123456789012345",
+        "0.000000000000000000000000000001", "0.1000000000000000000000000001",
+        "1e22", "1e23", "1e-22", "1e-23", "1e308", "1.7976931348623157e308", "1.8e308",
+        "2.2250738585072014e-308", "2.2250738585072011e-308", "4.9406564584124654e-324",
+        "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "1e400", "0e999999",
+        "8.98846567431158e307", "2.2204460492503131e-16", "7.038531e-26",
+        "9214843084008499", "0.30000000000000004", "1e", "1e+", "1e-x", "2.5e3x",
+        "-", ".", "-.", "x", "", "inf", "-Infinity", "nan", "0x1p3", "0X10",
+        "12.345678,", "-6.100000}", "00012", "1.2.3", "1e99999999999999999999",
+    };
+    for (size_t i = 0; i < sizeof (cases) / sizeof (cases[0]); i++)
+        _assert_same(cases[i]);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Случайные double, записанные так, как их пишут генераторы моделей
+TEST_CASE round_trip(size_t count)
+{
+    __LOG_INFO__("started");
+    char buf[64];
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t bits = _rand64();
+        double v;
+        memcpy(&v, &bits, sizeof (double));
+        if (isnan(v) || isinf(v))
+            continue;
+
+        snprintf(buf, sizeof (buf), "%.17g", v);
+        _assert_same(buf);
+        double parsed = bim_float_strtod(buf, NULL);
+        assert(memcmp(&parsed, &v, sizeof (double)) == 0);
+
+        snprintf(buf, sizeof (buf), "%.15e", v);
+        _assert_same(buf);
+    }
+    __LOG_INFO__(SUCCESS);
+}
+
+// Координаты в метрах с фиксированной точностью
+TEST_CASE coordinates(size_t count)
+{
+    __LOG_INFO__("started");
+    char buf[64];
+    for (size_t i = 0; i < count; i++)
+    {
+        double v = ((double)(_rand64() >> 11) / (double)(1ULL << 53) - 0.5) * 2e5;
+        snprintf(buf, sizeof (buf), "%.6f", v);
+        _assert_same(buf);
+        snprintf(buf, sizeof (buf), "%.3f", v);
+        _assert_same(buf);
+        snprintf(buf, sizeof (buf), "%.12g", v);
+        _assert_same(buf);
+    }
+    __LOG_INFO__(SUCCESS);
+}
+
+// Случайные строки цифр произвольной длины и порядка
+TEST_CASE random_digits(size_t count)
+{
+    __LOG_INFO__("started");
+    char buf[128];
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t r = _rand64();
+        size_t n = 0;
+        if (r & 1) buf[n++] = '-';
+        size_t int_digits = (r >> 1) % 12, frac_digits = (r >> 5) % 24;
+        for (size_t k = 0; k < int_digits; k++) buf[n++] = (char)('0' + _rand64() % 10);
+        if (frac_digits)
+        {
+            buf[n++] = '.';
+            for (size_t k = 0; k < frac_digits; k++) buf[n++] = (char)('0' + _rand64() % 10);
+        }
+        if ((r >> 10) & 1)
+            n += (size_t)snprintf(buf + n, sizeof (buf) - n, "e%d", (int)((r >> 11) % 700) - 350);
+        buf[n] = '\0';
+        _assert_same(buf);
+    }
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    edge_cases();
+    round_trip(1000000);
+    coordinates(1000000);
+    random_digits(1000000);
+
+    printf("====== TESTS END ======\n");
+    return 0;
+}
@@ -0,0 +1,625 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <math.h>
+#include "bim_json_object.h"
+#include "bim_polygon_tools.h"
+#include "bim_tools.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+// Внутренняя функция bim_tools.c
+int _calculate_transits_width(ArrayList *zones, ArrayList *transits, uint32_t handles_count);
+
+// Счетчик обращений к куче, функции подменяются при сборке (-Wl,--wrap)
+static uint64_t _allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+
+void* __wrap_malloc(size_t size)                { _allocs++; return __real_malloc(size); }
+void* __wrap_calloc(size_t nmemb, size_t size)  { _allocs++; return __real_calloc(nmemb, size); }
+void* __wrap_realloc(void *ptr, size_t size)    { _allocs++; return __real_realloc(ptr, size); }
+
+static bool _near(double v1, double v2, double rel)
+{
+    return fabs(v1 - v2) <= rel * fmax(fabs(v1), fabs(v2)) + 1e-300;
+}
+
+static double _area(point_t *points, size_t count)
+{
+    polygon_t polygon = {count, points};
+    return geom_tools_area_polygon(polygon);
+}
+
+TEST_CASE area_shapes(void)
+{
+    __LOG_INFO__("started");
+
+    point_t square[] = {{0, 0}, {2, 0}, {2, 2}, {0, 2}, {0, 0}};
+    assert(_area(square, 5) == 4);
+    assert(_area(square, 4) == 4);                  // Контур без повтора первой точки
+
+    point_t square_cw[] = {{0, 0}, {0, 2}, {2, 2}, {2, 0}, {0, 0}};
+    assert(_area(square_cw, 5) == 4);               // Обход по часовой стрелке
+
+    point_t triangle[] = {{0, 0}, {4, 0}, {0, 3}};
+    assert(_area(triangle, 3) == 6);
+
+    // Невыпуклое L-образное помещение 3x3 без угла 2x2
+    point_t l_shape[] = {{0, 0}, {3, 0}, {3, 1}, {1, 1}, {1, 3}, {0, 3}, {0, 0}};
+    assert(_area(l_shape, 7) == 5);
+
+    // Здание далеко от начала координат
+    point_t far[] = {{1e6, 1e6}, {1e6 + 0.3, 1e6}, {1e6 + 0.3, 1e6 + 0.7}, {1e6, 1e6 + 0.7}, {1e6, 1e6}};
+    assert(_near(_area(far, 5), 0.21, 1e-9));
+
+    assert(_area(square, 2) == 0);
+    assert(_area(square, 0) == 0);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+// Случайные звездчатые многоугольники: сравнение с суммой в long double
+TEST_CASE area_random(size_t count)
+{
+    __LOG_INFO__("started");
+    srand(1);
+    point_t points[64];
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t n = 3 + rand() % 60;
+        double cx = (rand() % 2000) - 1000.0, cy = (rand() % 2000) - 1000.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            double angle = 2 * M_PI * i / n;
+            double r = 1 + 10.0 * rand() / RAND_MAX;
+            points[i].x = cx + r * cos(angle);
+            points[i].y = cy + r * sin(angle);
+        }
+
+        long double reference = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const point_t *a = &points[i], *b = &points[(i + 1) % n];
+            reference += ((long double)a->x - cx) * ((long double)b->y - cy)
+                       - ((long double)b->x - cx) * ((long double)a->y - cy);
+        }
+        assert(_near(_area(points, n), (double)(fabsl(reference) / 2), 1e-12));
+    }
+    __LOG_INFO__(SUCCESS);
+}
+
+// Пакетный вызов совпадает с поэлементным, а на файлах из res -- с прежним
+// вычислением через триангуляцию (все помещения в них прямоугольные)
+TEST_CASE area_files(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_json_object_t *bim = bim_json_new(filename);
+    assert(bim);
+    for (size_t i = 0; i < bim->levels_count; i++)
+    {
+        const bim_json_level_t *level = &bim->levels[i];
+        const polygon_t **polygons = (const polygon_t **)malloc(sizeof (polygon_t *) * level->elements_count);
+        double *areas = (double *)malloc(sizeof (double) * level->elements_count);
+        for (size_t j = 0; j < level->elements_count; j++)
+            polygons[j] = level->elements[j].polygon;
+        geom_tools_area_polygons(polygons, level->elements_count, areas);
+
+        for (size_t j = 0; j < level->elements_count; j++)
+        {
+            assert(areas[j] == geom_tools_area_polygon(*polygons[j]));
+            assert(_near(areas[j], geom_tools_area_polygon_triangulated(*polygons[j]), 1e-12));
+        }
+        free(polygons);
+        free(areas);
+    }
+    bim_json_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+static uint8_t _inside(double x, double y, point_t *points, size_t count)
+{
+    point_t point = {x, y};
+    polygon_t polygon = {count, points};
+    return geom_tools_is_point_in_polygon(point, &polygon);
+}
+
+TEST_CASE point_in_shapes(void)
+{
+    __LOG_INFO__("started");
+
+    point_t square[] = {{0, 0}, {2, 0}, {2, 2}, {0, 2}, {0, 0}};
+    assert(_inside(1, 1, square, 5) == 1);
+    assert(_inside(1, 1, square, 4) == 1);          // Контур без повтора первой точки
+    assert(_inside(3, 1, square, 5) == 0);
+    assert(_inside(-1e-9, 1, square, 5) == 0);
+    assert(_inside(2, 1, square, 5) == 1);          // Точка на ребре
+    assert(_inside(1, 0, square, 5) == 1);
+    assert(_inside(2, 2, square, 5) == 1);          // Точка в вершине
+    assert(_inside(1, 2, square, 4) == 1);          // На замыкающем ребре
+
+    point_t square_cw[] = {{0, 0}, {0, 2}, {2, 2}, {2, 0}, {0, 0}};
+    assert(_inside(1, 1, square_cw, 5) == 1);
+    assert(_inside(1, 3, square_cw, 5) == 0);
+
+    // Точка в вырезанном углу L-образного помещения лежит внутри выпуклой
+    // оболочки, но не внутри помещения
+    point_t l_shape[] = {{0, 0}, {3, 0}, {3, 1}, {1, 1}, {1, 3}, {0, 3}, {0, 0}};
+    assert(_inside(2, 2, l_shape, 7) == 0);
+    assert(_inside(0.5, 2, l_shape, 7) == 1);
+    assert(_inside(2, 0.5, l_shape, 7) == 1);
+    assert(_inside(2, 1, l_shape, 7) == 1);
+    assert(_inside(1, 2, l_shape, 7) == 1);
+
+    // Луч от точки проходит через вершины контура
+    point_t diamond[] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+    assert(_inside(0, 0, diamond, 4) == 1);
+    assert(_inside(-2, 0, diamond, 4) == 0);
+    assert(_inside(2, 0, diamond, 4) == 0);
+    assert(_inside(0.5, 0.5, diamond, 4) == 1);
+
+    assert(_inside(0, 0, square, 2) == 0);
+
+    point_t points[] = {{1, 1}, {3, 1}, {2, 2}, {-1, -1}, {0.5, 0}};
+    uint8_t inside[5];
+    polygon_t polygon = {5, square};
+    geom_tools_is_points_in_polygon(points, 5, &polygon, inside);
+    assert(inside[0] == 1 && inside[1] == 0 && inside[2] == 1 && inside[3] == 0 && inside[4] == 1);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+// Случайные точки около звездчатых многоугольников: пакетный вызов и вызов
+// с готовыми данными многоугольника совпадают с поэлементным, а внутренняя часть звезды (круг радиуса 1) всегда внутри
+TEST_CASE point_in_random(size_t count)
+{
+    __LOG_INFO__("started");
+    srand(2);
+    point_t points[64];
+    point_t queries[32];
+    uint8_t inside[32];
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t n = 3 + rand() % 60;
+        double cx = (rand() % 2000) - 1000.0, cy = (rand() % 2000) - 1000.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            double angle = 2 * M_PI * i / n;
+            double r = 1 + 10.0 * rand() / RAND_MAX;
+            points[i].x = cx + r * cos(angle);
+            points[i].y = cy + r * sin(angle);
+        }
+        polygon_t polygon = {n, points};
+
+        for (size_t i = 0; i < 32; i++)
+        {
+            queries[i].x = cx + 24.0 * rand() / RAND_MAX - 12;
+            queries[i].y = cy + 24.0 * rand() / RAND_MAX - 12;
+        }
+        point_t edges[64];
+        polygon_cache_t cache;
+        geom_tools_polygon_cache_init(&cache, &polygon, edges);
+        uint8_t inside_cached[32];
+        geom_tools_is_points_in_polygon_cached(queries, 32, &cache, inside_cached);
+
+        geom_tools_is_points_in_polygon(queries, 32, &polygon, inside);
+        for (size_t i = 0; i < 32; i++)
+        {
+            assert(inside[i] == geom_tools_is_point_in_polygon(queries[i], &polygon));
+            assert(inside[i] == inside_cached[i]);
+            double d = hypot(queries[i].x - cx, queries[i].y - cy);
+            if (d < 0.5) assert(inside[i] == 1);
+            if (d > 11)  assert(inside[i] == 0);
+        }
+    }
+    __LOG_INFO__(SUCCESS);
+}
+
+// Вершины проемов относительно всех зон этажа: результат совпадает
+// с прежней проверкой через триангуляцию (все зоны в res прямоугольные)
+TEST_CASE point_in_files(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_json_object_t *bim = bim_json_new(filename);
+    assert(bim);
+    size_t matches = 0;
+    for (size_t i = 0; i < bim->levels_count; i++)
+    {
+        const bim_json_level_t *level = &bim->levels[i];
+        for (size_t t = 0; t < level->elements_count; t++)
+        {
+            const bim_json_element_t *transit = &level->elements[t];
+            if (transit->sign == ROOM || transit->sign == STAIR) continue;
+
+            const polygon_t *tpolygon = transit->polygon;
+            uint8_t inside[tpolygon->point_count];
+            for (size_t z = 0; z < level->elements_count; z++)
+            {
+                const bim_json_element_t *zone = &level->elements[z];
+                if (zone->sign != ROOM && zone->sign != STAIR) continue;
+
+                geom_tools_is_points_in_polygon(tpolygon->points, tpolygon->point_count, zone->polygon, inside);
+                for (size_t j = 0; j < tpolygon->point_count; j++)
+                {
+                    assert(inside[j] == geom_tools_is_point_in_polygon(tpolygon->points[j], zone->polygon));
+                    assert(inside[j] == geom_tools_is_point_in_polygon_triangulated(tpolygon->points[j], zone->polygon));
+                    matches += inside[j];
+                }
+            }
+        }
+    }
+    assert(matches > 0);
+    bim_json_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Поиск пересеченных ребер совпадает с перебором ребер через geom_tools_is_intersect_line
+TEST_CASE intersected_edges_random(size_t count)
+{
+    __LOG_INFO__("started");
+    srand(3);
+    point_t points[65];
+    point_t edges[65];
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t n = 3 + rand() % 60;
+        double cx = (rand() % 2000) - 1000.0, cy = (rand() % 2000) - 1000.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            double angle = 2 * M_PI * i / n;
+            double r = 1 + 10.0 * rand() / RAND_MAX;
+            points[i].x = cx + r * cos(angle);
+            points[i].y = cy + r * sin(angle);
+        }
+        points[n] = points[0];  // Замкнутый контур, как в файлах модели
+        polygon_t polygon = {n + 1, points};
+        polygon_cache_t cache;
+        geom_tools_polygon_cache_init(&cache, &polygon, edges);
+
+        point_t q1 = {cx + 30.0 * rand() / RAND_MAX - 15, cy + 30.0 * rand() / RAND_MAX - 15};
+        point_t q2 = {cx + 30.0 * rand() / RAND_MAX - 15, cy + 30.0 * rand() / RAND_MAX - 15};
+        line_t line = {q1, q2};
+
+        size_t expected = 0, expected_last = 0;
+        for (size_t i = 1; i < polygon.point_count; i++)
+        {
+            line_t edge = {points[i - 1], points[i]};
+            if (geom_tools_is_intersect_line(line, edge))
+            {
+                expected++;
+                expected_last = i - 1;
+            }
+        }
+
+        size_t last = 0;
+        assert(geom_tools_intersected_edges(&cache, line, &last) == expected);
+        if (expected) assert(last == expected_last);
+    }
+
+    point_t square[] = {{0, 0}, {2, 0}, {2, 2}, {0, 2}, {0, 0}};
+    polygon_t polygon = {5, square};
+    polygon_cache_t cache;
+    geom_tools_polygon_cache_init(&cache, &polygon, edges);
+    assert(cache.min.x == 0 && cache.min.y == 0 && cache.max.x == 2 && cache.max.y == 2);
+
+    point_t a = {1, 1}, b = {1, 3}, c = {5, 5}, d = {6, 6};
+    line_t crossing = {a, b}, away = {c, d};
+    size_t last = 0;
+    assert(geom_tools_intersected_edges(&cache, crossing, &last) == 1 && last == 2);
+    assert(geom_tools_intersected_edges(&cache, away, &last) == 0);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+// Функции геометрии, кроме прежних функций на основе триангуляции,
+// не обращаются к куче
+TEST_CASE zero_alloc_geometry(void)
+{
+    __LOG_INFO__("started");
+
+    point_t square[] = {{0, 0}, {2, 0}, {2, 2}, {0, 2}, {0, 0}};
+    polygon_t polygon = {5, square};
+    const polygon_t *polygons[] = {&polygon, &polygon};
+    point_t points[] = {{1, 1}, {3, 1}, {2, 2}};
+    point_t edges[5];
+    polygon_cache_t cache;
+    double areas[2];
+    uint8_t inside[3];
+    size_t last = 0;
+    line_t line = {{1, 1}, {1, 3}}, edge = {{0, 2}, {2, 2}};
+
+    _allocs = 0;
+    assert(geom_tools_area_polygon(polygon) == 4);
+    geom_tools_area_polygons(polygons, 2, areas);
+    assert(geom_tools_is_point_in_polygon(points[0], &polygon) == 1);
+    geom_tools_is_points_in_polygon(points, 3, &polygon, inside);
+    geom_tools_polygon_cache_init(&cache, &polygon, edges);
+    assert(geom_tools_is_point_in_polygon_cached(points[1], &cache) == 0);
+    geom_tools_is_points_in_polygon_cached(points, 3, &cache, inside);
+    assert(geom_tools_intersected_edges(&cache, line, &last) == 1);
+    assert(geom_tools_is_intersect_line(line, edge) == 1);
+    assert(geom_tools_length_side(points[0], points[1]) == 2);
+
+    point_t nearest = geom_tools_nearest_point(points[1], edge);
+    assert(nearest.x == 2 && nearest.y == 2);
+    line_t degenerate = {{5, 5}, {5, 5}};
+    nearest = geom_tools_nearest_point(points[0], degenerate);
+    assert(nearest.x == 5 && nearest.y == 5);
+    assert(_allocs == 0);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+// Вычисление ширины всех проемов здания выделяет один блок рабочей памяти,
+// независимо от количества проемов
+TEST_CASE zero_alloc_transits_width(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+
+    float widths[bim->transits->length];
+    for (size_t i = 0; i < bim->transits->length; i++)
+    {
+        bim_transit_t *transit = bim->transits->data[i];
+        widths[i] = transit->width;
+        transit->width = -1;
+    }
+
+    _allocs = 0;
+    assert(_calculate_transits_width(bim->zones, bim->transits, bim->json->handles_count) == 0);
+    assert(_allocs == 1);
+
+    for (size_t i = 0; i < bim->transits->length; i++)
+        assert(((bim_transit_t *)bim->transits->data[i])->width == widths[i]);
+
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Точный знак ориентации: координаты -- целые числа, умноженные на 2^-53
+static int _exact_orient(point_t a, point_t b, point_t c)
+{
+    const double scale = 9007199254740992.0; // 2^53
+    __int128 ax = (__int128)(a.x * scale), ay = (__int128)(a.y * scale);
+    __int128 bx = (__int128)(b.x * scale), by = (__int128)(b.y * scale);
+    __int128 cx = (__int128)(c.x * scale), cy = (__int128)(c.y * scale);
+    __int128 det = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+    return (det > 0) - (det < 0);
+}
+
+static int _sign(double v)
+{
+    return (v > 0) - (v < 0);
+}
+
+// Почти коллинеарные точки (пример Кеттнера и др.): точка p рядом с (0.5, 0.5)
+// и прямая через (24, 24) и (-24, -24). В double знак ориентации ошибается,
+// точные предикаты дают верный знак для всех точек
+TEST_CASE robust_predicates(void)
+{
+    __LOG_INFO__("started");
+    const double ulp = 1.0 / 9007199254740992.0; // 2^-53, шаг double около 0.5
+    const point_t a = {24, 24}, b = {-24, -24};
+    point_t triangle[] = {a, b, {24, -24}};
+    polygon_t polygon = {3, triangle};
+    point_t edges[3];
+    polygon_cache_t cache;
+    geom_tools_polygon_cache_init(&cache, &polygon, edges);
+
+    size_t flips = 0;
+    for (int robust = 0; robust < 2; robust++)
+    {
+        geom_tools_set_robust(robust);
+        assert(geom_tools_get_robust() == robust);
+        for (int i = 0; i < 64; i++)
+        {
+            for (int j = 0; j < 64; j++)
+            {
+                point_t p = {0.5 + i * ulp, 0.5 + j * ulp};
+                int exact = _exact_orient(a, b, p);
+                assert(_sign(geom_tools_orient2d(a, b, p)) == exact);
+
+                // Треугольник обходится против часовой стрелки: точка внутри,
+                // если она слева от ребра ab или на нем
+                uint8_t expected = exact >= 0;
+                uint8_t inside = geom_tools_is_point_in_polygon(p, &polygon);
+                assert(inside == geom_tools_is_point_in_polygon_cached(p, &cache));
+                if (robust)
+                {
+                    assert(inside == expected);
+                    line_t diagonal = {{p.x - 1, p.y + 1}, {p.x + 1, p.y - 1}};
+                    assert(geom_tools_is_intersect_line((line_t){a, b}, diagonal) == 1);
+                } else
+                {
+                    flips += inside != expected;
+                }
+            }
+        }
+    }
+    geom_tools_set_robust(false);
+    assert(flips > 0); // Без точных предикатов ошибки действительно возникают
+
+    __LOG_INFO__(SUCCESS);
+}
+
+// Площадь по треугольникам, как в geom_tools_area_polygon_triangulated
+static double _area_triangles(const polygon_t *polygon, const int *triangles, size_t count)
+{
+    double area = 0;
+    for (size_t i = 0; i < 3 * count; i += 3)
+    {
+        const point_t *a = &polygon->points[triangles[i]];
+        const point_t *b = &polygon->points[triangles[i + 1]];
+        const point_t *c = &polygon->points[triangles[i + 2]];
+        double ab = geom_tools_length_side(*a, *b);
+        double bc = geom_tools_length_side(*b, *c);
+        double ca = geom_tools_length_side(*c, *a);
+        double p = (ab + bc + ca) * 0.5;
+        area += sqrt(p * (p - ab) * (p - bc) * (p - ca));
+    }
+    return area;
+}
+
+// Триангуляция набора выпуклых многоугольников с общей рабочей памятью:
+// количество выделений памяти не зависит от количества многоугольников,
+// повторная триангуляция того же набора не выделяет память
+TEST_CASE triangulation_workspace(size_t count)
+{
+    __LOG_INFO__("started");
+    srand(2);
+    polygon_t *polygons = (polygon_t *)malloc(sizeof (polygon_t) * count);
+    const polygon_t **ptrs = (const polygon_t **)malloc(sizeof (polygon_t *) * count);
+    size_t *offsets = (size_t *)malloc(sizeof (size_t) * (count + 1));
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t n = 3 + rand() % 30;
+        double cx = (rand() % 2000) - 1000.0, cy = (rand() % 2000) - 1000.0, r = 1 + 10.0 * rand() / RAND_MAX;
+        polygons[k].point_count = n;
+        polygons[k].points = (point_t *)malloc(sizeof (point_t) * n);
+        for (size_t i = 0; i < n; i++)
+        {
+            double angle = 2 * M_PI * i / n;
+            polygons[k].points[i] = (point_t){cx + r * cos(angle), cy + r * sin(angle)};
+        }
+        ptrs[k] = &polygons[k];
+    }
+
+    geom_triangulation_t *ws = geom_tools_triangulation_new();
+    assert(ws);
+    _allocs = 0;
+    const int *triangles = geom_tools_triangulate_polygons(ws, ptrs, count, offsets);
+    uint64_t allocs = geom_tools_triangulation_allocs(ws);
+    assert(_allocs == allocs);  // Triangle не обращается к malloc напрямую
+    assert(allocs < 32);
+
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t n = offsets[k + 1] - offsets[k];
+        assert(n == polygons[k].point_count - 2);
+        assert(_near(_area_triangles(&polygons[k], triangles + 3 * offsets[k], n), geom_tools_area_polygon(polygons[k]), 1e-9));
+    }
+
+    _allocs = 0;
+    geom_tools_triangulate_polygons(ws, ptrs, count, offsets);
+    assert(_allocs == 0 && geom_tools_triangulation_allocs(ws) == allocs);
+
+    for (size_t k = 0; k < count; k += 97)
+    {
+        const int *single = NULL;
+        size_t n = geom_tools_triangulate(ws, &polygons[k], &single);
+        assert(n == polygons[k].point_count - 2);
+        assert(_area_triangles(&polygons[k], single, n) == geom_tools_area_polygon_triangulated(polygons[k]));
+    }
+    assert(_allocs == 0);
+
+    polygon_t segment = {2, polygons[0].points};
+    const int *none = NULL;
+    assert(geom_tools_triangulate(ws, &segment, &none) == 0);
+
+    geom_tools_triangulation_free(ws);
+    for (size_t k = 0; k < count; k++)
+        free(polygons[k].points);
+    free(polygons);
+    free(ptrs);
+    free(offsets);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Ширины проемов не зависят от количества потоков. Ошибка в одном проеме
+// не прерывает вычисление остальных
+TEST_CASE transits_width_threads(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+
+    size_t count = bim->transits->length;
+    float widths[count];
+    for (size_t i = 0; i < count; i++)
+        widths[i] = ((bim_transit_t *)bim->transits->data[i])->width;
+
+    uint32_t threads[] = {2, 3, 8};
+    for (size_t t = 0; t < sizeof (threads) / sizeof (threads[0]); t++)
+    {
+        bim_tools_set_threads(threads[t]);
+        for (size_t i = 0; i < count; i++)
+            ((bim_transit_t *)bim->transits->data[i])->width = -1;
+        assert(_calculate_transits_width(bim->zones, bim->transits, bim->json->handles_count) == 0);
+        for (size_t i = 0; i < count; i++)
+            assert(((bim_transit_t *)bim->transits->data[i])->width == widths[i]);
+    }
+
+    // Проем ссылается на несуществующую зону
+    bim_transit_t *broken = bim->transits->data[count / 2];
+    uint32_t output = broken->base->outputs[0];
+    broken->base->outputs[0] = bim->json->handles_count + 1;
+    for (size_t i = 0; i < count; i++)
+        ((bim_transit_t *)bim->transits->data[i])->width = -1;
+    assert(_calculate_transits_width(bim->zones, bim->transits, bim->json->handles_count) == -1);
+    for (size_t i = 0; i < count; i++)
+    {
+        const bim_transit_t *transit = bim->transits->data[i];
+        assert(transit == broken ? transit->width == -1 : transit->width == widths[i]);
+    }
+    broken->base->outputs[0] = output;
+    bim_tools_set_threads(1);
+
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    area_shapes();
+    area_random(10000);
+    area_files(ROOT_PATH"/one_zone_one_exit.json");
+    area_files(ROOT_PATH"/three_zone_three_transit.json");
+    area_files(ROOT_PATH"/two_levels.json");
+    area_files(ROOT_PATH"/building_test.json");
+
+    point_in_shapes();
+    point_in_random(10000);
+    intersected_edges_random(10000);
+    point_in_files(ROOT_PATH"/one_zone_one_exit.json");
+    point_in_files(ROOT_PATH"/three_zone_three_transit.json");
+    point_in_files(ROOT_PATH"/two_levels.json");
+    point_in_files(ROOT_PATH"/building_test.json");
+
+    zero_alloc_geometry();
+    robust_predicates();
+    triangulation_workspace(5000);
+    zero_alloc_transits_width(ROOT_PATH"/one_zone_one_exit.json");
+    zero_alloc_transits_width(ROOT_PATH"/three_zone_three_transit.json");
+    zero_alloc_transits_width(ROOT_PATH"/two_levels.json");
+    zero_alloc_transits_width(ROOT_PATH"/building_test.json");
+    transits_width_threads(ROOT_PATH"/three_zone_three_transit.json");
+    transits_width_threads(ROOT_PATH"/two_levels.json");
+    transits_width_threads(ROOT_PATH"/building_test.json");
+
+    printf("====== TESTS END ======\n");
+}
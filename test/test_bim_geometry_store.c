@@ -0,0 +1,232 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <float.h>
+#include "bim_tools.h"
+#include "bim_geometry_store.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define STORE_FILE "test_bim_geometry_store.json"
+
+// Многоугольник этажа в порядке нумерации хранилища
+static const polygon_t* _polygon(const bim_level_t *level, size_t k)
+{
+    return k < level->zone_count ? level->zones[k].base->polygon : level->transits[k - level->zone_count].base->polygon;
+}
+
+static double _perimeter(const polygon_t *polygon)
+{
+    double perimeter = 0;
+    for (size_t i = 0; i < polygon->point_count; i++)
+        perimeter += geom_tools_length_side(polygon->points[i], polygon->points[(i + 1) % polygon->point_count]);
+    return perimeter;
+}
+
+// Ближайшая точка контура перебором ребер через geom_tools_nearest_point
+static double _distance(const polygon_t *polygon, point_t point)
+{
+    double best = INFINITY;
+    for (size_t i = 0; i < polygon->point_count; i++)
+    {
+        line_t edge = {polygon->points[i], polygon->points[(i + 1) % polygon->point_count]};
+        double d = geom_tools_length_side(point, geom_tools_nearest_point(point, edge));
+        if (d < best) best = d;
+    }
+    return best;
+}
+
+// Погрешность координаты в режиме float: половина FLT_EPSILON от размера этажа
+static double _delta(const bim_geometry_store_t *store)
+{
+    double extent = 0;
+    for (size_t k = 0; k < store->polygon_count; k++)
+        if (bim_geometry_store_point_count(store, k) > 0)
+        {
+            extent = fmax(extent, fmax(fabs(store->boxes[2 * k + 1].x), fabs(store->boxes[2 * k + 1].y)));
+            extent = fmax(extent, fmax(fabs(store->boxes[2 * k].x), fabs(store->boxes[2 * k].y)));
+        }
+    return extent * FLT_EPSILON / 2;
+}
+
+// Расположение вершин в хранилище
+TEST_CASE store_layout(void)
+{
+    __LOG_INFO__("started");
+    point_t square[] = {{1, 1}, {3, 1}, {3, 3}, {1, 3}, {1, 1}};
+    point_t segment[] = {{0, 0}, {1, 0}};
+    polygon_t p1 = {5, square}, p2 = {2, segment};
+    const polygon_t *polygons[] = {&p1, NULL, &p2};
+
+    bim_geometry_precision_t precisions[] = {BIM_GEOMETRY_DOUBLE, BIM_GEOMETRY_FLOAT};
+    for (size_t t = 0; t < 2; t++)
+    {
+        bim_geometry_store_t *store = bim_geometry_store_new_polygons(polygons, 3, precisions[t]);
+        assert(store);
+        assert(store->polygon_count == 3);
+        assert(store->offsets[0] == 0 && store->offsets[1] == 6 && store->offsets[2] == 6 && store->offsets[3] == 9);
+        assert(bim_geometry_store_point_count(store, 0) == 5);
+        assert(bim_geometry_store_point_count(store, 1) == 0);
+        assert(bim_geometry_store_point_count(store, 2) == 2);
+        if (precisions[t] == BIM_GEOMETRY_FLOAT)
+            assert(store->origin.x == 0 && store->origin.y == 0); // Левый нижний угол всех вершин
+        assert(store->boxes[0].x == 1 - store->origin.x && store->boxes[1].y == 3 - store->origin.y);
+
+        double areas[3];
+        bim_geometry_store_areas(store, areas);
+        assert(areas[0] == 4 && areas[1] == 0 && areas[2] == 0);
+
+        point_t points[] = {{2, 2}, {1, 2}, {0, 2}, {3, 3}, {4, 4}};
+        uint8_t inside[5];
+        bim_geometry_store_points_in_polygon(store, 0, points, 5, inside);
+        assert(inside[0] == 1 && inside[1] == 1 && inside[2] == 0 && inside[3] == 1 && inside[4] == 0);
+        bim_geometry_store_points_in_polygon(store, 1, points, 5, inside);
+        assert(inside[0] == 0);
+
+        size_t last = 0;
+        assert(bim_geometry_store_intersected_edges(store, 0, (line_t){{0, 2}, {4, 2}}, &last) == 2);
+        assert(last == 3);
+        assert(bim_geometry_store_intersected_edges(store, 0, (line_t){{5, 5}, {6, 6}}, &last) == 0);
+
+        size_t edge = 0;
+        point_t nearest = bim_geometry_store_nearest_point(store, 0, (point_t){2, 0}, &edge);
+        assert(nearest.x == 2 && nearest.y == 1 && edge == 0);
+        nearest = bim_geometry_store_nearest_point(store, 1, (point_t){2, 0}, NULL);
+        assert(nearest.x == 2 && nearest.y == 0);
+
+        bim_geometry_store_free(store);
+    }
+    __LOG_INFO__(SUCCESS);
+}
+
+// Результаты по хранилищу double совпадают с bim_polygon_tools,
+// по хранилищу float -- отличаются не больше погрешности координат
+static void _check_level(const bim_level_t *level, bim_geometry_precision_t precision)
+{
+    bim_geometry_store_t *store = bim_geometry_store_new(level, precision);
+    assert(store);
+    size_t count = level->zone_count + level->transit_count;
+    assert(store->polygon_count == count);
+    bool exact = precision == BIM_GEOMETRY_DOUBLE;
+    double delta = _delta(store);
+
+    double *areas = (double *)malloc(sizeof (double) * count);
+    bim_geometry_store_areas(store, areas);
+    for (size_t k = 0; k < count; k++)
+    {
+        const polygon_t *polygon = _polygon(level, k);
+        double area = geom_tools_area_polygon(*polygon);
+        double bound = exact ? 1e-9 * fmax(1, area) : 2 * delta * _perimeter(polygon) + 1e-9;
+        assert(fabs(areas[k] - area) <= bound);
+    }
+    free(areas);
+
+    point_t *edges = (point_t *)malloc(sizeof (point_t) * 1024);
+    for (size_t t = 0; t < level->transit_count; t++)
+    {
+        const polygon_t *transit = level->transits[t].base->polygon;
+        for (size_t z = 0; z < level->zone_count; z++)
+        {
+            const polygon_t *zone = level->zones[z].base->polygon;
+            uint8_t inside[transit->point_count], expected[transit->point_count];
+            bim_geometry_store_points_in_polygon(store, z, transit->points, transit->point_count, inside);
+            geom_tools_is_points_in_polygon(transit->points, transit->point_count, zone, expected);
+
+            for (size_t i = 0; i < transit->point_count; i++)
+            {
+                point_t point = transit->points[i];
+                // Расхождение возможно только у точек около границы
+                assert(inside[i] == expected[i] || (!exact && _distance(zone, point) <= 4 * delta));
+
+                size_t edge = 0;
+                point_t nearest = bim_geometry_store_nearest_point(store, z, point, &edge);
+                double distance = _distance(zone, point);
+                if (exact)
+                    assert(geom_tools_length_side(point, nearest) == distance);
+                else
+                    assert(fabs(geom_tools_length_side(point, nearest) - distance) <= 4 * delta);
+            }
+
+            if (!exact || zone->point_count > 1024)
+                continue;
+            polygon_cache_t cache;
+            geom_tools_polygon_cache_init(&cache, zone, edges);
+            for (size_t i = 0; i + 1 < transit->point_count; i++)
+            {
+                line_t line = {transit->points[i], transit->points[i + 1]};
+                size_t last = 0, expected_last = 0;
+                assert(bim_geometry_store_intersected_edges(store, z, line, &last)
+                       == geom_tools_intersected_edges(&cache, line, &expected_last));
+                assert(last == expected_last);
+            }
+        }
+    }
+    free(edges);
+    bim_geometry_store_free(store);
+}
+
+TEST_CASE store_files(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+    for (size_t i = 0; i < bim->object->levels_count; i++)
+    {
+        _check_level(&bim->object->levels[i], BIM_GEOMETRY_DOUBLE);
+        _check_level(&bim->object->levels[i], BIM_GEOMETRY_FLOAT);
+    }
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+TEST_CASE store_generated(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(STORE_FILE, levels_count, rooms) == 0);
+    store_files(STORE_FILE);
+    remove(STORE_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    bim_tools_set_keep_geometry(true);
+
+    store_layout();
+    store_files(ROOT_PATH"/one_zone_one_exit.json");
+    store_files(ROOT_PATH"/three_zone_three_transit.json");
+    store_files(ROOT_PATH"/two_levels.json");
+    store_files(ROOT_PATH"/building_test.json");
+    store_generated(3, 50);
+
+    // С точными предикатами результаты также совпадают с bim_polygon_tools
+    geom_tools_set_robust(true);
+    store_files(ROOT_PATH"/building_test.json");
+    store_generated(2, 50);
+    geom_tools_set_robust(false);
+
+    printf("====== TESTS END ======\n");
+}
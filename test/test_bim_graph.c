@@ -0,0 +1,293 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_evac.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define GRAPH_FILE      "test_bim_graph.json"
+#define GRAPH_CACHE     "test_bim_graph.bimb"
+
+// Количество обращений к куче (см. --wrap в CMakeLists.txt)
+static uint64_t _allocs = 0;
+// Номер обращения к куче, которое завершится ошибкой (0 -- без ошибок)
+static uint64_t _fail_at = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+
+static bool _fail(void) { return ++_allocs == _fail_at; }
+
+void* __wrap_malloc(size_t size)                { return _fail() ? NULL : __real_malloc(size); }
+void* __wrap_calloc(size_t nmemb, size_t size)  { return _fail() ? NULL : __real_calloc(nmemb, size); }
+void* __wrap_realloc(void *ptr, size_t size)    { return _fail() ? NULL : __real_realloc(ptr, size); }
+
+// Граф CSR совпадает со списками смежности, включая порядок смежных вершин
+static void _assert_graph_eq_list(const bim_graph_t *graph, const bim_graph_list_t *list)
+{
+    assert(graph->node_count == list->node_count);
+    assert(graph->offsets[0] == 0);
+    assert(graph->offsets[graph->node_count] == 2 * graph->edge_count);
+    for (uint32_t v = 0; v < graph->node_count; v++)
+    {
+        const bim_node *node = list->head[v];
+        uint32_t k = graph->offsets[v];
+        for (; node && k < graph->offsets[v + 1]; node = node->next, k++)
+        {
+            assert(graph->adjacent[k].dest == node->dest);
+            assert(graph->adjacent[k].eid == node->eid);
+        }
+        assert(!node && k == graph->offsets[v + 1]);
+    }
+}
+
+TEST_CASE graph_files(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+
+    bim_graph_t *graph = bim_graph_new(bim);
+    bim_graph_list_t *list = bim_graph_list_new(bim);
+    assert(graph && list);
+    assert(graph->node_count == bim->zones->length);
+    assert(graph->edge_count == bim->transits->length);
+    _assert_graph_eq_list(graph, list);
+
+    // Каждый переход записан ровно у двух зон
+    uint8_t *seen = (uint8_t *)calloc(graph->edge_count, sizeof (uint8_t));
+    for (uint32_t k = 0; k < 2 * graph->edge_count; k++)
+    {
+        assert(graph->adjacent[k].dest < graph->node_count);
+        assert(graph->adjacent[k].eid < graph->edge_count);
+        seen[graph->adjacent[k].eid]++;
+    }
+    for (uint32_t i = 0; i < graph->edge_count; i++)
+        assert(seen[i] == 2);
+    free(seen);
+
+    bim_graph_list_free(list);
+    bim_graph_free(graph);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+static bool _has_output(const bim_zone_t *zone, uint32_t handle)
+{
+    for (size_t i = 0; i < zone->base->outputs_count; i++)
+        if (zone->base->outputs[i] == handle)
+            return true;
+    return false;
+}
+
+// Ребра, построенные по связям переходов, согласованы со связями зон:
+// обе зоны ребра ссылаются на переход
+TEST_CASE graph_edges(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(GRAPH_FILE, levels_count, rooms) == 0);
+    bim_t *bim = bim_tools_new(GRAPH_FILE);
+    remove(GRAPH_FILE);
+    assert(bim);
+
+    bim_edge *edges = (bim_edge *)malloc(sizeof (bim_edge) * bim->transits->length);
+    assert(bim_graph_edges(bim, edges) == 0);
+    for (size_t i = 0; i < bim->transits->length; i++)
+    {
+        const bim_transit_t *transit = bim->transits->data[i];
+        assert(edges[i].id == i);
+        assert(edges[i].src < edges[i].dest);
+        assert(edges[i].dest < bim->zones->length);
+        assert(_has_output(bim->zones->data[edges[i].src], transit->base->handle));
+        assert(_has_output(bim->zones->data[edges[i].dest], transit->base->handle));
+        assert((edges[i].dest == bim->zones->length - 1) == (transit->base->sign == DOOR_WAY_OUT));
+    }
+
+    free(edges);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// По готовым ребрам (файл кэша) граф строится ровно двумя выделениями памяти
+TEST_CASE graph_allocations(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(GRAPH_FILE, levels_count, rooms) == 0);
+    assert(bim_tools_compile(GRAPH_FILE, GRAPH_CACHE) == 0);
+    remove(GRAPH_FILE);
+    bim_t *bim = bim_tools_open_mapped(GRAPH_CACHE);
+    assert(bim && bim->edges);
+
+    _allocs = 0;
+    bim_graph_t *graph = bim_graph_new(bim);
+    assert(graph);
+    assert(_allocs == 2);
+
+    bim_graph_list_t *list = bim_graph_list_new(bim);
+    _assert_graph_eq_list(graph, list);
+
+    bim_graph_list_free(list);
+    bim_graph_free(graph);
+    bim_tools_free(bim);
+    remove(GRAPH_CACHE);
+    __LOG_INFO__(SUCCESS);
+}
+
+// При нехватке памяти на любом выделении граф не строится
+TEST_CASE graph_out_of_memory(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim && !bim->edges);
+
+    bim_graph_t *graph = NULL;
+    for (uint64_t n = 1; !graph; n++)
+    {
+        _allocs = 0;
+        _fail_at = n;
+        graph = bim_graph_new(bim);
+        _fail_at = 0;
+        assert(graph || n <= _allocs);
+    }
+
+    bim_graph_free(graph);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Шаг моделирования по графу CSR (очередь зон -- куча) дает те же результаты,
+// что и по спискам смежности (очередь зон на arraylist)
+TEST_CASE graph_moving_step(uint32_t levels_count, uint32_t rooms, uint32_t steps, uint32_t flags)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write_ex(GRAPH_FILE, levels_count, rooms, flags) == 0);
+    bim_t *b1 = bim_tools_new(GRAPH_FILE);
+    bim_t *b2 = bim_tools_new(GRAPH_FILE);
+    remove(GRAPH_FILE);
+    assert(b1 && b2);
+
+    bim_graph_t *graph = bim_graph_new(b1);
+    bim_graph_list_t *list = bim_graph_list_new(b2);
+    evac_def_modeling_step(b1, b1->zones->length);
+    for (uint32_t s = 0; s < steps; s++)
+    {
+        evac_moving_step(graph, b1->zones, b1->transits);
+        evac_moving_step_list(list, b2->zones, b2->transits);
+    }
+
+    for (size_t i = 0; i < b1->zones->length; i++)
+    {
+        const bim_zone_t *z1 = b1->zones->data[i], *z2 = b2->zones->data[i];
+        assert(z1->num_of_people == z2->num_of_people);
+        assert(z1->potential == z2->potential);
+        assert(z1->is_visited == z2->is_visited);
+    }
+    for (size_t i = 0; i < b1->transits->length; i++)
+    {
+        const bim_transit_t *t1 = b1->transits->data[i], *t2 = b2->transits->data[i];
+        assert(t1->num_of_people == t2->num_of_people);
+    }
+    assert(b1->object->outside->num_of_people > 0);
+
+    bim_graph_list_free(list);
+    bim_graph_free(graph);
+    bim_tools_free(b1);
+    bim_tools_free(b2);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Шаг моделирования по расписанию дает те же результаты, что и обход графа,
+// в том числе после перекрытия перехода (расписание строится заново)
+TEST_CASE graph_schedule(uint32_t levels_count, uint32_t rooms, uint32_t steps)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(GRAPH_FILE, levels_count, rooms) == 0);
+    bim_t *b1 = bim_tools_new(GRAPH_FILE);
+    bim_t *b2 = bim_tools_new(GRAPH_FILE);
+    remove(GRAPH_FILE);
+    assert(b1 && b2);
+
+    bim_graph_t *graph = bim_graph_new(b1);
+    bim_schedule_t *schedule = evac_schedule_new(graph);
+    assert(schedule && schedule->count == UINT32_MAX);
+    evac_def_modeling_step(b1, b1->zones->length);
+    // Если память для очереди не выделена, расписание остается не построенным
+    _allocs = 0;
+    _fail_at = 1;
+    evac_moving_step_scheduled(schedule, graph, b1->zones, b1->transits);
+    _fail_at = 0;
+    assert(schedule->count == UINT32_MAX);
+
+    for (uint32_t s = 0; s < steps; s++)
+    {
+        if (s == steps / 2)
+        {
+            ((bim_transit_t *)b1->transits->data[0])->is_blocked = true;
+            ((bim_transit_t *)b2->transits->data[0])->is_blocked = true;
+        }
+        evac_moving_step_scheduled(schedule, graph, b1->zones, b1->transits);
+        evac_moving_step(graph, b2->zones, b2->transits);
+        assert(schedule->count <= graph->edge_count);
+        assert(schedule->blocked[schedule->zone_count] == (s >= steps / 2));
+    }
+
+    for (size_t i = 0; i < b1->zones->length; i++)
+    {
+        const bim_zone_t *z1 = b1->zones->data[i], *z2 = b2->zones->data[i];
+        assert(z1->num_of_people == z2->num_of_people);
+        assert(z1->potential == z2->potential);
+        assert(z1->is_visited == z2->is_visited);
+    }
+    for (size_t i = 0; i < b1->transits->length; i++)
+    {
+        const bim_transit_t *t1 = b1->transits->data[i], *t2 = b2->transits->data[i];
+        assert(t1->num_of_people == t2->num_of_people);
+        assert(t1->is_visited == t2->is_visited);
+    }
+    assert(b1->object->outside->num_of_people > 0);
+
+    evac_schedule_free(schedule);
+    bim_graph_free(graph);
+    bim_tools_free(b1);
+    bim_tools_free(b2);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    graph_files(ROOT_PATH"/one_zone_one_exit.json");
+    graph_files(ROOT_PATH"/three_zone_three_transit.json");
+    graph_files(ROOT_PATH"/two_levels.json");
+    graph_files(ROOT_PATH"/building_test.json");
+    graph_edges(5, 200);
+    graph_allocations(3, 50);
+    graph_out_of_memory(ROOT_PATH"/two_levels.json");
+    graph_moving_step(4, 100, 50, 0);
+    graph_moving_step(2, 400, 20, BIM_GENERATOR_MESH);
+    graph_schedule(4, 100, 50);
+
+    printf("====== TESTS END ======\n");
+}
@@ -0,0 +1,190 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "bim_tools.h"
+#include "bim_index.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define INDEX_FILE "test_bim_index.json"
+
+// Зона с наименьшим номером, которой принадлежит точка, перебором всех зон
+static bim_zone_t* _zone_at(const bim_level_t *level, point_t point)
+{
+    for (size_t i = 0; i < level->zone_count; i++)
+        if (geom_tools_is_point_in_polygon(point, level->zones[i].base->polygon))
+            return &level->zones[i];
+    return NULL;
+}
+
+static bool _touch(const polygon_t *a, const polygon_t *b)
+{
+    for (size_t i = 0; i < a->point_count; i++)
+        if (geom_tools_is_point_in_polygon(a->points[i], b)) return true;
+    for (size_t i = 0; i < b->point_count; i++)
+        if (geom_tools_is_point_in_polygon(b->points[i], a)) return true;
+    for (size_t i = 0; i + 1 < a->point_count; i++)
+        for (size_t j = 0; j + 1 < b->point_count; j++)
+        {
+            line_t ea = {a->points[i], a->points[i + 1]}, eb = {b->points[j], b->points[j + 1]};
+            if (geom_tools_is_intersect_line(ea, eb)) return true;
+        }
+    return false;
+}
+
+// Запросы к индексу совпадают с перебором всех зон этажа
+static void _check_level(const bim_level_t *level, const bim_t *bim)
+{
+    assert(level->index);
+
+    // Вершины зон (точки на границе) и случайные точки в габаритах этажа
+    const bim_index_t *index = level->index;
+    for (size_t i = 0; i < level->zone_count; i++)
+    {
+        const polygon_t *polygon = level->zones[i].base->polygon;
+        for (size_t j = 0; j < polygon->point_count; j++)
+            assert(bim_index_zone_at(level, polygon->points[j]) == _zone_at(level, polygon->points[j]));
+    }
+    for (size_t i = 0; i < 2000; i++)
+    {
+        point_t point = {index->min.x - 1 + (index->cols * index->cell_size + 2) * rand() / RAND_MAX,
+                         index->min.y - 1 + (index->rows * index->cell_size + 2) * rand() / RAND_MAX};
+        assert(bim_index_zone_at(level, point) == _zone_at(level, point));
+    }
+
+    bim_zone_t *found[64];
+    for (size_t t = 0; t < level->transit_count; t++)
+    {
+        const bim_json_element_t *transit = level->transits[t].base;
+        size_t count = bim_index_zones_touching(level, transit->polygon, found, 64);
+        assert(count <= 64);
+
+        size_t expected = 0;
+        for (size_t i = 0; i < level->zone_count; i++)
+            if (_touch(transit->polygon, level->zones[i].base->polygon))
+                assert(found[expected++] == &level->zones[i]);
+        assert(count == expected);
+
+        // Соседи перехода из файла, которые находятся на том же этаже, касаются его
+        for (size_t j = 0; j < transit->outputs_count; j++)
+            for (size_t z = 0; z < bim->zones->length; z++)
+            {
+                bim_zone_t *zone = bim->zones->data[z];
+                if (zone->base->handle != transit->outputs[j]
+                    || zone < level->zones || zone >= level->zones + level->zone_count)
+                    continue;
+                bool is_found = false;
+                for (size_t i = 0; i < count; i++)
+                    is_found |= found[i] == zone;
+                assert(is_found);
+            }
+
+        // Если массив меньше результата, в нем остаются зоны с наименьшими номерами
+        if (count > 1)
+        {
+            bim_zone_t *first[1];
+            assert(bim_index_zones_touching(level, transit->polygon, first, 1) == count);
+            assert(first[0] == found[0]);
+        }
+    }
+}
+
+TEST_CASE index_files(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+    for (size_t i = 0; i < bim->object->levels_count; i++)
+        _check_level(&bim->object->levels[i], bim);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Синтетическое здание: центр каждого помещения находится в нем,
+// дверь между помещениями касается ровно двух помещений
+TEST_CASE index_generated(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(INDEX_FILE, levels_count, rooms) == 0);
+    bim_t *bim = bim_tools_new(INDEX_FILE);
+    assert(bim);
+
+    bim_zone_t *found[8];
+    for (size_t l = 0; l < bim->object->levels_count; l++)
+    {
+        const bim_level_t *level = &bim->object->levels[l];
+        for (size_t i = 0; i < level->zone_count; i++)
+        {
+            const polygon_t *polygon = level->zones[i].base->polygon;
+            point_t center = {(polygon->points[0].x + polygon->points[2].x) / 2,
+                              (polygon->points[0].y + polygon->points[2].y) / 2};
+            assert(bim_index_zone_at(level, center) == &level->zones[i]);
+        }
+        for (size_t t = 0; t < level->transit_count; t++)
+        {
+            const bim_json_element_t *transit = level->transits[t].base;
+            if (transit->sign == DOOR_WAY_INT)
+                assert(bim_index_zones_touching(level, transit->polygon, found, 8) == 2);
+        }
+    }
+    _check_level(&bim->object->levels[0], bim);
+
+    bim_tools_free(bim);
+    remove(INDEX_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Без полигонов индекс не строится, запросы ничего не находят
+TEST_CASE index_without_geometry(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_tools_set_keep_geometry(false);
+    bim_t *bim = bim_tools_new(filename);
+    bim_tools_set_keep_geometry(true);
+    assert(bim);
+
+    point_t point = {0, 0};
+    for (size_t i = 0; i < bim->object->levels_count; i++)
+    {
+        assert(bim->object->levels[i].index == NULL);
+        assert(bim_index_zone_at(&bim->object->levels[i], point) == NULL);
+    }
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    srand(1);
+    index_files(ROOT_PATH"/one_zone_one_exit.json");
+    index_files(ROOT_PATH"/three_zone_three_transit.json");
+    index_files(ROOT_PATH"/two_levels.json");
+    index_files(ROOT_PATH"/building_test.json");
+    index_generated(3, 400);
+    index_without_geometry(ROOT_PATH"/building_test.json");
+
+    printf("====== TESTS END ======\n");
+}
@@ -0,0 +1,216 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_evac.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+static void _assert_edges_eq(const bim_t *bim, const bim_t *mapped)
+{
+    size_t count = bim->transits->length;
+    bim_edge *e1 = (bim_edge *)malloc(sizeof (bim_edge) * count);
+    assert(bim_graph_edges(bim, e1) == 0);
+    const bim_edge *e2 = (const bim_edge *)mapped->edges;
+    for (size_t i = 0; i < count; i++)
+    {
+        assert(e1[i].src == e2[i].src);
+        assert(e1[i].dest == e2[i].dest);
+        assert(e1[i].id == e2[i].id);
+    }
+    free(e1);
+}
+
+TEST_CASE compile_and_open(const char *filename)
+{
+    __LOG_INFO__(filename);
+    const char *cache = "test_bim_mapped.bimb";
+    assert(bim_tools_compile(filename, cache) == 0);
+    assert(bim_tools_is_mapped_file(cache));
+    assert(!bim_tools_is_mapped_file(filename));
+
+    bim_t *bim = bim_tools_new(filename);
+    bim_t *mapped = bim_tools_open_mapped(cache);
+    assert(mapped);
+
+    assert(strcmp(bim->object->name, mapped->object->name) == 0);
+    assert(bim->object->levels_count == mapped->object->levels_count);
+    assert(bim->zones->length == mapped->zones->length);
+    assert(bim->transits->length == mapped->transits->length);
+
+    for (size_t i = 0; i < bim->zones->length; i++)
+    {
+        const bim_zone_t *z1 = bim->zones->data[i];
+        const bim_zone_t *z2 = mapped->zones->data[i];
+        assert(z1->base->id == z2->base->id);
+        assert(z1->base->sign == z2->base->sign);
+        assert(strcmp(z1->base->uuid, z2->base->uuid) == 0);
+        assert(z1->base->handle == z2->base->handle);
+        assert(z1->area == z2->area);
+        assert(z1->num_of_people == z2->num_of_people);
+        assert(z1->base->outputs_count == z2->base->outputs_count);
+        for (size_t k = 0; k < z1->base->outputs_count; k++)
+            assert(z1->base->outputs[k] == z2->base->outputs[k]);
+    }
+
+    for (size_t i = 0; i < bim->transits->length; i++)
+    {
+        const bim_transit_t *t1 = bim->transits->data[i];
+        const bim_transit_t *t2 = mapped->transits->data[i];
+        assert(strcmp(t1->base->uuid, t2->base->uuid) == 0);
+        assert(t1->width == t2->width);
+        assert(t1->base->polygon->point_count == t2->base->polygon->point_count);
+        assert(memcmp(t1->base->polygon->points, t2->base->polygon->points,
+                      sizeof (point_t) * t1->base->polygon->point_count) == 0);
+    }
+
+    _assert_edges_eq(bim, mapped);
+
+    bim_tools_free(bim);
+    bim_tools_free(mapped);
+    remove(cache);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+// Без полигонов модель должна совпадать с полной, а копии полей
+// элемента в зоне -- с самим элементом
+static void _assert_without_geometry(const bim_t *bim, const bim_t *light)
+{
+    assert(bim->zones->length == light->zones->length);
+    assert(bim->transits->length == light->transits->length);
+
+    for (size_t i = 0; i < light->zones->length; i++)
+    {
+        const bim_zone_t *z1 = bim->zones->data[i];
+        const bim_zone_t *z2 = light->zones->data[i];
+        assert(z2->base->polygon == NULL);
+        assert(z1->area == z2->area);
+        assert(z2->id == z2->base->id);
+        assert(z2->sign == z2->base->sign);
+        assert(z2->z_level == z2->base->z_level);
+        assert(z2->outputs_count == z2->base->outputs_count);
+    }
+
+    for (size_t i = 0; i < light->transits->length; i++)
+    {
+        const bim_transit_t *t1 = bim->transits->data[i];
+        const bim_transit_t *t2 = light->transits->data[i];
+        assert(t2->base->polygon == NULL);
+        assert(t1->width == t2->width);
+    }
+}
+
+TEST_CASE without_geometry(const char *filename)
+{
+    __LOG_INFO__(filename);
+    const char *cache = "test_bim_mapped.bimb";
+    assert(bim_tools_compile(filename, cache) == 0);
+
+    bim_t *bim = bim_tools_new(filename);
+    bim_tools_set_keep_geometry(false);
+    bim_t *light = bim_tools_new(filename);
+    bim_t *mapped = bim_tools_open_mapped(cache);
+    bim_tools_set_keep_geometry(true);
+
+    assert(light->json->geometry == NULL);
+    _assert_without_geometry(bim, light);
+    _assert_without_geometry(bim, mapped);
+
+    bim_tools_free(bim);
+    bim_tools_free(light);
+    bim_tools_free(mapped);
+    remove(cache);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+static void _write_file(const char *filename, const uint8_t *data, size_t size)
+{
+    FILE *fp = fopen(filename, "wb");
+    assert(fp);
+    assert(fwrite(data, 1, size, fp) == size);
+    fclose(fp);
+}
+
+// Усеченный и поврежденный кэш: файл либо отвергается, либо дает модель,
+// по которой строится граф и выполняется шаг моделирования
+TEST_CASE corrupted(const char *filename, uint32_t runs)
+{
+    __LOG_INFO__(filename);
+    const char *cache = "test_bim_mapped.bimb";
+    const char *broken = "test_bim_mapped_broken.bimb";
+    assert(bim_tools_compile(filename, cache) == 0);
+
+    FILE *fp = fopen(cache, "rb");
+    assert(fp);
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *)malloc(size);
+    uint8_t *copy = (uint8_t *)malloc(size);
+    assert(fread(data, 1, size, fp) == size);
+    fclose(fp);
+
+    _write_file(broken, data, size / 2);
+    assert(bim_tools_open_mapped(broken) == NULL);
+
+    uint64_t seed = 7;
+    for (uint32_t r = 0; r < runs; r++)
+    {
+        memcpy(copy, data, size);
+        for (int k = 0; k < 4; k++)
+        {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            copy[(seed >> 33) % size] ^= (uint8_t)(1 + ((seed >> 17) % 255));
+        }
+        _write_file(broken, copy, size);
+
+        bim_t *bim = bim_tools_open_mapped(broken);
+        if (!bim) continue;
+        bim_graph_t *graph = bim_graph_new(bim);
+        assert(graph);
+        evac_moving_step(graph, bim->zones, bim->transits);
+        bim_graph_free(graph);
+        bim_tools_free(bim);
+    }
+
+    free(data);
+    free(copy);
+    remove(broken);
+    remove(cache);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    compile_and_open(ROOT_PATH"/one_zone_one_exit.json");
+    compile_and_open(ROOT_PATH"/three_zone_three_transit.json");
+    compile_and_open(ROOT_PATH"/two_levels.json");
+    compile_and_open(ROOT_PATH"/building_test.json");
+    without_geometry(ROOT_PATH"/two_levels.json");
+    without_geometry(ROOT_PATH"/building_test.json");
+    corrupted(ROOT_PATH"/two_levels.json", 500);
+
+    printf("====== TESTS END ======\n");
+}
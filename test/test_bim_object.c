@@ -57,8 +57,10 @@ TEST_CASE one_zone_one_exit(void)
     assert(element2.polygon->point_count == 5);
 
     // adjacency
-    assert(strcmp(element1.uuid, element2.outputs[0]) == 0);
-    assert(strcmp(element2.uuid, element1.outputs[0]) == 0);
+    assert(element1.handle != element2.handle);
+    assert(element1.handle == element2.outputs[0]);
+    assert(element2.handle == element1.outputs[0]);
+    assert(bim_json->handles_count == 2);
 
     __LOG_INFO__(SUCCESS);
 }
@@ -73,10 +75,17 @@ TEST_CASE three_zone_three_transit(void)
     bim_json_level_t level = bim_json->levels[0];
     assert(level.elements_count == 6);
     assert(level.z_level == 0.0);
+    assert(level.outputs_count == (2 + 2 + 1) + (2 + 2) + 1); // помещения, проемы, выход
 
+    uint64_t outputs_begin = 0;
     for (size_t i = 0; i < level.elements_count; i++)
     {
         bim_json_element_t element = level.elements[i];
+        // Связи элементов лежат в пуле этажа подряд
+        assert(element.outputs_begin == outputs_begin);
+        assert(element.outputs == level.outputs + element.outputs_begin);
+        outputs_begin += element.outputs_count;
+
         if (element.sign == ROOM)
         {
             if (strcmp(element.name, "Room_3 (00 : 70250)") == 0)
@@ -131,6 +140,84 @@ TEST_CASE two_levels(void)
     __LOG_INFO__(SUCCESS);
 }
 
+static void _assert_element_eq(const bim_json_element_t *e1, const bim_json_element_t *e2)
+{
+    assert(e1->id == e2->id);
+    assert(strcmp(e1->uuid, e2->uuid) == 0);
+    assert(e1->handle == e2->handle);
+    assert(strcmp(e1->name, e2->name) == 0);
+    assert(e1->size_z == e2->size_z);
+    assert(e1->z_level == e2->z_level);
+    assert(e1->numofpeople == e2->numofpeople);
+    assert(e1->sign == e2->sign);
+    assert(e1->outputs_count == e2->outputs_count);
+    assert(e1->outputs_begin == e2->outputs_begin);
+    for (size_t k = 0; k < e1->outputs_count; k++)
+        assert(e1->outputs[k] == e2->outputs[k]);
+    assert(e1->polygon->point_count == e2->polygon->point_count);
+    for (size_t k = 0; k < e1->polygon->point_count; k++)
+    {
+        assert(e1->polygon->points[k].x == e2->polygon->points[k].x);
+        assert(e1->polygon->points[k].y == e2->polygon->points[k].y);
+    }
+}
+
+TEST_CASE stream_equals_dom(void)
+{
+    const char * filename = ROOT_PATH"/building_test.json";
+    __LOG_INFO__(filename);
+    bim_json_object_t *bim_stream = bim_json_new(filename);
+    bim_json_object_t *bim_dom = bim_json_new_dom(filename);
+
+    assert(strcmp(bim_stream->name, bim_dom->name) == 0);
+    assert(strcmp(bim_stream->address.city, bim_dom->address.city) == 0);
+    assert(bim_stream->handles_count == bim_dom->handles_count);
+    assert(bim_stream->levels_count == bim_dom->levels_count);
+    for (size_t i = 0; i < bim_stream->levels_count; i++)
+    {
+        const bim_json_level_t *l1 = &bim_stream->levels[i];
+        const bim_json_level_t *l2 = &bim_dom->levels[i];
+        assert(strcmp(l1->name, l2->name) == 0);
+        assert(l1->z_level == l2->z_level);
+        assert(l1->elements_count == l2->elements_count);
+        for (size_t j = 0; j < l1->elements_count; j++)
+            _assert_element_eq(&l1->elements[j], &l2->elements[j]);
+    }
+
+    bim_json_free(bim_stream);
+    bim_json_free(bim_dom);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+TEST_CASE parallel_equals_stream(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_json_object_t *bim_seq = bim_json_new(filename);
+    bim_json_object_t *bim_par = bim_json_new_parallel(filename, 4);
+
+    assert(strcmp(bim_seq->name, bim_par->name) == 0);
+    assert(strcmp(bim_seq->address.street_address, bim_par->address.street_address) == 0);
+    assert(bim_seq->handles_count == bim_par->handles_count);
+    assert(bim_seq->levels_count == bim_par->levels_count);
+    for (size_t i = 0; i < bim_seq->levels_count; i++)
+    {
+        const bim_json_level_t *l1 = &bim_seq->levels[i];
+        const bim_json_level_t *l2 = &bim_par->levels[i];
+        assert(strcmp(l1->name, l2->name) == 0);
+        assert(l1->z_level == l2->z_level);
+        assert(l1->elements_count == l2->elements_count);
+        assert(l1->outputs_count == l2->outputs_count);
+        for (size_t j = 0; j < l1->elements_count; j++)
+            _assert_element_eq(&l1->elements[j], &l2->elements[j]);
+    }
+
+    bim_json_free(bim_seq);
+    bim_json_free(bim_par);
+
+    __LOG_INFO__(SUCCESS);
+}
+
 int main (void)
 {
     printf("====== TESTS STARTS ======\n");
@@ -138,6 +225,9 @@ int main (void)
     one_zone_one_exit();
     three_zone_three_transit();
     two_levels();
+    stream_equals_dom();
+    parallel_equals_stream(ROOT_PATH"/two_levels.json");
+    parallel_equals_stream(ROOT_PATH"/building_test.json");
 
     printf("====== TESTS END ======\n");
 }
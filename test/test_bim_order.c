@@ -0,0 +1,292 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_order.h"
+#include "bim_evac.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define ORDER_FILE      "test_bim_order.json"
+#define ORDER_CACHE     "test_bim_order.bimb"
+
+/// UUID элементов модели в порядке списков
+typedef struct
+{
+    uint32_t    zone_count;
+    uint32_t    transit_count;
+    const char  **zones;
+    const char  **transits;
+} _uuids_t;
+
+static _uuids_t _uuids(const bim_t *bim)
+{
+    _uuids_t u = {bim->zones->length, bim->transits->length, NULL, NULL};
+    u.zones = (const char **)malloc(sizeof (char *) * (u.zone_count + u.transit_count));
+    u.transits = u.zones + u.zone_count;
+    for (uint32_t i = 0; i < u.zone_count; i++)
+        u.zones[i] = ((const bim_zone_t *)bim->zones->data[i])->base->uuid;
+    for (uint32_t i = 0; i < u.transit_count; i++)
+        u.transits[i] = ((const bim_transit_t *)bim->transits->data[i])->base->uuid;
+    return u;
+}
+
+// Список смежности каждой вершины исходного графа перенесен на место ее
+// нового номера без изменения порядка, степени вершин совпадают с графом,
+// построенным по модели заново
+static void _assert_graph_remapped(const bim_graph_t *graph, const bim_graph_t *before,
+                                   const bim_permutation_t *permutation, const bim_t *bim)
+{
+    assert(graph->node_count == before->node_count && graph->edge_count == before->edge_count);
+    for (uint32_t v = 0; v < before->node_count; v++)
+    {
+        uint32_t r = permutation->zones[v];
+        assert(graph->offsets[r + 1] - graph->offsets[r] == before->offsets[v + 1] - before->offsets[v]);
+        const bim_adjacent_t *a = graph->adjacent + graph->offsets[r];
+        for (uint32_t k = before->offsets[v]; k < before->offsets[v + 1]; k++, a++)
+        {
+            assert(a->dest == permutation->zones[before->adjacent[k].dest]);
+            assert(a->eid == permutation->transits[before->adjacent[k].eid]);
+        }
+    }
+
+    bim_graph_t *fresh = bim_graph_new(bim);
+    assert(fresh);
+    assert(memcmp(fresh->offsets, graph->offsets, sizeof (uint32_t) * (graph->node_count + 1)) == 0);
+    bim_graph_free(fresh);
+}
+
+// Модель перенумерована согласованно: номера зон равны местам в списке,
+// элементы этажей остались в своих массивах, перестановка ведет к исходным элементам
+static void _assert_renumbered(const bim_t *bim, const bim_graph_t *graph, const bim_graph_t *before,
+                               const _uuids_t *original, const bim_permutation_t *permutation)
+{
+    for (uint32_t i = 0; i < bim->zones->length; i++)
+        assert(((const bim_zone_t *)bim->zones->data[i])->id == i);
+    assert(bim->zones->data[bim->zones->length - 1] == bim->object->outside);
+
+    for (uint32_t i = 0; i < original->zone_count; i++)
+        assert(strcmp(((const bim_zone_t *)bim->zones->data[permutation->zones[i]])->base->uuid, original->zones[i]) == 0);
+    for (uint32_t i = 0; i < original->transit_count; i++)
+        assert(strcmp(((const bim_transit_t *)bim->transits->data[permutation->transits[i]])->base->uuid, original->transits[i]) == 0);
+
+    for (size_t i = 0; i < bim->object->levels_count; i++)
+    {
+        const bim_level_t *level = &bim->object->levels[i];
+        for (uint64_t j = 0; j < level->zone_count; j++)
+            assert(bim->zones->data[level->zones[j].id] == &level->zones[j]);
+        for (uint64_t j = 1; j < level->zone_count; j++)
+            assert(level->zones[j - 1].id < level->zones[j].id);
+    }
+
+    _assert_graph_remapped(graph, before, permutation, bim);
+}
+
+TEST_CASE order_files(const char *filename, bim_order_t order)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+    _uuids_t original = _uuids(bim);
+    bim_graph_t *graph = bim_graph_new(bim);
+    bim_graph_t *before = bim_graph_new(bim);
+    bim_permutation_t *permutation = bim_order_permutation_new(bim);
+
+    assert(bim_order_renumber(bim, graph, order, permutation) == 0);
+    _assert_renumbered(bim, graph, before, &original, permutation);
+
+    // Перестановки накапливаются: после второй перенумерации таблица
+    // по-прежнему ведет к исходным элементам
+    assert(bim_order_renumber(bim, graph, order == BIM_ORDER_BFS ? BIM_ORDER_RCM : BIM_ORDER_BFS, permutation) == 0);
+    _assert_renumbered(bim, graph, before, &original, permutation);
+
+    bim_order_permutation_free(permutation);
+    bim_graph_free(before);
+    bim_graph_free(graph);
+    free(original.zones);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// В порядке обхода в ширину номера зон не убывают с расстоянием от зоны вне здания
+TEST_CASE order_bfs_levels(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(ORDER_FILE, levels_count, rooms) == 0);
+    bim_t *bim = bim_tools_new(ORDER_FILE);
+    remove(ORDER_FILE);
+    assert(bim);
+    _uuids_t original = _uuids(bim);
+    bim_graph_t *graph = bim_graph_new(bim);
+    bim_graph_t *before = bim_graph_new(bim);
+    bim_permutation_t *permutation = bim_order_permutation_new(bim);
+
+    assert(bim_order_renumber(bim, graph, BIM_ORDER_BFS, permutation) == 0);
+    _assert_renumbered(bim, graph, before, &original, permutation);
+
+    uint32_t count = graph->node_count, outside = count - 1;
+    uint32_t *distance = (uint32_t *)malloc(sizeof (uint32_t) * count * 2);
+    uint32_t *queue = distance + count;
+    for (uint32_t v = 0; v < count; v++) distance[v] = UINT32_MAX;
+    size_t head = 0, tail = 0;
+    distance[outside] = 0;
+    queue[tail++] = outside;
+    while (head < tail)
+    {
+        uint32_t v = queue[head++];
+        for (uint32_t k = graph->offsets[v]; k < graph->offsets[v + 1]; k++)
+        {
+            uint32_t u = graph->adjacent[k].dest;
+            if (distance[u] != UINT32_MAX) continue;
+            distance[u] = distance[v] + 1;
+            queue[tail++] = u;
+        }
+    }
+    assert(tail == count);
+    for (uint32_t v = 1; v < outside; v++)
+        assert(distance[v - 1] <= distance[v]);
+
+    free(distance);
+    bim_order_permutation_free(permutation);
+    bim_graph_free(before);
+    bim_graph_free(graph);
+    free(original.zones);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Обратная перестановка восстанавливает исходную модель и граф
+TEST_CASE order_inverse(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(ORDER_FILE, levels_count, rooms) == 0);
+    bim_t *bim = bim_tools_new(ORDER_FILE);
+    remove(ORDER_FILE);
+    assert(bim);
+    _uuids_t original = _uuids(bim);
+    bim_graph_t *graph = bim_graph_new(bim);
+    bim_graph_t *before = bim_graph_new(bim);
+    bim_permutation_t *permutation = bim_order_permutation_new(bim);
+
+    assert(bim_order_renumber(bim, graph, BIM_ORDER_RCM, permutation) == 0);
+    _assert_renumbered(bim, graph, before, &original, permutation);
+
+    uint32_t *zone_rank = (uint32_t *)malloc(sizeof (uint32_t) * (original.zone_count + original.transit_count));
+    uint32_t *transit_rank = zone_rank + original.zone_count;
+    for (uint32_t i = 0; i < original.zone_count; i++)
+        zone_rank[permutation->zones[i]] = i;
+    for (uint32_t i = 0; i < original.transit_count; i++)
+        transit_rank[permutation->transits[i]] = i;
+    assert(bim_order_apply(bim, graph, zone_rank, transit_rank, permutation) == 0);
+
+    for (uint32_t i = 0; i < original.zone_count; i++)
+    {
+        assert(permutation->zones[i] == i);
+        assert(strcmp(((const bim_zone_t *)bim->zones->data[i])->base->uuid, original.zones[i]) == 0);
+    }
+    for (uint32_t i = 0; i < original.transit_count; i++)
+        assert(permutation->transits[i] == i);
+    assert(memcmp(before->offsets, graph->offsets, sizeof (uint32_t) * (graph->node_count + 1)) == 0);
+    assert(memcmp(before->adjacent, graph->adjacent, sizeof (bim_adjacent_t) * 2 * graph->edge_count) == 0);
+
+    // Зона вне здания должна остаться последней, иначе модель не изменяется
+    uint32_t tmp = zone_rank[0];
+    zone_rank[0] = zone_rank[original.zone_count - 1];
+    zone_rank[original.zone_count - 1] = tmp;
+    assert(bim_order_apply(bim, graph, zone_rank, transit_rank, NULL) == -1);
+    for (uint32_t i = 0; i < original.zone_count; i++)
+        assert(strcmp(((const bim_zone_t *)bim->zones->data[i])->base->uuid, original.zones[i]) == 0);
+
+    free(zone_rank);
+    bim_order_permutation_free(permutation);
+    bim_graph_free(before);
+    bim_graph_free(graph);
+    free(original.zones);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Перенумерация модели из кэша: ребра кэша больше не используются.
+// Моделирование на перенумерованной модели дает те же результаты
+TEST_CASE order_mapped(uint32_t levels_count, uint32_t rooms, uint32_t steps)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(ORDER_FILE, levels_count, rooms) == 0);
+    assert(bim_tools_compile(ORDER_FILE, ORDER_CACHE) == 0);
+    remove(ORDER_FILE);
+    bim_t *bim = bim_tools_open_mapped(ORDER_CACHE);
+    assert(bim && bim->edges);
+    _uuids_t original = _uuids(bim);
+    bim_graph_t *graph = bim_graph_new(bim);
+    bim_graph_t *before = bim_graph_new(bim);
+    bim_permutation_t *permutation = bim_order_permutation_new(bim);
+
+    assert(bim_order_renumber(bim, graph, BIM_ORDER_BFS, permutation) == 0);
+    assert(!bim->edges);
+    _assert_renumbered(bim, graph, before, &original, permutation);
+
+    bim_t *plain = bim_tools_open_mapped(ORDER_CACHE);
+    assert(plain);
+    evac_def_modeling_step(bim, bim->zones->length);
+    for (uint32_t s = 0; s < steps; s++)
+    {
+        evac_moving_step(graph, bim->zones, bim->transits);
+        evac_moving_step(before, plain->zones, plain->transits);
+    }
+    for (uint32_t i = 0; i < original.zone_count; i++)
+    {
+        const bim_zone_t *z1 = bim->zones->data[permutation->zones[i]], *z2 = plain->zones->data[i];
+        assert(z1->num_of_people == z2->num_of_people);
+        assert(z1->potential == z2->potential);
+        assert(z1->is_visited == z2->is_visited);
+    }
+    for (uint32_t i = 0; i < original.transit_count; i++)
+    {
+        const bim_transit_t *t1 = bim->transits->data[permutation->transits[i]], *t2 = plain->transits->data[i];
+        assert(t1->num_of_people == t2->num_of_people);
+    }
+    assert(bim->object->outside->num_of_people > 0);
+    bim_tools_free(plain);
+
+    bim_order_permutation_free(permutation);
+    bim_graph_free(before);
+    bim_graph_free(graph);
+    free(original.zones);
+    bim_tools_free(bim);
+    remove(ORDER_CACHE);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    order_files(ROOT_PATH"/one_zone_one_exit.json", BIM_ORDER_BFS);
+    order_files(ROOT_PATH"/three_zone_three_transit.json", BIM_ORDER_RCM);
+    order_files(ROOT_PATH"/two_levels.json", BIM_ORDER_BFS);
+    order_files(ROOT_PATH"/building_test.json", BIM_ORDER_RCM);
+    order_bfs_levels(4, 100);
+    order_inverse(3, 50);
+    order_mapped(3, 50, 20);
+
+    printf("====== TESTS END ======\n");
+}
@@ -0,0 +1,190 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define RELOAD_FILE "test_bim_reload.json"
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Обновленная модель должна совпадать с моделью, созданной с нуля
+static void _assert_models_eq(const bim_t *reloaded, const bim_t *fresh)
+{
+    assert(reloaded->zones->length == fresh->zones->length);
+    assert(reloaded->transits->length == fresh->transits->length);
+    for (size_t i = 0; i < fresh->zones->length; i++)
+    {
+        const bim_zone_t *z1 = reloaded->zones->data[i];
+        const bim_zone_t *z2 = fresh->zones->data[i];
+        assert(strcmp(z1->base->uuid, z2->base->uuid) == 0);
+        assert(z1->id == z2->id);
+        assert(z1->area == z2->area);
+    }
+    for (size_t i = 0; i < fresh->transits->length; i++)
+    {
+        const bim_transit_t *t1 = reloaded->transits->data[i];
+        const bim_transit_t *t2 = fresh->transits->data[i];
+        assert(strcmp(t1->base->uuid, t2->base->uuid) == 0);
+        assert(t1->width == t2->width);
+    }
+
+    bim_graph_t *g1 = bim_graph_new(reloaded);
+    bim_graph_t *g2 = bim_graph_new(fresh);
+    assert(g1->node_count == g2->node_count);
+    assert(g1->edge_count == g2->edge_count);
+    assert(memcmp(g1->offsets, g2->offsets, sizeof (uint32_t) * (g2->node_count + 1)) == 0);
+    for (size_t k = 0; k < 2 * g2->edge_count; k++)
+        assert(g1->adjacent[k].dest == g2->adjacent[k].dest && g1->adjacent[k].eid == g2->adjacent[k].eid);
+    bim_graph_free(g1);
+    bim_graph_free(g2);
+}
+
+TEST_CASE unchanged_file(void)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(RELOAD_FILE, 3, 50) == 0);
+    bim_t *bim = bim_tools_new(RELOAD_FILE);
+
+    uint64_t recomputed = UINT64_MAX;
+    bim = bim_tools_reload(bim, RELOAD_FILE, &recomputed);
+    assert(bim);
+    assert(recomputed == 0);
+
+    bim_t *fresh = bim_tools_new(RELOAD_FILE);
+    _assert_models_eq(bim, fresh);
+
+    bim_tools_free(fresh);
+    bim_tools_free(bim);
+    remove(RELOAD_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Добавление помещения: пересчитываются только новые элементы
+TEST_CASE added_room(void)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(RELOAD_FILE, 3, 50) == 0);
+    bim_t *bim = bim_tools_new(RELOAD_FILE);
+
+    assert(bim_generator_write(RELOAD_FILE, 3, 51) == 0);
+    uint64_t recomputed = 0;
+    bim = bim_tools_reload(bim, RELOAD_FILE, &recomputed);
+    assert(bim);
+    // На каждом этаже новое помещение и дверь к нему
+    assert(recomputed == 3 * 2);
+
+    bim_t *fresh = bim_tools_new(RELOAD_FILE);
+    _assert_models_eq(bim, fresh);
+
+    bim_tools_free(fresh);
+    bim_tools_free(bim);
+    remove(RELOAD_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Без полигонов в текущей модели изменения определяются по отпечаткам
+TEST_CASE without_geometry(void)
+{
+    __LOG_INFO__("started");
+    bim_tools_set_keep_geometry(false);
+    assert(bim_generator_write(RELOAD_FILE, 3, 51) == 0);
+    bim_t *bim = bim_tools_new(RELOAD_FILE);
+
+    assert(bim_generator_write(RELOAD_FILE, 3, 50) == 0);
+    uint64_t recomputed = UINT64_MAX;
+    bim = bim_tools_reload(bim, RELOAD_FILE, &recomputed);
+    assert(bim);
+    assert(recomputed == 0); // Элементы только удалены
+
+    bim_t *fresh = bim_tools_new(RELOAD_FILE);
+    _assert_models_eq(bim, fresh);
+
+    bim_tools_free(fresh);
+    bim_tools_free(bim);
+    bim_tools_set_keep_geometry(true);
+    remove(RELOAD_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+TEST_CASE broken_file(void)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(RELOAD_FILE, 1, 10) == 0);
+    bim_t *bim = bim_tools_new(RELOAD_FILE);
+
+    FILE *fp = fopen(RELOAD_FILE, "w");
+    fputs("{\"Level\":[", fp);
+    fclose(fp);
+    assert(bim_tools_reload(bim, RELOAD_FILE, NULL) == NULL);
+    assert(bim->zones->length > 1); // Текущая модель не изменилась
+
+    bim_tools_free(bim);
+    remove(RELOAD_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Время обновления модели из 10 тысяч элементов после правки
+TEST_CASE reload_time(void)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(RELOAD_FILE, 5, 1000) == 0);
+    bim_t *bim = bim_tools_new(RELOAD_FILE);
+    assert(bim_generator_write(RELOAD_FILE, 5, 1001) == 0);
+
+    double t0 = _now();
+    uint64_t recomputed = 0;
+    bim = bim_tools_reload(bim, RELOAD_FILE, &recomputed);
+    bim_graph_t *graph = bim_graph_new(bim);
+    double dt = _now() - t0;
+    assert(bim && graph);
+
+    char msg[128];
+    snprintf(msg, sizeof (msg), "elements: %lu, recomputed: %lu, reload: %.1f ms",
+             bim_generator_elements_count(5, 1001), recomputed, dt * 1e3);
+    __LOG_INFO__(msg);
+
+    bim_graph_free(graph);
+    bim_tools_free(bim);
+    remove(RELOAD_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    unchanged_file();
+    added_room();
+    without_geometry();
+    broken_file();
+    reload_time();
+
+    printf("====== TESTS END ======\n");
+}
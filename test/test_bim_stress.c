@@ -0,0 +1,153 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Нагрузочный тест на синтетическом здании (см. bim_generator.h).
+ * По умолчанию здание содержит около миллиона элементов:
+ * 500 этажей по 1000 помещений.
+ *
+ * Использование:
+ *   test_bim_stress [levels rooms_per_level [steps]]
+ */
+
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_evac.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define PEOPLE_PER_ROOM 5   ///< Количество людей в помещении синтетического здания
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double _people_total(const ArrayList *zones)
+{
+    double total = 0;
+    for (size_t i = 0; i < zones->length; i++)
+        total += ((const bim_zone_t *)zones->data[i])->num_of_people;
+    return total;
+}
+
+TEST_CASE large_building(uint32_t levels, uint32_t rooms, uint32_t steps)
+{
+    char info[256];
+    const char *filename = "test_bim_stress.json";
+    assert(bim_generator_write(filename, levels, rooms) == 0);
+
+    const uint64_t elements_count = bim_generator_elements_count(levels, rooms);
+    const uint64_t zones_count = (uint64_t)levels * (rooms + 1) + 1; // + зона вне здания
+    snprintf(info, sizeof (info), "%u x %u, элементов: %lu", levels, rooms, elements_count);
+    __LOG_INFO__(info);
+
+    double t0 = _now();
+    bim_t *bim = bim_tools_new(filename);
+    double t_load = _now() - t0;
+    remove(filename);
+    assert(bim);
+
+    // Счетчики не переполняются
+    assert(bim->object->levels_count == levels);
+    assert(bim->zones->length == zones_count);
+    assert(bim->zones->length + bim->transits->length == elements_count + 1);
+    for (size_t i = 0; i < levels; i++)
+    {
+        assert(bim->json->levels[i].elements_count == bim->object->levels[i].zone_count + bim->object->levels[i].transit_count);
+        assert(bim->object->levels[i].zone_count == rooms + 1);
+    }
+    assert(bim->object->outside->base->outputs_count == 1);
+    assert(bim->zones->data[bim->zones->length - 1] == bim->object->outside);
+
+    // Списки упорядочены по номерам, номер зоны совпадает с индексом
+    for (size_t i = 0; i < bim->zones->length; i++)
+        assert(((bim_zone_t *)bim->zones->data[i])->base->id == i);
+    for (size_t i = 0; i < bim->transits->length; i++)
+    {
+        const bim_transit_t *transit = bim->transits->data[i];
+        assert(transit->base->id == i);
+        assert(transit->width > 0);
+    }
+
+    t0 = _now();
+    bim_graph_t *graph = bim_graph_new(bim);
+    double t_graph = _now() - t0;
+    assert(graph);
+
+    // Каждый переход соединяет две разные зоны
+    bim_edge *edges = (bim_edge *)malloc(sizeof (bim_edge) * bim->transits->length);
+    assert(bim_graph_edges(bim, edges) == 0);
+    for (size_t i = 0; i < bim->transits->length; i++)
+    {
+        assert(edges[i].src < bim->zones->length);
+        assert(edges[i].dest < bim->zones->length);
+        assert(edges[i].src != edges[i].dest);
+    }
+    free(edges);
+
+    const double people = (double)PEOPLE_PER_ROOM * rooms * levels;
+    assert(bim_tools_get_numofpeople(bim) == people);
+
+    evac_def_modeling_step(bim, bim->zones->length);
+    evac_time_reset();
+    t0 = _now();
+    for (uint32_t i = 0; i < steps; i++)
+    {
+        evac_moving_step(graph, bim->zones, bim->transits);
+        evac_time_inc();
+    }
+    double t_steps = _now() - t0;
+
+    // Люди не появляются и не исчезают, часть уже вышла из здания
+    assert(fabs(_people_total(bim->zones) - people) < 1e-6 * people);
+    assert(steps == 0 || bim->object->outside->num_of_people > 0);
+
+    snprintf(info, sizeof (info), "загрузка %.2f с (%.0f элементов/с), граф %.2f с, шаг %.3f с (%.0f зон/с)",
+             t_load, elements_count / t_load, t_graph,
+             steps ? t_steps / steps : 0, steps ? bim->zones->length * steps / t_steps : 0);
+    __LOG_INFO__(info);
+
+    bim_graph_free(graph);
+    bim_tools_free(bim);
+
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (int argc, char **argv)
+{
+    uint32_t levels = 500, rooms = 1000, steps = 10;
+    if (argc >= 3)
+    {
+        levels = strtoul(argv[1], NULL, 10);
+        rooms = strtoul(argv[2], NULL, 10);
+    }
+    if (argc >= 4) steps = strtoul(argv[3], NULL, 10);
+
+    printf("====== TESTS STARTS ======\n");
+
+    large_building(levels, rooms, steps);
+
+    printf("====== TESTS END ======\n");
+}
@@ -0,0 +1,180 @@
+/* Copyright © 2021 bvchirkov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "bim_tools.h"
+#include "bim_graph.h"
+#include "bim_generator.h"
+
+#define TEST_CASE       void
+#define SUCCESS         "ОК"
+#define FAIL            "FAIL"
+#define __LOG_INFO__(str)   fprintf(stdout, "[%-5s()] :: %s\n", __func__, str)
+
+#define FULL_FILE       "test_bim_topology_full.json"
+#define STRIPPED_FILE   "test_bim_topology_stripped.json"
+
+// Внутренняя функция bim_topology.c
+int64_t _derive_topology(bim_t *bim, bool rewrite);
+
+// UUID элемента по номеру (номера UUID в разных файлах могут не совпадать)
+static const char* _uuid(const bim_t *bim, uint32_t handle)
+{
+    for (size_t i = 0; i < bim->json->levels_count; i++)
+        for (size_t j = 0; j < bim->json->levels[i].elements_count; j++)
+            if (bim->json->levels[i].elements[j].handle == handle)
+                return bim->json->levels[i].elements[j].uuid;
+    return NULL;
+}
+
+// Связи элементов совпадают как множества UUID
+static void _assert_outputs_eq(const bim_t *b1, const bim_json_element_t *e1, const bim_t *b2, const bim_json_element_t *e2)
+{
+    assert(strcmp(e1->uuid, e2->uuid) == 0);
+    assert(e1->outputs_count == e2->outputs_count);
+    for (size_t i = 0; i < e1->outputs_count; i++)
+    {
+        const char *uuid = _uuid(b1, e1->outputs[i]);
+        bool found = false;
+        for (size_t j = 0; j < e2->outputs_count && !found; j++)
+            found = strcmp(uuid, _uuid(b2, e2->outputs[j])) == 0;
+        assert(found);
+    }
+}
+
+// Модель со связями, восстановленными по геометрии, совпадает с исходной
+static void _assert_models_eq(const bim_t *restored, const bim_t *original)
+{
+    assert(restored->zones->length == original->zones->length);
+    assert(restored->transits->length == original->transits->length);
+    for (size_t i = 0; i + 1 < restored->zones->length; i++) // Без зоны вне здания
+    {
+        const bim_zone_t *z1 = restored->zones->data[i], *z2 = original->zones->data[i];
+        assert(z1->outputs_count == z2->outputs_count);
+        _assert_outputs_eq(restored, z1->base, original, z2->base);
+    }
+    for (size_t i = 0; i < restored->transits->length; i++)
+    {
+        const bim_transit_t *t1 = restored->transits->data[i], *t2 = original->transits->data[i];
+        assert(t1->width == t2->width);
+        _assert_outputs_eq(restored, t1->base, original, t2->base);
+    }
+
+    bim_edge *e1 = (bim_edge *)malloc(sizeof (bim_edge) * restored->transits->length);
+    bim_edge *e2 = (bim_edge *)malloc(sizeof (bim_edge) * original->transits->length);
+    assert(bim_graph_edges(restored, e1) == 0);
+    assert(bim_graph_edges(original, e2) == 0);
+    for (size_t i = 0; i < restored->transits->length; i++)
+        assert(e1[i].id == e2[i].id && e1[i].src == e2[i].src && e1[i].dest == e2[i].dest);
+    free(e1);
+    free(e2);
+}
+
+// В файлах из res связи совпадают с геометрией
+TEST_CASE topology_files(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    assert(bim);
+    assert(_derive_topology(bim, false) == 0);
+    bim_tools_free(bim);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Файл без связей: в режиме проверки расходятся все переходы,
+// в режиме перезаписи модель совпадает с моделью из полного файла
+TEST_CASE topology_restore(uint32_t levels_count, uint32_t rooms)
+{
+    __LOG_INFO__("started");
+    assert(bim_generator_write(FULL_FILE, levels_count, rooms) == 0);
+    assert(bim_generator_write_ex(STRIPPED_FILE, levels_count, rooms, BIM_GENERATOR_NO_OUTPUTS) == 0);
+
+    bim_t *original = bim_tools_new(FULL_FILE);
+    assert(original);
+    assert(_derive_topology(original, false) == 0);
+
+    bim_t *stripped = bim_tools_new(STRIPPED_FILE);
+    assert(stripped);
+    assert(_derive_topology(stripped, false) == (int64_t)stripped->transits->length);
+    bim_tools_free(stripped);
+
+    bim_tools_set_topology(BIM_TOPOLOGY_REWRITE);
+    bim_t *restored = bim_tools_new(STRIPPED_FILE);
+    bim_tools_set_topology(BIM_TOPOLOGY_OFF);
+    assert(restored);
+    assert(_derive_topology(restored, false) == 0);
+    _assert_models_eq(restored, original);
+
+    bim_tools_free(restored);
+    bim_tools_free(original);
+    remove(FULL_FILE);
+    remove(STRIPPED_FILE);
+    __LOG_INFO__(SUCCESS);
+}
+
+// Устаревшая связь двери исправляется, остальные связи не меняются
+TEST_CASE topology_stale(const char *filename)
+{
+    __LOG_INFO__(filename);
+    bim_t *bim = bim_tools_new(filename);
+    bim_t *original = bim_tools_new(filename);
+    assert(bim && original);
+
+    size_t idx = 0;
+    while (idx < bim->transits->length && ((bim_transit_t *)bim->transits->data[idx])->base->sign != DOOR_WAY_INT)
+        idx++;
+    assert(idx < bim->transits->length);
+    bim_transit_t *door = bim->transits->data[idx];
+
+    // Дверь ссылается на зону, которой не касается
+    const bim_zone_t *stranger = NULL;
+    for (size_t i = 0; i + 1 < bim->zones->length && !stranger; i++)
+    {
+        const bim_zone_t *zone = bim->zones->data[i];
+        if (zone->base->handle != door->base->outputs[0] && zone->base->handle != door->base->outputs[1])
+            stranger = zone;
+    }
+    assert(stranger);
+    door->base->outputs[1] = stranger->base->handle;
+
+    assert(_derive_topology(bim, false) == 1);
+    assert(_derive_topology(bim, true) == 1);
+    assert(_derive_topology(bim, false) == 0);
+    assert(door->width == -1); // Ширина вычисляется заново при создании модели
+    door->width = ((bim_transit_t *)original->transits->data[idx])->width;
+    _assert_models_eq(bim, original);
+
+    bim_tools_free(bim);
+    bim_tools_free(original);
+    __LOG_INFO__(SUCCESS);
+}
+
+int main (void)
+{
+    printf("====== TESTS STARTS ======\n");
+
+    topology_files(ROOT_PATH"/one_zone_one_exit.json");
+    topology_files(ROOT_PATH"/three_zone_three_transit.json");
+    topology_files(ROOT_PATH"/two_levels.json");
+    topology_files(ROOT_PATH"/building_test.json");
+    topology_restore(4, 200);
+    topology_stale(ROOT_PATH"/building_test.json");
+
+    printf("====== TESTS END ======\n");
+}
@@ -1429,6 +1429,29 @@ int status;
   exit(status);
 }
 
+/* Allocator set by trisetallocator(); NULL means malloc() and free().     */
+
+VOID *(*triallocate)(VOID *context, int size) = (VOID *(*)(VOID *, int)) NULL;
+void (*trirelease)(VOID *context, VOID *memptr) = (void (*)(VOID *, VOID *)) NULL;
+VOID *triallocatorcontext = (VOID *) NULL;
+
+#ifdef ANSI_DECLARATORS
+void trisetallocator(VOID *(*allocate)(VOID *context, int size),
+                     void (*release)(VOID *context, VOID *memptr),
+                     VOID *context)
+#else /* not ANSI_DECLARATORS */
+void trisetallocator(allocate, release, context)
+VOID *(*allocate)();
+void (*release)();
+VOID *context;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  triallocate = allocate;
+  trirelease = release;
+  triallocatorcontext = context;
+}
+
 #ifdef ANSI_DECLARATORS
 VOID *trimalloc(int size)
 #else /* not ANSI_DECLARATORS */
@@ -1439,7 +1462,11 @@ int size;
 {
   VOID *memptr;
 
-  memptr = (VOID *) malloc((unsigned int) size);
+  if (triallocate != NULL) {
+    memptr = triallocate(triallocatorcontext, size);
+  } else {
+    memptr = (VOID *) malloc((unsigned int) size);
+  }
   if (memptr == (VOID *) NULL) {
     printf("Error:  Out of memory.\n");
     triexit(1);
@@ -1455,7 +1482,11 @@ VOID *memptr;
 #endif /* not ANSI_DECLARATORS */
 
 {
-  free(memptr);
+  if (trirelease != NULL) {
+    trirelease(triallocatorcontext, memptr);
+  } else {
+    free(memptr);
+  }
 }
 
 /**                                                                         **/
@@ -5295,6 +5326,59 @@ vertex pc;
   return counterclockwiseadapt(pa, pb, pc, detsum);
 }
 
+/*****************************************************************************/
+/*                                                                           */
+/*  triorient2d()   Robust orientation test for library callers.             */
+/*                                                                           */
+/*  The same as counterclockwise(), without the mesh statistics and the -X   */
+/*  switch:  returns a positive value if the points pa, pb, and pc occur in  */
+/*  counterclockwise order, a negative value if clockwise, and zero if they  */
+/*  are collinear.  The sign is exact.  exactinit() must be called once      */
+/*  before the first call.                                                   */
+/*                                                                           */
+/*****************************************************************************/
+
+#ifdef ANSI_DECLARATORS
+REAL triorient2d(REAL *pa, REAL *pb, REAL *pc)
+#else /* not ANSI_DECLARATORS */
+REAL triorient2d(pa, pb, pc)
+REAL *pa;
+REAL *pb;
+REAL *pc;
+#endif /* not ANSI_DECLARATORS */
+
+{
+  REAL detleft, detright, det;
+  REAL detsum, errbound;
+
+  detleft = (pa[0] - pc[0]) * (pb[1] - pc[1]);
+  detright = (pa[1] - pc[1]) * (pb[0] - pc[0]);
+  det = detleft - detright;
+
+  if (detleft > 0.0) {
+    if (detright <= 0.0) {
+      return det;
+    } else {
+      detsum = detleft + detright;
+    }
+  } else if (detleft < 0.0) {
+    if (detright >= 0.0) {
+      return det;
+    } else {
+      detsum = -detleft - detright;
+    }
+  } else {
+    return det;
+  }
+
+  errbound = ccwerrboundA * detsum;
+  if ((det >= errbound) || (-det >= errbound)) {
+    return det;
+  }
+
+  return counterclockwiseadapt(pa, pb, pc, detsum);
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  incircle()   Return a positive value if the point pd lies inside the     */
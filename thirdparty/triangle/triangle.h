@@ -299,13 +299,44 @@ struct triangulateio {
   int numberofedges;                                             /* Out only */
 };
 
+/*****************************************************************************/
+/*                                                                           */
+/*  trisetallocator()   Replace the memory allocator used by Triangle.       */
+/*                                                                           */
+/*  While an allocator is set, trimalloc() calls allocate(context, size)     */
+/*  and trifree() calls release(context, memptr) instead of malloc() and     */
+/*  free().  This covers all memory Triangle allocates, including the output */
+/*  arrays of triangulate(), so a caller can serve it from a pool that is    */
+/*  reused between calls.  Passing NULL functions restores malloc() and      */
+/*  free().  The allocator is global, like the rest of Triangle's state:     */
+/*  set it and call triangulate() from one thread at a time.                 */
+/*                                                                           */
+/*****************************************************************************/
+
+/*****************************************************************************/
+/*                                                                           */
+/*  triorient2d()   Exact orientation test using Triangle's adaptive         */
+/*  precision arithmetic.  Returns a positive value if pa, pb, pc occur in   */
+/*  counterclockwise order, a negative value if clockwise, and zero if they  */
+/*  are collinear.  Call exactinit() once before the first use.              */
+/*                                                                           */
+/*****************************************************************************/
+
 #ifdef ANSI_DECLARATORS
 void triangulate(char *, struct triangulateio *, struct triangulateio *,
                  struct triangulateio *);
 void trifree(VOID *memptr);
+void trisetallocator(VOID *(*allocate)(VOID *context, int size),
+                     void (*release)(VOID *context, VOID *memptr),
+                     VOID *context);
+void exactinit(void);
+REAL triorient2d(REAL *pa, REAL *pb, REAL *pc);
 #else /* not ANSI_DECLARATORS */
 void triangulate();
 void trifree();
+void trisetallocator();
+void exactinit();
+REAL triorient2d();
 #endif /* not ANSI_DECLARATORS */
 
 #endif /* TRIANGLE_H_INCLUDED */